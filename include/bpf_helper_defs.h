@@ -254,11 +254,12 @@ bpf_printk(const char* fmt, ...);
 #endif
 
 /**
- * @brief Insert an element at the end of the map (only valid for stack and queue).
+ * @brief Insert an element at the end of the map (only valid for stack and queue), or add a value to a bloom filter.
  *
  * @param[in] map Map to update.
  * @param[in] value Value to insert into the map.
  * @param[in] flags Map flags - BPF_EXIST: If the map is full, the entry at the start of the map is discarded.
+ *  Must be BPF_ANY for a bloom filter.
  * @retval EBPF_SUCCESS The operation was successful.
  * @retval -EBPF_NO_MEMORY Unable to allocate resources for this
  *  entry.
@@ -285,14 +286,15 @@ EBPF_HELPER(int64_t, bpf_map_pop_elem, (void* map, void* value));
 #endif
 
 /**
- * @brief Copy an entry from the map (only valid for stack and queue).
+ * @brief Copy an entry from the map (only valid for stack and queue), or test whether a value was added to a bloom
+ * filter. A bloom filter can report a value that was never added, but never misses one that was.
  * Queue peeks at the beginning of the map.
  * Stack peeks at the end of the map.
  *
  * @param[in] map Map to search.
- * @param[out] value Value buffer to copy value from map into.
+ * @param[in,out] value Value buffer to copy value from map into, or value to test for a bloom filter.
  * @retval EBPF_SUCCESS The operation was successful.
- * @retval -EBPF_OBJECT_NOT_FOUND The map is empty.
+ * @retval -EBPF_OBJECT_NOT_FOUND The map is empty, or the value is not in the bloom filter.
  */
 EBPF_HELPER(int64_t, bpf_map_peek_elem, (void* map, void* value));
 #ifndef __doxygen
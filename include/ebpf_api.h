@@ -635,6 +635,124 @@ extern "C"
     _Must_inspect_result_ ebpf_result_t
     ebpf_map_set_wait_handle(fd_t map_fd, uint64_t index, ebpf_handle_t handle) EBPF_NO_EXCEPT;
 
+    /**
+     * @brief Function called by ebpf_map_snapshot to write the next part of a map image.
+     *
+     * @param[in] context Caller supplied context.
+     * @param[in] data Data to append to the image.
+     * @param[in] data_length Length of the data.
+     * @retval EBPF_SUCCESS All of the data was written.
+     * @retval other The snapshot is aborted and the error is returned to the caller of ebpf_map_snapshot.
+     */
+    typedef ebpf_result_t (*ebpf_map_image_write_fn)(
+        _Inout_opt_ void* context, _In_reads_bytes_(data_length) const void* data, size_t data_length);
+
+    /**
+     * @brief Function called by ebpf_map_restore to read the next part of a map image.
+     *
+     * @param[in] context Caller supplied context.
+     * @param[out] data Buffer to fill with the next data_length bytes of the image.
+     * @param[in] data_length Number of bytes to read.
+     * @retval EBPF_SUCCESS The buffer was filled.
+     * @retval other The restore is aborted and the error is returned to the caller of ebpf_map_restore.
+     */
+    typedef ebpf_result_t (*ebpf_map_image_read_fn)(
+        _Inout_opt_ void* context, _Out_writes_bytes_(data_length) void* data, size_t data_length);
+
+    /**
+     * @brief Serialize the contents of a map into a compact binary image, such as to carry a map that is not pinned
+     * across a restart of the process that owns it. The image is produced as a stream of chunks, one per batch read
+     * from the execution context, so it never has to be held in a single buffer. Per-CPU values are stored for every
+     * CPU. The map should not be modified while the snapshot is taken, otherwise the image may hold a mix of old and
+     * new entries.
+     *
+     * @param[in] map_fd File descriptor of the map.
+     * @param[in] write_fn Function called with each part of the image, in order.
+     * @param[in] context Context passed to write_fn.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_FD The file descriptor is not valid.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED The map type holds references to other objects, has no keys, or expires
+     * entries.
+     * @retval EBPF_NO_MEMORY Out of memory.
+     * @retval other Error returned by write_fn.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_snapshot(fd_t map_fd, _In_ ebpf_map_image_write_fn write_fn, _Inout_opt_ void* context) EBPF_NO_EXCEPT;
+
+    /**
+     * @brief Restore an image produced by ebpf_map_snapshot into a map, typically one that was just created with
+     * the same definition as the map the image was taken from. Entries are inserted in batches as the image is
+     * read, and existing entries with the same key are overwritten. LRU maps are restored with the entries in image
+     * order; the recency of the original map is not carried over.
+     *
+     * @param[in] map_fd File descriptor of the map.
+     * @param[in] read_fn Function called to read each part of the image, in order.
+     * @param[in] context Context passed to read_fn.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_FD The file descriptor is not valid.
+     * @retval EBPF_INVALID_ARGUMENT The image is malformed or does not match the definition of the map.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED The map type holds references to other objects, has no keys, or expires
+     * entries.
+     * @retval EBPF_NO_MEMORY Out of memory.
+     * @retval other Error returned by read_fn or by the map update.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_restore(fd_t map_fd, _In_ ebpf_map_image_read_fn read_fn, _Inout_opt_ void* context) EBPF_NO_EXCEPT;
+
+    /**
+     * @brief Create a shadow of a map for a double-buffered update. The shadow is a separate map with the same
+     * definition, which is staged with the usual map update, delete and batch functions while programs keep using
+     * the original map, and is then published with ebpf_map_publish_shadow.
+     *
+     * Only BPF_MAP_TYPE_HASH maps support shadows.
+     *
+     * @param[in] map_fd File descriptor of the map.
+     * @param[in] copy_forward If true, the shadow starts with a copy of the current entries of the map, so that an
+     *  incremental change only needs to write the entries that change. Otherwise the shadow starts empty.
+     * @param[out] shadow_map_fd File descriptor of the shadow map. The caller must close it.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_FD The file descriptor is not valid.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED The map type does not support shadows.
+     * @retval EBPF_NO_MEMORY Out of memory.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_create_shadow(fd_t map_fd, bool copy_forward, _Out_ fd_t* shadow_map_fd) EBPF_NO_EXCEPT;
+
+    /**
+     * @brief Atomically replace the contents of a map with the contents of its shadow, so that programs never see a
+     * partially applied update. The previous contents move to the shadow map, which can still be read, and are freed
+     * once it is closed and no program can still be reading them. For the next update, create a new shadow: updates
+     * and deletes on a published shadow, and publishing it again, fail with EBPF_INVALID_STATE.
+     *
+     * Updates to the map that run at the same time as the publish may land in the previous contents. They are then
+     * ordered before the publish, and replaced by the published contents.
+     *
+     * @param[in] map_fd File descriptor of the map.
+     * @param[in] shadow_map_fd File descriptor of a shadow created by ebpf_map_create_shadow.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_FD A file descriptor is not valid.
+     * @retval EBPF_INVALID_ARGUMENT The maps are the same, or their definitions differ.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED The map type does not support shadows.
+     * @retval EBPF_INVALID_STATE The shadow map was already published.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_publish_shadow(fd_t map_fd, fd_t shadow_map_fd) EBPF_NO_EXCEPT;
+
+    /**
+     * @brief Set how long the entries of a BPF_MAP_TYPE_HASH_TTL map live. An entry expires the given time after it
+     * was inserted or last updated: lookups, updates, deletes and key iteration treat it as not present from that
+     * point, and it is deleted shortly after without the caller having to scan the map. Entries written before the
+     * call keep their expiration time. The time to live of a new map is zero, which means that entries never expire.
+     *
+     * @param[in] map_fd File descriptor of the map.
+     * @param[in] time_to_live_in_ms Time to live of entries written from now on, in milliseconds.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_FD The file descriptor is not valid.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED The map is not a BPF_MAP_TYPE_HASH_TTL map.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_set_time_to_live(fd_t map_fd, uint32_t time_to_live_in_ms) EBPF_NO_EXCEPT;
+
     /**
      * @brief Get eBPF program type for the specified BPF program type.
      *
@@ -703,6 +821,18 @@ extern "C"
     _Must_inspect_result_ ebpf_result_t
     ebpf_program_synchronize() EBPF_NO_EXCEPT;
 
+    /**
+     * @brief Get the counters kept by the execution context for map operations,
+     * hash table bucket lengths, LRU evictions, dropped ring buffer and perf
+     * event array records, epoch processing and tail calls.
+     *
+     * @param[out] statistics Counters summed over all CPUs.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_NO_MEMORY Out of memory.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_get_runtime_statistics(_Out_ ebpf_runtime_statistics_t* statistics) EBPF_NO_EXCEPT;
+
     //
     // Windows-specific Ring Buffer APIs
     //
@@ -40,3 +40,42 @@ typedef enum _ebpf_object_type
     EBPF_OBJECT_LINK,
     EBPF_OBJECT_PROGRAM,
 } ebpf_object_type_t;
+
+#define EBPF_STATISTICS_HASH_CHAIN_LENGTH_BUCKETS 8
+
+// Fixed so that the size of ebpf_runtime_statistics_t does not change when map types are added.
+#define EBPF_STATISTICS_MAP_TYPE_CAPACITY 64
+
+static_assert(
+    BPF_MAP_TYPE_MAX <= EBPF_STATISTICS_MAP_TYPE_CAPACITY, "Map type statistics must have an entry per map type.");
+
+/**
+ * @brief Counters for operations on all maps of one type.
+ */
+typedef struct _ebpf_map_type_statistics
+{
+    uint64_t hit_count;    ///< Lookups that found an entry.
+    uint64_t miss_count;   ///< Lookups that did not find an entry.
+    uint64_t update_count; ///< Update attempts.
+    uint64_t delete_count; ///< Delete attempts.
+} ebpf_map_type_statistics_t;
+
+/**
+ * @brief Counters kept by the execution context since it was loaded. The
+ * execution context keeps one copy per CPU and returns their sum.
+ */
+typedef struct _ebpf_runtime_statistics
+{
+    /// Map operations indexed by ebpf_map_type_t. Entries at or above BPF_MAP_TYPE_MAX are zero.
+    ebpf_map_type_statistics_t map_type[EBPF_STATISTICS_MAP_TYPE_CAPACITY];
+    /// Hash table lookups by the length of the bucket that was searched. The last entry counts lookups in buckets
+    /// with at least EBPF_STATISTICS_HASH_CHAIN_LENGTH_BUCKETS - 1 entries.
+    uint64_t hash_chain_length[EBPF_STATISTICS_HASH_CHAIN_LENGTH_BUCKETS];
+    uint64_t lru_eviction_count;            ///< Entries evicted from LRU maps to make room for an insert.
+    uint64_t ring_buffer_drop_count;        ///< Ring buffer records dropped because the ring was full.
+    uint64_t perf_event_array_drop_count;   ///< Perf event array records dropped because the ring was full.
+    uint64_t epoch_advance_count;           ///< Number of times the global epoch advanced.
+    uint64_t epoch_free_list_insert_count;  ///< Items queued for release at the end of an epoch.
+    uint64_t epoch_free_list_release_count; ///< Items released from the epoch free lists.
+    uint64_t tail_call_count;               ///< Tail calls that transferred control to another program.
+} ebpf_runtime_statistics_t;
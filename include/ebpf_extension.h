@@ -314,6 +314,9 @@ typedef struct _ebpf_base_map_provider_properties
     ebpf_extension_header_t header;
     bool updates_original_value; // Whether the provider updates the original value during map operations, which
                                  // controls whether BPF programs can perform map CRUD operations.
+    bool direct_value_access;    // Whether lookups from BPF programs return a pointer to the stored value without
+                                 // invoking postprocess_map_find_element. Cannot be combined with
+                                 // updates_original_value.
 } ebpf_base_map_provider_properties_t;
 
 /**
@@ -433,7 +436,8 @@ typedef struct _ebpf_map_provider_data
 {
     ebpf_extension_header_t header;
     uint32_t map_type;                                            ///< Custom map type implemented by the provider.
-    uint32_t base_map_type;                                       ///< Base map type used to implement the custom map.
+    uint32_t base_map_type; ///< Base map type used to implement the custom map. One of BPF_MAP_TYPE_HASH,
+                            ///< BPF_MAP_TYPE_ARRAY or BPF_MAP_TYPE_PERCPU_ARRAY.
     ebpf_base_map_provider_properties_t* base_properties;         ///< Base map provider properties.
     ebpf_base_map_provider_dispatch_table_t* base_provider_table; ///< Pointer to base map provider dispatch table.
 } ebpf_map_provider_data_t;
@@ -34,6 +34,8 @@ typedef enum bpf_map_type
     BPF_MAP_TYPE_PERF_EVENT_ARRAY = 14, ///< Perf event array.
     BPF_MAP_TYPE_SAMPLE_HASH_MAP = 15,  ///< Sample hash map type.
     BPF_MAP_TYPE_XSKMAP = 16,           ///< AF_XDP socket (XSK) map.
+    BPF_MAP_TYPE_HASH_TTL = 17,         ///< Hash table whose entries expire a fixed time after they are written.
+    BPF_MAP_TYPE_BLOOM_FILTER = 18,     ///< Bloom filter, where values are added with push and tested with peek.
     BPF_MAP_TYPE_MAX                    ///< Maximum value for map types.
 } ebpf_map_type_t;
 
@@ -59,6 +61,8 @@ static const char* const _ebpf_map_type_names[] = {
     BPF_ENUM_TO_STRING(BPF_MAP_TYPE_PERF_EVENT_ARRAY),
     BPF_ENUM_TO_STRING(BPF_MAP_TYPE_SAMPLE_HASH_MAP),
     BPF_ENUM_TO_STRING(BPF_MAP_TYPE_XSKMAP),
+    BPF_ENUM_TO_STRING(BPF_MAP_TYPE_HASH_TTL),
+    BPF_ENUM_TO_STRING(BPF_MAP_TYPE_BLOOM_FILTER),
 };
 
 static const char* const _ebpf_map_display_names[] = {
@@ -79,6 +83,8 @@ static const char* const _ebpf_map_display_names[] = {
     "perf_event_array",
     "sample_hash_map",
     "xskmap",
+    "hash_ttl",
+    "bloom_filter",
 };
 
 typedef enum ebpf_map_option
@@ -117,6 +123,7 @@ typedef struct _ebpf_map_definition_in_memory
     uint32_t max_entries; ///< Maximum number of entries allowed in the map.
     ebpf_id_t inner_map_id;
     ebpf_pin_type_t pinning;
+    uint32_t map_flags; ///< Map creation flags (BPF_F_*).
 } ebpf_map_definition_in_memory_t;
 
 /**
@@ -395,6 +402,7 @@ struct bpf_link_info
 #endif
 
 #define BPF_OBJ_NAME_LEN 64
+#define EBPF_MAP_INFO_HASH_BUCKET_LENGTH_COUNT 8
 
 /**
  * @brief eBPF map information.  This structure can be retrieved by calling
@@ -414,12 +422,25 @@ struct bpf_map_info
     // Windows-specific fields.
     ebpf_id_t inner_map_id;     ///< ID of inner map template.
     uint32_t pinned_path_count; ///< Number of pinned paths.
+
+    // Windows-specific occupancy of hash based maps, maintained without walking the map. Zero for other map types.
+    uint32_t current_entries;   ///< Approximate count of entries in the map.
+    uint32_t hash_bucket_count; ///< Count of hash buckets.
+    uint64_t memory_bytes;      ///< Approximate bytes allocated for the map's buckets and values.
+    uint32_t hash_bucket_length_count[EBPF_MAP_INFO_HASH_BUCKET_LENGTH_COUNT]; ///< Count of buckets holding N
+                                                                                ///< entries; the last element
+                                                                                ///< counts longer buckets too.
 };
 
 #define BPF_ANY 0x0
 #define BPF_NOEXIST 0x1
 #define BPF_EXIST 0x2
 
+/* Map creation flags. */
+// Windows-specific: reserve the memory for max_entries entries of a hash, LRU hash or TTL hash map when it is
+// created, so that updates from programs don't call the allocator. Without it, entries are allocated on insert.
+#define BPF_F_PREALLOC (1U << 31)
+
 /**
  * @brief eBPF program information.  This structure can be retrieved by calling
  * \ref bpf_obj_get_info_by_fd on a program fd.
@@ -169,7 +169,7 @@ typedef enum _ebpf_helper_function
 
 #define EBPF_BASE_MAP_PROVIDER_PROPERTIES_CURRENT_VERSION 1
 #define EBPF_BASE_MAP_PROVIDER_PROPERTIES_CURRENT_VERSION_SIZE \
-    EBPF_SIZE_INCLUDING_FIELD(ebpf_base_map_provider_properties_t, updates_original_value)
+    EBPF_SIZE_INCLUDING_FIELD(ebpf_base_map_provider_properties_t, direct_value_access)
 #define EBPF_BASE_MAP_PROVIDER_PROPERTIES_CURRENT_VERSION_TOTAL_SIZE sizeof(ebpf_base_map_provider_properties_t)
 #define EBPF_BASE_MAP_PROVIDER_PROPERTIES_HEADER             \
     {EBPF_BASE_MAP_PROVIDER_PROPERTIES_CURRENT_VERSION,      \
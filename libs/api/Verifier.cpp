@@ -10,6 +10,7 @@
 #include "ebpf_tracelog.h"
 #include "ebpf_verifier_wrapper.hpp"
 #include "elfio_wrapper.hpp"
+#include "mapped_file.h"
 #pragma warning(push)
 #pragma warning(disable : 4100)  // unreferenced formal parameter
 #pragma warning(disable : 4244)  // conversion, possible loss of data
@@ -26,10 +27,9 @@
 
 #include <ElfWrapper.h>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <optional>
 #include <sstream>
-#include <sys/stat.h>
 #include <vector>
 
 #define elf_everparse_error ElfEverParseError
@@ -369,23 +369,12 @@ _get_map_names(
 }
 
 static void
-_get_map_names(
-    std::variant<std::string, std::vector<uint8_t>>& file_or_buffer,
-    _Inout_ vector<section_offset_to_map_t>& map_names) noexcept(false)
+_get_map_names(std::istream& stream, _Inout_ vector<section_offset_to_map_t>& map_names) noexcept(false)
 {
     ELFIO::elfio reader;
 
-    if (std::holds_alternative<std::string>(file_or_buffer)) {
-        if (!reader.load(std::get<std::string>(file_or_buffer))) {
-            throw std::runtime_error("Can't process ELF file " + std::get<std::string>(file_or_buffer));
-        }
-    } else {
-        std::stringstream buffer_stream(std::string(
-            std::get<std::vector<uint8_t>>(file_or_buffer).begin(),
-            std::get<std::vector<uint8_t>>(file_or_buffer).end()));
-        if (!reader.load(buffer_stream)) {
-            throw std::runtime_error("Can't process ELF file from memory");
-        }
+    if (!reader.load(stream)) {
+        throw std::runtime_error("Can't process ELF file");
     }
 
     ELFIO::const_symbol_section_accessor symbols{reader, reader.sections[".symtab"]};
@@ -418,60 +407,54 @@ load_byte_code(
         }
 
         std::vector<prevail::RawProgram> raw_programs;
-        std::vector<uint8_t> elf_data;
+        std::optional<mapped_file_t> mapped_file;
+        const char* elf_data = nullptr;
+        size_t elf_data_size = 0;
         std::string object_name;
 
-        // Convert file path to buffer, or use the provided buffer directly.
+        // Map the file rather than reading it, or use the provided buffer directly.
+        // Either way the ELF image is parsed in place without being copied.
         if (std::holds_alternative<std::string>(file_or_buffer)) {
             const std::string& file_path = std::get<std::string>(file_or_buffer);
             object_name = file_path;
 
-            std::ifstream file_stream(file_path, std::ios::binary | std::ios::ate);
-            if (!file_stream) {
+            try {
+                mapped_file.emplace(file_path);
+            } catch (const std::runtime_error&) {
                 *error_message = allocate_string(std::string("error: failed to open file: ") + file_path);
                 result = EBPF_FILE_NOT_FOUND;
                 goto Exit;
             }
-            std::streamsize file_size = file_stream.tellg();
-            if (file_size < 0 || !file_stream) {
-                *error_message = allocate_string(std::string("error: failed to determine file size: ") + file_path);
-                result = EBPF_FILE_NOT_FOUND;
-                goto Exit;
-            }
-            file_stream.seekg(0, std::ios::beg);
-            if (!file_stream) {
-                *error_message = allocate_string(std::string("error: failed to seek in file: ") + file_path);
-                result = EBPF_FILE_NOT_FOUND;
-                goto Exit;
-            }
-            elf_data.resize(static_cast<size_t>(file_size));
-            if (!file_stream.read(reinterpret_cast<char*>(elf_data.data()), file_size)) {
-                *error_message = allocate_string(std::string("error: failed to read file: ") + file_path);
-                result = EBPF_FILE_NOT_FOUND;
-                goto Exit;
-            }
+            elf_data = mapped_file->data();
+            elf_data_size = mapped_file->size();
         } else {
-            elf_data = std::get<std::vector<uint8_t>>(file_or_buffer);
+            const std::vector<uint8_t>& buffer = std::get<std::vector<uint8_t>>(file_or_buffer);
+            elf_data = reinterpret_cast<const char*>(buffer.data());
+            elf_data_size = buffer.size();
             object_name = "memory";
         }
 
         // Validate the ELF structure before passing to ELFIO to prevent crashes
         // from malformed ELF files (e.g., invalid relocation sections).
-        if (elf_data.size() > UINT32_MAX) {
+        if (elf_data_size > UINT32_MAX) {
             *error_message = allocate_string(std::string("error: ELF file ") + object_name + " is too large");
             result = EBPF_ELF_PARSING_FAILED;
             goto Exit;
         }
-        if (!ElfCheckElf(elf_data.size(), elf_data.data(), static_cast<uint32_t>(elf_data.size()))) {
+        if (!ElfCheckElf(
+                elf_data_size,
+                reinterpret_cast<uint8_t*>(const_cast<char*>(elf_data)),
+                static_cast<uint32_t>(elf_data_size))) {
             *error_message = allocate_string(
                 std::string("error: ELF file ") + object_name + " is malformed: " + _elf_everparse_error);
             result = EBPF_ELF_PARSING_FAILED;
             goto Exit;
         }
 
-        std::stringstream elf_stream(std::string(elf_data.begin(), elf_data.end()));
-
-        raw_programs = read_elf(elf_stream, object_name, section_name_string, "", verifier_options, platform);
+        {
+            memory_istream_t elf_stream(elf_data, elf_data_size);
+            raw_programs = read_elf(elf_stream, object_name, section_name_string, "", verifier_options, platform);
+        }
 
         if (raw_programs.size() == 0) {
             result = EBPF_ELF_PARSING_FAILED;
@@ -526,7 +509,10 @@ load_byte_code(
             program = nullptr;
         }
 
-        _get_map_names(file_or_buffer, map_names);
+        {
+            memory_istream_t elf_stream(elf_data, elf_data_size);
+            _get_map_names(elf_stream, map_names);
+        }
 
         auto map_descriptors = get_all_map_descriptors();
         size_t anonymous_map_count = 0;
@@ -872,31 +858,9 @@ static _Success_(return == 0) uint32_t _ebpf_api_elf_verify_program_from_stream(
     return 0;
 }
 
-static uint32_t
-_load_file_to_memory(
-    _In_ const std::string& path,
-    _Out_ std::string& data,
-    _Outptr_result_maybenull_z_ const char** error_message) noexcept
-{
-    data = "";
-    struct stat st;
-    if (stat(path.c_str(), &st)) {
-        *error_message = allocate_string(std::string("error: No such file or directory opening ") + path);
-        return 1;
-    }
-    if (std::ifstream stream{path, std::ios::in | std::ios::binary}) {
-        data.resize(st.st_size);
-        if (stream.read(data.data(), data.size())) {
-            *error_message = nullptr;
-            return 0;
-        }
-    }
-    *error_message = allocate_string(std::string("error: Failed to read file: ") + path);
-    return 1;
-}
-
-static _Success_(return == 0) uint32_t _verify_program_from_string(
-    std::string data,
+static _Success_(return == 0) uint32_t _verify_program_from_memory(
+    _In_reads_(data_length) const char* data,
+    size_t data_length,
     _In_z_ const char* name,
     _In_opt_z_ const char* section_name,
     _In_opt_z_ const char* program_name,
@@ -909,17 +873,23 @@ static _Success_(return == 0) uint32_t _verify_program_from_string(
     *error_message = nullptr;
     *report = nullptr;
 
+    if (data_length > UINT32_MAX) {
+        *error_message = allocate_string(std::string("error: ELF file ") + name + " is too large");
+        return 1;
+    }
+
     if (!ElfCheckElf(
-            data.size(),
-            const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(data.data())),
-            static_cast<uint32_t>(data.size()))) {
+            data_length,
+            const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(data)),
+            static_cast<uint32_t>(data_length))) {
 
         *error_message =
             allocate_string(std::string("error: ELF file ") + name + " is malformed: " + _elf_everparse_error);
         return 1;
     }
 
-    auto stream = std::stringstream(data);
+    // Parse the caller's buffer in place rather than copying it into a string stream.
+    memory_istream_t stream(data, data_length);
 
     // Clear thread local storage before calling into the verifier.
     // Note that TLS should be cleared here *before* calling into the verifier, not after.
@@ -943,13 +913,23 @@ _Success_(return == 0) uint32_t ebpf_api_elf_verify_program_from_file(
 {
     *error_message = nullptr;
     *report = nullptr;
-    std::string data;
-    uint32_t error = _load_file_to_memory(file, data, error_message);
-    if (error) {
-        return error;
+    try {
+        mapped_file_t mapped_file(file);
+        return _verify_program_from_memory(
+            mapped_file.data(),
+            mapped_file.size(),
+            file,
+            section_name,
+            program_name,
+            program_type,
+            verbosity,
+            report,
+            error_message,
+            stats);
+    } catch (const std::runtime_error& e) {
+        *error_message = allocate_string(std::string("error: ") + e.what());
+        return 1;
     }
-    return _verify_program_from_string(
-        data, file, section_name, program_name, program_type, verbosity, report, error_message, stats);
 }
 
 _Success_(return == 0) uint32_t ebpf_api_elf_verify_program_from_memory(
@@ -963,8 +943,9 @@ _Success_(return == 0) uint32_t ebpf_api_elf_verify_program_from_memory(
     _Outptr_result_maybenull_z_ const char** error_message,
     _Out_opt_ ebpf_api_verifier_stats_t* stats) noexcept
 {
-    return _verify_program_from_string(
-        std::string(data, data_length),
+    return _verify_program_from_memory(
+        data,
+        data_length,
         "memory",
         section_name,
         program_name,
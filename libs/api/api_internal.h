@@ -323,15 +323,17 @@ ebpf_map_delete_element_batch(fd_t map_fd, _In_ const void* keys, _Inout_ uint32
  * @brief Look up an element in an eBPF map.
  *  For a singleton map, return the value for the given key.
  *  For a per-cpu map, return aggregate value across all CPUs.
+ *  For a bloom filter, test whether the value in the buffer may have been added.
  *
  * @param[in] map_fd File descriptor for the eBPF map.
  * @param[in] key Pointer to buffer containing key.
- * @param[out] value Pointer to buffer that contains value on success.
+ * @param[in, out] value Pointer to buffer that contains value on success, or
+ *  the value to test for a bloom filter.
  *
  * @retval EBPF_SUCCESS The operation was successful.
  */
 _Must_inspect_result_ ebpf_result_t
-ebpf_map_lookup_element(fd_t map_fd, _In_opt_ const void* key, _Out_ void* value) noexcept;
+ebpf_map_lookup_element(fd_t map_fd, _In_opt_ const void* key, _Inout_ void* value) noexcept;
 
 /**
  * @brief Fetch the next batch of keys and values from an eBPF map.
@@ -41,13 +41,16 @@ typedef unsigned char boolean;
 #include "windows_platform_common.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <codecvt>
+#include <condition_variable>
 #include <cstdint>
 #include <fcntl.h>
 #include <functional>
 #include <io.h>
 #include <mutex>
 #include <rpc.h>
+#include <thread>
 
 using namespace peparse;
 using namespace Platform;
@@ -325,7 +328,8 @@ ebpf_map_create(
 
     ebpf_assert(map_fd);
 
-    if (opts && (opts->map_flags != 0 || opts->numa_node != 0 || opts->map_ifindex != 0)) {
+    // The execution context validates map_flags against the map type.
+    if (opts && (opts->numa_node != 0 || opts->map_ifindex != 0)) {
         result = EBPF_INVALID_ARGUMENT;
         goto Exit;
     }
@@ -336,6 +340,7 @@ ebpf_map_create(
         map_definition.key_size = key_size;
         map_definition.value_size = value_size;
         map_definition.max_entries = max_entries;
+        map_definition.map_flags = opts ? opts->map_flags : 0;
 
         // bpf_map_create_opts has inner_map_fd defined as __u32, so it cannot be set to
         // ebpf_fd_invalid (-1). Hence treat inner_map_fd = 0 as ebpf_fd_invalid.
@@ -461,7 +466,7 @@ Exit:
 CATCH_NO_MEMORY_EBPF_RESULT
 
 static ebpf_result_t
-_ebpf_map_lookup_element_helper(fd_t map_fd, bool find_and_delete, _In_opt_ const void* key, _Out_ void* value)
+_ebpf_map_lookup_element_helper(fd_t map_fd, bool find_and_delete, _In_opt_ const void* key, _Inout_ void* value)
     NO_EXCEPT_TRY
 {
     EBPF_LOG_ENTRY();
@@ -473,7 +478,6 @@ _ebpf_map_lookup_element_helper(fd_t map_fd, bool find_and_delete, _In_opt_ cons
     uint32_t type;
 
     ebpf_assert(value);
-    *((uint8_t*)value) = 0;
 
     map_handle = _get_handle_from_file_descriptor(map_fd);
     if (map_handle == ebpf_handle_invalid) {
@@ -491,6 +495,17 @@ _ebpf_map_lookup_element_helper(fd_t map_fd, bool find_and_delete, _In_opt_ cons
         goto Exit;
     }
     assert(value_size != 0);
+
+    // A bloom filter lookup tests the value passed in, which is sent to the execution context in place of the key.
+    if (type == BPF_MAP_TYPE_BLOOM_FILTER) {
+        if (find_and_delete) {
+            result = EBPF_OPERATION_NOT_SUPPORTED;
+            goto Exit;
+        }
+        result = _map_lookup_element(map_handle, false, value_size, (const uint8_t*)value, value_size, (uint8_t*)value);
+        goto Exit;
+    }
+    *((uint8_t*)value) = 0;
     if (BPF_MAP_TYPE_PER_CPU(type)) {
         value_size = EBPF_PAD_8(value_size) * libbpf_num_possible_cpus();
     }
@@ -643,7 +658,7 @@ Exit:
 CATCH_NO_MEMORY_EBPF_RESULT
 
 _Must_inspect_result_ ebpf_result_t
-ebpf_map_lookup_element(fd_t map_fd, _In_opt_ const void* key, _Out_ void* value) NO_EXCEPT_TRY
+ebpf_map_lookup_element(fd_t map_fd, _In_opt_ const void* key, _Inout_ void* value) NO_EXCEPT_TRY
 {
     EBPF_LOG_ENTRY();
     ebpf_assert(value);
@@ -992,6 +1007,309 @@ ebpf_map_update_element_batch(
 }
 CATCH_NO_MEMORY_EBPF_RESULT
 
+static bool
+_map_type_supports_image(uint32_t type)
+{
+    switch (type) {
+    // The values of these maps refer to other objects, and the handles and IDs would not be valid in a new map.
+    case BPF_MAP_TYPE_PROG_ARRAY:
+    case BPF_MAP_TYPE_HASH_OF_MAPS:
+    case BPF_MAP_TYPE_ARRAY_OF_MAPS:
+    case BPF_MAP_TYPE_XSKMAP:
+    // These maps have no keys to enumerate.
+    case BPF_MAP_TYPE_QUEUE:
+    case BPF_MAP_TYPE_STACK:
+    case BPF_MAP_TYPE_RINGBUF:
+    case BPF_MAP_TYPE_BLOOM_FILTER:
+    case BPF_MAP_TYPE_PERF_EVENT_ARRAY:
+    // The expiration time of an entry is not part of its value, so it could not be restored.
+    case BPF_MAP_TYPE_HASH_TTL:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief Build the image header that describes the given map.
+ *
+ * @param[in] map_handle Handle to the map.
+ * @param[out] header Image header for the map.
+ * @param[out] record_size Size in bytes of each record in an image of the map.
+ */
+static _Must_inspect_result_ ebpf_result_t
+_get_map_image_header(ebpf_handle_t map_handle, _Out_ ebpf_map_image_header_t* header, _Out_ size_t* record_size)
+{
+    ebpf_map_definition_in_memory_t definition = {};
+    uint32_t type = BPF_MAP_TYPE_UNSPEC;
+
+    memset(header, 0, sizeof(*header));
+    *record_size = 0;
+
+    ebpf_result_t result = _get_map_descriptor_properties(
+        map_handle, &type, &definition.key_size, &definition.value_size, &definition.max_entries);
+    if (result != EBPF_SUCCESS) {
+        return result;
+    }
+    if (!_map_type_supports_image(type) || definition.key_size == 0) {
+        return EBPF_OPERATION_NOT_SUPPORTED;
+    }
+    definition.type = static_cast<ebpf_map_type_t>(type);
+
+    ebpf_map_image_header_initialize(&definition, static_cast<uint32_t>(libbpf_num_possible_cpus()), header);
+    return ebpf_map_image_header_validate(header, record_size);
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_snapshot(fd_t map_fd, _In_ ebpf_map_image_write_fn write_fn, _Inout_opt_ void* context) NO_EXCEPT_TRY
+{
+    EBPF_LOG_ENTRY();
+    ebpf_result_t result;
+    ebpf_map_image_header_t header;
+    size_t record_size;
+    size_t max_records_per_chunk;
+    bool first_chunk = true;
+
+    ebpf_assert(write_fn);
+
+    ebpf_handle_t map_handle = _get_handle_from_file_descriptor(map_fd);
+    if (map_handle == ebpf_handle_invalid) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_FD);
+    }
+
+    result = _get_map_image_header(map_handle, &header, &record_size);
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(result);
+    }
+
+    // Each chunk of the image is the data of one batch reply, so it is bounded by the maximum reply length.
+    max_records_per_chunk =
+        (UINT16_MAX - EBPF_OFFSET_OF(ebpf_operation_map_get_next_key_value_batch_reply_t, data)) / record_size;
+    if (max_records_per_chunk == 0) {
+        EBPF_RETURN_RESULT(EBPF_OPERATION_NOT_SUPPORTED);
+    }
+
+    result = write_fn(context, &header, sizeof(header));
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(result);
+    }
+
+    ebpf_protocol_buffer_t request_buffer(
+        EBPF_OFFSET_OF(ebpf_operation_map_get_next_key_value_batch_request_t, previous_key));
+    ebpf_protocol_buffer_t reply_buffer(
+        EBPF_OFFSET_OF(ebpf_operation_map_get_next_key_value_batch_reply_t, data) +
+        max_records_per_chunk * record_size);
+    auto reply = reinterpret_cast<ebpf_operation_map_get_next_key_value_batch_reply_t*>(reply_buffer.data());
+
+    for (;;) {
+        auto request = reinterpret_cast<ebpf_operation_map_get_next_key_value_batch_request_t*>(request_buffer.data());
+        request->header.length = static_cast<uint16_t>(request_buffer.size());
+        request->header.id = ebpf_operation_id_t::EBPF_OPERATION_MAP_GET_NEXT_KEY_VALUE_BATCH;
+        request->handle = map_handle;
+        request->find_and_delete = false;
+
+        // A batch may hold fewer records than fit in the reply even when more entries follow, so only
+        // EBPF_NO_MORE_KEYS ends the enumeration.
+        result = win32_error_code_to_ebpf_result(invoke_ioctl(request_buffer, reply_buffer));
+        if (result == EBPF_NO_MORE_KEYS) {
+            result = EBPF_SUCCESS;
+            break;
+        }
+        if (result != EBPF_SUCCESS) {
+            EBPF_RETURN_RESULT(result);
+        }
+
+        size_t data_length =
+            reply->header.length - EBPF_OFFSET_OF(ebpf_operation_map_get_next_key_value_batch_reply_t, data);
+        size_t record_count = data_length / record_size;
+        if (record_count == 0 || record_count * record_size != data_length) {
+            EBPF_RETURN_RESULT(EBPF_INVALID_ARGUMENT);
+        }
+
+        ebpf_map_image_chunk_header_t chunk_header = {static_cast<uint32_t>(record_count)};
+        result = write_fn(context, &chunk_header, sizeof(chunk_header));
+        if (result != EBPF_SUCCESS) {
+            EBPF_RETURN_RESULT(result);
+        }
+        result = write_fn(context, reply->data, data_length);
+        if (result != EBPF_SUCCESS) {
+            EBPF_RETURN_RESULT(result);
+        }
+
+        // Continue after the last key of this batch.
+        if (first_chunk) {
+            request_buffer.resize(request_buffer.size() + header.key_size);
+            first_chunk = false;
+        }
+        const uint8_t* last_key = reply->data + (record_count - 1) * record_size;
+        std::copy(
+            last_key,
+            last_key + header.key_size,
+            reinterpret_cast<ebpf_operation_map_get_next_key_value_batch_request_t*>(request_buffer.data())
+                ->previous_key);
+    }
+
+    // A chunk without records ends the image.
+    ebpf_map_image_chunk_header_t end_of_image = {0};
+    EBPF_RETURN_RESULT(write_fn(context, &end_of_image, sizeof(end_of_image)));
+}
+CATCH_NO_MEMORY_EBPF_RESULT
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_restore(fd_t map_fd, _In_ ebpf_map_image_read_fn read_fn, _Inout_opt_ void* context) NO_EXCEPT_TRY
+{
+    EBPF_LOG_ENTRY();
+    ebpf_result_t result;
+    ebpf_map_image_header_t map_header;
+    ebpf_map_image_header_t image_header;
+    size_t record_size;
+    size_t image_record_size;
+    size_t max_records_per_request;
+
+    ebpf_assert(read_fn);
+
+    ebpf_handle_t map_handle = _get_handle_from_file_descriptor(map_fd);
+    if (map_handle == ebpf_handle_invalid) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_FD);
+    }
+
+    result = _get_map_image_header(map_handle, &map_header, &record_size);
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(result);
+    }
+
+    result = read_fn(context, &image_header, sizeof(image_header));
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(result);
+    }
+    result = ebpf_map_image_header_validate(&image_header, &image_record_size);
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_ARGUMENT);
+    }
+
+    // The records are passed to the execution context as they are, so their layout must match the map exactly.
+    // The maximum number of entries may differ; entries that do not fit fail the update.
+    if (image_header.map_type != map_header.map_type || image_header.key_size != map_header.key_size ||
+        image_header.value_size != map_header.value_size || image_header.cpu_count != map_header.cpu_count) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_ARGUMENT);
+    }
+    ebpf_assert(image_record_size == record_size);
+
+    max_records_per_request =
+        (UINT16_MAX - EBPF_OFFSET_OF(ebpf_operation_map_update_element_batch_request_t, data)) / record_size;
+    if (max_records_per_request == 0) {
+        EBPF_RETURN_RESULT(EBPF_OPERATION_NOT_SUPPORTED);
+    }
+
+    ebpf_protocol_buffer_t request_buffer;
+    for (;;) {
+        ebpf_map_image_chunk_header_t chunk_header;
+        result = read_fn(context, &chunk_header, sizeof(chunk_header));
+        if (result != EBPF_SUCCESS) {
+            EBPF_RETURN_RESULT(result);
+        }
+        if (chunk_header.record_count == 0) {
+            break;
+        }
+
+        // A chunk can hold more records than fit in an update request, so it may take several requests.
+        for (size_t records_left = chunk_header.record_count; records_left > 0;) {
+            size_t record_count = std::min(records_left, max_records_per_request);
+
+            request_buffer.resize(
+                EBPF_OFFSET_OF(ebpf_operation_map_update_element_batch_request_t, data) + record_count * record_size);
+            auto request = reinterpret_cast<ebpf_operation_map_update_element_batch_request_t*>(request_buffer.data());
+            request->header.length = static_cast<uint16_t>(request_buffer.size());
+            request->header.id = ebpf_operation_id_t::EBPF_OPERATION_MAP_UPDATE_ELEMENT_BATCH;
+            request->handle = (uint64_t)map_handle;
+            request->option = static_cast<ebpf_map_option_t>(EBPF_ANY);
+
+            // The records are read straight into the request.
+            result = read_fn(context, request->data, record_count * record_size);
+            if (result != EBPF_SUCCESS) {
+                EBPF_RETURN_RESULT(result);
+            }
+
+            ebpf_operation_map_update_element_batch_reply_t reply;
+            result = win32_error_code_to_ebpf_result(invoke_ioctl(request_buffer, reply));
+            if (result != EBPF_SUCCESS) {
+                EBPF_RETURN_RESULT(result);
+            }
+            if (reply.count_of_elements_processed != record_count) {
+                EBPF_RETURN_RESULT(EBPF_INVALID_ARGUMENT);
+            }
+
+            records_left -= record_count;
+        }
+    }
+
+    EBPF_RETURN_RESULT(EBPF_SUCCESS);
+}
+CATCH_NO_MEMORY_EBPF_RESULT
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_create_shadow(fd_t map_fd, bool copy_forward, _Out_ fd_t* shadow_map_fd) NO_EXCEPT_TRY
+{
+    EBPF_LOG_ENTRY();
+    ebpf_assert(shadow_map_fd);
+    *shadow_map_fd = ebpf_fd_invalid;
+
+    ebpf_handle_t map_handle = _get_handle_from_file_descriptor(map_fd);
+    if (map_handle == ebpf_handle_invalid) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_FD);
+    }
+
+    ebpf_operation_map_create_shadow_request_t request{
+        sizeof(request), ebpf_operation_id_t::EBPF_OPERATION_MAP_CREATE_SHADOW, map_handle, copy_forward};
+    ebpf_operation_map_create_shadow_reply_t reply{};
+
+    ebpf_result_t result = win32_error_code_to_ebpf_result(invoke_ioctl(request, reply));
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(result);
+    }
+
+    *shadow_map_fd = _create_file_descriptor_for_handle(reply.shadow_handle);
+    if (*shadow_map_fd == ebpf_fd_invalid) {
+        Platform::CloseHandle(reply.shadow_handle);
+        EBPF_RETURN_RESULT(EBPF_NO_MEMORY);
+    }
+    EBPF_RETURN_RESULT(EBPF_SUCCESS);
+}
+CATCH_NO_MEMORY_EBPF_RESULT
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_publish_shadow(fd_t map_fd, fd_t shadow_map_fd) NO_EXCEPT_TRY
+{
+    EBPF_LOG_ENTRY();
+    ebpf_handle_t map_handle = _get_handle_from_file_descriptor(map_fd);
+    ebpf_handle_t shadow_map_handle = _get_handle_from_file_descriptor(shadow_map_fd);
+    if (map_handle == ebpf_handle_invalid || shadow_map_handle == ebpf_handle_invalid) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_FD);
+    }
+
+    ebpf_operation_map_publish_shadow_request_t request{
+        sizeof(request), ebpf_operation_id_t::EBPF_OPERATION_MAP_PUBLISH_SHADOW, map_handle, shadow_map_handle};
+
+    EBPF_RETURN_RESULT(win32_error_code_to_ebpf_result(invoke_ioctl(request)));
+}
+CATCH_NO_MEMORY_EBPF_RESULT
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_set_time_to_live(fd_t map_fd, uint32_t time_to_live_in_ms) NO_EXCEPT_TRY
+{
+    EBPF_LOG_ENTRY();
+    ebpf_handle_t map_handle = _get_handle_from_file_descriptor(map_fd);
+    if (map_handle == ebpf_handle_invalid) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_FD);
+    }
+
+    ebpf_operation_map_set_time_to_live_request_t request{
+        sizeof(request), ebpf_operation_id_t::EBPF_OPERATION_MAP_SET_TIME_TO_LIVE, map_handle, time_to_live_in_ms};
+
+    EBPF_RETURN_RESULT(win32_error_code_to_ebpf_result(invoke_ioctl(request)));
+}
+CATCH_NO_MEMORY_EBPF_RESULT
+
 _Must_inspect_result_ ebpf_result_t
 ebpf_map_delete_element(fd_t map_fd, _In_ const void* key) NO_EXCEPT_TRY
 {
@@ -2136,6 +2454,7 @@ initialize_map(_Out_ ebpf_map_t* map, _In_ const map_cache_t& map_cache) noexcep
     map->map_definition.value_size = map_cache.verifier_map_descriptor.value_size;
     map->map_definition.max_entries = map_cache.verifier_map_descriptor.max_entries;
     map->map_definition.pinning = map_cache.pinning;
+    map->map_definition.map_flags = 0;
     map->map_id = map_cache.id;
     map->map_definition.inner_map_id = map_cache.inner_id;
     map->inner_map_original_fd = map_cache.verifier_map_descriptor.inner_map_fd;
@@ -3441,13 +3760,111 @@ catch (const std::runtime_error& ex)
 }
 CATCH_NO_MEMORY_EBPF_RESULT
 
-_Requires_lock_not_held_(_ebpf_state_mutex) static ebpf_result_t
-    _ebpf_object_load_programs(_Inout_ struct bpf_object* object) noexcept(false)
+// Maximum number of programs from a single object that are verified and loaded concurrently.
+#define EBPF_MAX_PARALLEL_PROGRAM_LOADS 8
+
+typedef struct _ebpf_program_load_work_item
+{
+    ebpf_program_t* program;
+    ebpf_program_load_info load_info;
+    ebpf_result_t result;
+} ebpf_program_load_work_item_t;
+
+/**
+ * @brief Queue of programs waiting to be verified and loaded. Programs are
+ * created by the caller and appended to the queue in object order, while
+ * workers drain it concurrently, so program creation is pipelined behind
+ * verification of the programs ahead of it.
+ */
+typedef struct _ebpf_program_load_queue
+{
+    std::mutex lock;
+    std::condition_variable item_available;
+    _Guarded_by_(lock) std::vector<ebpf_program_load_work_item_t> items;
+    _Guarded_by_(lock) size_t next_item = 0;
+    _Guarded_by_(lock) bool closed = false;
+    // Index of the first item that failed. Items after it are not loaded,
+    // since the object load as a whole will fail.
+    std::atomic<size_t> first_failed_item = SIZE_MAX;
+} ebpf_program_load_queue_t;
+
+static void
+_ebpf_program_load_worker(_Inout_ ebpf_program_load_queue_t* queue, bool worker_thread) noexcept
+{
+    for (;;) {
+        size_t index;
+        ebpf_program_load_work_item_t* item;
+        {
+            std::unique_lock lock(queue->lock);
+            queue->item_available.wait(
+                lock, [queue] { return queue->closed || queue->next_item < queue->items.size(); });
+            if (queue->next_item == queue->items.size()) {
+                break;
+            }
+            index = queue->next_item++;
+            // The items vector is reserved up front, so this pointer stays valid after the lock is dropped.
+            item = &queue->items[index];
+        }
+
+        if (index > queue->first_failed_item) {
+            item->result = EBPF_CANCELED;
+            continue;
+        }
+
+        item->result =
+            ebpf_rpc_load_program(&item->load_info, &item->program->log_buffer, &item->program->log_buffer_size);
+
+        if (worker_thread) {
+            // Verification state is kept in thread-local storage. Clear it so that
+            // the next program handled by this worker starts from a clean slate.
+            ebpf_clear_thread_local_storage();
+        }
+
+        if (item->result != EBPF_SUCCESS) {
+            size_t first_failed_item = queue->first_failed_item;
+            while (index < first_failed_item &&
+                   !queue->first_failed_item.compare_exchange_weak(first_failed_item, index)) {
+            }
+        }
+    }
+}
+
+static void
+_ebpf_program_load_worker_thread(_Inout_ ebpf_program_load_queue_t* queue) noexcept
+{
+    _ebpf_program_load_worker(queue, true);
+
+    // Release the per-thread device handle opened by this worker.
+    ebpf_api_thread_local_cleanup();
+}
+
+// Close the queue and wait for every queued program to be processed.
+static void
+_ebpf_program_load_queue_drain(
+    _Inout_ ebpf_program_load_queue_t* queue, _Inout_ std::vector<std::thread>& workers) noexcept
+{
+    {
+        std::unique_lock lock(queue->lock);
+        queue->closed = true;
+    }
+    queue->item_available.notify_all();
+
+    if (workers.empty()) {
+        _ebpf_program_load_worker(queue, false);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+// Create each program in the object and queue it to be verified and loaded.
+_Requires_lock_not_held_(_ebpf_state_mutex) static ebpf_result_t _ebpf_object_queue_programs(
+    _Inout_ struct bpf_object* object,
+    _In_ std::vector<original_fd_handle_map_t>& handle_map,
+    _Inout_ ebpf_program_load_queue_t* queue) noexcept(false)
 {
-    EBPF_LOG_ENTRY();
-    ebpf_assert(object);
     ebpf_result_t result = EBPF_SUCCESS;
-    std::vector<original_fd_handle_map_t> handle_map;
 
     for (ebpf_program_t* program : object->programs) {
         if (!program->autoload) {
@@ -3456,6 +3873,10 @@ _Requires_lock_not_held_(_ebpf_state_mutex) static ebpf_result_t
         if (prog_is_subprog(object, program)) {
             continue;
         }
+        if (queue->first_failed_item != SIZE_MAX) {
+            // A program already failed to load, so don't create any more.
+            break;
+        }
         result = _create_program(
             program->program_type, object->object_name, program->section_name, program->program_name, &program->handle);
         if (result != EBPF_SUCCESS) {
@@ -3472,7 +3893,8 @@ _Requires_lock_not_held_(_ebpf_state_mutex) static ebpf_result_t
         }
 
         // Populate load_info.
-        ebpf_program_load_info load_info = {0};
+        ebpf_program_load_work_item_t item = {program, {0}, EBPF_SUCCESS};
+        ebpf_program_load_info& load_info = item.load_info;
         load_info.object_name = const_cast<char*>(object->object_name);
         load_info.section_name = const_cast<char*>(program->section_name);
         load_info.program_name = const_cast<char*>(program->program_name);
@@ -3482,26 +3904,77 @@ _Requires_lock_not_held_(_ebpf_state_mutex) static ebpf_result_t
         load_info.instructions = reinterpret_cast<ebpf_instruction_t*>(program->instructions);
         load_info.instruction_count = program->instruction_count;
         load_info.execution_context = execution_context_kernel_mode;
-        load_info.map_count = (uint32_t)object->maps.size();
-
+        load_info.map_count = (uint32_t)handle_map.size();
         if (load_info.map_count > 0) {
-            for (auto& map : object->maps) {
-                ebpf_id_t inner_map_id = (map->inner_map) ? map->inner_map->map_id : EBPF_ID_NONE;
-                handle_map.emplace_back(
-                    map->original_fd,
-                    map->map_id,
-                    map->inner_map_original_fd,
-                    inner_map_id,
-                    reinterpret_cast<file_handle_t>(map->map_handle));
-            }
-
             load_info.handle_map = handle_map.data();
         }
 
-        result = ebpf_rpc_load_program(&load_info, &program->log_buffer, &program->log_buffer_size);
-        if (result != EBPF_SUCCESS) {
-            break;
+        {
+            std::unique_lock lock(queue->lock);
+            queue->items.push_back(item);
         }
+        queue->item_available.notify_one();
+    }
+
+    return result;
+}
+
+_Requires_lock_not_held_(_ebpf_state_mutex) static ebpf_result_t
+    _ebpf_object_load_programs(_Inout_ struct bpf_object* object) noexcept(false)
+{
+    EBPF_LOG_ENTRY();
+    ebpf_assert(object);
+    ebpf_result_t result = EBPF_SUCCESS;
+    std::vector<original_fd_handle_map_t> handle_map;
+    ebpf_program_load_queue_t queue;
+    std::vector<std::thread> workers;
+
+    size_t program_count = 0;
+    for (ebpf_program_t* program : object->programs) {
+        if (program->autoload && !prog_is_subprog(object, program)) {
+            program_count++;
+        }
+    }
+
+    for (auto& map : object->maps) {
+        ebpf_id_t inner_map_id = (map->inner_map) ? map->inner_map->map_id : EBPF_ID_NONE;
+        handle_map.emplace_back(
+            map->original_fd,
+            map->map_id,
+            map->inner_map_original_fd,
+            inner_map_id,
+            reinterpret_cast<file_handle_t>(map->map_handle));
+    }
+
+    // Reserve all items up front so that workers can hold pointers into the vector.
+    queue.items.reserve(program_count);
+
+    // Programs are verified independently of each other, so verify them on a bounded
+    // pool of workers. A single program is loaded on the calling thread.
+    size_t worker_count = std::min<size_t>(
+        {program_count, (size_t)std::max(std::thread::hardware_concurrency(), 1u), EBPF_MAX_PARALLEL_PROGRAM_LOADS});
+    try {
+        while (workers.size() < worker_count && worker_count > 1) {
+            workers.emplace_back(_ebpf_program_load_worker_thread, &queue);
+        }
+    } catch (const std::system_error&) {
+        // Continue with however many workers could be started. If none could,
+        // the calling thread drains the queue below.
+    }
+
+    try {
+        result = _ebpf_object_queue_programs(object, handle_map, &queue);
+    } catch (...) {
+        // Workers hold pointers into the queue, so they must finish before it goes away.
+        _ebpf_program_load_queue_drain(&queue, workers);
+        throw;
+    }
+    _ebpf_program_load_queue_drain(&queue, workers);
+
+    // Report the first failure in object order, so that the result and the
+    // diagnostics are the same regardless of how the workers were scheduled.
+    if (queue.first_failed_item != SIZE_MAX) {
+        result = queue.items[queue.first_failed_item].result;
     }
 
     if (result == EBPF_SUCCESS) {
@@ -5206,6 +5679,23 @@ ebpf_program_synchronize() NO_EXCEPT_TRY
 }
 CATCH_NO_MEMORY_EBPF_RESULT
 
+_Must_inspect_result_ ebpf_result_t
+ebpf_get_runtime_statistics(_Out_ ebpf_runtime_statistics_t* statistics) NO_EXCEPT_TRY
+{
+    EBPF_LOG_ENTRY();
+    ebpf_assert(statistics);
+    ebpf_operation_get_runtime_statistics_request_t request{
+        sizeof(request), ebpf_operation_id_t::EBPF_OPERATION_GET_RUNTIME_STATISTICS};
+    ebpf_operation_get_runtime_statistics_reply_t reply{};
+
+    ebpf_result_t result = win32_error_code_to_ebpf_result(invoke_ioctl(request, reply));
+    if (result == EBPF_SUCCESS) {
+        *statistics = reply.statistics;
+    }
+    EBPF_RETURN_RESULT(result);
+}
+CATCH_NO_MEMORY_EBPF_RESULT
+
 void
 ebpf_api_thread_local_cleanup() noexcept
 {
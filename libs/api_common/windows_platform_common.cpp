@@ -771,10 +771,12 @@ clear_ebpf_provider_data()
 }
 
 _Success_(return == EBPF_SUCCESS) ebpf_result_t
-    get_program_type_info_from_tls(_Outptr_ const ebpf_program_info_t** info)
+    get_program_type_info_from_tls(
+        _Outptr_ const ebpf_program_info_t** info, _In_opt_ const ebpf_program_type_t* program_type)
 {
-    const GUID* program_type =
-        reinterpret_cast<const GUID*>(prevail::thread_local_program_info->type.platform_specific_data);
+    if (program_type == nullptr) {
+        program_type = reinterpret_cast<const GUID*>(prevail::thread_local_program_info->type.platform_specific_data);
+    }
     ebpf_result_t result = EBPF_SUCCESS;
 
     _load_ebpf_provider_data();
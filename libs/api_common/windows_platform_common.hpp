@@ -43,8 +43,19 @@ get_attach_type_name(_In_ const ebpf_attach_type_t* attach_type);
 void
 clear_ebpf_provider_data();
 
+/**
+ * @brief Get the program information cached in thread-local storage by a
+ * previous call to get_program_type_windows().
+ *
+ * @param[out] info Pointer to the cached program information.
+ * @param[in] program_type Program type to look up. If NULL, the program type
+ *  of the program being verified on this thread is used.
+ * @retval EBPF_SUCCESS The operation was successful.
+ * @retval EBPF_OBJECT_NOT_FOUND No program information is cached for this program type.
+ */
 _Success_(return == EBPF_SUCCESS) ebpf_result_t
-    get_program_type_info_from_tls(_Outptr_ const ebpf_program_info_t** info);
+    get_program_type_info_from_tls(
+        _Outptr_ const ebpf_program_info_t** info, _In_opt_ const ebpf_program_type_t* program_type = nullptr);
 
 void
 clear_program_info_cache();
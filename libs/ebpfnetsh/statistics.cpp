@@ -0,0 +1,80 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#include "bpf/libbpf.h"
+#include "ebpf_api.h"
+#include "statistics.h"
+
+#include <iostream>
+
+// The following function uses Windows-specific types as inputs to match
+// the definition of "FN_HANDLE_CMD" in the public NetSh.h file.
+unsigned long
+handle_ebpf_show_statistics(
+    IN LPCWSTR machine,
+    _Inout_updates_(argc) LPWSTR* argv,
+    IN DWORD current_index,
+    IN DWORD argc,
+    IN DWORD flags,
+    IN LPCVOID data,
+    OUT BOOL* done)
+{
+    UNREFERENCED_PARAMETER(argv);
+    UNREFERENCED_PARAMETER(current_index);
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(machine);
+    UNREFERENCED_PARAMETER(flags);
+    UNREFERENCED_PARAMETER(data);
+    UNREFERENCED_PARAMETER(done);
+
+    ebpf_runtime_statistics_t statistics;
+    ebpf_result_t result = ebpf_get_runtime_statistics(&statistics);
+    if (result != EBPF_SUCCESS) {
+        std::cout << "Error: Reading runtime statistics failed: " << result << std::endl;
+        return ERROR_SUPPRESS_OUTPUT;
+    }
+
+    std::cout << "\n";
+    std::cout << "          Map Type       Lookups          Hits        Misses       Updates       Deletes\n";
+    std::cout << "==================  ============  ============  ============  ============  ============\n";
+    for (int type = 0; type < BPF_MAP_TYPE_MAX; type++) {
+        const ebpf_map_type_statistics_t& map_type = statistics.map_type[type];
+        uint64_t lookup_count = map_type.hit_count + map_type.miss_count;
+        if (lookup_count == 0 && map_type.update_count == 0 && map_type.delete_count == 0) {
+            continue;
+        }
+        printf(
+            "%18s%14llu%14llu%14llu%14llu%14llu\n",
+            libbpf_bpf_map_type_str(static_cast<bpf_map_type>(type)),
+            lookup_count,
+            map_type.hit_count,
+            map_type.miss_count,
+            map_type.update_count,
+            map_type.delete_count);
+    }
+
+    std::cout << "\n";
+    std::cout << "Hash bucket length       Lookups\n";
+    std::cout << "==================  ============\n";
+    for (int length = 0; length < EBPF_STATISTICS_HASH_CHAIN_LENGTH_BUCKETS; length++) {
+        printf(
+            "%17d%s%14llu\n",
+            length,
+            (length == EBPF_STATISTICS_HASH_CHAIN_LENGTH_BUCKETS - 1) ? "+" : " ",
+            statistics.hash_chain_length[length]);
+    }
+
+    std::cout << "\n";
+    printf("LRU evictions                : %llu\n", statistics.lru_eviction_count);
+    printf("Ring buffer drops            : %llu\n", statistics.ring_buffer_drop_count);
+    printf("Perf event array drops       : %llu\n", statistics.perf_event_array_drop_count);
+    printf("Epoch advances               : %llu\n", statistics.epoch_advance_count);
+    // The CPUs' counters are read one after the other, so a release can be seen without its insert.
+    uint64_t free_list_depth = 0;
+    if (statistics.epoch_free_list_insert_count > statistics.epoch_free_list_release_count) {
+        free_list_depth = statistics.epoch_free_list_insert_count - statistics.epoch_free_list_release_count;
+    }
+    printf("Epoch free list depth        : %llu\n", free_list_depth);
+    printf("Tail calls                   : %llu\n", statistics.tail_call_count);
+    return NO_ERROR;
+}
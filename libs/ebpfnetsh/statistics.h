@@ -0,0 +1,17 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <windows.h>
+#include <netsh.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    FN_HANDLE_CMD handle_ebpf_show_statistics;
+
+#ifdef __cplusplus
+}
+#endif
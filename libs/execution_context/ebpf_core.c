@@ -9,6 +9,7 @@
 #include "ebpf_epoch.h"
 #include "ebpf_extension_uuids.h"
 #include "ebpf_handle.h"
+#include "ebpf_hash_table.h"
 #include "ebpf_link.h"
 #include "ebpf_maps.h"
 #include "ebpf_native.h"
@@ -17,6 +18,7 @@
 #include "ebpf_random.h"
 #include "ebpf_serialize.h"
 #include "ebpf_state.h"
+#include "ebpf_statistics.h"
 #include "ebpf_strings.h"
 #include "ebpf_tracelog.h"
 
@@ -37,6 +39,50 @@ const NPI_MODULEID ebpf_general_helper_function_module_id = {
 
 static ebpf_pinning_table_t* _ebpf_core_map_pinning_table = NULL;
 
+// bpf_printk accepts at most three arguments after the format string.
+#define EBPF_CORE_PRINTK_MAX_ARGUMENTS 3
+
+// Upper bound on the number of distinct format strings kept in the printk format cache.
+// Formats seen after the cache is full are parsed on every call, as if there were no cache.
+#define EBPF_CORE_PRINTK_MAX_FORMATS 4096
+
+typedef struct _ebpf_core_printk_specifier
+{
+    char conversion; ///< One of PRINTK_SPECIFIER_CHARS.
+    bool is_64_bit;  ///< True for the "ll" length modifier.
+} ebpf_core_printk_specifier_t;
+
+/**
+ * @brief A bpf_printk format string that has been validated and assigned an ID.
+ *
+ * The cache is keyed by the format exactly as passed to bpf_printk, so the
+ * validation, the copy used for formatting and the ID are computed once per
+ * distinct format rather than on every call.
+ */
+typedef struct _ebpf_core_printk_format
+{
+    struct _ebpf_core_printk_format* next; ///< Next format in _ebpf_core_printk_format_list.
+    cxplat_utf8_string_t key;              ///< Format as passed to bpf_printk, points into data.
+    uint32_t id;                           ///< ID logged in place of the format string.
+    int specifier_count;                   ///< Count of conversion specifiers, or -1 if the format is invalid.
+    size_t literal_length;                 ///< Length of the formatted output excluding conversions.
+    ebpf_core_printk_specifier_t specifiers[EBPF_CORE_PRINTK_MAX_ARGUMENTS];
+    volatile int64_t announced_generation; ///< Deferred session generation this format was last logged in.
+    const char* format;                    ///< Null-terminated format without trailing newline, points into data.
+    char data[1];                          ///< Storage for key followed by format.
+} ebpf_core_printk_format_t;
+
+static ebpf_hash_table_t* _ebpf_core_printk_formats = NULL;
+static ebpf_lock_t _ebpf_core_printk_format_lock;
+// List of all cached formats, so they can be freed at termination. Updated under _ebpf_core_printk_format_lock.
+static ebpf_core_printk_format_t* _ebpf_core_printk_format_list = NULL;
+static volatile int32_t _ebpf_core_printk_next_format_id = 0;
+
+// Consumers of deferred printk events need the format string for each ID. Formats are logged again the first time
+// they are used after deferred printk events are enabled, which is tracked by bumping a generation number.
+static volatile int32_t _ebpf_core_printk_deferred_enabled = 0;
+static volatile int64_t _ebpf_core_printk_deferred_generation = 0;
+
 // Assume enabled until we can query it.
 // Extern variable defined in ebpf_core_jit.h.
 bool ebpf_platform_hypervisor_code_integrity_enabled = true;
@@ -73,7 +119,7 @@ _ebpf_core_map_push_elem(_Inout_ ebpf_map_t* map, _In_ const uint8_t* value, uin
 static int
 _ebpf_core_map_pop_elem(_Inout_ ebpf_map_t* map, _Out_ uint8_t* value);
 static int
-_ebpf_core_map_peek_elem(_Inout_ ebpf_map_t* map, _Out_ uint8_t* value);
+_ebpf_core_map_peek_elem(_Inout_ ebpf_map_t* map, _Inout_ uint8_t* value);
 static uint64_t
 _ebpf_core_get_pid_tgid();
 static uint64_t
@@ -253,6 +299,43 @@ ebpf_core_terminate_pinning_table()
     _ebpf_core_map_pinning_table = NULL;
 }
 
+static void
+_ebpf_core_printk_format_extract(_In_ const uint8_t* value, _Outptr_ const uint8_t** data, _Out_ size_t* length)
+{
+    const cxplat_utf8_string_t* key = *(cxplat_utf8_string_t**)value;
+    *data = key->value;
+    *length = key->length * 8;
+}
+
+static _Must_inspect_result_ ebpf_result_t
+_ebpf_core_initiate_printk_formats()
+{
+    const ebpf_hash_table_creation_options_t options = {
+        .key_size = sizeof(cxplat_utf8_string_t*),
+        .value_size = sizeof(ebpf_core_printk_format_t*),
+        .extract_function = _ebpf_core_printk_format_extract,
+        .allocation_tag = EBPF_POOL_TAG_CORE,
+        .max_entries = EBPF_CORE_PRINTK_MAX_FORMATS,
+    };
+
+    ebpf_lock_create(&_ebpf_core_printk_format_lock);
+    return ebpf_hash_table_create(&_ebpf_core_printk_formats, &options);
+}
+
+static void
+_ebpf_core_terminate_printk_formats()
+{
+    ebpf_hash_table_destroy(_ebpf_core_printk_formats);
+    _ebpf_core_printk_formats = NULL;
+
+    while (_ebpf_core_printk_format_list != NULL) {
+        ebpf_core_printk_format_t* format = _ebpf_core_printk_format_list;
+        _ebpf_core_printk_format_list = format->next;
+        ebpf_free(format);
+    }
+    ebpf_lock_destroy(&_ebpf_core_printk_format_lock);
+}
+
 _Must_inspect_result_ ebpf_result_t
 ebpf_core_initiate()
 {
@@ -279,6 +362,11 @@ ebpf_core_initiate()
         goto Done;
     }
 
+    return_value = ebpf_statistics_initiate();
+    if (return_value != EBPF_SUCCESS) {
+        goto Done;
+    }
+
     return_value = ebpf_maps_initiate();
     if (return_value != EBPF_SUCCESS) {
         goto Done;
@@ -301,6 +389,11 @@ ebpf_core_initiate()
         goto Done;
     }
 
+    return_value = _ebpf_core_initiate_printk_formats();
+    if (return_value != EBPF_SUCCESS) {
+        goto Done;
+    }
+
     return_value = ebpf_handle_table_initiate();
     if (return_value != EBPF_SUCCESS) {
         goto Done;
@@ -358,6 +451,8 @@ ebpf_core_terminate()
 
     ebpf_core_terminate_pinning_table();
 
+    _ebpf_core_terminate_printk_formats();
+
     ebpf_state_terminate();
 
     ebpf_maps_terminate();
@@ -365,6 +460,9 @@ ebpf_core_terminate()
     // Verify that all ebpf_core_object_t objects have been freed.
     ebpf_object_tracking_terminate();
 
+    // The counters are freed through the epoch, so this must precede epoch termination.
+    ebpf_statistics_terminate();
+
     // Shut down the epoch tracker and free any remaining memory or work items.
     // Note: Some objects may only be released on epoch termination.
     ebpf_epoch_synchronize();
@@ -700,6 +798,14 @@ Done:
     EBPF_RETURN_RESULT(result);
 }
 
+// Protocol handlers run in an epoch (see ebpf_core_invoke_protocol_handler), so short synchronous map operations
+// borrow the map for the duration of the call rather than writing to its shared reference count.
+static ebpf_result_t
+_ebpf_core_borrow_map_by_handle(ebpf_handle_t handle, _Outptr_ ebpf_map_t** map)
+{
+    return ebpf_object_borrow_by_handle(handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)map);
+}
+
 static ebpf_result_t
 _ebpf_core_protocol_map_find_element(
     _In_ const ebpf_operation_map_find_element_request_t* request,
@@ -712,7 +818,7 @@ _ebpf_core_protocol_map_find_element(
     size_t value_length;
     size_t key_length;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -744,7 +850,6 @@ _ebpf_core_protocol_map_find_element(
     reply->header.length = reply_length;
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -757,7 +862,7 @@ _ebpf_core_protocol_map_update_element(_In_ const ebpf_operation_map_update_elem
     size_t value_length;
     size_t key_length;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -781,7 +886,6 @@ _ebpf_core_protocol_map_update_element(_In_ const ebpf_operation_map_update_elem
         map, key_length, request->data, value_length, request->data + key_length, request->option, 0);
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -798,7 +902,7 @@ _ebpf_core_protocol_map_update_element_batch(
     size_t data_length;
     size_t key_and_value_length;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -843,7 +947,6 @@ _ebpf_core_protocol_map_update_element_batch(
     reply->count_of_elements_processed = (uint32_t)output_count;
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -884,7 +987,7 @@ _ebpf_core_protocol_map_delete_element(_In_ const ebpf_operation_map_delete_elem
     ebpf_map_t* map = NULL;
     size_t key_length;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -898,7 +1001,6 @@ _ebpf_core_protocol_map_delete_element(_In_ const ebpf_operation_map_delete_elem
     retval = ebpf_map_delete_entry(map, key_length, request->key, 0);
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -914,7 +1016,7 @@ _ebpf_core_protocol_map_delete_element_batch(
     size_t input_count = 0;
     size_t output_count = 0;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -946,7 +1048,6 @@ _ebpf_core_protocol_map_delete_element_batch(
     reply->count_of_elements_processed = (uint32_t)output_count;
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -962,7 +1063,7 @@ _ebpf_core_protocol_map_get_next_key(
     size_t previous_key_length;
     size_t next_key_length;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -1005,8 +1106,6 @@ _ebpf_core_protocol_map_get_next_key(
     reply->header.length = reply_length;
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
-
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -1022,7 +1121,7 @@ _ebpf_core_protocol_map_get_next_key_value_batch(
     size_t previous_key_length;
     size_t reply_data_length = 0;
 
-    retval = EBPF_OBJECT_REFERENCE_BY_HANDLE(request->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map);
+    retval = _ebpf_core_borrow_map_by_handle(request->handle, &map);
     if (retval != EBPF_SUCCESS) {
         goto Done;
     }
@@ -1066,8 +1165,6 @@ _ebpf_core_protocol_map_get_next_key_value_batch(
         (uint16_t)(EBPF_OFFSET_OF(ebpf_operation_map_get_next_key_value_batch_reply_t, data) + reply_data_length);
 
 Done:
-    EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
-
     EBPF_RETURN_RESULT(retval);
 }
 
@@ -2221,6 +2318,84 @@ Done:
     EBPF_RETURN_RESULT(result);
 }
 
+static ebpf_result_t
+_ebpf_core_protocol_get_runtime_statistics(
+    _In_ const ebpf_operation_get_runtime_statistics_request_t* request,
+    _Out_ ebpf_operation_get_runtime_statistics_reply_t* reply)
+{
+    EBPF_LOG_ENTRY();
+    UNREFERENCED_PARAMETER(request);
+    ebpf_statistics_query(&reply->statistics);
+    EBPF_RETURN_RESULT(EBPF_SUCCESS);
+}
+
+static ebpf_result_t
+_ebpf_core_protocol_map_create_shadow(
+    _In_ const ebpf_operation_map_create_shadow_request_t* request,
+    _Out_ ebpf_operation_map_create_shadow_reply_t* reply)
+{
+    EBPF_LOG_ENTRY();
+    ebpf_result_t result;
+    ebpf_map_t* map = NULL;
+    ebpf_map_t* shadow_map = NULL;
+
+    result = _ebpf_core_borrow_map_by_handle(request->handle, &map);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+
+    result = ebpf_map_create_shadow(map, request->copy_forward, &shadow_map);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+
+    result = ebpf_handle_create(&reply->shadow_handle, (ebpf_base_object_t*)shadow_map);
+
+Done:
+    if (shadow_map != NULL) {
+        EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)shadow_map);
+    }
+    EBPF_RETURN_RESULT(result);
+}
+
+static ebpf_result_t
+_ebpf_core_protocol_map_publish_shadow(_In_ const ebpf_operation_map_publish_shadow_request_t* request)
+{
+    EBPF_LOG_ENTRY();
+    ebpf_result_t result;
+    ebpf_map_t* map = NULL;
+    ebpf_map_t* shadow_map = NULL;
+
+    result = _ebpf_core_borrow_map_by_handle(request->handle, &map);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+
+    result = _ebpf_core_borrow_map_by_handle(request->shadow_handle, &shadow_map);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+
+    result = ebpf_map_publish_shadow(map, shadow_map);
+
+Done:
+    EBPF_RETURN_RESULT(result);
+}
+
+static ebpf_result_t
+_ebpf_core_protocol_map_set_time_to_live(_In_ const ebpf_operation_map_set_time_to_live_request_t* request)
+{
+    EBPF_LOG_ENTRY();
+    ebpf_map_t* map = NULL;
+
+    ebpf_result_t result = _ebpf_core_borrow_map_by_handle(request->handle, &map);
+    if (result != EBPF_SUCCESS) {
+        EBPF_RETURN_RESULT(result);
+    }
+
+    EBPF_RETURN_RESULT(ebpf_map_set_time_to_live(map, request->time_to_live_in_ms));
+}
+
 static void*
 _ebpf_core_map_find_element(ebpf_map_t* map, const uint8_t* key)
 {
@@ -2352,46 +2527,51 @@ _ebpf_core_is_current_admin(_In_ const void* ctx)
 // Only integers are currently supported.
 #define PRINTK_SPECIFIER_CHARS "diux"
 
-static long
-_ebpf_core_trace_printk(_In_reads_(fmt_size) const char* fmt, size_t fmt_size, int arg_count, ...)
+/**
+ * @brief Copy and validate a format string.
+ *
+ * @param[in] fmt Format string as passed to bpf_printk.
+ * @param[in] fmt_size Size of fmt in bytes, including the null terminator.
+ * @returns Pointer to the new format, or NULL on allocation failure. An invalid
+ * format is returned with a specifier_count of -1.
+ */
+static _Ret_maybenull_ ebpf_core_printk_format_t*
+_ebpf_core_printk_format_create(_In_reads_(fmt_size) const char* fmt, size_t fmt_size)
 {
-    if (fmt_size > MAX_PRINTK_STRING_SIZE - 1) {
-        // Disallow large fmt_size values.
-        return -1;
+    ebpf_core_printk_format_t* format = (ebpf_core_printk_format_t*)ebpf_allocate_with_tag(
+        EBPF_OFFSET_OF(ebpf_core_printk_format_t, data) + (fmt_size * 2) + 1, EBPF_POOL_TAG_CORE);
+    if (format == NULL) {
+        return NULL;
     }
 
-    // If the provider is not enabled, don't bother with the rest.
-    if (!TraceLoggingProviderEnabled(ebpf_tracelog_provider, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK)) {
-        return 0;
-    }
-
-    // Make a copy of the original format string.
-    char* output = (char*)ebpf_allocate_with_tag(fmt_size + 1, EBPF_POOL_TAG_CORE);
-    if (output == NULL) {
-        return -1;
-    }
-    memcpy(output, fmt, fmt_size);
+    memcpy(format->data, fmt, fmt_size);
+    format->key.value = (uint8_t*)format->data;
+    format->key.length = fmt_size;
 
     // Make sure the output is null-terminated, and
     // remove the newline if present.
     // A well-formed input should be null terminated,
     // so look at the next-to-last byte.
-    char* end = output + fmt_size - 2;
-    if (*end != '\n') {
-        end++;
+    char* output = format->data + fmt_size;
+    memcpy(output, fmt, fmt_size);
+    size_t length = (fmt_size > 0) ? fmt_size - 1 : 0;
+    if (length > 0 && output[length - 1] == '\n') {
+        length--;
     }
-    *end = '\0';
+    output[length] = '\0';
+    format->format = output;
 
     /* Validate format string.
      * The conversion specifiers are limited to:
      * %d, %i, %u, %x, %ld, %li, %lu, %lx, %lld, %lli, %llu, %llx.
      * No modifier (size of field, padding with zeroes, etc.) is available.
      */
-    long bytes_written = -1;
     const char* p;
     int specifier_count = 0;
+    size_t literal_length = 0;
     for (p = output; *p; p++) {
         if (*p != '%') {
+            literal_length++;
             continue;
         }
         if (p[1] == 0) {
@@ -2400,47 +2580,197 @@ _ebpf_core_trace_printk(_In_reads_(fmt_size) const char* fmt, size_t fmt_size, i
         if (p[1] == '%') {
             // Allow a %% escape.
             p++;
+            literal_length++;
             continue;
         }
 
-        // We found a specifier.  Verify that it is in the legal set.
-        if (strchr(PRINTK_SPECIFIER_CHARS, p[1])) {
-            // We found a legal one character specifier.
-            p++;
-            specifier_count++;
-            continue;
+        // We found a specifier. Verify that it is in the legal set, with at most two 'l' modifiers.
+        size_t modifier_count = 0;
+        while (modifier_count < 2 && p[1 + modifier_count] == 'l') {
+            modifier_count++;
         }
-
-        if (p[1] != 'l' || p[2] == 0) {
+        char conversion = p[1 + modifier_count];
+        if (conversion == 0 || strchr(PRINTK_SPECIFIER_CHARS, conversion) == NULL) {
             break;
         }
-        if (strchr(PRINTK_SPECIFIER_CHARS, p[2])) {
-            // We found a legal two character specifier.
-            p += 2;
-            specifier_count++;
-            continue;
+        if (specifier_count < EBPF_CORE_PRINTK_MAX_ARGUMENTS) {
+            format->specifiers[specifier_count].conversion = conversion;
+            format->specifiers[specifier_count].is_64_bit = (modifier_count == 2);
         }
+        p += 1 + modifier_count;
+        specifier_count++;
+    }
 
-        if (p[2] != 'l' || p[3] == 0) {
-            break;
+    format->specifier_count = (*p == 0) ? specifier_count : -1;
+    format->literal_length = literal_length;
+    format->id = (uint32_t)ebpf_interlocked_increment_int32(&_ebpf_core_printk_next_format_id);
+    return format;
+}
+
+/**
+ * @brief Find a format in the printk format cache, adding it if it is not present.
+ *
+ * @param[in] fmt Format string as passed to bpf_printk.
+ * @param[in] fmt_size Size of fmt in bytes, including the null terminator.
+ * @param[out] cached Set to false if the caller owns the returned format and must free it.
+ * @returns Pointer to the format, or NULL on allocation failure.
+ */
+static _Ret_maybenull_ ebpf_core_printk_format_t*
+_ebpf_core_printk_format_get(_In_reads_(fmt_size) const char* fmt, size_t fmt_size, _Out_ bool* cached)
+{
+    const cxplat_utf8_string_t key = {(uint8_t*)fmt, fmt_size};
+    const cxplat_utf8_string_t* key_pointer = &key;
+    ebpf_core_printk_format_t** existing_format;
+
+    *cached = true;
+    if (_ebpf_core_printk_formats != NULL &&
+        ebpf_hash_table_find(_ebpf_core_printk_formats, (const uint8_t*)&key_pointer, (uint8_t**)&existing_format) ==
+            EBPF_SUCCESS) {
+        return *existing_format;
+    }
+
+    ebpf_core_printk_format_t* format = _ebpf_core_printk_format_create(fmt, fmt_size);
+    if (format == NULL || _ebpf_core_printk_formats == NULL) {
+        *cached = false;
+        return format;
+    }
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_core_printk_format_lock);
+    if (ebpf_hash_table_find(_ebpf_core_printk_formats, (const uint8_t*)&key_pointer, (uint8_t**)&existing_format) ==
+        EBPF_SUCCESS) {
+        // Another CPU added the same format first.
+        ebpf_free(format);
+        format = *existing_format;
+    } else {
+        const cxplat_utf8_string_t* new_key = &format->key;
+        if (ebpf_hash_table_update(
+                _ebpf_core_printk_formats,
+                NULL,
+                (const uint8_t*)&new_key,
+                (const uint8_t*)&format,
+                EBPF_HASH_TABLE_OPERATION_INSERT) == EBPF_SUCCESS) {
+            format->next = _ebpf_core_printk_format_list;
+            _ebpf_core_printk_format_list = format;
+        } else {
+            // The cache is full, so the caller uses this copy once and frees it.
+            *cached = false;
         }
-        if (strchr(PRINTK_SPECIFIER_CHARS, p[3])) {
-            // We found a legal three character specifier.
-            p += 3;
-            specifier_count++;
-            continue;
+    }
+    ebpf_lock_unlock(&_ebpf_core_printk_format_lock, state);
+
+    return format;
+}
+
+/**
+ * @brief Compute the number of characters a call would have produced if it had been formatted.
+ *
+ * @param[in] format Valid format.
+ * @param[in] arguments Arguments to the conversion specifiers.
+ * @returns Count of characters, excluding the null terminator.
+ */
+static long
+_ebpf_core_printk_formatted_length(
+    _In_ const ebpf_core_printk_format_t* format, _In_reads_(EBPF_CORE_PRINTK_MAX_ARGUMENTS) const uint64_t* arguments)
+{
+    size_t length = format->literal_length;
+    for (int index = 0; index < format->specifier_count; index++) {
+        const ebpf_core_printk_specifier_t* specifier = &format->specifiers[index];
+        // Without "ll" the argument is consumed as a 32-bit int or long.
+        uint64_t value = specifier->is_64_bit ? arguments[index] : (uint32_t)arguments[index];
+        uint64_t base = 10;
+        if (specifier->conversion == 'x') {
+            base = 16;
+        } else if (specifier->conversion == 'd' || specifier->conversion == 'i') {
+            int64_t signed_value = specifier->is_64_bit ? (int64_t)value : (int64_t)(int32_t)value;
+            if (signed_value < 0) {
+                length++;
+                value = 0 - (uint64_t)signed_value;
+            }
         }
-        break;
+        do {
+            length++;
+            value /= base;
+        } while (value != 0);
     }
+    return (long)length;
+}
 
-    if ((*p == 0) && (arg_count == specifier_count)) {
+/**
+ * @brief Log the format string for a deferred printk event, unless it has already
+ * been logged since deferred printk events were last enabled.
+ *
+ * @param[in, out] format Format about to be referenced by ID.
+ */
+static void
+_ebpf_core_printk_announce_format(_Inout_ ebpf_core_printk_format_t* format)
+{
+    int64_t generation = _ebpf_core_printk_deferred_generation;
+    if (format->announced_generation != generation) {
+        format->announced_generation = generation;
+        ebpf_log_printk_format(format->id, format->format);
+    }
+}
+
+static long
+_ebpf_core_trace_printk(_In_reads_(fmt_size) const char* fmt, size_t fmt_size, int arg_count, ...)
+{
+    if (fmt_size > MAX_PRINTK_STRING_SIZE - 1) {
+        // Disallow large fmt_size values.
+        return -1;
+    }
+
+    // Formatted messages take precedence, so that sessions enabling all keywords
+    // see the same output as before deferred printk events existed.
+    bool formatted =
+        TraceLoggingProviderEnabled(ebpf_tracelog_provider, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK);
+    bool deferred = false;
+    if (!formatted) {
+        deferred = TraceLoggingProviderEnabled(
+            ebpf_tracelog_provider, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK_DEFERRED);
+    }
+
+    // Track transitions so that formats are logged again for each new deferred session.
+    if (deferred != (_ebpf_core_printk_deferred_enabled != 0)) {
+        int32_t previous = ebpf_interlocked_compare_exchange_int32(
+            &_ebpf_core_printk_deferred_enabled, deferred ? 1 : 0, deferred ? 0 : 1);
+        if (deferred && previous == 0) {
+            ebpf_interlocked_increment_int64(&_ebpf_core_printk_deferred_generation);
+        }
+    }
+
+    // If the provider is not enabled, don't bother with the rest.
+    if (!formatted && !deferred) {
+        return 0;
+    }
+
+    bool cached;
+    ebpf_core_printk_format_t* format = _ebpf_core_printk_format_get(fmt, fmt_size, &cached);
+    if (format == NULL) {
+        return -1;
+    }
+
+    long bytes_written = -1;
+    if (arg_count == format->specifier_count) {
         va_list arg_list;
         va_start(arg_list, arg_count);
-        bytes_written = ebpf_platform_printk(output, arg_list);
+        if (formatted) {
+            bytes_written = ebpf_platform_printk(format->format, arg_list);
+        } else {
+            // Log only the format ID and the arguments. Formatting is left to the consumer.
+            uint64_t arguments[EBPF_CORE_PRINTK_MAX_ARGUMENTS] = {0};
+            for (int index = 0; index < arg_count; index++) {
+                arguments[index] = va_arg(arg_list, uint64_t);
+            }
+            _ebpf_core_printk_announce_format(format);
+            ebpf_log_printk(format->id, (uint32_t)arg_count, arguments[0], arguments[1], arguments[2]);
+            bytes_written = _ebpf_core_printk_formatted_length(format, arguments);
+        }
         va_end(arg_list);
     }
 
-    ebpf_free(output);
+    if (!cached) {
+        ebpf_free(format);
+    }
     return bytes_written;
 }
 
@@ -2587,7 +2917,7 @@ _ebpf_core_map_pop_elem(_Inout_ ebpf_map_t* map, _Out_ uint8_t* value)
 }
 
 static int
-_ebpf_core_map_peek_elem(_Inout_ ebpf_map_t* map, _Out_ uint8_t* value)
+_ebpf_core_map_peek_elem(_Inout_ ebpf_map_t* map, _Inout_ uint8_t* value)
 {
     return -ebpf_map_peek_entry(map, 0, value, EBPF_MAP_FLAG_HELPER);
 }
@@ -2923,6 +3253,10 @@ static ebpf_protocol_handler_t _ebpf_protocol_handlers[] = {
     DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_NO_REPLY(ring_buffer_map_unmap_buffer, PROTOCOL_ALL_MODES),
     DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_NO_REPLY_ASYNC(epoch_synchronize, PROTOCOL_ALL_MODES),
     DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_NO_REPLY(link_set_legacy_mode, PROTOCOL_ALL_MODES),
+    DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_FIXED_REPLY(get_runtime_statistics, PROTOCOL_ALL_MODES),
+    DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_FIXED_REPLY(map_create_shadow, PROTOCOL_ALL_MODES),
+    DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_NO_REPLY(map_publish_shadow, PROTOCOL_ALL_MODES),
+    DECLARE_PROTOCOL_HANDLER_FIXED_REQUEST_NO_REPLY(map_set_time_to_live, PROTOCOL_ALL_MODES),
 };
 
 _Must_inspect_result_ ebpf_result_t
@@ -13,7 +13,9 @@
 #include "ebpf_maps.h"
 #include "ebpf_object.h"
 #include "ebpf_program.h"
+#include "ebpf_random.h"
 #include "ebpf_ring_buffer.h"
+#include "ebpf_statistics.h"
 #include "ebpf_tracelog.h"
 
 #define IS_NESTED_ARRAY_MAP(x) ((x) == BPF_MAP_TYPE_ARRAY_OF_MAPS || (x) == BPF_MAP_TYPE_PROG_ARRAY)
@@ -36,10 +38,14 @@ typedef struct _ebpf_core_map
     uint8_t* data;
     uint8_t* custom_map_context; // Pointer to custom map context, if any. Must be NULL for regular maps.
     const ebpf_map_metadata_table_properties_t* properties; // NULL for custom maps.
+    bool shadow_published; // Set once the map was published as a shadow. It then holds the previous entries.
 } ebpf_core_map_t;
 
 static ebpf_hash_table_t* _ebpf_map_type_metadata_table = NULL;
 
+// Serializes publishing shadow maps, so that a table is never owned by two maps.
+static ebpf_lock_t _ebpf_map_publish_lock;
+
 static inline bool
 _ebpf_map_type_is_valid(uint32_t map_type)
 {
@@ -126,6 +132,10 @@ typedef struct _ebpf_core_object_map
 // Limit maximum map allocation size to 128GB.
 #define EBPF_MAP_MAXIMUM_ALLOCATION (((uint64_t)1) << 37)
 
+// Limit the entries reserved up front by preallocated hash maps to bound the non-paged memory a single map pins.
+// Updates beyond the reservation fall back to the epoch allocator.
+#define EBPF_MAP_MAXIMUM_PREALLOCATED_ENTRIES (64 * 1024)
+
 /**
  * @brief The BPF_MAP_TYPE_LRU_HASH is a hash table that stores a limited number of entries. When the map is full, the
  * least recently used entry is removed to make room for a new entry. The map is implemented as a hash table with a pair
@@ -366,120 +376,184 @@ typedef struct _ebpf_core_map_async_query_context
 } ebpf_core_map_async_query_context_t;
 
 /**
- * Core map structure for BPF_MAP_TYPE_QUEUE and BPF_MAP_TYPE_STACK
- * ebpf_core_circular_map_t stores an array of uint8_t* pointers. Each pointer
- * stores a version of a value that has been pushed to the queue or stack. The
- * structure can't store the map values directly as the caller expects items
- * returned from peek to remain unmodified. If items are stored directly in
- * the array, then a sequence of:
- * 1) push
- * 2) peek
- * 3) pop
- * 4) push
- * can result in aliasing the record, which would result in unexpected behavior.
+ * Core map structure for BPF_MAP_TYPE_QUEUE.
+ * The queue is a bounded multi-producer multi-consumer ring of cells, each holding a sequence number and the value
+ * inline. Producers and consumers claim a position with a compare-exchange on their own counter and then use the
+ * cell's sequence number to hand the value over, so pushes and pops from different CPUs never take a lock or call
+ * the allocator. Values are copied out while the consumer owns the cell, so a value can't be overwritten by a later
+ * push while it is being read.
+ *
+ * For the cell at index position % max_entries, the sequence number is:
+ * - 2 * position when the cell is free for the push at position.
+ * - 2 * position + 1 once that push has written the value, so the cell can be popped at position.
+ * Doubling the position keeps a full and an empty cell apart even when max_entries is 1.
  */
+typedef struct _ebpf_core_queue_cell
+{
+    volatile int64_t sequence;
+    uint8_t value[1];
+} ebpf_core_queue_cell_t;
 
-typedef struct _ebpf_core_circular_map
+typedef struct _ebpf_core_queue_map
+{
+    ebpf_core_map_t core_map;
+    size_t cell_size;
+    __declspec(align(EBPF_CACHE_LINE_SIZE)) volatile int64_t enqueue_position; //< Next position to push at.
+    __declspec(align(EBPF_CACHE_LINE_SIZE)) volatile int64_t dequeue_position; //< Next position to pop from.
+} ebpf_core_queue_map_t;
+
+/**
+ * Core map structure for BPF_MAP_TYPE_STACK.
+ * Values are stored inline in a circular array so that pushing with BPF_EXIST can drop the oldest value when the
+ * stack is full. Values are copied in and out while holding the lock.
+ */
+typedef struct _ebpf_core_stack_map
 {
     ebpf_core_map_t core_map;
     ebpf_lock_t lock;
-    size_t begin;
-    size_t end;
-    enum
-    {
-        EBPF_CORE_QUEUE = 1,
-        EBPF_CORE_STACK = 2,
-    } type;
-    uint8_t* slots[1];
-} ebpf_core_circular_map_t;
+    size_t begin; //< Index of the oldest value.
+    size_t count; //< Count of values in the stack.
+} ebpf_core_stack_map_t;
 
-static size_t
-_ebpf_core_circular_map_add(_In_ const ebpf_core_circular_map_t* map, size_t value, int delta)
+static inline ebpf_core_queue_cell_t*
+_ebpf_core_queue_map_cell(_In_ const ebpf_core_queue_map_t* map, int64_t position)
 {
-    return (map->core_map.ebpf_map_definition.max_entries + value + (size_t)delta) %
-           map->core_map.ebpf_map_definition.max_entries;
+    size_t index = (size_t)((uint64_t)position % map->core_map.ebpf_map_definition.max_entries);
+    return (ebpf_core_queue_cell_t*)(map->core_map.data + index * map->cell_size);
 }
 
-static uint8_t*
-_ebpf_core_circular_map_peek_or_pop(_Inout_ ebpf_core_circular_map_t* map, bool pop)
+static ebpf_result_t
+_ebpf_core_queue_map_push(_Inout_ ebpf_core_queue_map_t* map, _In_ const uint8_t* value)
 {
-    uint8_t* return_value = NULL;
+    ebpf_core_queue_cell_t* cell;
+    int64_t position = ReadNoFence64(&map->enqueue_position);
+    for (;;) {
+        cell = _ebpf_core_queue_map_cell(map, position);
+        int64_t difference = ReadAcquire64(&cell->sequence) - 2 * position;
+        if (difference == 0) {
+            int64_t observed =
+                ebpf_interlocked_compare_exchange_int64(&map->enqueue_position, position + 1, position);
+            if (observed == position) {
+                break;
+            }
+            position = observed;
+        } else if (difference < 0) {
+            // The cell still holds the value pushed max_entries positions ago.
+            return EBPF_OUT_OF_SPACE;
+        } else {
+            // Another producer claimed this position.
+            position = ReadNoFence64(&map->enqueue_position);
+        }
+    }
 
-    if (map->type == EBPF_CORE_QUEUE) {
-        // Remove from the beginning.
-        return_value = map->slots[map->begin];
-        if (return_value == NULL) {
-            ebpf_assert(map->begin == map->end);
-            goto Done;
+    memcpy(cell->value, value, map->core_map.ebpf_map_definition.value_size);
+    WriteRelease64(&cell->sequence, 2 * position + 1);
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_ebpf_core_queue_map_pop(_Inout_ ebpf_core_queue_map_t* map, _Out_opt_ uint8_t* value)
+{
+    ebpf_core_queue_cell_t* cell;
+    int64_t position = ReadNoFence64(&map->dequeue_position);
+    for (;;) {
+        cell = _ebpf_core_queue_map_cell(map, position);
+        int64_t difference = ReadAcquire64(&cell->sequence) - (2 * position + 1);
+        if (difference == 0) {
+            int64_t observed =
+                ebpf_interlocked_compare_exchange_int64(&map->dequeue_position, position + 1, position);
+            if (observed == position) {
+                break;
+            }
+            position = observed;
+        } else if (difference < 0) {
+            // No value has been pushed at this position yet.
+            return EBPF_OBJECT_NOT_FOUND;
+        } else {
+            // Another consumer claimed this position.
+            position = ReadNoFence64(&map->dequeue_position);
         }
-        if (pop) {
-            map->slots[map->begin] = NULL;
-            map->begin = _ebpf_core_circular_map_add(map, map->begin, 1);
+    }
+
+    if (value) {
+        memcpy(value, cell->value, map->core_map.ebpf_map_definition.value_size);
+    }
+    // Free the cell for the push max_entries positions later.
+    WriteRelease64(&cell->sequence, 2 * (position + (int64_t)map->core_map.ebpf_map_definition.max_entries));
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_ebpf_core_queue_map_peek(_In_ const ebpf_core_queue_map_t* map, _Out_ uint8_t* value)
+{
+    for (;;) {
+        int64_t position = ReadAcquire64(&map->dequeue_position);
+        ebpf_core_queue_cell_t* cell = _ebpf_core_queue_map_cell(map, position);
+        int64_t sequence = ReadAcquire64(&cell->sequence);
+        if (sequence < 2 * position + 1) {
+            return EBPF_OBJECT_NOT_FOUND;
         }
-    } else {
-        // Remove from the end.
-        size_t new_end = _ebpf_core_circular_map_add(map, map->end, -1);
-        return_value = map->slots[new_end];
-        if (return_value == NULL) {
-            ebpf_assert(map->begin == map->end);
-            goto Done;
+        if (sequence > 2 * position + 1) {
+            // The value was popped after dequeue_position was read.
+            continue;
         }
-        if (pop) {
-            map->slots[new_end] = NULL;
-            map->end = new_end;
+        memcpy(value, cell->value, map->core_map.ebpf_map_definition.value_size);
+        // A push only overwrites the value after a pop has changed the sequence number, so the copy is intact if the
+        // sequence number didn't change while copying.
+        MemoryBarrier();
+        if (ReadNoFence64(&cell->sequence) == sequence) {
+            return EBPF_SUCCESS;
         }
     }
+}
+
+static ebpf_result_t
+_ebpf_core_stack_map_peek_or_pop(_Inout_ ebpf_core_stack_map_t* map, bool pop, _Out_ uint8_t* value)
+{
+    size_t max_entries = map->core_map.ebpf_map_definition.max_entries;
+    size_t value_size = map->core_map.ebpf_map_definition.value_size;
+    ebpf_result_t result = EBPF_SUCCESS;
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&map->lock);
+    if (map->count == 0) {
+        result = EBPF_OBJECT_NOT_FOUND;
+        goto Done;
+    }
+    // Remove from the end.
+    size_t index = (map->begin + map->count - 1) % max_entries;
+    memcpy(value, map->core_map.data + index * value_size, value_size);
     if (pop) {
-        // The return_value is not freed until the current epoch is retired.
-        ebpf_epoch_free(return_value);
+        map->count--;
     }
 Done:
-#pragma warning(push)
-#pragma warning(disable : 6001) // Using uninitialized memory 'return_value'.
-    return return_value;
-#pragma warning(pop)
+    ebpf_lock_unlock(&map->lock, state);
+    return result;
 }
 
 static ebpf_result_t
-_ebpf_core_circular_map_push(_Inout_ ebpf_core_circular_map_t* map, _In_ const uint8_t* data, bool replace)
-{
-    ebpf_result_t return_value;
-    uint8_t* new_data = NULL;
-    uint8_t* old_data = NULL;
-    new_data = ebpf_epoch_allocate_with_tag(map->core_map.ebpf_map_definition.value_size, EBPF_POOL_TAG_MAP);
-    if (new_data == NULL) {
-        return_value = EBPF_NO_MEMORY;
-        goto Done;
-    }
-    memcpy(new_data, data, map->core_map.ebpf_map_definition.value_size);
+_ebpf_core_stack_map_push(_Inout_ ebpf_core_stack_map_t* map, _In_ const uint8_t* value, bool replace)
+{
+    size_t max_entries = map->core_map.ebpf_map_definition.max_entries;
+    size_t value_size = map->core_map.ebpf_map_definition.value_size;
+    ebpf_result_t result = EBPF_SUCCESS;
 
-    if (map->slots[map->end] != NULL) {
-        ebpf_assert(map->begin == map->end);
-        if (replace) {
-            old_data = map->slots[map->end];
-            map->slots[map->end] = NULL;
-            map->begin = _ebpf_core_circular_map_add(map, map->begin, 1);
-        } else {
-            return_value = EBPF_OUT_OF_SPACE;
+    ebpf_lock_state_t state = ebpf_lock_lock(&map->lock);
+    if (map->count == max_entries) {
+        if (!replace) {
+            result = EBPF_OUT_OF_SPACE;
             goto Done;
         }
+        // Drop the oldest value.
+        map->begin = (map->begin + 1) % max_entries;
+        map->count--;
     }
-
     // Insert at the end.
-    map->slots[map->end] = new_data;
-    new_data = NULL;
-    map->end = _ebpf_core_circular_map_add(map, map->end, 1);
-
-    return_value = EBPF_SUCCESS;
-
+    size_t index = (map->begin + map->count) % max_entries;
+    memcpy(map->core_map.data + index * value_size, value, value_size);
+    map->count++;
 Done:
-    if (new_data) {
-        ebpf_epoch_free(new_data);
-    }
-    if (old_data) {
-        ebpf_epoch_free(old_data);
-    }
-    return return_value;
+    ebpf_lock_unlock(&map->lock, state);
+    return result;
 }
 
 static ebpf_program_type_t
@@ -506,6 +580,12 @@ typedef struct _ebpf_map_metadata_table_properties
     ebpf_result_t (*update_entry_per_cpu)(
         _Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key, _In_ const uint8_t* value, ebpf_map_option_t option);
     ebpf_result_t (*delete_entry)(_Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key);
+    // Optional. For maps that store values inline and can't return a stable pointer from find_entry, copies the
+    // value at the head of the map and removes it if pop is set. A bloom filter instead tests the value passed in.
+    ebpf_result_t (*peek_or_pop_entry)(_Inout_ ebpf_core_map_t* map, bool pop, _Inout_ uint8_t* value);
+    // Optional. For per-CPU maps that don't store the values of all CPUs contiguously, returns the value of a CPU
+    // given the data returned by find_entry.
+    uint8_t* (*get_value_for_cpu)(_In_ const ebpf_core_map_t* map, _In_ const uint8_t* data, uint32_t cpu);
     ebpf_result_t (*next_key_and_value)(
         _Inout_ ebpf_core_map_t* map,
         _In_ const uint8_t* previous_key,
@@ -541,6 +621,10 @@ typedef struct _ebpf_map_metadata_table_properties
     int zero_length_value : 1;
     int per_cpu : 1;
     int key_history : 1;
+    // Map data is an ebpf_hash_table_t.
+    int hash_table : 1;
+    // The map can be created with BPF_F_PREALLOC.
+    int preallocate : 1;
 } ebpf_map_metadata_table_properties_t;
 
 typedef struct _ebpf_map_metadata_table
@@ -1168,6 +1252,7 @@ _initialize_hash_map_internal(
     size_t value_size,
     size_t supplemental_value_size,
     bool fixed_size_map,
+    bool preallocated,
     _In_opt_ void (*extract_function)(
         _In_ const uint8_t* value, _Outptr_ const uint8_t** data, _Out_ size_t* length_in_bits),
     _In_opt_ ebpf_hash_table_notification_function notification_callback,
@@ -1187,6 +1272,8 @@ _initialize_hash_map_internal(
         .value_size = actual_value_size,
         .minimum_bucket_count = map->ebpf_map_definition.max_entries,
         .max_entries = fixed_size_map ? map->ebpf_map_definition.max_entries : EBPF_HASH_TABLE_NO_LIMIT,
+        .preallocated_entries =
+            preallocated ? min(map->ebpf_map_definition.max_entries, EBPF_MAP_MAXIMUM_PREALLOCATED_ENTRIES) : 0,
         .extract_function = extract_function,
         .allocation_tag = EBPF_POOL_TAG_MAP,
         .supplemental_value_size = supplemental_value_size,
@@ -1222,6 +1309,7 @@ _create_hash_map_internal(
     size_t value_size,
     size_t supplemental_value_size,
     bool fixed_size_map,
+    bool preallocated,
     _In_opt_ void (*extract_function)(
         _In_ const uint8_t* value, _Outptr_ const uint8_t** data, _Out_ size_t* length_in_bits),
     _In_opt_ ebpf_hash_table_notification_function notification_callback,
@@ -1243,6 +1331,7 @@ _create_hash_map_internal(
         value_size,
         supplemental_value_size,
         fixed_size_map,
+        preallocated,
         extract_function,
         notification_callback,
         notification_flags,
@@ -1272,7 +1361,16 @@ _create_hash_map(
         return EBPF_INVALID_ARGUMENT;
     }
     return _create_hash_map_internal(
-        sizeof(ebpf_core_map_t), map_definition, 0, 0, false, NULL, NULL, EBPF_HASH_TABLE_NOTIFICATION_TYPE_NONE, map);
+        sizeof(ebpf_core_map_t),
+        map_definition,
+        0,
+        0,
+        false,
+        (map_definition->map_flags & BPF_F_PREALLOC) != 0,
+        NULL,
+        NULL,
+        EBPF_HASH_TABLE_NOTIFICATION_TYPE_NONE,
+        map);
 }
 
 static void
@@ -1347,6 +1445,7 @@ _create_object_hash_map(
         actual_value_size,
         0,
         false,
+        false,
         NULL,
         NULL,
         EBPF_HASH_TABLE_NOTIFICATION_TYPE_NONE,
@@ -1638,6 +1737,7 @@ _create_lru_hash_map(
         0,
         supplemental_value_size,
         true,
+        (map_definition->map_flags & BPF_F_PREALLOC) != 0,
         NULL,
         _lru_hash_table_notification,
         EBPF_HASH_TABLE_NOTIFICATION_TYPE_ALL,
@@ -1788,7 +1888,9 @@ _reap_oldest_map_entry(_Inout_ ebpf_core_map_t* map)
         // Attempt to delete the entry from the cold list.
         // This may fail if the entry has already been freed, but that's okay as the caller will
         // attempt to reap again if the next insert fails.
-        (void)_delete_hash_map_entry(map, EBPF_LRU_ENTRY_KEY_PTR(lru_map, entry));
+        if (_delete_hash_map_entry(map, EBPF_LRU_ENTRY_KEY_PTR(lru_map, entry)) == EBPF_SUCCESS) {
+            EBPF_STATISTICS_INCREMENT(lru_eviction_count);
+        }
     }
 }
 
@@ -2087,196 +2189,1082 @@ _next_hash_map_key_and_value(
     return result;
 }
 
-static __forceinline ebpf_result_t
-_ebpf_adjust_value_pointer(_In_ const ebpf_map_t* map, _Inout_ uint8_t** value)
-{
-    uint32_t current_cpu;
+/**
+ * @brief The BPF_MAP_TYPE_HASH_TTL map is a hash table whose entries expire a fixed time after they are inserted or
+ * updated. Each value carries an ebpf_hash_ttl_entry_t in its supplemental area that holds the expiration time, a
+ * copy of the key and a link into a hierarchical timer wheel owned by the map.
+ *
+ * - Lookups, updates, deletes and key iteration treat an entry whose expiration time has passed as not present, so
+ * expiry is exact from the point of view of programs and applications even before the entry is removed. An update or
+ * delete that finds such an entry deletes it, and an insert into a full map deletes the expired entries and retries.
+ * - The wheel has EBPF_HASH_TTL_WHEEL_LEVELS levels of EBPF_HASH_TTL_WHEEL_SLOTS slots. A slot on level 0 holds the
+ * entries expiring in one tick, and a slot on each higher level covers a whole lap of the level below. When the wheel
+ * reaches a slot on a higher level, its entries are moved down to the level below.
+ * - Each map has a timer work item that ticks it while it has entries. Each tick moves the entries of the level 0
+ * slots that are due to the map's expired list and deletes at most EBPF_HASH_TTL_MAXIMUM_EXPIRED_PER_TICK of them, so
+ * the cost of a tick does not depend on the size of the map.
+ *
+ * Lock order is the map's sweep lock, then the hash table bucket lock, then the map's wheel lock. The hash table calls
+ * the notification function with the bucket lock held, so the sweep drops the wheel lock before deleting an entry.
+ */
 
-    if (map->properties == NULL || !(map->properties->per_cpu)) {
-        return EBPF_SUCCESS;
-    }
+// Length of a tick of the timer wheel, in 100ns units.
+#define EBPF_HASH_TTL_TICK (100 * 10000)
+#define EBPF_HASH_TTL_TICK_IN_MICROSECONDS (EBPF_HASH_TTL_TICK / 10)
 
-    current_cpu = ebpf_get_current_cpu();
+#define EBPF_HASH_TTL_WHEEL_LEVELS 3
+#define EBPF_HASH_TTL_WHEEL_SLOT_BITS 6
+#define EBPF_HASH_TTL_WHEEL_SLOTS (1 << EBPF_HASH_TTL_WHEEL_SLOT_BITS)
+#define EBPF_HASH_TTL_WHEEL_SLOT_MASK (EBPF_HASH_TTL_WHEEL_SLOTS - 1)
 
-    (*value) += EBPF_PAD_8((size_t)map->original_value_size) * current_cpu;
-    return EBPF_SUCCESS;
-}
+// Limit the entries deleted from a map per tick to bound the time spent at DISPATCH_LEVEL.
+#define EBPF_HASH_TTL_MAXIMUM_EXPIRED_PER_TICK 1024
 
 /**
- * @brief Insert the supplied value into the per-cpu value buffer of the map.
- * If the map doesn't contain an existing value, create a new all-zero value,
- * insert it, then set the per-cpu value. Note: This races with updates to the
- * value buffer from user mode.
- *
- * @param[in] map Map to update.
- * @param[in] key Key to search for.
- * @param[in] value Value to insert.
- * @retval EBPF_SUCCESS The operation was successful.
- * @retval EBPF_NO_MEMORY Unable to allocate resources for this
- *  entry.
- * @retval EBPF_INVALID_ARGUMENT Unable to perform this operation due to
- * current CPU > allocated value buffer size.
+ * @brief Expiration state stored in the supplemental area of each value, followed by a copy of the key.
  */
-_Must_inspect_result_ ebpf_result_t
-_update_entry_per_cpu(
-    _Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key, _In_ const uint8_t* value, ebpf_map_option_t option)
+typedef struct _ebpf_hash_ttl_entry
 {
+    ebpf_list_entry_t list_entry; //< Link in a wheel slot or the expired list. Points to itself when not linked.
+    uint64_t expiration_time;     //< Time since boot at which the entry expires, or 0 if it never expires.
+} ebpf_hash_ttl_entry_t;
 
-    ebpf_assert(map->properties != NULL);
-    __analysis_assume(map->properties != NULL);
+#define EBPF_HASH_TTL_ENTRY_KEY_PTR(entry) ((uint8_t*)((ebpf_hash_ttl_entry_t*)(entry) + 1))
 
-    uint8_t* target;
-    if (map->properties->find_entry(map, key, false, &target) != EBPF_SUCCESS) {
-        ebpf_result_t return_value = map->properties->update_entry(map, key, NULL, option);
-        if (return_value != EBPF_SUCCESS) {
-            return return_value;
-        }
-        if (map->properties->find_entry(map, key, false, &target) != EBPF_SUCCESS) {
-            return EBPF_NO_MEMORY;
-        }
-    }
-    if (_ebpf_adjust_value_pointer(map, &target) != EBPF_SUCCESS) {
-        return EBPF_INVALID_ARGUMENT;
-    }
+// EBPF_HASH_TTL_SWEEP_SCHEDULED is set while the sweep timer of a map is armed, so that it is never armed twice.
+// EBPF_HASH_TTL_SWEEP_STOPPED keeps the sweep from arming the timer again once the map is being deleted. It is set
+// with the sweep lock held, and the sweep only arms the timer again with that lock held.
+#define EBPF_HASH_TTL_SWEEP_SCHEDULED 0x1
+#define EBPF_HASH_TTL_SWEEP_STOPPED 0x2
 
-    memcpy(target, value, ebpf_map_get_effective_value_size(map));
-    return EBPF_SUCCESS;
-}
+/**
+ * @brief The map definition for a TTL hash map.
+ */
+typedef struct _ebpf_core_hash_ttl_map
+{
+    ebpf_core_map_t core_map;                          //< Core map structure.
+    volatile uint64_t time_to_live;                    //< Lifetime of new entries in 100ns units, 0 for no expiry.
+    ebpf_timer_work_item_t* sweep_timer;               //< Timer work item that sweeps the map.
+    volatile int32_t sweep_state;                      //< EBPF_HASH_TTL_SWEEP_* flags.
+    ebpf_lock_t sweep_lock;                            //< Lock serializing sweeps of the map.
+    ebpf_lock_t lock;                                  //< Lock protecting the timer wheel.
+    _Guarded_by_(lock) uint64_t next_tick;             //< First tick whose level 0 slot has not been processed.
+    _Guarded_by_(lock) size_t entry_count;             //< Entries in the wheel and the expired list.
+    _Guarded_by_(lock) ebpf_list_entry_t expired_list; //< Entries that expired and are waiting to be deleted.
+    _Guarded_by_(lock) ebpf_list_entry_t wheel[EBPF_HASH_TTL_WHEEL_LEVELS][EBPF_HASH_TTL_WHEEL_SLOTS];
+    _Guarded_by_(sweep_lock) uint8_t sweep_key[1]; //< Key being deleted by the sweep.
+} ebpf_core_hash_ttl_map_t;
 
 static void
-_lpm_extract(_In_ const uint8_t* value, _Outptr_ const uint8_t** data, _Out_ size_t* length_in_bits)
+_ebpf_hash_ttl_schedule_sweep(_Inout_ ebpf_core_hash_ttl_map_t* map)
 {
-    const ebpf_core_lpm_key_t* key = (const ebpf_core_lpm_key_t*)value;
-    *data = value;
-    // The length of the hash table key is the size of the prefix length (32 bits) plus the prefix length.
-    *length_in_bits = sizeof(uint32_t) * 8 + key->prefix_length;
+    if (ebpf_interlocked_compare_exchange_int32(&map->sweep_state, EBPF_HASH_TTL_SWEEP_SCHEDULED, 0) == 0) {
+        ebpf_schedule_timer_work_item(map->sweep_timer, EBPF_HASH_TTL_TICK_IN_MICROSECONDS);
+    }
 }
 
-static ebpf_result_t
-_create_lpm_map(
-    _In_ const ebpf_map_definition_in_memory_t* map_definition,
-    ebpf_handle_t inner_map_handle,
-    _Outptr_ ebpf_core_map_t** map)
+/**
+ * @brief Link an entry into the wheel slot that is processed on the tick it expires. Entries that are already due
+ * go to the slot of the next tick.
+ *
+ * @param[in, out] map TTL map that owns the wheel.
+ * @param[in, out] entry Entry to link.
+ */
+_Requires_lock_held_(map->lock) static void _ebpf_hash_ttl_wheel_insert(
+    _Inout_ ebpf_core_hash_ttl_map_t* map, _Inout_ ebpf_hash_ttl_entry_t* entry)
 {
-    ebpf_result_t result = EBPF_SUCCESS;
-    // Key is uint32_t prefix length plus space for a max length prefix.
-    // - Only the prefix length plus prefix_length bits are actually used in an lpm key.
-    size_t max_prefix_length = (map_definition->key_size - sizeof(uint32_t)) * 8;
-    ebpf_core_lpm_map_t* lpm_map = NULL;
-
-    EBPF_LOG_ENTRY();
-
-    *map = NULL;
-
-    if (inner_map_handle != ebpf_handle_invalid) {
-        result = EBPF_INVALID_ARGUMENT;
-        goto Exit;
+    uint64_t tick = (entry->expiration_time + EBPF_HASH_TTL_TICK - 1) / EBPF_HASH_TTL_TICK;
+    if (tick < map->next_tick) {
+        tick = map->next_tick;
     }
 
-    result = _create_hash_map_internal(
-        EBPF_OFFSET_OF(ebpf_core_lpm_map_t, data) + ebpf_bitmap_size(max_prefix_length + 1),
-        map_definition,
-        0,
-        0,
-        false,
-        _lpm_extract,
-        NULL,
-        EBPF_HASH_TABLE_NOTIFICATION_TYPE_NONE,
-        (ebpf_core_map_t**)&lpm_map);
-    if (result != EBPF_SUCCESS) {
-        goto Exit;
+    // Use the lowest level on which the entry is less than a lap away. The slot on that level is then reached after
+    // next_tick, which is when the entries in it are moved to a lower level.
+    uint32_t level = 0;
+    uint64_t slot_index = tick;
+    while (level < EBPF_HASH_TTL_WHEEL_LEVELS - 1 &&
+           slot_index - (map->next_tick >> (level * EBPF_HASH_TTL_WHEEL_SLOT_BITS)) >= EBPF_HASH_TTL_WHEEL_SLOTS) {
+        level++;
+        slot_index = tick >> (level * EBPF_HASH_TTL_WHEEL_SLOT_BITS);
     }
-    lpm_map->max_prefix = (uint32_t)max_prefix_length;
-    // Add one to max_prefix_length to account for max length prefixes in the prefix_length bitmap.
-    ebpf_bitmap_initialize((ebpf_bitmap_t*)lpm_map->data, max_prefix_length + 1);
 
-    *map = &lpm_map->core_map;
+    // Entries beyond the span of the wheel wait in the last slot of the top level and are placed again from there.
+    uint64_t next_slot_index = map->next_tick >> (level * EBPF_HASH_TTL_WHEEL_SLOT_BITS);
+    if (slot_index - next_slot_index >= EBPF_HASH_TTL_WHEEL_SLOTS) {
+        slot_index = next_slot_index + EBPF_HASH_TTL_WHEEL_SLOTS - 1;
+    }
 
-Exit:
-    EBPF_RETURN_RESULT(result);
+    ebpf_list_insert_tail(&map->wheel[level][slot_index & EBPF_HASH_TTL_WHEEL_SLOT_MASK], &entry->list_entry);
 }
 
-static ebpf_result_t
-_find_lpm_map_entry(_Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, uint64_t flags, _Outptr_ uint8_t** data)
+/**
+ * @brief Process the ticks that have elapsed. Entries in higher level slots that are reached are moved down, and the
+ * entries in level 0 slots that are reached move to the expired list.
+ *
+ * @param[in, out] map TTL map that owns the wheel.
+ * @param[in] now Current time since boot.
+ */
+_Requires_lock_held_(map->lock) static void _ebpf_hash_ttl_wheel_advance(
+    _Inout_ ebpf_core_hash_ttl_map_t* map, uint64_t now)
 {
-    bool delete_on_success = (flags & EBPF_MAP_FIND_FLAG_DELETE) != 0;
-    if (!map || !key || delete_on_success) {
-        return EBPF_INVALID_ARGUMENT;
-    }
+    uint64_t now_tick = now / EBPF_HASH_TTL_TICK;
 
-    ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
-    ebpf_core_lpm_key_t* lpm_key = (ebpf_core_lpm_key_t*)key;
-    if (!lpm_key || lpm_key->prefix_length > trie_map->max_prefix) {
-        return EBPF_INVALID_ARGUMENT;
+    if (map->entry_count == 0) {
+        // Skip the ticks of an empty wheel.
+        map->next_tick = now_tick + 1;
+        return;
     }
-    uint32_t original_prefix_length = lpm_key->prefix_length;
-    uint8_t* value = NULL;
 
-    ebpf_bitmap_cursor_t cursor;
-    // Start the key size search from the size of the passed in key.
-    // Iterate down through the inserted key lengths until we find a match.
-    // - Uses the passed in key for iteration by overwriting the prefix length.
-    ebpf_bitmap_start_reverse_search_at((ebpf_bitmap_t*)trie_map->data, &cursor, original_prefix_length);
-    lpm_key->prefix_length = (uint32_t)ebpf_bitmap_reverse_search_next_bit(&cursor);
-    while (lpm_key->prefix_length != MAXUINT32) {
-        if (_find_hash_map_entry(map, key, flags & ~EBPF_MAP_FIND_FLAG_DELETE, &value) == EBPF_SUCCESS) {
-            break;
+    for (; map->next_tick <= now_tick; map->next_tick++) {
+        uint64_t tick = map->next_tick;
+
+        // Higher levels go first, so that entries moved down to a slot that is due now are picked up.
+        for (uint32_t level = EBPF_HASH_TTL_WHEEL_LEVELS - 1; level > 0; level--) {
+            uint32_t shift = level * EBPF_HASH_TTL_WHEEL_SLOT_BITS;
+            if ((tick & ((1ull << shift) - 1)) != 0) {
+                continue;
+            }
+            ebpf_list_entry_t* slot = &map->wheel[level][(tick >> shift) & EBPF_HASH_TTL_WHEEL_SLOT_MASK];
+            while (!ebpf_list_is_empty(slot)) {
+                ebpf_list_entry_t* list_entry = slot->Flink;
+                ebpf_list_remove_entry(list_entry);
+                _ebpf_hash_ttl_wheel_insert(map, EBPF_FROM_FIELD(ebpf_hash_ttl_entry_t, list_entry, list_entry));
+            }
         }
-        lpm_key->prefix_length = (uint32_t)ebpf_bitmap_reverse_search_next_bit(&cursor);
-    }
 
-    // Restore the original prefix length.
-    lpm_key->prefix_length = original_prefix_length;
-    if (!value) {
-        return EBPF_KEY_NOT_FOUND;
-    } else {
-        *data = value;
-        return EBPF_SUCCESS;
+        ebpf_list_entry_t* slot = &map->wheel[0][tick & EBPF_HASH_TTL_WHEEL_SLOT_MASK];
+        if (!ebpf_list_is_empty(slot)) {
+            ebpf_list_entry_t* first_entry = slot->Flink;
+            ebpf_list_remove_entry(slot);
+            ebpf_list_append_tail_list(&map->expired_list, first_entry);
+            ebpf_list_initialize(slot);
+        }
     }
 }
 
-static ebpf_result_t
-_delete_lpm_map_entry(_In_ ebpf_core_map_t* map, _Inout_ const uint8_t* key)
+/**
+ * @brief Delete up to EBPF_HASH_TTL_MAXIMUM_EXPIRED_PER_TICK expired entries from a map.
+ *
+ * @param[in, out] map TTL map to sweep.
+ * @param[in] now Current time since boot.
+ * @returns True if the map still has entries in its wheel.
+ */
+_Requires_lock_held_(map->sweep_lock) static bool _ebpf_hash_ttl_map_sweep(
+    _Inout_ ebpf_core_hash_ttl_map_t* map, uint64_t now)
 {
-    ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
-    uint32_t prefix_length = *(uint32_t*)key;
-    if (prefix_length > trie_map->max_prefix) {
-        return EBPF_INVALID_ARGUMENT;
+    size_t key_size = map->core_map.ebpf_map_definition.key_size;
+    ebpf_lock_state_t state = ebpf_lock_lock(&map->lock);
+    _ebpf_hash_ttl_wheel_advance(map, now);
+
+    for (size_t count = 0; count < EBPF_HASH_TTL_MAXIMUM_EXPIRED_PER_TICK; count++) {
+        if (ebpf_list_is_empty(&map->expired_list)) {
+            break;
+        }
+        ebpf_hash_ttl_entry_t* entry = EBPF_FROM_FIELD(ebpf_hash_ttl_entry_t, list_entry, map->expired_list.Flink);
+        ebpf_list_remove_entry(&entry->list_entry);
+        ebpf_list_initialize(&entry->list_entry);
+        map->entry_count--;
+        memcpy(map->sweep_key, EBPF_HASH_TTL_ENTRY_KEY_PTR(entry), key_size);
+        ebpf_lock_unlock(&map->lock, state);
+
+        // The key may have been written again since the entry expired. The notification function then refuses the
+        // delete, as the value in the table is not expired.
+        (void)ebpf_hash_table_delete((ebpf_hash_table_t*)map->core_map.data, (uint8_t*)&now, map->sweep_key);
+
+        state = ebpf_lock_lock(&map->lock);
     }
 
-    return _delete_hash_map_entry(map, key);
+    bool pending = map->entry_count != 0;
+    ebpf_lock_unlock(&map->lock, state);
+    return pending;
 }
 
-static ebpf_result_t
-_update_lpm_map_entry(
-    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+_IRQL_requires_(DISPATCH_LEVEL) static void
+_ebpf_hash_ttl_sweep(_Inout_opt_ void* context)
 {
-    ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
-    if (!key) {
-        return EBPF_INVALID_ARGUMENT;
-    }
-    ebpf_core_lpm_key_t* lpm_key = (ebpf_core_lpm_key_t*)key;
-    if (lpm_key->prefix_length > trie_map->max_prefix) {
-        return EBPF_INVALID_ARGUMENT;
+    ebpf_core_hash_ttl_map_t* map = (ebpf_core_hash_ttl_map_t*)context;
+    if (!map) {
+        return;
     }
 
-    ebpf_result_t result = _update_hash_map_entry(map, key, data, option);
-    if (result == EBPF_SUCCESS) {
-        // Test if the bit is set before setting it. This avoids the overhead of a the interlocked operation.
-        if (!ebpf_bitmap_test_bit((ebpf_bitmap_t*)trie_map->data, lpm_key->prefix_length)) {
-            ebpf_bitmap_set_bit((ebpf_bitmap_t*)trie_map->data, lpm_key->prefix_length, true);
-        }
+    // Clear EBPF_HASH_TTL_SWEEP_SCHEDULED before sweeping, so that an entry added during the sweep arms the timer for
+    // the next tick. That tick can start before this one ends, so sweeps of the map are serialized by its sweep lock.
+    (void)ebpf_interlocked_compare_exchange_int32(&map->sweep_state, 0, EBPF_HASH_TTL_SWEEP_SCHEDULED);
+
+    ebpf_epoch_state_t epoch_state = {0};
+    ebpf_epoch_enter(&epoch_state);
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&map->sweep_lock);
+    if (_ebpf_hash_ttl_map_sweep(map, cxplat_query_time_since_boot_approximate(false))) {
+        _ebpf_hash_ttl_schedule_sweep(map);
     }
-    return result;
+    ebpf_lock_unlock(&map->sweep_lock, state);
+
+    ebpf_epoch_exit(&epoch_state);
 }
 
-static ebpf_result_t
-_next_lpm_map_key_and_value(
-    _Inout_ ebpf_core_map_t* map,
-    _In_opt_ const uint8_t* previous_key,
-    _Inout_ uint8_t* next_key,
-    _Inout_opt_ uint8_t** next_value)
-{
+/**
+ * @brief Check whether the value of an entry has expired.
+ *
+ * @param[in] map TTL map the value belongs to.
+ * @param[in] value Value in the hash table.
+ * @param[in] now Current time since boot.
+ * @returns True if the entry has expired.
+ */
+static bool
+_ebpf_hash_ttl_value_is_expired(_In_ const ebpf_core_map_t* map, _In_ uint8_t* value, uint64_t now)
+{
+    const ebpf_hash_ttl_entry_t* entry = (const ebpf_hash_ttl_entry_t*)_get_supplemental_value(map, value);
+    return entry->expiration_time != 0 && entry->expiration_time <= now;
+}
+
+/**
+ * @brief Delete the entry for a key if it has expired, without waiting for the sweep.
+ *
+ * @param[in, out] map TTL map to delete the entry from.
+ * @param[in] key Key of the entry.
+ * @param[in] now Current time since boot.
+ * @returns True if an expired entry was deleted.
+ */
+static bool
+_ebpf_hash_ttl_delete_if_expired(_Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key, uint64_t now)
+{
+    uint8_t* value;
+    if (ebpf_hash_table_find((ebpf_hash_table_t*)map->data, key, &value) != EBPF_SUCCESS ||
+        !_ebpf_hash_ttl_value_is_expired(map, value, now)) {
+        return false;
+    }
+
+    // As in the sweep, the notification function refuses the delete if the key was written again in the meantime.
+    return ebpf_hash_table_delete((ebpf_hash_table_t*)map->data, (uint8_t*)&now, key) == EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_hash_ttl_table_notification(
+    _In_ void* context,
+    _In_opt_ void* operation_context,
+    _In_ ebpf_hash_table_notification_type_t type,
+    _In_ const uint8_t* key,
+    _In_ uint8_t* value)
+{
+    ebpf_core_hash_ttl_map_t* map = (ebpf_core_hash_ttl_map_t*)context;
+    ebpf_hash_ttl_entry_t* entry = (ebpf_hash_ttl_entry_t*)_get_supplemental_value(&map->core_map, value);
+    ebpf_lock_state_t state;
+
+    switch (type) {
+    case EBPF_HASH_TABLE_NOTIFICATION_TYPE_ALLOCATE: {
+        uint64_t time_to_live = ReadULong64NoFence(&map->time_to_live);
+        ebpf_list_initialize(&entry->list_entry);
+        memcpy(EBPF_HASH_TTL_ENTRY_KEY_PTR(entry), key, map->core_map.ebpf_map_definition.key_size);
+        if (time_to_live == 0) {
+            entry->expiration_time = 0;
+            break;
+        }
+        uint64_t now = cxplat_query_time_since_boot_approximate(false);
+        entry->expiration_time = now + time_to_live;
+
+        state = ebpf_lock_lock(&map->lock);
+        if (map->entry_count++ == 0) {
+            // The wheel was idle, so start it from the current tick.
+            map->next_tick = now / EBPF_HASH_TTL_TICK + 1;
+        }
+        _ebpf_hash_ttl_wheel_insert(map, entry);
+        ebpf_lock_unlock(&map->lock, state);
+
+        _ebpf_hash_ttl_schedule_sweep(map);
+        break;
+    }
+    case EBPF_HASH_TABLE_NOTIFICATION_TYPE_FREE:
+        if (operation_context != NULL) {
+            // Delete from the sweep, where the operation context is the time of the sweep.
+            uint64_t sweep_time = *(const uint64_t*)operation_context;
+            if (entry->expiration_time == 0 || entry->expiration_time > sweep_time) {
+                return EBPF_OBJECT_ALREADY_EXISTS;
+            }
+        }
+        state = ebpf_lock_lock(&map->lock);
+        if (!ebpf_list_is_empty(&entry->list_entry)) {
+            ebpf_list_remove_entry(&entry->list_entry);
+            ebpf_list_initialize(&entry->list_entry);
+            map->entry_count--;
+        }
+        ebpf_lock_unlock(&map->lock, state);
+        break;
+    case EBPF_HASH_TABLE_NOTIFICATION_TYPE_USE:
+        break;
+    default:
+        ebpf_assert(!"Invalid notification type");
+    }
+
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_create_hash_ttl_map(
+    _In_ const ebpf_map_definition_in_memory_t* map_definition,
+    ebpf_handle_t inner_map_handle,
+    _Outptr_ ebpf_core_map_t** map)
+{
+    ebpf_result_t retval;
+    ebpf_core_hash_ttl_map_t* ttl_map = NULL;
+
+    *map = NULL;
+
+    if (inner_map_handle != ebpf_handle_invalid) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // Align the supplemental value to 8 byte boundary.
+    size_t supplemental_value_size;
+    retval = ebpf_safe_size_t_add(
+        sizeof(ebpf_hash_ttl_entry_t) + EBPF_PAD_8(map_definition->value_size) - map_definition->value_size,
+        map_definition->key_size,
+        &supplemental_value_size);
+    if (retval != EBPF_SUCCESS) {
+        return retval;
+    }
+
+    size_t ttl_map_size;
+    retval = ebpf_safe_size_t_add(
+        EBPF_OFFSET_OF(ebpf_core_hash_ttl_map_t, sweep_key), map_definition->key_size, &ttl_map_size);
+    if (retval != EBPF_SUCCESS) {
+        return retval;
+    }
+
+    retval = _create_hash_map_internal(
+        ttl_map_size,
+        map_definition,
+        0,
+        supplemental_value_size,
+        false,
+        (map_definition->map_flags & BPF_F_PREALLOC) != 0,
+        NULL,
+        _hash_ttl_table_notification,
+        EBPF_HASH_TABLE_NOTIFICATION_TYPE_ALLOCATE | EBPF_HASH_TABLE_NOTIFICATION_TYPE_FREE,
+        (ebpf_core_map_t**)&ttl_map);
+    if (retval != EBPF_SUCCESS) {
+        return retval;
+    }
+
+    ebpf_lock_create(&ttl_map->sweep_lock);
+    ebpf_lock_create(&ttl_map->lock);
+    ttl_map->sweep_state = 0;
+    ttl_map->time_to_live = 0;
+    ttl_map->entry_count = 0;
+    ttl_map->next_tick = cxplat_query_time_since_boot_approximate(false) / EBPF_HASH_TTL_TICK + 1;
+    ebpf_list_initialize(&ttl_map->expired_list);
+    for (uint32_t level = 0; level < EBPF_HASH_TTL_WHEEL_LEVELS; level++) {
+        for (uint32_t slot = 0; slot < EBPF_HASH_TTL_WHEEL_SLOTS; slot++) {
+            ebpf_list_initialize(&ttl_map->wheel[level][slot]);
+        }
+    }
+
+    retval = ebpf_allocate_timer_work_item(&ttl_map->sweep_timer, _ebpf_hash_ttl_sweep, ttl_map);
+    if (retval != EBPF_SUCCESS) {
+        ebpf_hash_table_destroy((ebpf_hash_table_t*)ttl_map->core_map.data);
+        ebpf_lock_destroy(&ttl_map->lock);
+        ebpf_lock_destroy(&ttl_map->sweep_lock);
+        ebpf_epoch_free_cache_aligned(ttl_map);
+        return retval;
+    }
+
+    *map = &ttl_map->core_map;
+    return EBPF_SUCCESS;
+}
+
+static void
+_delete_hash_ttl_map(_In_ _Post_invalid_ ebpf_core_map_t* map)
+{
+    ebpf_core_hash_ttl_map_t* ttl_map = EBPF_FROM_FIELD(ebpf_core_hash_ttl_map_t, core_map, map);
+
+    // Keep the sweep from arming the timer again. A sweep that is running either armed the timer before the flag was
+    // set, in which case freeing the timer work item cancels it, or finds the flag set. Freeing the timer work item
+    // also waits for a sweep that is queued or running. Maps are deleted at PASSIVE_LEVEL from an epoch work item.
+    ebpf_lock_state_t state = ebpf_lock_lock(&ttl_map->sweep_lock);
+    (void)ebpf_interlocked_or_int32(&ttl_map->sweep_state, EBPF_HASH_TTL_SWEEP_STOPPED);
+    ebpf_lock_unlock(&ttl_map->sweep_lock, state);
+    ebpf_free_timer_work_item(ttl_map->sweep_timer);
+
+    ebpf_hash_table_destroy((ebpf_hash_table_t*)map->data);
+    ebpf_lock_destroy(&ttl_map->lock);
+    ebpf_lock_destroy(&ttl_map->sweep_lock);
+    ebpf_epoch_free_cache_aligned(map);
+}
+
+static ebpf_result_t
+_find_hash_ttl_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, uint64_t flags, _Outptr_ uint8_t** data)
+{
+    uint8_t* value = NULL;
+
+    if (!map || !key) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    if (ebpf_hash_table_find((ebpf_hash_table_t*)map->data, key, &value) != EBPF_SUCCESS) {
+        value = NULL;
+    }
+
+    // An expired entry is not visible, even if the sweep has not deleted it yet.
+    if (value != NULL && _ebpf_hash_ttl_value_is_expired(map, value, cxplat_query_time_since_boot_approximate(false))) {
+        value = NULL;
+    }
+
+    if (value != NULL && (flags & EBPF_MAP_FIND_FLAG_DELETE) != 0) {
+        // Delete is atomic.
+        // Only return value if both find and delete succeeded.
+        if (_delete_hash_map_entry(map, key) != EBPF_SUCCESS) {
+            value = NULL;
+        }
+    }
+
+    *data = value;
+    return *data == NULL ? EBPF_OBJECT_NOT_FOUND : EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_update_hash_ttl_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+{
+    if (!map || !key) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    uint64_t now = cxplat_query_time_since_boot_approximate(false);
+
+    // An expired entry is not present for EBPF_NOEXIST and EBPF_EXIST, so delete it before the update. EBPF_ANY
+    // replaces it either way.
+    if (option != EBPF_ANY) {
+        (void)_ebpf_hash_ttl_delete_if_expired(map, key, now);
+    }
+
+    ebpf_result_t result = _update_hash_map_entry(map, key, data, option);
+    if (result == EBPF_OUT_OF_SPACE) {
+        // Expired entries still count toward max_entries until they are deleted. Like an LRU map evicts its oldest
+        // entries when it is full, delete the expired ones now instead of waiting for the next tick, and try again.
+        ebpf_core_hash_ttl_map_t* ttl_map = EBPF_FROM_FIELD(ebpf_core_hash_ttl_map_t, core_map, map);
+        ebpf_lock_state_t state = ebpf_lock_lock(&ttl_map->sweep_lock);
+        (void)_ebpf_hash_ttl_map_sweep(ttl_map, now);
+        ebpf_lock_unlock(&ttl_map->sweep_lock, state);
+
+        result = _update_hash_map_entry(map, key, data, option);
+    }
+
+    return result;
+}
+
+static ebpf_result_t
+_delete_hash_ttl_map_entry(_Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key)
+{
+    if (!map || !key) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // An expired entry is deleted, but reported as not found like a lookup does.
+    if (_ebpf_hash_ttl_delete_if_expired(map, key, cxplat_query_time_since_boot_approximate(false))) {
+        return EBPF_KEY_NOT_FOUND;
+    }
+
+    return _delete_hash_map_entry(map, key);
+}
+
+static ebpf_result_t
+_next_hash_ttl_map_key_and_value(
+    _Inout_ ebpf_core_map_t* map,
+    _In_opt_ const uint8_t* previous_key,
+    _Out_ uint8_t* next_key,
+    _Inout_opt_ uint8_t** next_value)
+{
+    if (!map || !next_key) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // Skip the entries that have expired. The keys are walked in place, so they stay valid for the current epoch.
+    uint64_t now = cxplat_query_time_since_boot_approximate(false);
+    const uint8_t* key = previous_key;
+    for (;;) {
+        uint8_t* key_pointer;
+        uint8_t* value;
+        ebpf_result_t result =
+            ebpf_hash_table_next_key_pointer_and_value((ebpf_hash_table_t*)map->data, key, &key_pointer, &value);
+        if (result != EBPF_SUCCESS) {
+            return result;
+        }
+        if (!_ebpf_hash_ttl_value_is_expired(map, value, now)) {
+            memcpy(next_key, key_pointer, map->ebpf_map_definition.key_size);
+            if (next_value) {
+                *next_value = value;
+            }
+            return EBPF_SUCCESS;
+        }
+        key = key_pointer;
+    }
+}
+
+static __forceinline ebpf_result_t
+_ebpf_adjust_value_pointer(_In_ const ebpf_map_t* map, _Inout_ uint8_t** value)
+{
+    uint32_t current_cpu;
+
+    if (map->properties == NULL || !(map->properties->per_cpu)) {
+        return EBPF_SUCCESS;
+    }
+
+    current_cpu = ebpf_get_current_cpu();
+
+    if (map->properties->get_value_for_cpu != NULL) {
+        *value = map->properties->get_value_for_cpu(map, *value, current_cpu);
+        return EBPF_SUCCESS;
+    }
+
+    (*value) += EBPF_PAD_8((size_t)map->original_value_size) * current_cpu;
+    return EBPF_SUCCESS;
+}
+
+/**
+ * @brief Copy the value returned by find_entry or next_key_and_value to a caller's buffer. For per-CPU maps, the
+ * buffer receives the padded values of all CPUs.
+ *
+ * @param[in] map Map the value belongs to.
+ * @param[in] data Data returned by the map.
+ * @param[out] value Buffer of map value size to copy the value to.
+ */
+static void
+_ebpf_map_copy_value(
+    _In_ const ebpf_map_t* map,
+    _In_ const uint8_t* data,
+    _Out_writes_(map->ebpf_map_definition.value_size) uint8_t* value)
+{
+    if (map->properties->get_value_for_cpu == NULL) {
+        memcpy(value, data, map->ebpf_map_definition.value_size);
+        return;
+    }
+
+    size_t stride = EBPF_PAD_8((size_t)map->original_value_size);
+    for (uint32_t cpu = 0; cpu < ebpf_get_cpu_count(); cpu++) {
+        memcpy(value + cpu * stride, map->properties->get_value_for_cpu(map, data, cpu), stride);
+    }
+}
+
+/**
+ * @brief Insert the supplied value into the per-cpu value buffer of the map.
+ * If the map doesn't contain an existing value, create a new all-zero value,
+ * insert it, then set the per-cpu value. Note: This races with updates to the
+ * value buffer from user mode.
+ *
+ * @param[in] map Map to update.
+ * @param[in] key Key to search for.
+ * @param[in] value Value to insert.
+ * @retval EBPF_SUCCESS The operation was successful.
+ * @retval EBPF_NO_MEMORY Unable to allocate resources for this
+ *  entry.
+ * @retval EBPF_INVALID_ARGUMENT Unable to perform this operation due to
+ * current CPU > allocated value buffer size.
+ */
+_Must_inspect_result_ ebpf_result_t
+_update_entry_per_cpu(
+    _Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key, _In_ const uint8_t* value, ebpf_map_option_t option)
+{
+
+    ebpf_assert(map->properties != NULL);
+    __analysis_assume(map->properties != NULL);
+
+    uint8_t* target;
+    if (map->properties->find_entry(map, key, false, &target) != EBPF_SUCCESS) {
+        ebpf_result_t return_value = map->properties->update_entry(map, key, NULL, option);
+        if (return_value != EBPF_SUCCESS) {
+            return return_value;
+        }
+        if (map->properties->find_entry(map, key, false, &target) != EBPF_SUCCESS) {
+            return EBPF_NO_MEMORY;
+        }
+    }
+    if (_ebpf_adjust_value_pointer(map, &target) != EBPF_SUCCESS) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    memcpy(target, value, ebpf_map_get_effective_value_size(map));
+    return EBPF_SUCCESS;
+}
+
+/**
+ * @brief BPF_MAP_TYPE_PERCPU_HASH keeps the per-CPU values outside of the hash table, in slabs of slots. Each slab
+ * has one cache aligned allocation per CPU holding that CPU's copy of the values in the slab, so a CPU updating its
+ * copy of a value only ever touches cache lines that belong to that CPU. The hash table stores an
+ * ebpf_percpu_hash_slot_t that identifies the slot holding the values for the key.
+ *
+ * The value of a deleted or replaced key may still be referenced by a program running in the current epoch, so its
+ * slot is first retired and only returned to the free list by an epoch work item once the epoch ends. Slabs are
+ * added as needed and are only freed when the map is deleted.
+ */
+
+// Maximum number of slots in a slab.
+#define EBPF_PERCPU_HASH_SLAB_SLOT_COUNT 64
+
+typedef struct _ebpf_percpu_hash_slab ebpf_percpu_hash_slab_t;
+
+/**
+ * @brief Location of the per-CPU values of a key. This is the value stored in the hash table.
+ */
+typedef struct _ebpf_percpu_hash_slot
+{
+    ebpf_percpu_hash_slab_t* slab; //< Slab containing the slot, or NULL for the end of a slot list.
+    size_t index;                  //< Index of the slot in the slab.
+} ebpf_percpu_hash_slot_t;
+
+typedef struct _ebpf_percpu_hash_slab
+{
+    ebpf_percpu_hash_slab_t* next_slab; //< Next slab in the map.
+    ebpf_percpu_hash_slot_t* links;     //< Links for the free and retired slot lists, one per slot.
+    uint8_t* cpu_values[1];             //< Values for each CPU, one cache aligned allocation per CPU.
+} ebpf_percpu_hash_slab_t;
+
+typedef struct _ebpf_core_percpu_hash_map
+{
+    ebpf_core_map_t core_map;                 //< Core map structure.
+    size_t value_stride;                      //< Size of each value in a CPU's slab allocation.
+    size_t slot_count;                        //< Number of slots in each slab.
+    ebpf_lock_t lock;                         //< Lock protecting the slabs and slot lists.
+    ebpf_percpu_hash_slab_t* slabs;           //< List of slabs.
+    ebpf_percpu_hash_slot_t free_slots;       //< Slots available for new keys.
+    ebpf_percpu_hash_slot_t retired_slots;    //< Slots released in the current epoch.
+    ebpf_percpu_hash_slot_t reclaiming_slots; //< Slots waiting for the scheduled epoch work item.
+    bool reclaim_pending;                     //< An epoch work item is scheduled to reclaim slots.
+} ebpf_core_percpu_hash_map_t;
+
+static __forceinline uint8_t*
+_get_percpu_hash_map_slot_value(
+    _In_ const ebpf_core_percpu_hash_map_t* percpu_map, _In_ const ebpf_percpu_hash_slot_t* slot, uint32_t cpu)
+{
+    return slot->slab->cpu_values[cpu] + slot->index * percpu_map->value_stride;
+}
+
+static uint8_t*
+_get_percpu_hash_map_value_for_cpu(_In_ const ebpf_core_map_t* map, _In_ const uint8_t* data, uint32_t cpu)
+{
+    const ebpf_core_percpu_hash_map_t* percpu_map = EBPF_FROM_FIELD(ebpf_core_percpu_hash_map_t, core_map, map);
+    return _get_percpu_hash_map_slot_value(percpu_map, (const ebpf_percpu_hash_slot_t*)data, cpu);
+}
+
+static void
+_push_percpu_hash_map_slot(_Inout_ ebpf_percpu_hash_slot_t* list, _In_ const ebpf_percpu_hash_slot_t* slot)
+{
+    slot->slab->links[slot->index] = *list;
+    *list = *slot;
+}
+
+static void
+_free_percpu_hash_map_slab(_Frees_ptr_ ebpf_percpu_hash_slab_t* slab)
+{
+    for (uint32_t cpu = 0; cpu < ebpf_get_cpu_count(); cpu++) {
+        ebpf_epoch_free_cache_aligned(slab->cpu_values[cpu]);
+    }
+    ebpf_epoch_free(slab);
+}
+
+/**
+ * @brief Allocate a new slab and add its slots to the free list. Must be called with the map lock held.
+ *
+ * @param[in, out] percpu_map Map to add the slab to.
+ * @retval EBPF_SUCCESS The operation was successful.
+ * @retval EBPF_NO_MEMORY Unable to allocate resources for the slab.
+ */
+static ebpf_result_t
+_add_percpu_hash_map_slab(_Inout_ ebpf_core_percpu_hash_map_t* percpu_map)
+{
+    uint32_t cpu_count = ebpf_get_cpu_count();
+    size_t links_offset =
+        EBPF_PAD_8(EBPF_OFFSET_OF(ebpf_percpu_hash_slab_t, cpu_values) + cpu_count * sizeof(uint8_t*));
+    size_t slab_size = links_offset + percpu_map->slot_count * sizeof(ebpf_percpu_hash_slot_t);
+
+    ebpf_percpu_hash_slab_t* slab =
+        (ebpf_percpu_hash_slab_t*)ebpf_epoch_allocate_with_tag(slab_size, EBPF_POOL_TAG_MAP);
+    if (slab == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    slab->links = (ebpf_percpu_hash_slot_t*)((uint8_t*)slab + links_offset);
+
+    // Round each CPU's allocation up to a cache line so that no cache line is shared between CPUs.
+    size_t cpu_values_size = EBPF_PAD_CACHE(percpu_map->slot_count * percpu_map->value_stride);
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++) {
+        slab->cpu_values[cpu] =
+            (uint8_t*)ebpf_epoch_allocate_cache_aligned_with_tag(cpu_values_size, EBPF_POOL_TAG_MAP);
+        if (slab->cpu_values[cpu] == NULL) {
+            _free_percpu_hash_map_slab(slab);
+            return EBPF_NO_MEMORY;
+        }
+    }
+
+    slab->next_slab = percpu_map->slabs;
+    percpu_map->slabs = slab;
+
+    // Push in reverse order so that slots are handed out in address order.
+    for (size_t index = percpu_map->slot_count; index > 0; index--) {
+        ebpf_percpu_hash_slot_t slot = {slab, index - 1};
+        _push_percpu_hash_map_slot(&percpu_map->free_slots, &slot);
+    }
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_allocate_percpu_hash_map_slot(_Inout_ ebpf_core_percpu_hash_map_t* percpu_map, _Out_ ebpf_percpu_hash_slot_t* slot)
+{
+    ebpf_result_t result = EBPF_SUCCESS;
+    ebpf_lock_state_t state = ebpf_lock_lock(&percpu_map->lock);
+    if (percpu_map->free_slots.slab == NULL) {
+        result = _add_percpu_hash_map_slab(percpu_map);
+    }
+    if (result == EBPF_SUCCESS) {
+        *slot = percpu_map->free_slots;
+        percpu_map->free_slots = slot->slab->links[slot->index];
+    }
+    ebpf_lock_unlock(&percpu_map->lock, state);
+    return result;
+}
+
+static void
+_retire_percpu_hash_map_slot(_Inout_ ebpf_core_percpu_hash_map_t* percpu_map, _In_ const ebpf_percpu_hash_slot_t* slot)
+{
+    ebpf_lock_state_t state = ebpf_lock_lock(&percpu_map->lock);
+    _push_percpu_hash_map_slot(&percpu_map->retired_slots, slot);
+    ebpf_lock_unlock(&percpu_map->lock, state);
+}
+
+static void
+_schedule_percpu_hash_map_reclaim(_Inout_ ebpf_core_percpu_hash_map_t* percpu_map);
+
+/**
+ * @brief Epoch work item that returns the slots retired before it was scheduled to the free list.
+ *
+ * @param[in, out] context Pointer to the map.
+ */
+static void
+_reclaim_percpu_hash_map_slots(_Inout_ void* context)
+{
+    ebpf_core_percpu_hash_map_t* percpu_map = (ebpf_core_percpu_hash_map_t*)context;
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&percpu_map->lock);
+    while (percpu_map->reclaiming_slots.slab != NULL) {
+        ebpf_percpu_hash_slot_t slot = percpu_map->reclaiming_slots;
+        percpu_map->reclaiming_slots = slot.slab->links[slot.index];
+        _push_percpu_hash_map_slot(&percpu_map->free_slots, &slot);
+    }
+    percpu_map->reclaim_pending = false;
+    ebpf_lock_unlock(&percpu_map->lock, state);
+
+    // Pick up any slots retired while this batch was pending.
+    _schedule_percpu_hash_map_reclaim(percpu_map);
+
+    EBPF_OBJECT_RELEASE_REFERENCE(&percpu_map->core_map.object);
+}
+
+/**
+ * @brief Schedule an epoch work item to reclaim the retired slots. This must only be called once the entries that
+ * referenced the retired slots are no longer reachable from the hash table.
+ *
+ * @param[in, out] percpu_map Map to reclaim slots for.
+ */
+static void
+_schedule_percpu_hash_map_reclaim(_Inout_ ebpf_core_percpu_hash_map_t* percpu_map)
+{
+    // Only one batch is reclaimed at a time. Skip the allocation if a batch is already pending; the slots will be
+    // picked up when it completes. This unlocked check is repeated under the lock below.
+    if (percpu_map->reclaim_pending || percpu_map->retired_slots.slab == NULL) {
+        return;
+    }
+
+    ebpf_epoch_work_item_t* work_item = ebpf_epoch_allocate_work_item(percpu_map, _reclaim_percpu_hash_map_slots);
+    if (work_item == NULL) {
+        // The slots stay retired until a later operation schedules a reclaim.
+        return;
+    }
+
+    bool schedule = false;
+    ebpf_lock_state_t state = ebpf_lock_lock(&percpu_map->lock);
+    if (!percpu_map->reclaim_pending && percpu_map->retired_slots.slab != NULL) {
+        percpu_map->reclaiming_slots = percpu_map->retired_slots;
+        percpu_map->retired_slots.slab = NULL;
+        percpu_map->reclaim_pending = true;
+        schedule = true;
+    }
+    ebpf_lock_unlock(&percpu_map->lock, state);
+
+    if (schedule) {
+        // The work item keeps the map alive until it runs.
+        EBPF_OBJECT_ACQUIRE_REFERENCE(&percpu_map->core_map.object);
+        ebpf_epoch_schedule_work_item(work_item);
+    } else {
+        ebpf_epoch_cancel_work_item(work_item);
+    }
+}
+
+static ebpf_result_t
+_percpu_hash_map_notification(
+    _In_ void* context,
+    _In_opt_ void* operation_context,
+    _In_ ebpf_hash_table_notification_type_t type,
+    _In_ const uint8_t* key,
+    _In_ uint8_t* value)
+{
+    UNREFERENCED_PARAMETER(key);
+    ebpf_core_percpu_hash_map_t* percpu_map = (ebpf_core_percpu_hash_map_t*)context;
+    ebpf_percpu_hash_slot_t* slot = (ebpf_percpu_hash_slot_t*)value;
+    // The operation context, if any, is the caller's buffer containing the values for all CPUs.
+    const uint8_t* values = (const uint8_t*)operation_context;
+
+    switch (type) {
+    case EBPF_HASH_TABLE_NOTIFICATION_TYPE_ALLOCATE: {
+        ebpf_result_t result = _allocate_percpu_hash_map_slot(percpu_map, slot);
+        if (result != EBPF_SUCCESS) {
+            return result;
+        }
+        for (uint32_t cpu = 0; cpu < ebpf_get_cpu_count(); cpu++) {
+            uint8_t* target = _get_percpu_hash_map_slot_value(percpu_map, slot, cpu);
+            if (values != NULL) {
+                memcpy(target, values + cpu * percpu_map->value_stride, percpu_map->value_stride);
+            } else {
+                memset(target, 0, percpu_map->value_stride);
+            }
+        }
+        break;
+    }
+    case EBPF_HASH_TABLE_NOTIFICATION_TYPE_FREE:
+        _retire_percpu_hash_map_slot(percpu_map, slot);
+        break;
+    default:
+        ebpf_assert(!"Invalid notification type");
+    }
+
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_create_percpu_hash_map(
+    _In_ const ebpf_map_definition_in_memory_t* map_definition,
+    ebpf_handle_t inner_map_handle,
+    _Outptr_ ebpf_core_map_t** map)
+{
+    ebpf_result_t result;
+    ebpf_core_percpu_hash_map_t* percpu_map = NULL;
+
+    if (inner_map_handle != ebpf_handle_invalid) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    result = _create_hash_map_internal(
+        sizeof(ebpf_core_percpu_hash_map_t),
+        map_definition,
+        sizeof(ebpf_percpu_hash_slot_t),
+        0,
+        false,
+        false,
+        NULL,
+        _percpu_hash_map_notification,
+        EBPF_HASH_TABLE_NOTIFICATION_TYPE_ALLOCATE | EBPF_HASH_TABLE_NOTIFICATION_TYPE_FREE,
+        (ebpf_core_map_t**)&percpu_map);
+    if (result != EBPF_SUCCESS) {
+        return result;
+    }
+
+    // The map definition value size already covers the padded values of all CPUs.
+    percpu_map->value_stride = map_definition->value_size / ebpf_get_cpu_count();
+    percpu_map->slot_count = min(map_definition->max_entries, EBPF_PERCPU_HASH_SLAB_SLOT_COUNT);
+    ebpf_lock_create(&percpu_map->lock);
+    percpu_map->slabs = NULL;
+    percpu_map->free_slots.slab = NULL;
+    percpu_map->retired_slots.slab = NULL;
+    percpu_map->reclaiming_slots.slab = NULL;
+    percpu_map->reclaim_pending = false;
+
+    *map = &percpu_map->core_map;
+    return EBPF_SUCCESS;
+}
+
+static void
+_delete_percpu_hash_map(_In_ _Post_invalid_ ebpf_core_map_t* map)
+{
+    ebpf_core_percpu_hash_map_t* percpu_map = EBPF_FROM_FIELD(ebpf_core_percpu_hash_map_t, core_map, map);
+
+    // Pending reclaim work items hold a reference on the map, so none can be outstanding here.
+    ebpf_assert(!percpu_map->reclaim_pending);
+
+    ebpf_hash_table_destroy((ebpf_hash_table_t*)map->data);
+    while (percpu_map->slabs != NULL) {
+        ebpf_percpu_hash_slab_t* slab = percpu_map->slabs;
+        percpu_map->slabs = slab->next_slab;
+        _free_percpu_hash_map_slab(slab);
+    }
+    ebpf_lock_destroy(&percpu_map->lock);
+    ebpf_epoch_free_cache_aligned(map);
+}
+
+static ebpf_result_t
+_find_percpu_hash_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, uint64_t flags, _Outptr_ uint8_t** data)
+{
+    ebpf_result_t result = _find_hash_map_entry(map, key, flags, data);
+    if (flags & EBPF_MAP_FIND_FLAG_DELETE) {
+        _schedule_percpu_hash_map_reclaim(EBPF_FROM_FIELD(ebpf_core_percpu_hash_map_t, core_map, map));
+    }
+    return result;
+}
+
+static ebpf_result_t
+_update_percpu_hash_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+{
+    // The values are copied into the new slot by the ALLOCATE notification, so pass them as the operation context
+    // and let the hash table zero the slot reference.
+    ebpf_result_t result = _update_hash_map_entry_operation_context(map, (uint8_t*)data, key, NULL, option);
+    _schedule_percpu_hash_map_reclaim(EBPF_FROM_FIELD(ebpf_core_percpu_hash_map_t, core_map, map));
+    return result;
+}
+
+static ebpf_result_t
+_delete_percpu_hash_map_entry(_Inout_ ebpf_core_map_t* map, _In_ const uint8_t* key)
+{
+    ebpf_result_t result = _delete_hash_map_entry(map, key);
+    if (result == EBPF_SUCCESS) {
+        _schedule_percpu_hash_map_reclaim(EBPF_FROM_FIELD(ebpf_core_percpu_hash_map_t, core_map, map));
+    }
+    return result;
+}
+
+static void
+_lpm_extract(_In_ const uint8_t* value, _Outptr_ const uint8_t** data, _Out_ size_t* length_in_bits)
+{
+    const ebpf_core_lpm_key_t* key = (const ebpf_core_lpm_key_t*)value;
+    *data = value;
+    // The length of the hash table key is the size of the prefix length (32 bits) plus the prefix length.
+    *length_in_bits = sizeof(uint32_t) * 8 + key->prefix_length;
+}
+
+static ebpf_result_t
+_create_lpm_map(
+    _In_ const ebpf_map_definition_in_memory_t* map_definition,
+    ebpf_handle_t inner_map_handle,
+    _Outptr_ ebpf_core_map_t** map)
+{
+    ebpf_result_t result = EBPF_SUCCESS;
+    // Key is uint32_t prefix length plus space for a max length prefix.
+    // - Only the prefix length plus prefix_length bits are actually used in an lpm key.
+    size_t max_prefix_length = (map_definition->key_size - sizeof(uint32_t)) * 8;
+    ebpf_core_lpm_map_t* lpm_map = NULL;
+
+    EBPF_LOG_ENTRY();
+
+    *map = NULL;
+
+    if (inner_map_handle != ebpf_handle_invalid) {
+        result = EBPF_INVALID_ARGUMENT;
+        goto Exit;
+    }
+
+    result = _create_hash_map_internal(
+        EBPF_OFFSET_OF(ebpf_core_lpm_map_t, data) + ebpf_bitmap_size(max_prefix_length + 1),
+        map_definition,
+        0,
+        0,
+        false,
+        false,
+        _lpm_extract,
+        NULL,
+        EBPF_HASH_TABLE_NOTIFICATION_TYPE_NONE,
+        (ebpf_core_map_t**)&lpm_map);
+    if (result != EBPF_SUCCESS) {
+        goto Exit;
+    }
+    lpm_map->max_prefix = (uint32_t)max_prefix_length;
+    // Add one to max_prefix_length to account for max length prefixes in the prefix_length bitmap.
+    ebpf_bitmap_initialize((ebpf_bitmap_t*)lpm_map->data, max_prefix_length + 1);
+
+    *map = &lpm_map->core_map;
+
+Exit:
+    EBPF_RETURN_RESULT(result);
+}
+
+static ebpf_result_t
+_find_lpm_map_entry(_Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, uint64_t flags, _Outptr_ uint8_t** data)
+{
+    bool delete_on_success = (flags & EBPF_MAP_FIND_FLAG_DELETE) != 0;
+    if (!map || !key || delete_on_success) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
+    ebpf_core_lpm_key_t* lpm_key = (ebpf_core_lpm_key_t*)key;
+    if (!lpm_key || lpm_key->prefix_length > trie_map->max_prefix) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+    uint32_t original_prefix_length = lpm_key->prefix_length;
+    uint8_t* value = NULL;
+
+    ebpf_bitmap_cursor_t cursor;
+    // Start the key size search from the size of the passed in key.
+    // Iterate down through the inserted key lengths until we find a match.
+    // - Uses the passed in key for iteration by overwriting the prefix length.
+    ebpf_bitmap_start_reverse_search_at((ebpf_bitmap_t*)trie_map->data, &cursor, original_prefix_length);
+    lpm_key->prefix_length = (uint32_t)ebpf_bitmap_reverse_search_next_bit(&cursor);
+    while (lpm_key->prefix_length != MAXUINT32) {
+        if (_find_hash_map_entry(map, key, flags & ~EBPF_MAP_FIND_FLAG_DELETE, &value) == EBPF_SUCCESS) {
+            break;
+        }
+        lpm_key->prefix_length = (uint32_t)ebpf_bitmap_reverse_search_next_bit(&cursor);
+    }
+
+    // Restore the original prefix length.
+    lpm_key->prefix_length = original_prefix_length;
+    if (!value) {
+        return EBPF_KEY_NOT_FOUND;
+    } else {
+        *data = value;
+        return EBPF_SUCCESS;
+    }
+}
+
+static ebpf_result_t
+_delete_lpm_map_entry(_In_ ebpf_core_map_t* map, _Inout_ const uint8_t* key)
+{
+    ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
+    uint32_t prefix_length = *(uint32_t*)key;
+    if (prefix_length > trie_map->max_prefix) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    return _delete_hash_map_entry(map, key);
+}
+
+static ebpf_result_t
+_update_lpm_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+{
+    ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
+    if (!key) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+    ebpf_core_lpm_key_t* lpm_key = (ebpf_core_lpm_key_t*)key;
+    if (lpm_key->prefix_length > trie_map->max_prefix) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    ebpf_result_t result = _update_hash_map_entry(map, key, data, option);
+    if (result == EBPF_SUCCESS) {
+        // Test if the bit is set before setting it. This avoids the overhead of a the interlocked operation.
+        if (!ebpf_bitmap_test_bit((ebpf_bitmap_t*)trie_map->data, lpm_key->prefix_length)) {
+            ebpf_bitmap_set_bit((ebpf_bitmap_t*)trie_map->data, lpm_key->prefix_length, true);
+        }
+    }
+    return result;
+}
+
+static ebpf_result_t
+_next_lpm_map_key_and_value(
+    _Inout_ ebpf_core_map_t* map,
+    _In_opt_ const uint8_t* previous_key,
+    _Inout_ uint8_t* next_key,
+    _Inout_opt_ uint8_t** next_value)
+{
     ebpf_core_lpm_map_t* trie_map = EBPF_FROM_FIELD(ebpf_core_lpm_map_t, core_map, map);
     ebpf_core_lpm_key_t* lpm_key = (ebpf_core_lpm_key_t*)next_key;
     ebpf_core_lpm_key_t* previous_lpm_key = (ebpf_core_lpm_key_t*)previous_key;
@@ -2303,12 +3291,14 @@ _create_queue_map(
     if (inner_map_handle != ebpf_handle_invalid || map_definition->key_size != 0) {
         return EBPF_INVALID_ARGUMENT;
     }
-    size_t circular_map_size =
-        EBPF_OFFSET_OF(ebpf_core_circular_map_t, slots) + map_definition->max_entries * sizeof(uint8_t*);
-    result = _create_array_map_with_map_struct_size(circular_map_size, map_definition, 0, map);
+    size_t cell_size = EBPF_OFFSET_OF(ebpf_core_queue_cell_t, value) + EBPF_PAD_8(map_definition->value_size);
+    result = _create_array_map_with_map_struct_size(sizeof(ebpf_core_queue_map_t), map_definition, cell_size, map);
     if (result == EBPF_SUCCESS) {
-        ebpf_core_circular_map_t* circular_map = EBPF_FROM_FIELD(ebpf_core_circular_map_t, core_map, *map);
-        circular_map->type = EBPF_CORE_QUEUE;
+        ebpf_core_queue_map_t* queue_map = EBPF_FROM_FIELD(ebpf_core_queue_map_t, core_map, *map);
+        queue_map->cell_size = cell_size;
+        for (uint32_t index = 0; index < map_definition->max_entries; index++) {
+            _ebpf_core_queue_map_cell(queue_map, index)->sequence = 2 * (int64_t)index;
+        }
     }
     return result;
 }
@@ -2319,37 +3309,33 @@ _create_stack_map(
     ebpf_handle_t inner_map_handle,
     _Outptr_ ebpf_core_map_t** map)
 {
-    ebpf_result_t result;
     if (inner_map_handle != ebpf_handle_invalid || map_definition->key_size != 0) {
         return EBPF_INVALID_ARGUMENT;
     }
-    size_t circular_map_size =
-        EBPF_OFFSET_OF(ebpf_core_circular_map_t, slots) + map_definition->max_entries * sizeof(uint8_t*);
-    result = _create_array_map_with_map_struct_size(circular_map_size, map_definition, 0, map);
-    if (result == EBPF_SUCCESS) {
-        ebpf_core_circular_map_t* circular_map = EBPF_FROM_FIELD(ebpf_core_circular_map_t, core_map, *map);
-        circular_map->type = EBPF_CORE_STACK;
-    }
-    return result;
+    return _create_array_map_with_map_struct_size(sizeof(ebpf_core_stack_map_t), map_definition, 0, map);
 }
 
 static void
 _delete_circular_map(_In_ _Post_invalid_ ebpf_core_map_t* map)
 {
-    ebpf_core_circular_map_t* circular_map = EBPF_FROM_FIELD(ebpf_core_circular_map_t, core_map, map);
-    // Free all the elements stored in the stack.
-    for (size_t i = 0; i < circular_map->core_map.ebpf_map_definition.max_entries; i++) {
-        ebpf_epoch_free(circular_map->slots[i]);
-    }
-    ebpf_epoch_free(circular_map);
+    // Values are stored inline, so there is nothing else to free.
+    ebpf_epoch_free(map);
 }
 
 static ebpf_result_t
-_find_circular_map_entry(
-    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, uint64_t flags, _Outptr_ uint8_t** data)
+_peek_or_pop_queue_map_entry(_Inout_ ebpf_core_map_t* map, bool pop, _Out_ uint8_t* value)
 {
-    bool delete_on_success = (flags & EBPF_MAP_FIND_FLAG_DELETE) != 0;
-    if (!map) {
+    ebpf_core_queue_map_t* queue_map = EBPF_FROM_FIELD(ebpf_core_queue_map_t, core_map, map);
+    return pop ? _ebpf_core_queue_map_pop(queue_map, value) : _ebpf_core_queue_map_peek(queue_map, value);
+}
+
+static ebpf_result_t
+_update_queue_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+{
+    ebpf_result_t result;
+
+    if (!map || !data) {
         return EBPF_INVALID_ARGUMENT;
     }
 
@@ -2357,32 +3343,225 @@ _find_circular_map_entry(
     // so we cannot require key to be null.
     UNREFERENCED_PARAMETER(key);
 
-    ebpf_core_circular_map_t* circular_map = EBPF_FROM_FIELD(ebpf_core_circular_map_t, core_map, map);
-    ebpf_lock_state_t state = ebpf_lock_lock(&circular_map->lock);
-    *data = _ebpf_core_circular_map_peek_or_pop(circular_map, delete_on_success);
-    ebpf_lock_unlock(&circular_map->lock, state);
-    return *data == NULL ? EBPF_OBJECT_NOT_FOUND : EBPF_SUCCESS;
+    ebpf_core_queue_map_t* queue_map = EBPF_FROM_FIELD(ebpf_core_queue_map_t, core_map, map);
+    for (;;) {
+        result = _ebpf_core_queue_map_push(queue_map, data);
+        if (result != EBPF_OUT_OF_SPACE || !(option & BPF_EXIST)) {
+            break;
+        }
+        // Replace the oldest entry. If another consumer empties the queue first, the push is simply retried.
+        (void)_ebpf_core_queue_map_pop(queue_map, NULL);
+    }
+    return result;
+}
+
+static ebpf_result_t
+_peek_or_pop_stack_map_entry(_Inout_ ebpf_core_map_t* map, bool pop, _Out_ uint8_t* value)
+{
+    ebpf_core_stack_map_t* stack_map = EBPF_FROM_FIELD(ebpf_core_stack_map_t, core_map, map);
+    return _ebpf_core_stack_map_peek_or_pop(stack_map, pop, value);
 }
 
 static ebpf_result_t
-_update_circular_map_entry(
+_update_stack_map_entry(
     _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+{
+    if (!map || !data) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // Stack uses no key, but the caller always passes in a non-null pointer (with a 0 key size)
+    // so we cannot require key to be null.
+    UNREFERENCED_PARAMETER(key);
+
+    ebpf_core_stack_map_t* stack_map = EBPF_FROM_FIELD(ebpf_core_stack_map_t, core_map, map);
+    return _ebpf_core_stack_map_push(stack_map, data, option & BPF_EXIST);
+}
+
+/**
+ * @brief The BPF_MAP_TYPE_BLOOM_FILTER map is a set that can return false positives but never false negatives. A
+ * push adds a value and a peek tests whether a value may have been added; values can't be listed or removed. The key
+ * size is zero and max_entries is the number of values the filter is sized for.
+ *
+ * The filter is split into cache line sized blocks. The upper half of a 64-bit hash of the value picks the block,
+ * and the lower half gives the EBPF_BLOOM_FILTER_HASH_COUNT bit positions inside it by double hashing. All the bits
+ * of a value are in one cache line, so a peek costs a single cache miss however large the filter is, at the price of
+ * a slightly higher false positive rate than an unblocked filter of the same size.
+ */
+
+// Number of bits set per value. Matches the Linux default for a bloom filter created without map_extra.
+#define EBPF_BLOOM_FILTER_HASH_COUNT 5
+
+#define EBPF_BLOOM_FILTER_BLOCK_BITS (EBPF_CACHE_LINE_SIZE * 8)
+#define EBPF_BLOOM_FILTER_BLOCK_WORDS (EBPF_CACHE_LINE_SIZE / sizeof(uint64_t))
+
+typedef struct _ebpf_core_bloom_filter_map
+{
+    ebpf_core_map_t core_map;
+    uint64_t seed;       //< Random seed of the hash, so that colliding values can't be chosen ahead of time.
+    uint64_t block_mask; //< Number of blocks minus one. The number of blocks is a power of two.
+} ebpf_core_bloom_filter_map_t;
+
+static inline uint64_t
+_ebpf_bloom_filter_mix(uint64_t hash)
+{
+    // Finalizer of the 64-bit MurmurHash3.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static uint64_t
+_ebpf_bloom_filter_hash(
+    _In_ const ebpf_core_bloom_filter_map_t* map, _In_reads_(length) const uint8_t* value, size_t length)
+{
+    uint64_t hash = map->seed ^ (length * 0x9e3779b97f4a7c15ull);
+    uint64_t chunk;
+
+    while (length >= sizeof(chunk)) {
+        memcpy(&chunk, value, sizeof(chunk));
+        hash ^= _ebpf_bloom_filter_mix(chunk);
+        hash = ((hash << 27) | (hash >> 37)) * 0x9e3779b97f4a7c15ull;
+        value += sizeof(chunk);
+        length -= sizeof(chunk);
+    }
+    if (length > 0) {
+        chunk = 0;
+        memcpy(&chunk, value, length);
+        hash ^= _ebpf_bloom_filter_mix(chunk);
+    }
+    return _ebpf_bloom_filter_mix(hash);
+}
+
+/**
+ * @brief Set or test the bits of a value.
+ *
+ * @param[in, out] map Bloom filter map.
+ * @param[in] value Value to add or test.
+ * @param[in] set True to set the bits of the value, false to only test them.
+ * @returns True if all the bits of the value were already set.
+ */
+static bool
+_ebpf_bloom_filter_set_or_test(_Inout_ ebpf_core_bloom_filter_map_t* map, _In_ const uint8_t* value, bool set)
+{
+    uint64_t hash = _ebpf_bloom_filter_hash(map, value, map->core_map.ebpf_map_definition.value_size);
+    volatile int64_t* block =
+        (volatile int64_t*)map->core_map.data + ((hash >> 32) & map->block_mask) * EBPF_BLOOM_FILTER_BLOCK_WORDS;
+    uint32_t position = (uint32_t)hash;
+    uint32_t step = (position >> 16) | 1;
+    bool present = true;
+
+    for (uint32_t index = 0; index < EBPF_BLOOM_FILTER_HASH_COUNT; index++, position += step) {
+        uint32_t bit = position % EBPF_BLOOM_FILTER_BLOCK_BITS;
+        int64_t mask = (int64_t)(1ull << (bit % 64));
+        volatile int64_t* word = &block[bit / 64];
+        if ((ReadNoFence64(word) & mask) != 0) {
+            continue;
+        }
+        present = false;
+        if (!set) {
+            break;
+        }
+        // Test before setting so that adding a value that is already present doesn't write the shared cache line.
+        (void)ebpf_interlocked_or_int64(word, mask);
+    }
+    return present;
+}
+
+static ebpf_result_t
+_create_bloom_filter_map(
+    _In_ const ebpf_map_definition_in_memory_t* map_definition,
+    ebpf_handle_t inner_map_handle,
+    _Outptr_ ebpf_core_map_t** map)
 {
     ebpf_result_t result;
+    ebpf_core_bloom_filter_map_t* bloom_map = NULL;
+
+    *map = NULL;
+    if (inner_map_handle != ebpf_handle_invalid || map_definition->key_size != 0 ||
+        map_definition->value_size == 0 || map_definition->max_entries == 0) {
+        return EBPF_INVALID_ARGUMENT;
+    }
 
+    // k / ln(2) bits per value is the size for which k hash functions are optimal, a false positive rate of about
+    // 3% with k = 5. The number of blocks is rounded up to a power of two so that a block can be picked with a mask.
+    uint64_t bit_count = ((uint64_t)map_definition->max_entries * EBPF_BLOOM_FILTER_HASH_COUNT * 1443) / 1000;
+    uint64_t block_count = 1;
+    while (block_count * EBPF_BLOOM_FILTER_BLOCK_BITS < bit_count) {
+        block_count <<= 1;
+    }
+
+    size_t blocks_size;
+    result = ebpf_safe_size_t_multiply((size_t)block_count, EBPF_CACHE_LINE_SIZE, &blocks_size);
+    if (result != EBPF_SUCCESS) {
+        return result;
+    }
+    size_t full_map_size;
+    result = ebpf_safe_size_t_add(EBPF_PAD_CACHE(sizeof(ebpf_core_bloom_filter_map_t)), blocks_size, &full_map_size);
+    if (result != EBPF_SUCCESS) {
+        return result;
+    }
+    if (full_map_size > EBPF_MAP_MAXIMUM_ALLOCATION) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    bloom_map = ebpf_epoch_allocate_cache_aligned_with_tag(full_map_size, EBPF_POOL_TAG_MAP);
+    if (bloom_map == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    memset(bloom_map, 0, full_map_size);
+
+    bloom_map->core_map.ebpf_map_definition = *map_definition;
+    bloom_map->core_map.data = (uint8_t*)bloom_map + EBPF_PAD_CACHE(sizeof(ebpf_core_bloom_filter_map_t));
+    bloom_map->seed = ((uint64_t)ebpf_random_uint32() << 32) | ebpf_random_uint32();
+    bloom_map->block_mask = block_count - 1;
+
+    *map = &bloom_map->core_map;
+    return EBPF_SUCCESS;
+}
+
+static void
+_delete_bloom_filter_map(_In_ _Post_invalid_ ebpf_core_map_t* map)
+{
+    ebpf_epoch_free_cache_aligned(EBPF_FROM_FIELD(ebpf_core_bloom_filter_map_t, core_map, map));
+}
+
+static ebpf_result_t
+_peek_or_pop_bloom_filter_map_entry(_Inout_ ebpf_core_map_t* map, bool pop, _Inout_ uint8_t* value)
+{
+    // Values can't be removed from a bloom filter, and a peek tests the value passed in rather than returning one.
+    if (pop) {
+        return EBPF_OPERATION_NOT_SUPPORTED;
+    }
+
+    ebpf_core_bloom_filter_map_t* bloom_map = EBPF_FROM_FIELD(ebpf_core_bloom_filter_map_t, core_map, map);
+    return _ebpf_bloom_filter_set_or_test(bloom_map, value, false) ? EBPF_SUCCESS : EBPF_OBJECT_NOT_FOUND;
+}
+
+static ebpf_result_t
+_update_bloom_filter_map_entry(
+    _Inout_ ebpf_core_map_t* map, _In_opt_ const uint8_t* key, _In_opt_ const uint8_t* data, ebpf_map_option_t option)
+{
     if (!map || !data) {
         return EBPF_INVALID_ARGUMENT;
     }
 
-    // Queue uses no key, but the caller always passes in a non-null pointer (with a 0 key size)
+    // Bloom filter uses no key, but the caller always passes in a non-null pointer (with a 0 key size)
     // so we cannot require key to be null.
     UNREFERENCED_PARAMETER(key);
 
-    ebpf_core_circular_map_t* circular_map = EBPF_FROM_FIELD(ebpf_core_circular_map_t, core_map, map);
-    ebpf_lock_state_t state = ebpf_lock_lock(&circular_map->lock);
-    result = _ebpf_core_circular_map_push(circular_map, data, option & BPF_EXIST);
-    ebpf_lock_unlock(&circular_map->lock, state);
-    return result;
+    // Only BPF_ANY is meaningful. Pushes from a program pass EBPF_MAP_FLAG_HELPER in the option, which shares its bit
+    // with BPF_NOEXIST, so only BPF_EXIST can be rejected.
+    if (option & BPF_EXIST) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    ebpf_core_bloom_filter_map_t* bloom_map = EBPF_FROM_FIELD(ebpf_core_bloom_filter_map_t, core_map, map);
+    (void)_ebpf_bloom_filter_set_or_test(bloom_map, data, true);
+    return EBPF_SUCCESS;
 }
 
 typedef void
@@ -2939,6 +4118,10 @@ ebpf_ring_buffer_map_output(_Inout_ ebpf_core_map_t* map, _In_reads_bytes_(lengt
 
     result = ebpf_ring_buffer_output((ebpf_ring_buffer_t*)map->data, data, length);
     if (result != EBPF_SUCCESS) {
+        if (result == EBPF_NO_MEMORY) {
+            // The ring is full.
+            EBPF_STATISTICS_INCREMENT(ring_buffer_drop_count);
+        }
         goto Exit;
     }
 
@@ -3187,6 +4370,7 @@ ebpf_perf_event_array_map_output(_Inout_ ebpf_map_t* map, _In_reads_bytes_(lengt
         // Non-atomic increment is safe: per-CPU counter updated at DISPATCH_LEVEL.
         ebpf_perf_event_array_producer_page_t* producer_page = ebpf_perf_event_array_get_producer_page(ring->ring);
         WriteULong64Release(&producer_page->lost_records, ReadULong64Acquire(&producer_page->lost_records) + 1);
+        EBPF_STATISTICS_INCREMENT(perf_event_array_drop_count);
         goto Exit;
     }
     memcpy(record_data, data, length);
@@ -3273,6 +4457,7 @@ ebpf_perf_event_array_map_output_with_capture(
         // Non-atomic increment is safe: per-CPU counter updated at DISPATCH_LEVEL.
         ebpf_perf_event_array_producer_page_t* producer_page = ebpf_perf_event_array_get_producer_page(ring->ring);
         WriteULong64Release(&producer_page->lost_records, ReadULong64Acquire(&producer_page->lost_records) + 1);
+        EBPF_STATISTICS_INCREMENT(perf_event_array_drop_count);
         goto Exit;
     }
     memcpy(record_data, data, length);
@@ -3308,6 +4493,8 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
                 .update_entry = _update_hash_map_entry,
                 .delete_entry = _delete_hash_map_entry,
                 .next_key_and_value = _next_hash_map_key_and_value,
+                .hash_table = true,
+                .preallocate = true,
             },
     },
     {
@@ -3339,14 +4526,16 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
         .map_type = BPF_MAP_TYPE_PERCPU_HASH,
         .properties =
             {
-                .create_map = _create_hash_map,
-                .delete_map = _delete_hash_map,
-                .find_entry = _find_hash_map_entry,
-                .update_entry = _update_hash_map_entry,
+                .create_map = _create_percpu_hash_map,
+                .delete_map = _delete_percpu_hash_map,
+                .find_entry = _find_percpu_hash_map_entry,
+                .update_entry = _update_percpu_hash_map_entry,
                 .update_entry_per_cpu = _update_entry_per_cpu,
-                .delete_entry = _delete_hash_map_entry,
+                .delete_entry = _delete_percpu_hash_map_entry,
+                .get_value_for_cpu = _get_percpu_hash_map_value_for_cpu,
                 .next_key_and_value = _next_hash_map_key_and_value,
                 .per_cpu = true,
+                .hash_table = true,
             },
     },
     {
@@ -3373,6 +4562,7 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
                 .update_entry_with_handle = _update_map_hash_map_entry_with_handle,
                 .delete_entry = _delete_map_hash_map_entry,
                 .next_key_and_value = _next_hash_map_key_and_value,
+                .hash_table = true,
             },
     },
     {
@@ -3398,6 +4588,8 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
                 .delete_entry = _delete_hash_map_entry,
                 .next_key_and_value = _next_hash_map_key_and_value,
                 .key_history = true,
+                .hash_table = true,
+                .preallocate = true,
             },
     },
     // LPM_TRIE is currently a hash-map with special behavior for find.
@@ -3411,6 +4603,7 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
                 .update_entry = _update_lpm_map_entry,
                 .delete_entry = _delete_lpm_map_entry,
                 .next_key_and_value = _next_lpm_map_key_and_value,
+                .hash_table = true,
             },
     },
     {
@@ -3419,8 +4612,8 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
             {
                 .create_map = _create_queue_map,
                 .delete_map = _delete_circular_map,
-                .find_entry = _find_circular_map_entry,
-                .update_entry = _update_circular_map_entry,
+                .update_entry = _update_queue_map_entry,
+                .peek_or_pop_entry = _peek_or_pop_queue_map_entry,
                 .zero_length_key = true,
             },
     },
@@ -3437,6 +4630,8 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
                 .next_key_and_value = _next_hash_map_key_and_value,
                 .per_cpu = true,
                 .key_history = true,
+                .hash_table = true,
+                .preallocate = true,
             },
     },
     {
@@ -3445,8 +4640,8 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
             {
                 .create_map = _create_stack_map,
                 .delete_map = _delete_circular_map,
-                .find_entry = _find_circular_map_entry,
-                .update_entry = _update_circular_map_entry,
+                .update_entry = _update_stack_map_entry,
+                .peek_or_pop_entry = _peek_or_pop_stack_map_entry,
                 .zero_length_key = true,
             },
     },
@@ -3487,6 +4682,31 @@ const ebpf_map_metadata_table_t ebpf_map_metadata_tables[] = {
                 .per_cpu = true,
             },
     },
+    {
+        .map_type = BPF_MAP_TYPE_HASH_TTL,
+        .properties =
+            {
+                .create_map = _create_hash_ttl_map,
+                .delete_map = _delete_hash_ttl_map,
+                .find_entry = _find_hash_ttl_map_entry,
+                .update_entry = _update_hash_ttl_map_entry,
+                .delete_entry = _delete_hash_ttl_map_entry,
+                .next_key_and_value = _next_hash_ttl_map_key_and_value,
+                .hash_table = true,
+                .preallocate = true,
+            },
+    },
+    {
+        .map_type = BPF_MAP_TYPE_BLOOM_FILTER,
+        .properties =
+            {
+                .create_map = _create_bloom_filter_map,
+                .delete_map = _delete_bloom_filter_map,
+                .update_entry = _update_bloom_filter_map_entry,
+                .peek_or_pop_entry = _peek_or_pop_bloom_filter_map_entry,
+                .zero_length_key = true,
+            },
+    },
 };
 
 _Must_inspect_result_ ebpf_result_t
@@ -3554,10 +4774,12 @@ ebpf_maps_initiate()
     if (result != EBPF_SUCCESS) {
         return result;
     }
+    ebpf_lock_create(&_ebpf_map_publish_lock);
 
     for (size_t index = 0; index < EBPF_COUNT_OF(ebpf_map_metadata_tables); index++) {
         const ebpf_map_metadata_table_t* table = &ebpf_map_metadata_tables[index];
-        ebpf_assert(table->map_type == (ebpf_map_type_t)index);
+        // Types provided by extensions have no entry, so the table is sorted by type but may have gaps.
+        ebpf_assert(index == 0 || table->map_type > ebpf_map_metadata_tables[index - 1].map_type);
         result = _ebpf_map_metadata_table_add(table->map_type, &table->properties);
         if (result != EBPF_SUCCESS) {
             EBPF_LOG_MESSAGE_UINT64_UINT64(
@@ -3566,8 +4788,7 @@ ebpf_maps_initiate()
                 "Failed to add map metadata table entry",
                 table->map_type,
                 result);
-            ebpf_hash_table_destroy(_ebpf_map_type_metadata_table);
-            _ebpf_map_type_metadata_table = NULL;
+            ebpf_maps_terminate();
             return result;
         }
     }
@@ -3581,6 +4802,7 @@ ebpf_maps_terminate()
     if (_ebpf_map_type_metadata_table != NULL) {
         ebpf_hash_table_destroy(_ebpf_map_type_metadata_table);
         _ebpf_map_type_metadata_table = NULL;
+        ebpf_lock_destroy(&_ebpf_map_publish_lock);
     }
 }
 
@@ -3625,6 +4847,17 @@ ebpf_map_create(
 
     const ebpf_map_metadata_table_properties_t* properties = _ebpf_map_metadata_table_query(type);
 
+    if ((ebpf_map_definition->map_flags & ~BPF_F_PREALLOC) != 0 ||
+        ((ebpf_map_definition->map_flags & BPF_F_PREALLOC) && (properties == NULL || !properties->preallocate))) {
+        EBPF_LOG_MESSAGE_UINT64(
+            EBPF_TRACELOG_LEVEL_ERROR,
+            EBPF_TRACELOG_KEYWORD_MAP,
+            "Unsupported map flags",
+            ebpf_map_definition->map_flags);
+        result = EBPF_INVALID_ARGUMENT;
+        goto Exit;
+    }
+
     if (properties == NULL) {
         // Not a built-in map type we recognize; it may be a custom map.
         EBPF_LOG_MESSAGE_UINT64(
@@ -3724,6 +4957,22 @@ ebpf_map_find_entry(
         return ebpf_custom_map_find_entry(map, key_size, key, value_size, value, flags);
     }
 
+    // A find from user mode has no input value, so the value to test for in a bloom filter is passed as the key.
+    if (!(flags & EBPF_MAP_FLAG_HELPER) && (map->ebpf_map_definition.type == BPF_MAP_TYPE_BLOOM_FILTER)) {
+        if (key_size != map->ebpf_map_definition.value_size || value_size != map->ebpf_map_definition.value_size) {
+            EBPF_LOG_MESSAGE_UINT64_UINT64(
+                EBPF_TRACELOG_LEVEL_ERROR,
+                EBPF_TRACELOG_KEYWORD_MAP,
+                "Incorrect bloom filter value size",
+                key_size,
+                map->ebpf_map_definition.value_size);
+            return EBPF_INVALID_ARGUMENT;
+        }
+        // On the ioctl path the request and the reply share one buffer, so the key and the value may overlap.
+        memmove(value, key, value_size);
+        key_size = 0;
+    }
+
     if (!(flags & EBPF_MAP_FLAG_HELPER) && (key_size != map->ebpf_map_definition.key_size)) {
         EBPF_LOG_MESSAGE_UINT64_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
@@ -3745,7 +4994,9 @@ ebpf_map_find_entry(
     }
 
     ebpf_map_type_t type = map->ebpf_map_definition.type;
-    if (map->properties->find_entry == NULL) {
+    // Maps that store values inline can only copy them out, so they can't return a pointer to a helper.
+    bool copy_out = map->properties->peek_or_pop_entry != NULL && !(flags & EBPF_MAP_FLAG_HELPER);
+    if (map->properties->find_entry == NULL && !copy_out) {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR, EBPF_TRACELOG_KEYWORD_MAP, "ebpf_map_find_entry not supported on map", type);
         return EBPF_OPERATION_NOT_SUPPORTED;
@@ -3753,6 +5004,16 @@ ebpf_map_find_entry(
 
     EBPF_LOG_MAP_OPERATION(flags, "find", map, key);
 
+    if (copy_out) {
+        result = map->properties->peek_or_pop_entry(map, (flags & EBPF_MAP_FIND_FLAG_DELETE) != 0, value);
+        if (result != EBPF_SUCCESS) {
+            EBPF_STATISTICS_INCREMENT(map_type[type].miss_count);
+        } else {
+            EBPF_STATISTICS_INCREMENT(map_type[type].hit_count);
+        }
+        return result;
+    }
+
     // Disallow reads to prog array maps from this helper call for now.
     if ((flags & EBPF_MAP_FLAG_HELPER) && (type == BPF_MAP_TYPE_PROG_ARRAY)) {
         EBPF_LOG_MESSAGE(
@@ -3761,6 +5022,11 @@ ebpf_map_find_entry(
     }
 
     result = map->properties->find_entry(map, key, flags, &return_value);
+    if (result != EBPF_SUCCESS || return_value == NULL) {
+        EBPF_STATISTICS_INCREMENT(map_type[type].miss_count);
+    } else {
+        EBPF_STATISTICS_INCREMENT(map_type[type].hit_count);
+    }
     if (result != EBPF_SUCCESS) {
         return result;
     }
@@ -3779,7 +5045,7 @@ ebpf_map_find_entry(
         ebpf_core_object_t* object = (ebpf_core_object_t*)return_value;
         *(uint32_t*)value = object->id;
     } else {
-        memcpy(value, return_value, map->ebpf_map_definition.value_size);
+        _ebpf_map_copy_value(map, return_value, value);
     }
     return EBPF_SUCCESS;
 }
@@ -3886,7 +5152,14 @@ ebpf_map_update_entry(
         return EBPF_OPERATION_NOT_SUPPORTED;
     }
 
+    if (map->shadow_published) {
+        EBPF_LOG_MESSAGE(
+            EBPF_TRACELOG_LEVEL_ERROR, EBPF_TRACELOG_KEYWORD_MAP, "Shadow map can't be updated after it is published");
+        return EBPF_INVALID_STATE;
+    }
+
     EBPF_LOG_MAP_OPERATION(flags, "update", map, key);
+    EBPF_STATISTICS_INCREMENT(map_type[map->ebpf_map_definition.type].update_count);
 
     if ((flags & EBPF_MAP_FLAG_HELPER) && (map->properties->update_entry_per_cpu != NULL)) {
         result = map->properties->update_entry_per_cpu(map, key, value, option);
@@ -3953,7 +5226,14 @@ ebpf_map_delete_entry(_In_ ebpf_map_t* map, size_t key_size, _In_reads_(key_size
         return EBPF_OPERATION_NOT_SUPPORTED;
     }
 
+    if (map->shadow_published) {
+        EBPF_LOG_MESSAGE(
+            EBPF_TRACELOG_LEVEL_ERROR, EBPF_TRACELOG_KEYWORD_MAP, "Shadow map can't be updated after it is published");
+        return EBPF_INVALID_STATE;
+    }
+
     EBPF_LOG_MAP_OPERATION(flags, "delete", map, key);
+    EBPF_STATISTICS_INCREMENT(map_type[map->ebpf_map_definition.type].delete_count);
 
     ebpf_result_t result = map->properties->delete_entry(map, key);
     return result;
@@ -3992,6 +5272,10 @@ ebpf_map_next_key(
     return map->properties->next_key_and_value(map, previous_key, next_key, NULL);
 }
 
+static_assert(
+    EBPF_MAP_INFO_HASH_BUCKET_LENGTH_COUNT == EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT,
+    "bpf_map_info reports the hash table's bucket length histogram as is.");
+
 _Must_inspect_result_ ebpf_result_t
 ebpf_map_get_info(
     _In_ const ebpf_map_t* map, _Out_writes_to_(*info_size, *info_size) uint8_t* buffer, _Inout_ uint16_t* info_size)
@@ -4020,7 +5304,7 @@ ebpf_map_get_info(
     info->key_size = map->ebpf_map_definition.key_size;
     info->value_size = map->original_value_size;
     info->max_entries = map->ebpf_map_definition.max_entries;
-    info->map_flags = 0;
+    info->map_flags = map->ebpf_map_definition.map_flags;
     if (info->type == BPF_MAP_TYPE_ARRAY_OF_MAPS || info->type == BPF_MAP_TYPE_HASH_OF_MAPS) {
         ebpf_core_object_map_t* object_map = EBPF_FROM_FIELD(ebpf_core_object_map_t, core_map, map);
         info->inner_map_id = object_map->core_map.ebpf_map_definition.inner_map_id
@@ -4030,6 +5314,16 @@ ebpf_map_get_info(
         info->inner_map_id = EBPF_ID_NONE;
     }
     info->pinned_path_count = map->object.pinned_path_count;
+    if (!MAP_IS_CUSTOM(map) && map->properties->hash_table) {
+        ebpf_hash_table_statistics_t statistics;
+        ebpf_hash_table_get_statistics((ebpf_hash_table_t*)map->data, &statistics);
+        info->current_entries = (uint32_t)statistics.entry_count;
+        info->hash_bucket_count = (uint32_t)statistics.bucket_count;
+        info->memory_bytes = statistics.memory_bytes;
+        for (size_t index = 0; index < EBPF_MAP_INFO_HASH_BUCKET_LENGTH_COUNT; index++) {
+            info->hash_bucket_length_count[index] = (uint32_t)statistics.bucket_length_count[index];
+        }
+    }
     ebpf_assert(sizeof(info->name) >= map->name.length);
     strncpy_s(info->name, sizeof(info->name), (char*)map->name.value, map->name.length);
     if (map->name.length < sizeof(info->name)) {
@@ -4079,6 +5373,10 @@ ebpf_map_pop_entry(_Inout_ ebpf_map_t* map, size_t value_size, _Out_writes_(valu
         return ebpf_custom_map_find_entry(map, 0, NULL, value_size, value, EBPF_MAP_FIND_FLAG_DELETE);
     }
 
+    if (map->properties->peek_or_pop_entry != NULL) {
+        return map->properties->peek_or_pop_entry(map, true, value);
+    }
+
     if (map->properties->find_entry == NULL) {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
@@ -4098,7 +5396,8 @@ ebpf_map_pop_entry(_Inout_ ebpf_map_t* map, size_t value_size, _Out_writes_(valu
 }
 
 _Must_inspect_result_ ebpf_result_t
-ebpf_map_peek_entry(_Inout_ ebpf_map_t* map, size_t value_size, _Out_writes_(value_size) uint8_t* value, int flags)
+ebpf_map_peek_entry(
+    _Inout_ ebpf_map_t* map, size_t value_size, _Inout_updates_(value_size) uint8_t* value, int flags)
 {
     uint8_t* return_value;
     if (!(flags & EBPF_MAP_FLAG_HELPER) && (value_size != map->ebpf_map_definition.value_size)) {
@@ -4115,6 +5414,10 @@ ebpf_map_peek_entry(_Inout_ ebpf_map_t* map, size_t value_size, _Out_writes_(val
         return EBPF_SUCCESS;
     }
 
+    if (map->properties->peek_or_pop_entry != NULL) {
+        return map->properties->peek_or_pop_entry(map, false, value);
+    }
+
     if (map->properties->find_entry == NULL) {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
@@ -4204,7 +5507,7 @@ ebpf_map_get_next_key_and_value_batch(
             ebpf_core_object_t* object = (ebpf_core_object_t*)ReadULong64NoFence((volatile const uint64_t*)next_value);
             *(uint32_t*)(key_and_value + output_length + key_size) = object ? object->id : 0;
         } else {
-            memcpy(key_and_value + output_length + key_size, next_value, value_size);
+            _ebpf_map_copy_value(map, next_value, key_and_value + output_length + key_size);
         }
 
         if ((flags & EBPF_MAP_FIND_FLAG_DELETE) && (previous_key != NULL)) {
@@ -4223,36 +5526,167 @@ ebpf_map_get_next_key_and_value_batch(
         output_length += key_size + value_size;
     }
 
-    if (result == EBPF_NO_MORE_KEYS && output_length != 0) {
-        // Returned at least one key/value pair.
-        result = EBPF_SUCCESS;
+    if (result == EBPF_NO_MORE_KEYS && output_length != 0) {
+        // Returned at least one key/value pair.
+        result = EBPF_SUCCESS;
+    }
+
+    *key_and_value_length = output_length;
+
+    if ((flags & EBPF_MAP_FIND_FLAG_DELETE) && (previous_key != NULL) && (output_length != 0)) {
+        // If the caller requested deletion, delete the last entry.
+        ebpf_result_t delete_result = map->properties->delete_entry(map, previous_key);
+        if (delete_result != EBPF_SUCCESS) {
+            EBPF_LOG_MESSAGE_UINT64(
+                EBPF_TRACELOG_LEVEL_ERROR, EBPF_TRACELOG_KEYWORD_MAP, "Failed to delete last entry", delete_result);
+            result = delete_result;
+        }
+    }
+
+    return result;
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_get_value_address(_In_ const ebpf_map_t* map, _Out_ uintptr_t* value_address)
+{
+    if (map->ebpf_map_definition.type != BPF_MAP_TYPE_ARRAY) {
+        return EBPF_INVALID_ARGUMENT;
+    } else {
+        ebpf_core_map_t* core_map = (ebpf_core_map_t*)map;
+        *value_address = (uintptr_t)core_map->data;
+    }
+    return EBPF_SUCCESS;
+}
+
+/**
+ * @brief Shadow maps are only supported for hash maps, where all the state that holds the entries is in the hash
+ * table that map->data points to. Other map types keep entry state in the map structure itself.
+ */
+static bool
+_ebpf_map_supports_shadow(_In_ const ebpf_core_map_t* map)
+{
+    return map->properties != NULL && map->ebpf_map_definition.type == BPF_MAP_TYPE_HASH;
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_create_shadow(_In_ const ebpf_map_t* map, bool copy_forward, _Outptr_ ebpf_map_t** shadow_map)
+{
+    EBPF_LOG_ENTRY();
+    ebpf_result_t result;
+    ebpf_map_t* local_map = NULL;
+
+    *shadow_map = NULL;
+
+    if (!_ebpf_map_supports_shadow(map)) {
+        EBPF_RETURN_RESULT(EBPF_OPERATION_NOT_SUPPORTED);
+    }
+
+    ebpf_map_definition_in_memory_t definition = map->ebpf_map_definition;
+    definition.value_size = map->original_value_size;
+    definition.pinning = LIBBPF_PIN_NONE;
+    result = ebpf_map_create(&map->name, &definition, ebpf_handle_invalid, &local_map);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+
+    if (copy_forward) {
+        // Copy the entries as they are now. Entries written to the map after they are copied are not carried over.
+        const ebpf_hash_table_t* source = (const ebpf_hash_table_t*)map->data;
+        uint8_t* previous_key = NULL;
+        for (;;) {
+            uint8_t* next_key;
+            uint8_t* value;
+            result = ebpf_hash_table_next_key_pointer_and_value(source, previous_key, &next_key, &value);
+            if (result == EBPF_NO_MORE_KEYS) {
+                result = EBPF_SUCCESS;
+                break;
+            }
+            if (result == EBPF_KEY_NOT_FOUND) {
+                // The previous key was deleted from the map, so its position is lost. Walk the map again from the
+                // start; the entries copied so far are overwritten with their current values.
+                previous_key = NULL;
+                continue;
+            }
+            if (result != EBPF_SUCCESS) {
+                goto Done;
+            }
+            result = ebpf_hash_table_update(
+                (ebpf_hash_table_t*)local_map->data, NULL, next_key, value, EBPF_HASH_TABLE_OPERATION_ANY);
+            if (result != EBPF_SUCCESS) {
+                goto Done;
+            }
+            previous_key = next_key;
+        }
+    }
+
+    *shadow_map = local_map;
+    local_map = NULL;
+
+Done:
+    if (local_map != NULL) {
+        EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)local_map);
     }
+    EBPF_RETURN_RESULT(result);
+}
 
-    *key_and_value_length = output_length;
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_publish_shadow(_Inout_ ebpf_map_t* map, _Inout_ ebpf_map_t* shadow_map)
+{
+    EBPF_LOG_ENTRY();
 
-    if ((flags & EBPF_MAP_FIND_FLAG_DELETE) && (previous_key != NULL) && (output_length != 0)) {
-        // If the caller requested deletion, delete the last entry.
-        ebpf_result_t delete_result = map->properties->delete_entry(map, previous_key);
-        if (delete_result != EBPF_SUCCESS) {
-            EBPF_LOG_MESSAGE_UINT64(
-                EBPF_TRACELOG_LEVEL_ERROR, EBPF_TRACELOG_KEYWORD_MAP, "Failed to delete last entry", delete_result);
-            result = delete_result;
-        }
+    if (map == shadow_map) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_ARGUMENT);
+    }
+    if (!_ebpf_map_supports_shadow(map) || !_ebpf_map_supports_shadow(shadow_map)) {
+        EBPF_RETURN_RESULT(EBPF_OPERATION_NOT_SUPPORTED);
+    }
+    if (map->ebpf_map_definition.type != shadow_map->ebpf_map_definition.type ||
+        map->ebpf_map_definition.key_size != shadow_map->ebpf_map_definition.key_size ||
+        map->ebpf_map_definition.value_size != shadow_map->ebpf_map_definition.value_size ||
+        map->ebpf_map_definition.max_entries != shadow_map->ebpf_map_definition.max_entries) {
+        EBPF_RETURN_RESULT(EBPF_INVALID_ARGUMENT);
     }
 
-    return result;
+    // Programs and map operations read map->data once per operation, so each of them sees either the old or the
+    // new table in full. The interlocked exchange makes the writes that staged the shadow table visible before the
+    // table itself. The old table moves to the shadow map, and is freed with it once the caller releases the shadow
+    // map; that free is deferred by the epoch, after any program still reading the old table has finished.
+    //
+    // An update that read map->data before the exchange still writes to the old table, so it is ordered before the
+    // publish and replaced by the published entries. The shadow map then holds the previous entries, which may still
+    // be written by such updates and are not the entries of the map, so it can't be staged or published again.
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_map_publish_lock);
+    if (shadow_map->shadow_published) {
+        ebpf_lock_unlock(&_ebpf_map_publish_lock, state);
+        EBPF_RETURN_RESULT(EBPF_INVALID_STATE);
+    }
+    uint8_t* published_table = shadow_map->data;
+    uint8_t* previous_table = map->data;
+    void* exchanged_table =
+        ebpf_interlocked_compare_exchange_pointer((void* volatile*)&map->data, published_table, previous_table);
+    ebpf_assert(exchanged_table == previous_table);
+    UNREFERENCED_PARAMETER(exchanged_table);
+    shadow_map->data = previous_table;
+    shadow_map->shadow_published = true;
+    ebpf_lock_unlock(&_ebpf_map_publish_lock, state);
+
+    EBPF_RETURN_RESULT(EBPF_SUCCESS);
 }
 
 _Must_inspect_result_ ebpf_result_t
-ebpf_map_get_value_address(_In_ const ebpf_map_t* map, _Out_ uintptr_t* value_address)
+ebpf_map_set_time_to_live(_Inout_ ebpf_map_t* map, uint32_t time_to_live_in_ms)
 {
-    if (map->ebpf_map_definition.type != BPF_MAP_TYPE_ARRAY) {
-        return EBPF_INVALID_ARGUMENT;
-    } else {
-        ebpf_core_map_t* core_map = (ebpf_core_map_t*)map;
-        *value_address = (uintptr_t)core_map->data;
+    EBPF_LOG_ENTRY();
+
+    if (MAP_IS_CUSTOM(map) || map->ebpf_map_definition.type != BPF_MAP_TYPE_HASH_TTL) {
+        EBPF_RETURN_RESULT(EBPF_OPERATION_NOT_SUPPORTED);
     }
-    return EBPF_SUCCESS;
+
+    ebpf_core_hash_ttl_map_t* ttl_map = EBPF_FROM_FIELD(ebpf_core_hash_ttl_map_t, core_map, map);
+    // Convert from milliseconds to 100ns units. Entries that already exist keep their expiration time.
+    WriteULong64NoFence(&ttl_map->time_to_live, (uint64_t)time_to_live_in_ms * 10000);
+
+    EBPF_RETURN_RESULT(EBPF_SUCCESS);
 }
 
 #pragma region Custom Maps
@@ -4270,14 +5704,22 @@ static ebpf_base_map_client_dispatch_table_t _ebpf_custom_map_client_dispatch_ta
     ebpf_epoch_free,
     ebpf_epoch_free_cache_aligned};
 
-static ebpf_map_type_t _supported_base_map_types[] = {BPF_MAP_TYPE_HASH};
+static ebpf_map_type_t _supported_base_map_types[] = {
+    BPF_MAP_TYPE_HASH, BPF_MAP_TYPE_ARRAY, BPF_MAP_TYPE_PERCPU_ARRAY};
 
 #define EBPF_CUSTOM_MAP_PROVIDER_FLAG_UPDATES_ORIGINAL_VALUE 0x1
+#define EBPF_CUSTOM_MAP_PROVIDER_FLAG_DIRECT_VALUE_ACCESS 0x2
 
 #define UPDATE_ORIGINAL_VALUE_FLAG_PRESENT(flags)                        \
     (((flags) & EBPF_CUSTOM_MAP_PROVIDER_FLAG_UPDATES_ORIGINAL_VALUE) == \
      EBPF_CUSTOM_MAP_PROVIDER_FLAG_UPDATES_ORIGINAL_VALUE)
 
+#define DIRECT_VALUE_ACCESS_FLAG_PRESENT(flags)                       \
+    (((flags) & EBPF_CUSTOM_MAP_PROVIDER_FLAG_DIRECT_VALUE_ACCESS) == \
+     EBPF_CUSTOM_MAP_PROVIDER_FLAG_DIRECT_VALUE_ACCESS)
+
+#define IS_CUSTOM_MAP_ARRAY_BASE(type) ((type) == BPF_MAP_TYPE_ARRAY || (type) == BPF_MAP_TYPE_PERCPU_ARRAY)
+
 /**
  * @brief custom map structure with NMR client components.
  */
@@ -4293,6 +5735,7 @@ typedef struct _ebpf_custom_map
     NPI_MODULEID module_id;
     ebpf_map_type_t base_map_type;
     size_t actual_value_size;
+    size_t array_entry_size; // Bytes stored per key by array base maps, covering every CPU for per-CPU arrays.
     uint32_t provider_flags;
     EX_RUNDOWN_REF provider_rundown_reference; // Synchronization for provider access.
 } ebpf_custom_map_t;
@@ -4369,6 +5812,7 @@ _ebpf_custom_map_create_hash_map(
         actual_value_size,
         0,
         true,
+        false,
         NULL,
         _custom_hash_map_notification,
         EBPF_HASH_TABLE_NOTIFICATION_TYPE_FREE,
@@ -4568,6 +6012,302 @@ _custom_hash_map_notification(
     return result;
 }
 
+static ebpf_result_t
+_ebpf_custom_map_create_array_map(_Inout_ ebpf_custom_map_t* map, size_t actual_value_size)
+{
+    ebpf_result_t result;
+    const ebpf_map_definition_in_memory_t* map_definition = &map->core_map.ebpf_map_definition;
+    size_t entry_size = actual_value_size;
+    size_t data_size;
+
+    if (map_definition->key_size != sizeof(uint32_t) || map_definition->max_entries == 0) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // Per-CPU arrays store one 8-byte aligned copy of the value per CPU for each key, in the same layout as
+    // BPF_MAP_TYPE_PERCPU_ARRAY.
+    if (map->base_map_type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+        result = ebpf_safe_size_t_multiply(EBPF_PAD_8(actual_value_size), ebpf_get_cpu_count(), &entry_size);
+        if (result != EBPF_SUCCESS) {
+            return result;
+        }
+    }
+
+    result = ebpf_safe_size_t_multiply(map_definition->max_entries, entry_size, &data_size);
+    if (result != EBPF_SUCCESS) {
+        return result;
+    }
+
+    // Prevent allocation larger than 128GB (default maximum non-paged pool size).
+    if (data_size > EBPF_MAP_MAXIMUM_ALLOCATION) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    map->core_map.data = (uint8_t*)ebpf_allocate_cache_aligned_with_tag(data_size, EBPF_POOL_TAG_MAP);
+    if (map->core_map.data == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    memset(map->core_map.data, 0, data_size);
+    map->array_entry_size = entry_size;
+
+    return EBPF_SUCCESS;
+}
+
+static _Ret_maybenull_ uint8_t*
+_ebpf_custom_map_get_array_map_entry(_In_ const ebpf_custom_map_t* map, _In_opt_ const uint8_t* key)
+{
+    if (key == NULL) {
+        return NULL;
+    }
+
+    uint32_t index = *(uint32_t*)key;
+    if (index >= map->core_map.ebpf_map_definition.max_entries) {
+        return NULL;
+    }
+
+    return map->core_map.data + (size_t)index * map->array_entry_size;
+}
+
+static void
+_ebpf_custom_map_delete_array_map(_Inout_ ebpf_custom_map_t* map)
+{
+    if (map->core_map.data == NULL) {
+        return;
+    }
+
+    // Array entries always exist, so every slot is reported to the provider, including slots never written to.
+    if (map->provider_dispatch->preprocess_map_delete_element != NULL) {
+        for (uint32_t index = 0; index < map->core_map.ebpf_map_definition.max_entries; index++) {
+            map->provider_dispatch->preprocess_map_delete_element(
+                map->provider_context,
+                map->core_map.custom_map_context,
+                map->core_map.ebpf_map_definition.key_size,
+                (const uint8_t*)&index,
+                map->array_entry_size,
+                map->core_map.data + (size_t)index * map->array_entry_size,
+                EBPF_MAP_OPERATION_MAP_CLEANUP);
+        }
+    }
+
+    ebpf_free_cache_aligned(map->core_map.data);
+    map->core_map.data = NULL;
+}
+
+static ebpf_result_t
+_ebpf_custom_map_update_array_map_entry(
+    _Inout_ ebpf_custom_map_t* custom_map,
+    _In_opt_ const uint8_t* key,
+    size_t value_size,
+    _In_reads_(value_size) const uint8_t* value,
+    ebpf_map_option_t option,
+    int flags)
+{
+    ebpf_result_t result = EBPF_SUCCESS;
+    ebpf_base_map_provider_dispatch_table_t* provider_dispatch = custom_map->provider_dispatch;
+    const ebpf_map_definition_in_memory_t* map_definition = &custom_map->core_map.ebpf_map_definition;
+    uint8_t* out_value = NULL;
+    uint8_t* old_value = NULL;
+    ebpf_lock_state_t lock_state = 0;
+    bool lock_acquired = false;
+    bool replicate = false;
+
+    // Array entries always exist and can't be inserted.
+    if (option == EBPF_NOEXIST) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    uint8_t* entry = _ebpf_custom_map_get_array_map_entry(custom_map, key);
+    if (entry == NULL) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // Work out which part of the entry this update replaces. Programs update the current CPU's copy of a per-CPU
+    // value. User mode either supplies every CPU's copy or a single value that is written to all of them.
+    bool per_cpu = (custom_map->base_map_type == BPF_MAP_TYPE_PERCPU_ARRAY);
+    uint8_t* target = entry;
+    size_t target_size = custom_map->actual_value_size;
+    size_t in_value_size = map_definition->value_size;
+    if (flags & EBPF_MAP_FLAG_HELPER) {
+        if (per_cpu) {
+            target += EBPF_PAD_8(custom_map->actual_value_size) * ebpf_get_current_cpu();
+        }
+    } else if (value_size == map_definition->value_size) {
+        if (per_cpu) {
+            target_size = custom_map->array_entry_size;
+            replicate = true;
+        }
+    } else if (per_cpu && value_size == custom_map->array_entry_size) {
+        target_size = custom_map->array_entry_size;
+        in_value_size = value_size;
+    } else {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    if (UPDATE_ORIGINAL_VALUE_FLAG_PRESENT(custom_map->provider_flags)) {
+        // Note that this code path is only valid for update from user mode, not in hot path (e.g., helper calls).
+        out_value = (uint8_t*)ebpf_allocate_with_tag(custom_map->actual_value_size, EBPF_POOL_TAG_MAP);
+        if (out_value == NULL) {
+            return EBPF_NO_MEMORY;
+        }
+        memset(out_value, 0, custom_map->actual_value_size);
+    }
+
+    if (provider_dispatch->preprocess_map_delete_element != NULL) {
+        // Keep the replaced value so that the provider can release anything it references once the update is done.
+        old_value = (uint8_t*)ebpf_allocate_with_tag(target_size, EBPF_POOL_TAG_MAP);
+        if (old_value == NULL) {
+            result = EBPF_NO_MEMORY;
+            goto Exit;
+        }
+    }
+
+    if (provider_dispatch->preprocess_map_update_element != NULL ||
+        provider_dispatch->preprocess_map_delete_element != NULL) {
+        // Acquire lock to serialize updates and the provider notifications for them.
+        lock_state = ebpf_lock_lock(&custom_map->lock);
+        lock_acquired = true;
+    }
+
+    if (provider_dispatch->preprocess_map_update_element != NULL) {
+        size_t out_value_size =
+            UPDATE_ORIGINAL_VALUE_FLAG_PRESENT(custom_map->provider_flags) ? custom_map->actual_value_size : 0;
+        result = provider_dispatch->preprocess_map_update_element(
+            custom_map->provider_context,
+            custom_map->core_map.custom_map_context,
+            map_definition->key_size,
+            key,
+            in_value_size,
+            value,
+            out_value_size,
+            out_value,
+            _get_provider_flags(flags, false));
+        if (result != EBPF_SUCCESS) {
+            goto Exit;
+        }
+    }
+
+    if (old_value != NULL) {
+        memcpy(old_value, target, target_size);
+    }
+
+    const uint8_t* new_value = out_value ? out_value : value;
+    if (replicate) {
+        for (uint32_t cpu = 0; cpu < ebpf_get_cpu_count(); cpu++) {
+            memcpy(
+                target + EBPF_PAD_8(custom_map->actual_value_size) * cpu, new_value, custom_map->actual_value_size);
+        }
+    } else {
+        memcpy(target, new_value, target_size);
+    }
+
+    if (old_value != NULL) {
+        provider_dispatch->preprocess_map_delete_element(
+            custom_map->provider_context,
+            custom_map->core_map.custom_map_context,
+            map_definition->key_size,
+            key,
+            target_size,
+            old_value,
+            _get_provider_flags(flags, true));
+    }
+
+Exit:
+    if (lock_acquired) {
+        ebpf_lock_unlock(&custom_map->lock, lock_state);
+    }
+    ebpf_free(old_value);
+    ebpf_free(out_value);
+
+    return result;
+}
+
+static ebpf_result_t
+_ebpf_custom_map_delete_array_map_entry(_Inout_ ebpf_custom_map_t* custom_map, _In_opt_ const uint8_t* key, int flags)
+{
+    ebpf_result_t result = EBPF_SUCCESS;
+
+    uint8_t* entry = _ebpf_custom_map_get_array_map_entry(custom_map, key);
+    if (entry == NULL) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    // As with BPF_MAP_TYPE_ARRAY, deleting an entry resets it to zero.
+    ebpf_lock_state_t lock_state = ebpf_lock_lock(&custom_map->lock);
+    if (custom_map->provider_dispatch->preprocess_map_delete_element != NULL) {
+        result = custom_map->provider_dispatch->preprocess_map_delete_element(
+            custom_map->provider_context,
+            custom_map->core_map.custom_map_context,
+            custom_map->core_map.ebpf_map_definition.key_size,
+            key,
+            custom_map->array_entry_size,
+            entry,
+            _get_provider_flags(flags, false));
+    }
+    if (result == EBPF_SUCCESS) {
+        memset(entry, 0, custom_map->array_entry_size);
+    }
+    ebpf_lock_unlock(&custom_map->lock, lock_state);
+
+    return result;
+}
+
+/**
+ * @brief Find the stored value for a key in the base map of a custom map.
+ *
+ * @param[in] custom_map Custom map to search.
+ * @param[in] key Key to search for.
+ * @param[in] flags EBPF_MAP_FLAG_HELPER selects the current CPU's copy of a per-CPU value.
+ * @param[out] data Pointer to the stored value.
+ * @param[out] data_size Size of the stored value.
+ * @retval EBPF_SUCCESS The operation was successful.
+ * @retval EBPF_OBJECT_NOT_FOUND The key was not found.
+ * @retval EBPF_INVALID_ARGUMENT An invalid argument was supplied.
+ */
+static ebpf_result_t
+_ebpf_custom_map_find_base_map_entry(
+    _In_ ebpf_custom_map_t* custom_map,
+    _In_opt_ const uint8_t* key,
+    int flags,
+    _Outptr_ uint8_t** data,
+    _Out_ size_t* data_size)
+{
+    *data = NULL;
+    *data_size = 0;
+
+    switch (custom_map->base_map_type) {
+    case BPF_MAP_TYPE_HASH: {
+        ebpf_result_t result = _ebpf_custom_map_find_hash_map_entry(&custom_map->core_map, key, data);
+        if (result != EBPF_SUCCESS) {
+            return result;
+        }
+        *data_size = custom_map->actual_value_size;
+        return EBPF_SUCCESS;
+    }
+    case BPF_MAP_TYPE_ARRAY:
+    case BPF_MAP_TYPE_PERCPU_ARRAY: {
+        uint8_t* entry = _ebpf_custom_map_get_array_map_entry(custom_map, key);
+        if (entry == NULL) {
+            return (key == NULL) ? EBPF_INVALID_ARGUMENT : EBPF_OBJECT_NOT_FOUND;
+        }
+        if (custom_map->base_map_type == BPF_MAP_TYPE_PERCPU_ARRAY && (flags & EBPF_MAP_FLAG_HELPER)) {
+            *data = entry + EBPF_PAD_8(custom_map->actual_value_size) * ebpf_get_current_cpu();
+            *data_size = custom_map->actual_value_size;
+        } else {
+            *data = entry;
+            *data_size = custom_map->array_entry_size;
+        }
+        return EBPF_SUCCESS;
+    }
+    default:
+        EBPF_LOG_MESSAGE_UINT64(
+            EBPF_TRACELOG_LEVEL_ERROR,
+            EBPF_TRACELOG_KEYWORD_MAP,
+            "Unsupported base map type for custom map",
+            custom_map->base_map_type);
+        return EBPF_INVALID_OBJECT;
+    }
+}
+
 _Must_inspect_result_ ebpf_result_t
 ebpf_custom_map_create(
     _In_ const ebpf_map_definition_in_memory_t* map_definition,
@@ -4707,13 +6447,18 @@ ebpf_custom_map_create(
         }
     }
 
-    // Create hash map.
-    result = _ebpf_custom_map_create_hash_map(map_definition, actual_value_size, &custom_map->core_map);
+    // Create the base map.
+    if (custom_map->base_map_type == BPF_MAP_TYPE_HASH) {
+        result = _ebpf_custom_map_create_hash_map(map_definition, actual_value_size, &custom_map->core_map);
+    } else {
+        ebpf_assert(IS_CUSTOM_MAP_ARRAY_BASE(custom_map->base_map_type));
+        result = _ebpf_custom_map_create_array_map(custom_map, actual_value_size);
+    }
     if (result != EBPF_SUCCESS) {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
             EBPF_TRACELOG_KEYWORD_MAP,
-            "Failed to create hash map for custom map type",
+            "Failed to create base map for custom map type",
             custom_map->core_map.ebpf_map_definition.type);
 
         goto Done;
@@ -4745,6 +6490,8 @@ ebpf_custom_map_delete(_In_ _Post_ptr_invalid_ ebpf_core_map_t* map)
 
     if (custom_map->base_map_type == BPF_MAP_TYPE_HASH) {
         _ebpf_custom_map_delete_hash_map(custom_map);
+    } else if (IS_CUSTOM_MAP_ARRAY_BASE(custom_map->base_map_type)) {
+        _ebpf_custom_map_delete_array_map(custom_map);
     }
 
     // Call provider to notify map deletion.
@@ -4810,6 +6557,23 @@ _ebpf_custom_map_client_attach_provider(
         goto Done;
     }
 
+    // Programs can't access values that the provider transforms, so direct access only applies to maps whose stored
+    // value is the value the program sees. Per-CPU values are only stored as supplied, for the same reason.
+    bool direct_value_access =
+        provider_data->base_properties->header.size >=
+            EBPF_SIZE_INCLUDING_FIELD(ebpf_base_map_provider_properties_t, direct_value_access) &&
+        provider_data->base_properties->direct_value_access;
+    if (provider_data->base_properties->updates_original_value &&
+        (direct_value_access || provider_data->base_map_type == BPF_MAP_TYPE_PERCPU_ARRAY)) {
+        EBPF_LOG_MESSAGE_UINT64(
+            EBPF_TRACELOG_LEVEL_ERROR,
+            EBPF_TRACELOG_KEYWORD_MAP,
+            "Invalid base map provider properties for custom map",
+            provider_data->map_type);
+        status = STATUS_INVALID_PARAMETER;
+        goto Done;
+    }
+
     // Provider supports the requested map type.
     // Create a cache-aligned copy of the dispatch table for hot path performance.
     provider_dispatch_table = (ebpf_base_map_provider_dispatch_table_t*)ebpf_allocate_cache_aligned_with_tag(
@@ -4841,6 +6605,8 @@ _ebpf_custom_map_client_attach_provider(
         min(sizeof(ebpf_base_map_provider_properties_t), provider_data->base_properties->header.size));
     custom_map->provider_flags =
         properties.updates_original_value ? EBPF_CUSTOM_MAP_PROVIDER_FLAG_UPDATES_ORIGINAL_VALUE : 0;
+    custom_map->provider_flags |=
+        properties.direct_value_access ? EBPF_CUSTOM_MAP_PROVIDER_FLAG_DIRECT_VALUE_ACCESS : 0;
 
     memcpy(
         provider_dispatch_table,
@@ -4905,6 +6671,7 @@ _ebpf_custom_map_find_element(_In_ const ebpf_map_t* map, _In_ const uint8_t* ke
 
     ebpf_result_t result;
     uint8_t* data = NULL;
+    size_t data_size;
 
     // This call is from the provider to find an element in the map. Check if this is a custom map.
     ebpf_core_map_t* core_map = (ebpf_core_map_t*)map;
@@ -4914,19 +6681,10 @@ _ebpf_custom_map_find_element(_In_ const ebpf_map_t* map, _In_ const uint8_t* ke
     }
     ebpf_custom_map_t* custom_map = CONTAINING_RECORD(map, ebpf_custom_map_t, core_map);
 
-    if (custom_map->base_map_type == BPF_MAP_TYPE_HASH) {
-        // Find the entry in the hash table first.
-        result = _ebpf_custom_map_find_hash_map_entry(core_map, key, &data);
-        if (result != EBPF_SUCCESS) {
-            return result;
-        }
-    } else {
-        EBPF_LOG_MESSAGE_UINT64(
-            EBPF_TRACELOG_LEVEL_ERROR,
-            EBPF_TRACELOG_KEYWORD_MAP,
-            "Unsupported base map type for custom map",
-            custom_map->base_map_type);
-        return EBPF_INVALID_OBJECT;
+    // Providers are handed the whole stored value, which for per-CPU arrays covers every CPU.
+    result = _ebpf_custom_map_find_base_map_entry(custom_map, key, 0, &data, &data_size);
+    if (result != EBPF_SUCCESS) {
+        return result;
     }
 
     *value = data;
@@ -4946,21 +6704,33 @@ ebpf_custom_map_find_entry(
     ebpf_custom_map_t* custom_map = CONTAINING_RECORD(map, ebpf_custom_map_t, core_map);
     ebpf_result_t result = EBPF_OPERATION_NOT_SUPPORTED;
     uint8_t* data = NULL;
+    size_t data_size;
     uint32_t provider_flags = _get_provider_flags(flags, false);
 
+    // Providers that don't need to see program lookups let programs use the stored value directly, which skips the
+    // provider dispatch on the hot path.
+    if (DIRECT_VALUE_ACCESS_FLAG_PRESENT(custom_map->provider_flags) && (flags & EBPF_MAP_FLAG_HELPER) &&
+        !(flags & EBPF_MAP_FIND_FLAG_DELETE)) {
+        result = _ebpf_custom_map_find_base_map_entry(custom_map, key, flags, &data, &data_size);
+        if (result == EBPF_SUCCESS) {
+            *((uint8_t**)value) = data;
+        }
+        return result;
+    }
+
     // If the map is configured to update the original value, and this is a helper call, fail the call.
     if (UPDATE_ORIGINAL_VALUE_FLAG_PRESENT(custom_map->provider_flags) && (flags & EBPF_MAP_FLAG_HELPER)) {
         return EBPF_OPERATION_NOT_SUPPORTED;
     }
 
-    if (custom_map->base_map_type == BPF_MAP_TYPE_HASH) {
-        // Find the entry in the hash table first.
-        result = _ebpf_custom_map_find_hash_map_entry(&custom_map->core_map, key, &data);
-        if (result != EBPF_SUCCESS) {
-            return result;
-        }
-    } else {
-        __fastfail(FAST_FAIL_INVALID_ARG);
+    // Array entries can't be deleted, so find and delete is only supported on hash maps.
+    if (IS_CUSTOM_MAP_ARRAY_BASE(custom_map->base_map_type) && (flags & EBPF_MAP_FIND_FLAG_DELETE)) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    result = _ebpf_custom_map_find_base_map_entry(custom_map, key, flags, &data, &data_size);
+    if (result != EBPF_SUCCESS) {
+        return result;
     }
 
     // Get provider dispatch.
@@ -4981,7 +6751,7 @@ ebpf_custom_map_find_entry(
             custom_map->core_map.custom_map_context,
             key_size,
             key,
-            custom_map->actual_value_size,
+            data_size,
             data,
             out_value_size,
             value_pointer,
@@ -5001,11 +6771,14 @@ ebpf_custom_map_find_entry(
     }
 
     // If it is a helper function call, return the pointer to the original data. Otherwise, copy the data to the output
-    // buffer.
+    // buffer. User mode reads of a per-CPU array return as many CPUs' values as fit in the buffer.
     if (flags & EBPF_MAP_FLAG_HELPER) {
         *((uint8_t**)value) = data;
     } else if (value_pointer == NULL) {
-        memcpy(value, data, min(value_size, map->ebpf_map_definition.value_size));
+        size_t copy_size = (custom_map->base_map_type == BPF_MAP_TYPE_PERCPU_ARRAY)
+                               ? data_size
+                               : map->ebpf_map_definition.value_size;
+        memcpy(value, data, min(value_size, copy_size));
     }
 
     return result;
@@ -5033,6 +6806,8 @@ ebpf_custom_map_update_entry(
         // Find the entry in the hash table first.
         result = _ebpf_custom_map_update_hash_map_entry(
             &custom_map->core_map, key_size, key, value_size, value, option, flags);
+    } else if (IS_CUSTOM_MAP_ARRAY_BASE(custom_map->base_map_type)) {
+        result = _ebpf_custom_map_update_array_map_entry(custom_map, key, value_size, value, option, flags);
     } else {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
@@ -5065,6 +6840,8 @@ ebpf_custom_map_delete_entry(_In_ ebpf_map_t* map, size_t key_size, _In_reads_(k
             _delete_hash_map_entry_operation_context(&custom_map->core_map, (uint8_t*)&operation_context, key);
         ebpf_lock_unlock(&custom_map->lock, lock_state);
         return result;
+    } else if (IS_CUSTOM_MAP_ARRAY_BASE(custom_map->base_map_type)) {
+        return _ebpf_custom_map_delete_array_map_entry(custom_map, key, flags);
     } else {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
@@ -5084,6 +6861,8 @@ ebpf_custom_map_get_next_key(_Inout_ ebpf_map_t* map, _In_opt_ const uint8_t* pr
     if (custom_map->base_map_type == BPF_MAP_TYPE_HASH) {
         // Get the next key from the hash table first.
         result = _next_hash_map_key_and_value(&custom_map->core_map, previous_key, next_key, NULL);
+    } else if (IS_CUSTOM_MAP_ARRAY_BASE(custom_map->base_map_type)) {
+        result = _next_array_map_key_and_value(&custom_map->core_map, previous_key, next_key, NULL);
     } else {
         EBPF_LOG_MESSAGE_UINT64(
             EBPF_TRACELOG_LEVEL_ERROR,
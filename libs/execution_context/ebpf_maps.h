@@ -368,7 +368,8 @@ extern "C"
         _In_ void* ctx, _Inout_ ebpf_map_t* map, uint64_t flags, _In_reads_bytes_(length) uint8_t* data, size_t length);
 
     /**
-     * @brief Insert an element at the end of the map (only valid for stack and queue).
+     * @brief Insert an element at the end of the map (only valid for stack and queue), or add a value to a bloom
+     * filter.
      *
      * @param[in, out] map Map to update.
      * @param[in] value_size Size of value to insert into the map.
@@ -400,19 +401,21 @@ extern "C"
     ebpf_map_pop_entry(_Inout_ ebpf_map_t* map, size_t value_size, _Out_writes_(value_size) uint8_t* value, int flags);
 
     /**
-     * @brief Copy an entry from the map (only valid for stack and queue).
+     * @brief Copy an entry from the map (only valid for stack and queue), or test whether a value was added to a
+     * bloom filter.
      * Queue peeks at the beginning of the map.
      * Stack peeks at the end of the map.
      *
      * @param[in, out] map Map to search and update metadata on.
      * @param[in] value_size Size of the value buffer to copy value from map into.
-     * @param[out] value Value buffer to copy value from map into.
+     * @param[in, out] value Value buffer to copy value from map into, or value to test for a bloom filter.
      * @retval EBPF_SUCCESS The operation was successful.
-     * @retval EBPF_OBJECT_NOT_FOUND The map is empty.
+     * @retval EBPF_OBJECT_NOT_FOUND The map is empty, or the value is not in the bloom filter.
      */
     EBPF_INLINE_HINT
     _Must_inspect_result_ ebpf_result_t
-    ebpf_map_peek_entry(_Inout_ ebpf_map_t* map, size_t value_size, _Out_writes_(value_size) uint8_t* value, int flags);
+    ebpf_map_peek_entry(
+        _Inout_ ebpf_map_t* map, size_t value_size, _Inout_updates_(value_size) uint8_t* value, int flags);
 
     /**
      * @brief Get the ID of a given map.
@@ -458,6 +461,54 @@ extern "C"
     _Must_inspect_result_ ebpf_result_t
     ebpf_map_get_value_address(_In_ const ebpf_map_t* map, _Out_ uintptr_t* value_address);
 
+    /**
+     * @brief Create a shadow of a map: a new map with the same definition, that can be staged with ordinary map
+     * updates and then published into the original map with ebpf_map_publish_shadow.
+     *
+     * @param[in] map Map to create a shadow of.
+     * @param[in] copy_forward If true, the shadow starts with a copy of the entries of the map, so that incremental
+     *  changes don't require the whole map to be written again. Otherwise the shadow starts empty.
+     * @param[out] shadow_map Pointer to memory that will contain the shadow map on success.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED Shadows are not supported for this map type.
+     * @retval EBPF_NO_MEMORY Unable to allocate resources for this
+     *  operation.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_create_shadow(_In_ const ebpf_map_t* map, bool copy_forward, _Outptr_ ebpf_map_t** shadow_map);
+
+    /**
+     * @brief Atomically replace the entries of a map with the entries of its shadow. Programs see either the old or
+     * the new entries, never a mix of both. The previous entries move to the shadow map, which can still be read and
+     * is then released; once released, the previous entries are freed when the current epoch ends. The shadow map
+     * rejects updates, deletes and being published again with EBPF_INVALID_STATE.
+     *
+     * Updates that read the map's table before the publish still write to the previous entries. They are ordered
+     * before the publish, and replaced by the published entries.
+     *
+     * @param[in, out] map Map to publish into.
+     * @param[in, out] shadow_map Shadow map, created by ebpf_map_create_shadow from a map with the same definition.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_ARGUMENT The maps are the same, or their definitions differ.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED Shadows are not supported for this map type.
+     * @retval EBPF_INVALID_STATE The shadow map was already published.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_publish_shadow(_Inout_ ebpf_map_t* map, _Inout_ ebpf_map_t* shadow_map);
+
+    /**
+     * @brief Set the time to live of the entries of a BPF_MAP_TYPE_HASH_TTL map. Entries inserted or updated after
+     * the call expire the given time after they were written; entries that already exist keep their expiration time.
+     * A time to live of zero, which is the initial value, means that entries never expire.
+     *
+     * @param[in, out] map Map to configure.
+     * @param[in] time_to_live_in_ms Time to live of new entries, in milliseconds.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_OPERATION_NOT_SUPPORTED The map is not a BPF_MAP_TYPE_HASH_TTL map.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_set_time_to_live(_Inout_ ebpf_map_t* map, uint32_t time_to_live_in_ms);
+
 #ifdef __cplusplus
 }
 #endif
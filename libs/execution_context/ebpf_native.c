@@ -4,6 +4,7 @@
 #define EBPF_FILE_ID EBPF_FILE_ID_NATIVE
 
 #include "ebpf_core.h"
+#include "ebpf_epoch.h"
 #include "ebpf_error.h"
 #include "ebpf_handle.h"
 #include "ebpf_hash_table.h"
@@ -1093,42 +1094,33 @@ Done:
     EBPF_RETURN_RESULT(return_value);
 }
 
-static ebpf_native_map_t*
-_ebpf_native_get_next_map_to_create(_In_reads_(map_count) ebpf_native_map_t* maps, size_t map_count)
+static bool
+_ebpf_native_is_map_ready_to_create(
+    _In_reads_(map_count) ebpf_native_map_t* maps, size_t map_count, _Inout_ ebpf_native_map_t* map)
 {
-    for (uint32_t i = 0; i < map_count; i++) {
-        ebpf_native_map_t* map = &maps[i];
-        if (map->handle != ebpf_handle_invalid) {
-            // Already created.
-            continue;
-        }
-        if (!_ebpf_native_is_map_in_map(map)) {
-            return map;
-        }
-        if (map->inner_map == NULL) {
-            // This map requires an inner map template, look up which one.
-            for (uint32_t j = 0; j < map_count; j++) {
-                ebpf_native_map_t* inner_map = &maps[j];
-                if (inner_map->original_id == map->inner_map_original_id) {
-                    map->inner_map = inner_map;
-                    break;
-                }
-            }
-            if (map->inner_map == NULL) {
-                // We can't create this map because there is no inner template.
-                continue;
+    if (map->handle != ebpf_handle_invalid) {
+        // Already created.
+        return false;
+    }
+    if (!_ebpf_native_is_map_in_map(map)) {
+        return true;
+    }
+    if (map->inner_map == NULL) {
+        // This map requires an inner map template, look up which one.
+        for (uint32_t j = 0; j < map_count; j++) {
+            ebpf_native_map_t* inner_map = &maps[j];
+            if (inner_map->original_id == map->inner_map_original_id) {
+                map->inner_map = inner_map;
+                break;
             }
         }
-        if (map->inner_map->handle == ebpf_handle_invalid) {
-            // We need to create the inner map template first.
-            continue;
+        if (map->inner_map == NULL) {
+            // We can't create this map because there is no inner template.
+            return false;
         }
-
-        return map;
     }
-
-    // There are no maps left that we can create.
-    return NULL;
+    // The inner map template must be created first.
+    return map->inner_map->handle != ebpf_handle_invalid;
 }
 
 static ebpf_result_t
@@ -1364,6 +1356,14 @@ _ebpf_native_set_initial_map_values(_Inout_ ebpf_native_module_instance_t* insta
             continue;
         }
 
+        // Reference the map once for all of its initial values rather than once per value.
+        ebpf_map_t* map_to_update = NULL;
+        result = EBPF_OBJECT_REFERENCE_BY_HANDLE(
+            native_map_to_update->handle, EBPF_OBJECT_MAP, (ebpf_core_object_t**)&map_to_update);
+        if (result != EBPF_SUCCESS) {
+            break;
+        }
+
         // For each value in the map, find the map or program to insert.
         for (size_t j = 0; j < map_initial_values[i].count; j++) {
             // Skip empty initial values.
@@ -1376,7 +1376,7 @@ _ebpf_native_set_initial_map_values(_Inout_ ebpf_native_module_instance_t* insta
             if (_ebpf_native_is_map_in_map(native_map_to_update)) {
                 ebpf_native_map_t* native_map_to_insert =
                     _ebpf_native_find_map_by_name(instance, map_initial_values[i].values[j]);
-                if (native_map_to_update == NULL) {
+                if (native_map_to_insert == NULL) {
                     result = EBPF_INVALID_ARGUMENT;
                     break;
                 }
@@ -1395,15 +1395,17 @@ _ebpf_native_set_initial_map_values(_Inout_ ebpf_native_module_instance_t* insta
             }
 
             uint32_t key = (uint32_t)j;
-            result = ebpf_core_update_map_with_handle(
-                native_map_to_update->handle,
-                (uint8_t*)&key,
+            result = ebpf_map_update_entry_with_handle(
+                map_to_update,
                 native_map_to_update->entry.definition.key_size,
-                handle_to_insert);
+                (uint8_t*)&key,
+                handle_to_insert,
+                EBPF_ANY);
             if (result != EBPF_SUCCESS) {
                 break;
             }
         }
+        EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map_to_update);
         if (result != EBPF_SUCCESS) {
             break;
         }
@@ -1474,16 +1476,180 @@ _ebpf_native_initialize_global_variables(
     EBPF_RETURN_RESULT(result);
 }
 
+/**
+ * @brief State shared by the work items that create the map objects of one batch.
+ */
+typedef struct _ebpf_native_map_creation_batch
+{
+    KEVENT completion_event;
+    volatile int32_t pending_count;
+} ebpf_native_map_creation_batch_t;
+
+typedef struct _ebpf_native_map_creation
+{
+    ebpf_native_map_creation_batch_t* batch;
+    ebpf_native_map_t* native_map;
+    ebpf_map_t* map;
+    ebpf_result_t result;
+} ebpf_native_map_creation_t;
+
+/**
+ * @brief Create the map object for a native map. The handle is created separately as handles belong to the process
+ * of the calling thread.
+ */
+static ebpf_result_t
+_ebpf_native_create_map_object(_In_ const ebpf_native_map_t* native_map, _Outptr_ ebpf_map_t** map)
+{
+    ebpf_result_t result;
+    cxplat_utf8_string_t map_name = {0};
+    ebpf_map_definition_in_memory_t map_definition = {0};
+    ebpf_handle_t inner_map_handle = (native_map->inner_map) ? native_map->inner_map->handle : ebpf_handle_invalid;
+
+    *map = NULL;
+    map_name.length = strlen(native_map->entry.name);
+    map_name.value = (uint8_t*)ebpf_allocate_with_tag(map_name.length, EBPF_POOL_TAG_NATIVE);
+    if (map_name.value == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    memcpy(map_name.value, native_map->entry.name, map_name.length);
+    map_definition.type = native_map->entry.definition.type;
+    map_definition.key_size = native_map->entry.definition.key_size;
+    map_definition.value_size = native_map->entry.definition.value_size;
+    map_definition.max_entries = native_map->entry.definition.max_entries;
+
+    result = ebpf_map_create(&map_name, &map_definition, inner_map_handle, map);
+
+    ebpf_free(map_name.value);
+    return result;
+}
+
+static void
+_ebpf_native_create_map_work_item(_In_ cxplat_preemptible_work_item_t* work_item, _In_opt_ void* work_item_context)
+{
+    _Analysis_assume_(work_item_context != NULL);
+
+    ebpf_native_map_creation_t* creation = (ebpf_native_map_creation_t*)work_item_context;
+    ebpf_native_map_creation_batch_t* batch = creation->batch;
+    ebpf_epoch_state_t epoch_state = {0};
+
+    ebpf_epoch_enter(&epoch_state);
+    creation->result = _ebpf_native_create_map_object(creation->native_map, &creation->map);
+    ebpf_epoch_exit(&epoch_state);
+
+    cxplat_free_preemptible_work_item(work_item);
+    if (ebpf_interlocked_decrement_int32(&batch->pending_count) == 0) {
+        KeSetEvent(&batch->completion_event, 0, FALSE);
+    }
+}
+
+/**
+ * @brief Create a batch of maps that do not depend on each other. Allocating and zeroing the storage of large maps
+ * dominates the cost of creating them, so when more than one map object is needed the objects are created
+ * concurrently on preemptible work items. Maps that need an inner map template are created on the calling thread as
+ * the template is referenced by a handle. Handles are then created and maps pinned on the calling thread.
+ *
+ * @param[in, out] maps Maps in the batch.
+ * @param[in] map_count Number of maps in the batch.
+ * @retval EBPF_SUCCESS The operation was successful.
+ * @retval EBPF_NO_MEMORY Unable to allocate resources for this operation.
+ */
+static ebpf_result_t
+_ebpf_native_create_map_batch(_In_reads_(map_count) ebpf_native_map_t** maps, size_t map_count)
+{
+    ebpf_result_t result = EBPF_SUCCESS;
+    ebpf_native_map_creation_batch_t batch = {0};
+    ebpf_native_map_creation_t* creations = NULL;
+    size_t creation_count = 0;
+    size_t concurrent_count = 0;
+
+    // Maps pinned by name may reuse an existing map.
+    for (size_t index = 0; index < map_count; index++) {
+        if (maps[index]->entry.definition.pinning == LIBBPF_PIN_BY_NAME) {
+            result = _ebpf_native_reuse_map(maps[index]);
+            if (result != EBPF_SUCCESS) {
+                return result;
+            }
+        }
+    }
+
+    creations =
+        (ebpf_native_map_creation_t*)ebpf_allocate_with_tag(map_count * sizeof(*creations), EBPF_POOL_TAG_NATIVE);
+    if (creations == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    for (size_t index = 0; index < map_count; index++) {
+        if (maps[index]->reused) {
+            continue;
+        }
+        creations[creation_count].batch = &batch;
+        creations[creation_count].native_map = maps[index];
+        if (maps[index]->inner_map == NULL) {
+            concurrent_count++;
+        }
+        creation_count++;
+    }
+
+    KeInitializeEvent(&batch.completion_event, NotificationEvent, FALSE);
+    // Hold one count for the calling thread so the event is not set until every work item has been queued.
+    batch.pending_count = 1;
+    for (size_t index = 0; index < creation_count; index++) {
+        ebpf_native_map_creation_t* creation = &creations[index];
+        cxplat_preemptible_work_item_t* work_item = NULL;
+
+        if (concurrent_count > 1 && creation->native_map->inner_map == NULL &&
+            ebpf_allocate_preemptible_work_item(&work_item, _ebpf_native_create_map_work_item, creation) ==
+                EBPF_SUCCESS) {
+            ebpf_interlocked_increment_int32(&batch.pending_count);
+            cxplat_queue_preemptible_work_item(work_item);
+        } else {
+            // Create the map inline if it needs an inner map template or the work item could not be allocated.
+            creation->result = _ebpf_native_create_map_object(creation->native_map, &creation->map);
+        }
+    }
+    if (ebpf_interlocked_decrement_int32(&batch.pending_count) != 0) {
+        KeWaitForSingleObject(&batch.completion_event, Executive, KernelMode, FALSE, NULL);
+    }
+
+    for (size_t index = 0; index < creation_count; index++) {
+        ebpf_native_map_creation_t* creation = &creations[index];
+        ebpf_native_map_t* native_map = creation->native_map;
+
+        if (result == EBPF_SUCCESS) {
+            result = creation->result;
+        }
+        if (result == EBPF_SUCCESS) {
+            result = ebpf_handle_create(&native_map->handle, (ebpf_base_object_t*)creation->map);
+        }
+        // The handle holds its own reference, and any map not given a handle is freed here.
+        if (creation->result == EBPF_SUCCESS) {
+            EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)creation->map);
+        }
+        if (result != EBPF_SUCCESS) {
+            continue;
+        }
+
+        // If pin_path is set and the map is not yet pinned, pin it now.
+        if (native_map->pin_path.value != NULL && !native_map->pinned) {
+            result = ebpf_core_update_pinning(native_map->handle, &native_map->pin_path);
+            if (result == EBPF_SUCCESS) {
+                native_map->pinned = true;
+            }
+        }
+    }
+
+    ebpf_free(creations);
+    return result;
+}
+
 static ebpf_result_t
 _ebpf_native_create_maps(_Inout_ ebpf_native_module_instance_t* instance)
 {
     EBPF_LOG_ENTRY();
     ebpf_result_t result = EBPF_SUCCESS;
     ebpf_native_map_t* native_maps = NULL;
+    ebpf_native_map_t** batch = NULL;
     map_entry_t* maps = NULL;
     size_t map_count = 0;
-    cxplat_utf8_string_t map_name = {0};
-    ebpf_map_definition_in_memory_t map_definition = {0};
     const ebpf_native_module_t* module = instance->module;
 
     // Get the maps
@@ -1506,9 +1672,21 @@ _ebpf_native_create_maps(_Inout_ ebpf_native_module_instance_t* instance)
         goto Done;
     }
 
-    for (uint32_t count = 0; count < map_count; count++) {
-        ebpf_native_map_t* native_map = _ebpf_native_get_next_map_to_create(native_maps, map_count);
-        if (native_map == NULL) {
+    batch = (ebpf_native_map_t**)ebpf_allocate_with_tag(map_count * sizeof(ebpf_native_map_t*), EBPF_POOL_TAG_NATIVE);
+    if (batch == NULL) {
+        result = EBPF_NO_MEMORY;
+        goto Done;
+    }
+
+    // Create the maps in batches. Each batch holds every map whose inner map template, if any, already exists.
+    for (size_t remaining_count = map_count; remaining_count > 0;) {
+        size_t batch_count = 0;
+        for (uint32_t i = 0; i < map_count; i++) {
+            if (_ebpf_native_is_map_ready_to_create(native_maps, map_count, &native_maps[i])) {
+                batch[batch_count++] = &native_maps[i];
+            }
+        }
+        if (batch_count == 0) {
             // Any remaining maps cannot be created.
             result = EBPF_INVALID_OBJECT;
             EBPF_LOG_MESSAGE_GUID(
@@ -1519,45 +1697,11 @@ _ebpf_native_create_maps(_Inout_ ebpf_native_module_instance_t* instance)
             break;
         }
 
-        if (native_map->entry.definition.pinning == LIBBPF_PIN_BY_NAME) {
-            result = _ebpf_native_reuse_map(native_map);
-            if (result != EBPF_SUCCESS) {
-                break;
-            }
-            if (native_map->reused) {
-                continue;
-            }
-        }
-
-        ebpf_handle_t inner_map_handle = (native_map->inner_map) ? native_map->inner_map->handle : ebpf_handle_invalid;
-        map_name.length = strlen(native_map->entry.name);
-        map_name.value = (uint8_t*)ebpf_allocate_with_tag(map_name.length, EBPF_POOL_TAG_NATIVE);
-        if (map_name.value == NULL) {
-            result = EBPF_NO_MEMORY;
-            break;
-        }
-        memcpy(map_name.value, native_map->entry.name, map_name.length);
-        map_definition.type = native_map->entry.definition.type;
-        map_definition.key_size = native_map->entry.definition.key_size;
-        map_definition.value_size = native_map->entry.definition.value_size;
-        map_definition.max_entries = native_map->entry.definition.max_entries;
-
-        result = ebpf_core_create_map(&map_name, &map_definition, inner_map_handle, &native_map->handle);
+        result = _ebpf_native_create_map_batch(batch, batch_count);
         if (result != EBPF_SUCCESS) {
             break;
         }
-
-        ebpf_free(map_name.value);
-        map_name.value = NULL;
-
-        // If pin_path is set and the map is not yet pinned, pin it now.
-        if (native_map->pin_path.value != NULL && !native_map->pinned) {
-            result = ebpf_core_update_pinning(native_map->handle, &native_map->pin_path);
-            if (result != EBPF_SUCCESS) {
-                break;
-            }
-            native_map->pinned = true;
-        }
+        remaining_count -= batch_count;
     }
 
 Done:
@@ -1566,9 +1710,7 @@ Done:
         instance->maps = NULL;
         instance->map_count = 0;
     }
-    if (map_name.value != NULL) {
-        ebpf_free(map_name.value);
-    }
+    ebpf_free(batch);
 
     EBPF_RETURN_RESULT(result);
 }
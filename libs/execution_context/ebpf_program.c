@@ -18,6 +18,7 @@
 #include "ebpf_program_types.h"
 #include "ebpf_shared_framework.h"
 #include "ebpf_state.h"
+#include "ebpf_statistics.h"
 #include "ebpf_tracelog.h"
 #include "ubpf.h"
 
@@ -25,6 +26,7 @@
 
 static size_t _ebpf_program_state_index = MAXUINT64;
 #define EBPF_MAX_HASH_SIZE 128
+#define EBPF_PROGRAM_INFORMATION_CACHE_MAX_ENTRIES 256
 
 // Global flag to disable invoking programs. This is used when fuzzing the IOCTL interface.
 bool ebpf_program_disable_invoke = false;
@@ -194,25 +196,417 @@ _ebpf_program_update_jit_helpers(
 _Requires_lock_held_(program->lock) static ebpf_result_t _ebpf_program_get_helper_function_address(
     _In_ const ebpf_program_t* program, const uint32_t helper_function_id, _Out_ helper_function_address_t* address);
 
-_Must_inspect_result_ ebpf_result_t
-ebpf_program_initiate()
+_IRQL_requires_max_(PASSIVE_LEVEL) static ebpf_result_t _ebpf_program_compute_program_information_hash(
+    _In_ const uint32_t* actual_helper_ids,
+    size_t count_of_actual_helper_ids,
+    _In_ const ebpf_program_data_t* general_program_information_data,
+    _In_ const ebpf_program_data_t* extension_program_data,
+    _In_ const cxplat_utf8_string_t* hash_algorithm,
+    _Outptr_ uint8_t** hash,
+    _Out_ size_t* hash_length);
+
+/**
+ * @brief Program information hash and helper function addresses computed for one set of helper function ids of a
+ * program type. Reloading a native module creates new programs that resolve the same helper function ids against the
+ * same provider, so the results are kept until a program information provider attaches or detaches.
+ *
+ * The helper function ids, the helper function addresses and the hash algorithm name follow the entry in the same
+ * allocation.
+ */
+typedef struct _ebpf_program_information_cache_entry
+{
+    ebpf_list_entry_t list_entry;
+    ebpf_program_type_t program_type;
+    cxplat_utf8_string_t hash_algorithm;
+    size_t helper_function_count;
+    uint32_t* helper_function_ids;
+    helper_function_address_t* helper_function_addresses; ///< Valid only if addresses_valid is set.
+    bool addresses_valid;
+    size_t hash_length; ///< Zero if the hash has not been computed.
+    uint8_t hash[EBPF_MAX_HASH_SIZE];
+} ebpf_program_information_cache_entry_t;
+
+/**
+ * @brief Binding of the cache client to one program information provider.
+ */
+typedef struct _ebpf_program_information_cache_binding
+{
+    ebpf_list_entry_t list_entry;
+    ebpf_program_type_t program_type; ///< Module ID of the provider.
+} ebpf_program_information_cache_binding_t;
+
+typedef struct _ebpf_program_information_cache_key
 {
-    return ebpf_state_allocate_index(&_ebpf_program_state_index);
+    const ebpf_program_type_t* program_type;
+    const cxplat_utf8_string_t* hash_algorithm;
+    size_t helper_function_count;
+    _Field_size_(helper_function_count) const uint32_t* helper_function_ids;
+} ebpf_program_information_cache_key_t;
+
+static ebpf_lock_t _ebpf_program_information_cache_lock;
+// List of ebpf_program_information_cache_entry_t, least recently used first.
+static _Guarded_by_(_ebpf_program_information_cache_lock) ebpf_list_entry_t _ebpf_program_information_cache;
+static _Guarded_by_(_ebpf_program_information_cache_lock) size_t _ebpf_program_information_cache_count = 0;
+// List of ebpf_program_information_cache_binding_t. Results are only cached for program types whose provider is bound,
+// so a program that is still using the data of a detaching provider can not add it to the cache.
+static _Guarded_by_(_ebpf_program_information_cache_lock) ebpf_list_entry_t _ebpf_program_information_cache_bindings;
+// Incremented each time the cache is flushed. A result computed while the generation changed may come from a provider
+// that has since detached, so it is not added to the cache.
+static _Guarded_by_(_ebpf_program_information_cache_lock) uint64_t _ebpf_program_information_cache_generation = 0;
+static HANDLE _ebpf_program_information_cache_nmr_handle = NULL;
+
+static const NPI_MODULEID _ebpf_program_information_cache_module_id = {
+    sizeof(_ebpf_program_information_cache_module_id),
+    MIT_GUID,
+    {
+        /* 5a0b2c6e-93d4-4f1e-8c57-2e7f1b3d9a40 */
+        0x5a0b2c6e,
+        0x93d4,
+        0x4f1e,
+        {0x8c, 0x57, 0x2e, 0x7f, 0x1b, 0x3d, 0x9a, 0x40},
+    },
+};
+
+static NPI_CLIENT_ATTACH_PROVIDER_FN _ebpf_program_information_cache_attach_provider;
+static NPI_CLIENT_DETACH_PROVIDER_FN _ebpf_program_information_cache_detach_provider;
+
+// Client that stays attached to every program information provider so that the cache is flushed whenever a provider
+// deregisters.
+static const NPI_CLIENT_CHARACTERISTICS _ebpf_program_information_cache_client_characteristics = {
+    0,
+    sizeof(_ebpf_program_information_cache_client_characteristics),
+    _ebpf_program_information_cache_attach_provider,
+    _ebpf_program_information_cache_detach_provider,
+    NULL,
+    {
+        0,
+        sizeof(NPI_REGISTRATION_INSTANCE),
+        &EBPF_PROGRAM_INFO_EXTENSION_IID,
+        &_ebpf_program_information_cache_module_id,
+        0,
+        NULL,
+    },
+};
+
+static void
+_ebpf_program_information_cache_flush()
+{
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_program_information_cache_lock);
+    _ebpf_program_information_cache_generation++;
+    while (!ebpf_list_is_empty(&_ebpf_program_information_cache)) {
+        ebpf_list_entry_t* list_entry = ebpf_list_remove_head_entry(&_ebpf_program_information_cache);
+        ebpf_free(CONTAINING_RECORD(list_entry, ebpf_program_information_cache_entry_t, list_entry));
+    }
+    _ebpf_program_information_cache_count = 0;
+    ebpf_lock_unlock(&_ebpf_program_information_cache_lock, state);
 }
 
-void
-ebpf_program_terminate()
+static NTSTATUS
+_ebpf_program_information_cache_attach_provider(
+    _In_ HANDLE nmr_binding_handle,
+    _In_ void* client_context,
+    _In_ const NPI_REGISTRATION_INSTANCE* provider_registration_instance)
+{
+    UNREFERENCED_PARAMETER(client_context);
+    void* provider_binding_context;
+    const void* provider_dispatch;
+
+    if (provider_registration_instance->ModuleId->Type != MIT_GUID) {
+        return STATUS_NOINTERFACE;
+    }
+
+    ebpf_program_information_cache_binding_t* binding = (ebpf_program_information_cache_binding_t*)
+        ebpf_allocate_with_tag(sizeof(ebpf_program_information_cache_binding_t), EBPF_POOL_TAG_PROGRAM);
+    if (binding == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+    binding->program_type = provider_registration_instance->ModuleId->Guid;
+
+    NTSTATUS status = NmrClientAttachProvider(
+        nmr_binding_handle,
+        binding,
+        &_ebpf_program_information_client_dispatch_table,
+        &provider_binding_context,
+        &provider_dispatch);
+    if (!NT_SUCCESS(status)) {
+        // Results for this program type are not cached, as the cache would not learn when the provider detaches.
+        EBPF_LOG_MESSAGE_NTSTATUS(
+            EBPF_TRACELOG_LEVEL_ERROR,
+            EBPF_TRACELOG_KEYWORD_PROGRAM,
+            "NmrClientAttachProvider failed for program information cache.",
+            status);
+        ebpf_free(binding);
+        return status;
+    }
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_program_information_cache_lock);
+    ebpf_list_insert_tail(&_ebpf_program_information_cache_bindings, &binding->list_entry);
+    ebpf_lock_unlock(&_ebpf_program_information_cache_lock, state);
+    return status;
+}
+
+static NTSTATUS
+_ebpf_program_information_cache_detach_provider(_In_ void* client_binding_context)
 {
+    ebpf_program_information_cache_binding_t* binding =
+        (ebpf_program_information_cache_binding_t*)client_binding_context;
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_program_information_cache_lock);
+    ebpf_list_remove_entry(&binding->list_entry);
+    ebpf_lock_unlock(&_ebpf_program_information_cache_lock, state);
+    ebpf_free(binding);
+
+    // Programs may still be attached to the provider, but nothing computed from its data is added from now on.
+    _ebpf_program_information_cache_flush();
+    return STATUS_SUCCESS;
 }
 
-_IRQL_requires_max_(PASSIVE_LEVEL) static ebpf_result_t _ebpf_program_compute_program_information_hash(
+_Requires_lock_held_(_ebpf_program_information_cache_lock) static bool _ebpf_program_information_cache_is_bound(
+    _In_ const ebpf_program_type_t* program_type)
+{
+    for (ebpf_list_entry_t* list_entry = _ebpf_program_information_cache_bindings.Flink;
+         list_entry != &_ebpf_program_information_cache_bindings;
+         list_entry = list_entry->Flink) {
+        ebpf_program_information_cache_binding_t* binding =
+            CONTAINING_RECORD(list_entry, ebpf_program_information_cache_binding_t, list_entry);
+        if (memcmp(&binding->program_type, program_type, sizeof(*program_type)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+_Requires_lock_held_(_ebpf_program_information_cache_lock) static ebpf_program_information_cache_entry_t*
+    _ebpf_program_information_cache_find(_In_ const ebpf_program_information_cache_key_t* key)
+{
+    for (ebpf_list_entry_t* list_entry = _ebpf_program_information_cache.Flink;
+         list_entry != &_ebpf_program_information_cache;
+         list_entry = list_entry->Flink) {
+        ebpf_program_information_cache_entry_t* entry =
+            CONTAINING_RECORD(list_entry, ebpf_program_information_cache_entry_t, list_entry);
+        if (entry->helper_function_count == key->helper_function_count &&
+            entry->hash_algorithm.length == key->hash_algorithm->length &&
+            memcmp(&entry->program_type, key->program_type, sizeof(entry->program_type)) == 0 &&
+            memcmp(
+                entry->helper_function_ids,
+                key->helper_function_ids,
+                key->helper_function_count * sizeof(uint32_t)) == 0 &&
+            memcmp(entry->hash_algorithm.value, key->hash_algorithm->value, key->hash_algorithm->length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Look up the cached results for a set of helper function ids.
+ *
+ * @param[in] key Program type, hash algorithm and helper function ids to look up.
+ * @param[out] hash Buffer of EBPF_MAX_HASH_SIZE bytes that receives the hash, or NULL if the hash is not needed.
+ * @param[out] hash_length Length of the hash.
+ * @param[out] addresses Array that receives the helper function addresses, or NULL if they are not needed.
+ * @param[out] generation Cache generation to pass to _ebpf_program_information_cache_update on a miss.
+ * @retval true Every requested result was found.
+ * @retval false At least one requested result was not found.
+ */
+static bool
+_ebpf_program_information_cache_lookup(
+    _In_ const ebpf_program_information_cache_key_t* key,
+    _Out_writes_bytes_opt_(EBPF_MAX_HASH_SIZE) uint8_t* hash,
+    _Out_ size_t* hash_length,
+    _Out_writes_opt_(key->helper_function_count) helper_function_address_t* addresses,
+    _Out_ uint64_t* generation)
+{
+    bool found = false;
+    *hash_length = 0;
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_program_information_cache_lock);
+    *generation = _ebpf_program_information_cache_generation;
+    ebpf_program_information_cache_entry_t* entry = _ebpf_program_information_cache_find(key);
+    if (entry == NULL) {
+        goto Exit;
+    }
+    if ((hash != NULL && entry->hash_length == 0) || (addresses != NULL && !entry->addresses_valid)) {
+        goto Exit;
+    }
+    if (hash != NULL) {
+        memcpy(hash, entry->hash, entry->hash_length);
+        *hash_length = entry->hash_length;
+    }
+    if (addresses != NULL) {
+        memcpy(addresses, entry->helper_function_addresses, key->helper_function_count * sizeof(*addresses));
+    }
+    // Keep the most recently used entries at the tail so that eviction removes the least recently used one.
+    ebpf_list_remove_entry(&entry->list_entry);
+    ebpf_list_insert_tail(&_ebpf_program_information_cache, &entry->list_entry);
+    found = true;
+
+Exit:
+    ebpf_lock_unlock(&_ebpf_program_information_cache_lock, state);
+    return found;
+}
+
+/**
+ * @brief Add results for a set of helper function ids to the cache. The results are dropped if the cache was flushed
+ * since the lookup that returned generation, or if no provider of the program type is bound to the cache.
+ *
+ * @param[in] key Program type, hash algorithm and helper function ids the results were computed for.
+ * @param[in] generation Generation returned by _ebpf_program_information_cache_lookup.
+ * @param[in] hash Program information hash, or NULL.
+ * @param[in] hash_length Length of the hash.
+ * @param[in] addresses Helper function addresses, or NULL.
+ */
+static void
+_ebpf_program_information_cache_update(
+    _In_ const ebpf_program_information_cache_key_t* key,
+    uint64_t generation,
+    _In_reads_bytes_opt_(hash_length) const uint8_t* hash,
+    size_t hash_length,
+    _In_reads_opt_(key->helper_function_count) const helper_function_address_t* addresses)
+{
+    ebpf_program_information_cache_entry_t* evicted_entry = NULL;
+    if (hash_length > EBPF_MAX_HASH_SIZE) {
+        return;
+    }
+
+    // Build the entry before taking the lock, it is freed below if an entry for the key already exists.
+    size_t addresses_size = key->helper_function_count * sizeof(helper_function_address_t);
+    size_t ids_size = key->helper_function_count * sizeof(uint32_t);
+    ebpf_program_information_cache_entry_t* new_entry = (ebpf_program_information_cache_entry_t*)ebpf_allocate_with_tag(
+        sizeof(*new_entry) + addresses_size + ids_size + key->hash_algorithm->length, EBPF_POOL_TAG_PROGRAM);
+    if (new_entry == NULL) {
+        return;
+    }
+    new_entry->program_type = *key->program_type;
+    new_entry->helper_function_count = key->helper_function_count;
+    new_entry->helper_function_addresses = (helper_function_address_t*)(new_entry + 1);
+    new_entry->helper_function_ids = (uint32_t*)((uint8_t*)new_entry->helper_function_addresses + addresses_size);
+    memcpy(new_entry->helper_function_ids, key->helper_function_ids, ids_size);
+    new_entry->hash_algorithm.value = (uint8_t*)new_entry->helper_function_ids + ids_size;
+    new_entry->hash_algorithm.length = key->hash_algorithm->length;
+    memcpy(new_entry->hash_algorithm.value, key->hash_algorithm->value, key->hash_algorithm->length);
+
+    ebpf_lock_state_t state = ebpf_lock_lock(&_ebpf_program_information_cache_lock);
+    if (generation != _ebpf_program_information_cache_generation ||
+        !_ebpf_program_information_cache_is_bound(key->program_type)) {
+        goto Exit;
+    }
+    ebpf_program_information_cache_entry_t* entry = _ebpf_program_information_cache_find(key);
+    if (entry == NULL) {
+        if (_ebpf_program_information_cache_count == EBPF_PROGRAM_INFORMATION_CACHE_MAX_ENTRIES) {
+            evicted_entry = CONTAINING_RECORD(
+                ebpf_list_remove_head_entry(&_ebpf_program_information_cache),
+                ebpf_program_information_cache_entry_t,
+                list_entry);
+            _ebpf_program_information_cache_count--;
+        }
+        entry = new_entry;
+        new_entry = NULL;
+        ebpf_list_insert_tail(&_ebpf_program_information_cache, &entry->list_entry);
+        _ebpf_program_information_cache_count++;
+    }
+    if (hash != NULL) {
+        memcpy(entry->hash, hash, hash_length);
+        entry->hash_length = hash_length;
+    }
+    if (addresses != NULL) {
+        memcpy(entry->helper_function_addresses, addresses, addresses_size);
+        entry->addresses_valid = true;
+    }
+
+Exit:
+    ebpf_lock_unlock(&_ebpf_program_information_cache_lock, state);
+    ebpf_free(new_entry);
+    ebpf_free(evicted_entry);
+}
+
+/**
+ * @brief Compute the program information hash for a set of helper function ids, or return the cached hash if the
+ * same program type, hash algorithm and helper function ids were hashed since the provider attached.
+ */
+_IRQL_requires_max_(PASSIVE_LEVEL) static ebpf_result_t _ebpf_program_get_program_information_hash(
+    _In_ const ebpf_program_type_t* program_type,
     _In_ const uint32_t* actual_helper_ids,
     size_t count_of_actual_helper_ids,
     _In_ const ebpf_program_data_t* general_program_information_data,
     _In_ const ebpf_program_data_t* extension_program_data,
     _In_ const cxplat_utf8_string_t* hash_algorithm,
     _Outptr_ uint8_t** hash,
-    _Out_ size_t* hash_length);
+    _Out_ size_t* hash_length)
+{
+    const ebpf_program_information_cache_key_t key = {
+        program_type, hash_algorithm, count_of_actual_helper_ids, actual_helper_ids};
+    uint8_t cached_hash[EBPF_MAX_HASH_SIZE];
+    size_t cached_hash_length;
+    uint64_t generation;
+
+    if (_ebpf_program_information_cache_lookup(&key, cached_hash, &cached_hash_length, NULL, &generation)) {
+        *hash = (uint8_t*)ebpf_allocate_with_tag(cached_hash_length, EBPF_POOL_TAG_PROGRAM);
+        if (*hash == NULL) {
+            return EBPF_NO_MEMORY;
+        }
+        memcpy(*hash, cached_hash, cached_hash_length);
+        *hash_length = cached_hash_length;
+        return EBPF_SUCCESS;
+    }
+
+    ebpf_result_t result = _ebpf_program_compute_program_information_hash(
+        actual_helper_ids,
+        count_of_actual_helper_ids,
+        general_program_information_data,
+        extension_program_data,
+        hash_algorithm,
+        hash,
+        hash_length);
+    if (result == EBPF_SUCCESS) {
+        _ebpf_program_information_cache_update(&key, generation, *hash, *hash_length, NULL);
+    }
+    return result;
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_program_initiate()
+{
+    ebpf_result_t result = ebpf_state_allocate_index(&_ebpf_program_state_index);
+    if (result != EBPF_SUCCESS) {
+        return result;
+    }
+
+    ebpf_lock_create(&_ebpf_program_information_cache_lock);
+    ebpf_list_initialize(&_ebpf_program_information_cache);
+    ebpf_list_initialize(&_ebpf_program_information_cache_bindings);
+    NTSTATUS status = NmrRegisterClient(
+        &_ebpf_program_information_cache_client_characteristics, NULL, &_ebpf_program_information_cache_nmr_handle);
+    if (!NT_SUCCESS(status)) {
+        EBPF_LOG_MESSAGE_NTSTATUS(
+            EBPF_TRACELOG_LEVEL_ERROR,
+            EBPF_TRACELOG_KEYWORD_PROGRAM,
+            "NmrRegisterClient failed for program information cache.",
+            status);
+        // ebpf_program_terminate only releases the cache once the client is registered, so undo the setup here.
+        _ebpf_program_information_cache_nmr_handle = NULL;
+        ebpf_lock_destroy(&_ebpf_program_information_cache_lock);
+        _ebpf_program_state_index = MAXUINT64;
+        return _ntstatus_to_ebpf_result(status);
+    }
+    return EBPF_SUCCESS;
+}
+
+void
+ebpf_program_terminate()
+{
+    if (_ebpf_program_information_cache_nmr_handle) {
+        NTSTATUS status = NmrDeregisterClient(_ebpf_program_information_cache_nmr_handle);
+        if (status == STATUS_PENDING) {
+            NmrWaitForClientDeregisterComplete(_ebpf_program_information_cache_nmr_handle);
+        } else {
+            ebpf_assert(NT_SUCCESS(status));
+        }
+        _ebpf_program_information_cache_nmr_handle = NULL;
+        _ebpf_program_information_cache_flush();
+        ebpf_lock_destroy(&_ebpf_program_information_cache_lock);
+    }
+}
 
 static bool
 _ebpf_program_match_provider_data_module_id(_In_ const PNPI_MODULEID npi_module_id, _In_ const GUID* expected_module_id)
@@ -488,7 +882,8 @@ _ebpf_program_type_specific_program_information_attach_provider(
     if (actual_helper_ids_set) {
         // Compute the hash of the program information. This requires passive IRQL
         // and must be done outside the lock.
-        if (_ebpf_program_compute_program_information_hash(
+        if (_ebpf_program_get_program_information_hash(
+                &program->parameters.program_type,
                 actual_helper_function_ids,
                 actual_helper_function_count,
                 general_program_information_data,
@@ -1597,6 +1992,7 @@ ebpf_program_invoke(
         } else {
             current_program = execution_state->tail_call_state.next_program;
             execution_state->tail_call_state.next_program = NULL;
+            EBPF_STATISTICS_INCREMENT(tail_call_count);
         }
     }
     return EBPF_SUCCESS;
@@ -1754,12 +2150,25 @@ ebpf_program_get_helper_function_addresses(
     EBPF_LOG_ENTRY();
     ebpf_result_t result = EBPF_SUCCESS;
     ebpf_lock_state_t state = ebpf_lock_lock((ebpf_lock_t*)&program->lock);
+    const ebpf_program_information_cache_key_t key = {
+        &program->parameters.program_type,
+        &program->parameters.program_info_hash_type,
+        program->helper_function_count,
+        program->helper_function_ids};
+    // JIT programs call helpers through their own trampoline table, so only native programs share addresses.
+    bool use_cache = program->parameters.code_type == EBPF_CODE_NATIVE && program->helper_function_count > 0;
+    uint64_t generation = 0;
+    size_t hash_length;
 
     if (program->helper_function_count > addresses_count) {
         result = EBPF_INSUFFICIENT_BUFFER;
         goto Exit;
     }
 
+    if (use_cache && _ebpf_program_information_cache_lookup(&key, NULL, &hash_length, addresses, &generation)) {
+        goto Exit;
+    }
+
     for (uint32_t index = 0; index < program->helper_function_count; index++) {
         result =
             _ebpf_program_get_helper_function_address(program, program->helper_function_ids[index], &addresses[index]);
@@ -1768,6 +2177,10 @@ ebpf_program_get_helper_function_addresses(
         }
     }
 
+    if (use_cache && result == EBPF_SUCCESS) {
+        _ebpf_program_information_cache_update(&key, generation, NULL, 0, addresses);
+    }
+
 Exit:
     ebpf_lock_unlock((ebpf_lock_t*)&program->lock, state);
     EBPF_RETURN_RESULT(result);
@@ -1881,7 +2294,8 @@ ebpf_program_set_program_info_hash(_Inout_ ebpf_program_t* program)
     lock_held = false;
 
     // Compute the hash of the program information. This requires passive IRQL and must be done outside the lock.
-    result = _ebpf_program_compute_program_information_hash(
+    result = _ebpf_program_get_program_information_hash(
+        &program->parameters.program_type,
         actual_helper_function_ids,
         actual_helper_function_count,
         general_program_information_data,
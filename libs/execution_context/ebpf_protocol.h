@@ -55,6 +55,10 @@ typedef enum _ebpf_operation_id
     EBPF_OPERATION_RING_BUFFER_MAP_UNMAP_BUFFER,
     EBPF_OPERATION_EPOCH_SYNCHRONIZE,
     EBPF_OPERATION_LINK_SET_LEGACY_MODE,
+    EBPF_OPERATION_GET_RUNTIME_STATISTICS,
+    EBPF_OPERATION_MAP_CREATE_SHADOW,
+    EBPF_OPERATION_MAP_PUBLISH_SHADOW,
+    EBPF_OPERATION_MAP_SET_TIME_TO_LIVE,
 } ebpf_operation_id_t;
 
 typedef enum _ebpf_code_type
@@ -622,4 +626,42 @@ typedef struct _ebpf_operation_link_set_legacy_mode_request
 {
     struct _ebpf_operation_header header;
     ebpf_handle_t link_handle;
-} ebpf_operation_link_set_legacy_mode_request_t;
\ No newline at end of file
+} ebpf_operation_link_set_legacy_mode_request_t;
+
+typedef struct _ebpf_operation_get_runtime_statistics_request
+{
+    struct _ebpf_operation_header header;
+} ebpf_operation_get_runtime_statistics_request_t;
+
+typedef struct _ebpf_operation_get_runtime_statistics_reply
+{
+    struct _ebpf_operation_header header;
+    ebpf_runtime_statistics_t statistics;
+} ebpf_operation_get_runtime_statistics_reply_t;
+
+typedef struct _ebpf_operation_map_create_shadow_request
+{
+    struct _ebpf_operation_header header;
+    ebpf_handle_t handle;
+    bool copy_forward;
+} ebpf_operation_map_create_shadow_request_t;
+
+typedef struct _ebpf_operation_map_create_shadow_reply
+{
+    struct _ebpf_operation_header header;
+    ebpf_handle_t shadow_handle;
+} ebpf_operation_map_create_shadow_reply_t;
+
+typedef struct _ebpf_operation_map_publish_shadow_request
+{
+    struct _ebpf_operation_header header;
+    ebpf_handle_t handle;
+    ebpf_handle_t shadow_handle;
+} ebpf_operation_map_publish_shadow_request_t;
+
+typedef struct _ebpf_operation_map_set_time_to_live_request
+{
+    struct _ebpf_operation_header header;
+    ebpf_handle_t handle;
+    uint32_t time_to_live_in_ms;
+} ebpf_operation_map_set_time_to_live_request_t;
@@ -6,6 +6,7 @@
 #include "catch_wrapper.hpp"
 #include "ebpf_async.h"
 #include "ebpf_core.h"
+#include "ebpf_epoch.h"
 #include "ebpf_maps.h"
 #include "ebpf_object.h"
 #include "ebpf_program.h"
@@ -14,9 +15,11 @@
 #include "helpers.h"
 #include "test_helper.hpp"
 
+#include <atomic>
 #include <iomanip>
 #include <optional>
 #include <set>
+#include <thread>
 
 extern "C"
 {
@@ -108,6 +111,13 @@ _test_crud_operations(ebpf_map_type_t map_type)
         run_at_dpc = true;
         error_on_full = EBPF_OUT_OF_SPACE;
         break;
+    case BPF_MAP_TYPE_HASH_TTL:
+        is_array = false;
+        supports_find_and_delete = true;
+        behavior_on_max_entries = MAP_BEHAVIOR_INSERT;
+        run_at_dpc = false;
+        error_on_full = EBPF_OUT_OF_SPACE;
+        break;
     default:
         ebpf_assert((false, "Unsupported map type"));
         return;
@@ -321,6 +331,255 @@ MAP_TEST(BPF_MAP_TYPE_PERCPU_HASH);
 MAP_TEST(BPF_MAP_TYPE_PERCPU_ARRAY);
 MAP_TEST(BPF_MAP_TYPE_LRU_HASH);
 MAP_TEST(BPF_MAP_TYPE_LRU_PERCPU_HASH);
+MAP_TEST(BPF_MAP_TYPE_HASH_TTL);
+
+TEST_CASE("map_percpu_hash_slot_reuse", "[execution_context]")
+{
+    _ebpf_core_initializer core;
+    core.initialize();
+
+    if (ebpf_get_cpu_count() < 2) {
+        return;
+    }
+
+    // Several slabs worth of entries.
+    const uint32_t entry_count = 256;
+    ebpf_map_definition_in_memory_t map_definition{
+        BPF_MAP_TYPE_PERCPU_HASH, sizeof(uint32_t), sizeof(uint64_t), entry_count};
+    map_ptr map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) == EBPF_SUCCESS);
+        map.reset(local_map);
+    }
+
+    // Insert every key from the given CPU, as a program would.
+    auto fill = [&](uint32_t cpu) {
+        emulate_dpc_t dpc(cpu);
+        for (uint32_t key = 0; key < entry_count; key++) {
+            uint64_t value = static_cast<uint64_t>(key) + 1;
+            REQUIRE(
+                ebpf_map_update_entry(
+                    map.get(),
+                    0,
+                    reinterpret_cast<const uint8_t*>(&key),
+                    0,
+                    reinterpret_cast<const uint8_t*>(&value),
+                    EBPF_ANY,
+                    EBPF_MAP_FLAG_HELPER) == EBPF_SUCCESS);
+        }
+    };
+
+    // Return the address of each key's value on the given CPU, checking the value it holds.
+    auto collect = [&](uint32_t cpu, bool expect_value) {
+        emulate_dpc_t dpc(cpu);
+        std::set<uint8_t*> addresses;
+        for (uint32_t key = 0; key < entry_count; key++) {
+            uint8_t* value = nullptr;
+            REQUIRE(
+                ebpf_map_find_entry(
+                    map.get(),
+                    0,
+                    reinterpret_cast<const uint8_t*>(&key),
+                    0,
+                    reinterpret_cast<uint8_t*>(&value),
+                    EBPF_MAP_FLAG_HELPER) == EBPF_SUCCESS);
+            REQUIRE(*reinterpret_cast<uint64_t*>(value) == (expect_value ? static_cast<uint64_t>(key) + 1 : 0));
+            addresses.insert(value);
+        }
+        return addresses;
+    };
+
+    fill(0);
+    std::set<uint8_t*> cpu_1_addresses = collect(1, false);
+    REQUIRE(cpu_1_addresses.size() == entry_count);
+
+    {
+        emulate_dpc_t dpc(0);
+        for (uint32_t key = 0; key < entry_count; key++) {
+            REQUIRE(
+                ebpf_map_delete_entry(map.get(), 0, reinterpret_cast<const uint8_t*>(&key), EBPF_MAP_FLAG_HELPER) ==
+                EBPF_SUCCESS);
+        }
+    }
+
+    // The retired slots are returned to the free list by epoch work items queued on CPU 0, one batch at a time.
+    {
+        scoped_cpu_affinity affinity(0);
+        for (size_t retry = 0; retry < 100 && !ebpf_epoch_is_free_list_empty(0); retry++) {
+            ebpf_epoch_synchronize();
+        }
+        REQUIRE(ebpf_epoch_is_free_list_empty(0));
+    }
+
+    // Refill from the other CPU. Every entry must land in a reclaimed slot, with the stale values cleared.
+    fill(1);
+    std::set<uint8_t*> refill_addresses = collect(1, true);
+    REQUIRE(refill_addresses == cpu_1_addresses);
+    (void)collect(0, false);
+}
+
+static size_t
+_count_map_entries(_In_ ebpf_map_t* map)
+{
+    size_t count = 0;
+    uint32_t previous_key;
+    uint32_t next_key;
+    while (ebpf_map_next_key(
+               map,
+               sizeof(next_key),
+               count == 0 ? nullptr : reinterpret_cast<const uint8_t*>(&previous_key),
+               reinterpret_cast<uint8_t*>(&next_key)) == EBPF_SUCCESS) {
+        previous_key = next_key;
+        count++;
+    }
+    return count;
+}
+
+TEST_CASE("map_hash_ttl_expiry", "[execution_context]")
+{
+    _ebpf_core_initializer core;
+    core.initialize();
+    ebpf_map_definition_in_memory_t map_definition{
+        BPF_MAP_TYPE_HASH_TTL, sizeof(uint32_t), sizeof(uint64_t), _test_map_size};
+    map_ptr map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) == EBPF_SUCCESS);
+        map.reset(local_map);
+    }
+    const uint32_t expiring_key_count = 64;
+    uint64_t value = 0;
+
+    // An entry written before the time to live is set never expires.
+    uint32_t key = 0;
+    REQUIRE(
+        ebpf_map_update_entry(
+            map.get(),
+            sizeof(key),
+            reinterpret_cast<const uint8_t*>(&key),
+            sizeof(value),
+            reinterpret_cast<const uint8_t*>(&value),
+            EBPF_ANY,
+            0) == EBPF_SUCCESS);
+
+    REQUIRE(ebpf_map_set_time_to_live(map.get(), 200) == EBPF_SUCCESS);
+    for (key = 1; key <= expiring_key_count; key++) {
+        value = key;
+        REQUIRE(
+            ebpf_map_update_entry(
+                map.get(),
+                sizeof(key),
+                reinterpret_cast<const uint8_t*>(&key),
+                sizeof(value),
+                reinterpret_cast<const uint8_t*>(&value),
+                EBPF_ANY,
+                0) == EBPF_SUCCESS);
+    }
+    key = 1;
+    REQUIRE(
+        ebpf_map_find_entry(
+            map.get(), sizeof(key), reinterpret_cast<const uint8_t*>(&key), sizeof(value), (uint8_t*)&value, 0) ==
+        EBPF_SUCCESS);
+    REQUIRE(value == 1);
+
+    // Lookups stop returning an entry once it expires.
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    REQUIRE(
+        ebpf_map_find_entry(
+            map.get(), sizeof(key), reinterpret_cast<const uint8_t*>(&key), sizeof(value), (uint8_t*)&value, 0) ==
+        EBPF_OBJECT_NOT_FOUND);
+    key = 0;
+    REQUIRE(
+        ebpf_map_find_entry(
+            map.get(), sizeof(key), reinterpret_cast<const uint8_t*>(&key), sizeof(value), (uint8_t*)&value, 0) ==
+        EBPF_SUCCESS);
+
+    // Key iteration skips the expired entries, whether or not the timer wheel has deleted them yet.
+    REQUIRE(_count_map_entries(map.get()) == 1);
+
+    // Updates and deletes also treat an expired entry as not present.
+    auto update = [](ebpf_map_t* target_map, uint32_t entry_key, uint64_t entry_value, ebpf_map_option_t option) {
+        return ebpf_map_update_entry(
+            target_map,
+            sizeof(entry_key),
+            reinterpret_cast<const uint8_t*>(&entry_key),
+            sizeof(entry_value),
+            reinterpret_cast<const uint8_t*>(&entry_value),
+            option,
+            0);
+    };
+    REQUIRE(update(map.get(), 2, 2, EBPF_NOEXIST) == EBPF_SUCCESS);
+    REQUIRE(update(map.get(), 3, 3, EBPF_EXIST) == EBPF_KEY_NOT_FOUND);
+    key = 4;
+    REQUIRE(
+        ebpf_map_delete_entry(map.get(), sizeof(key), reinterpret_cast<const uint8_t*>(&key), 0) == EBPF_KEY_NOT_FOUND);
+    REQUIRE(_count_map_entries(map.get()) == 2);
+
+    // Expired entries that still count toward max_entries are deleted to make room for an insert into a full map.
+    ebpf_map_definition_in_memory_t small_map_definition{
+        BPF_MAP_TYPE_HASH_TTL, sizeof(uint32_t), sizeof(uint64_t), expiring_key_count};
+    map_ptr small_map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &small_map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) ==
+            EBPF_SUCCESS);
+        small_map.reset(local_map);
+    }
+    REQUIRE(ebpf_map_set_time_to_live(small_map.get(), 200) == EBPF_SUCCESS);
+    for (key = 0; key < expiring_key_count; key++) {
+        REQUIRE(update(small_map.get(), key, key, EBPF_NOEXIST) == EBPF_SUCCESS);
+    }
+    REQUIRE(update(small_map.get(), expiring_key_count, 0, EBPF_NOEXIST) == EBPF_OUT_OF_SPACE);
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    for (key = expiring_key_count; key < 2 * expiring_key_count; key++) {
+        REQUIRE(update(small_map.get(), key, key, EBPF_NOEXIST) == EBPF_SUCCESS);
+    }
+    REQUIRE(_count_map_entries(small_map.get()) == expiring_key_count);
+
+    // A map can be deleted while its sweep timer is armed.
+    map_ptr pending_map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) == EBPF_SUCCESS);
+        pending_map.reset(local_map);
+    }
+    REQUIRE(ebpf_map_set_time_to_live(pending_map.get(), 60 * 1000) == EBPF_SUCCESS);
+    key = 1;
+    REQUIRE(
+        ebpf_map_update_entry(
+            pending_map.get(),
+            sizeof(key),
+            reinterpret_cast<const uint8_t*>(&key),
+            sizeof(value),
+            reinterpret_cast<const uint8_t*>(&value),
+            EBPF_ANY,
+            0) == EBPF_SUCCESS);
+    pending_map.reset();
+    ebpf_epoch_synchronize();
+
+    // Only TTL hash maps have a time to live.
+    ebpf_map_definition_in_memory_t hash_map_definition{
+        BPF_MAP_TYPE_HASH, sizeof(uint32_t), sizeof(uint64_t), _test_map_size};
+    map_ptr hash_map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &hash_map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) ==
+            EBPF_SUCCESS);
+        hash_map.reset(local_map);
+    }
+    REQUIRE(ebpf_map_set_time_to_live(hash_map.get(), 200) == EBPF_OPERATION_NOT_SUPPORTED);
+}
 
 TEST_CASE("map_create_invalid", "[execution_context][negative]")
 {
@@ -356,6 +615,15 @@ TEST_CASE("map_create_invalid", "[execution_context][negative]")
                 20,
             },
         },
+        {
+            "BPF_MAP_TYPE_BLOOM_FILTER",
+            {
+                BPF_MAP_TYPE_BLOOM_FILTER,
+                4, // Key size must be 0 for bloom filter.
+                20,
+                20,
+            },
+        },
         {
             "BPF_MAP_TYPE_HASH_OF_MAPS",
             {
@@ -952,6 +1220,104 @@ TEST_CASE("map_crud_operations_queue", "[execution_context]")
         EBPF_INVALID_ARGUMENT);
 }
 
+TEST_CASE("map_queue_single_entry", "[execution_context]")
+{
+    _ebpf_core_initializer core;
+    core.initialize();
+    ebpf_map_definition_in_memory_t map_definition{BPF_MAP_TYPE_QUEUE, 0, sizeof(uint32_t), 1};
+    map_ptr map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) == EBPF_SUCCESS);
+        map.reset(local_map);
+    }
+    uint32_t return_value = MAXUINT32;
+
+    // A queue with a single cell must still tell a full cell from an empty one.
+    for (uint32_t value = 0; value < 3; value++) {
+        REQUIRE(ebpf_map_push_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) == EBPF_SUCCESS);
+        REQUIRE(
+            ebpf_map_push_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) ==
+            EBPF_OUT_OF_SPACE);
+        REQUIRE(
+            ebpf_map_pop_entry(map.get(), sizeof(return_value), reinterpret_cast<uint8_t*>(&return_value), 0) ==
+            EBPF_SUCCESS);
+        REQUIRE(return_value == value);
+        REQUIRE(
+            ebpf_map_peek_entry(map.get(), sizeof(return_value), reinterpret_cast<uint8_t*>(&return_value), 0) ==
+            EBPF_OBJECT_NOT_FOUND);
+    }
+}
+
+TEST_CASE("map_queue_concurrent_push_pop", "[execution_context]")
+{
+    _ebpf_core_initializer core;
+    core.initialize();
+    const uint32_t thread_count = 4;
+    const uint32_t values_per_producer = 10000;
+    ebpf_map_definition_in_memory_t map_definition{BPF_MAP_TYPE_QUEUE, 0, sizeof(uint64_t), 64};
+    map_ptr map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) == EBPF_SUCCESS);
+        map.reset(local_map);
+    }
+
+    // Each value carries its producer in the high half and a sequence number in the low half.
+    std::vector<std::atomic<uint32_t>> pop_counts(thread_count * values_per_producer);
+    std::atomic<uint32_t> total_popped = 0;
+    std::atomic<bool> out_of_order = false;
+    std::vector<std::thread> threads;
+    for (uint32_t producer = 0; producer < thread_count; producer++) {
+        threads.emplace_back([&, producer]() {
+            for (uint32_t sequence = 0; sequence < values_per_producer; sequence++) {
+                uint64_t value = (static_cast<uint64_t>(producer) << 32) | sequence;
+                while (ebpf_map_push_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) ==
+                       EBPF_OUT_OF_SPACE) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (uint32_t consumer = 0; consumer < thread_count; consumer++) {
+        threads.emplace_back([&]() {
+            // A single consumer must see the values of each producer in the order they were pushed.
+            std::vector<int64_t> last_sequence(thread_count, -1);
+            while (total_popped < thread_count * values_per_producer) {
+                uint64_t value;
+                if (ebpf_map_pop_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) !=
+                    EBPF_SUCCESS) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                uint32_t producer = static_cast<uint32_t>(value >> 32);
+                uint32_t sequence = static_cast<uint32_t>(value);
+                if (static_cast<int64_t>(sequence) <= last_sequence[producer]) {
+                    out_of_order = true;
+                }
+                last_sequence[producer] = sequence;
+                pop_counts[producer * values_per_producer + sequence]++;
+                total_popped++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(!out_of_order);
+    for (const auto& count : pop_counts) {
+        REQUIRE(count == 1);
+    }
+    uint64_t value;
+    REQUIRE(
+        ebpf_map_pop_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) == EBPF_OBJECT_NOT_FOUND);
+}
+
 TEST_CASE("map_crud_operations_stack", "[execution_context]")
 {
     _ebpf_core_initializer core;
@@ -1004,6 +1370,88 @@ TEST_CASE("map_crud_operations_stack", "[execution_context]")
         EBPF_OBJECT_NOT_FOUND);
 }
 
+TEST_CASE("map_bloom_filter", "[execution_context]")
+{
+    _ebpf_core_initializer core;
+    core.initialize();
+    const uint32_t max_entries = 1000;
+    ebpf_map_definition_in_memory_t map_definition{BPF_MAP_TYPE_BLOOM_FILTER, 0, sizeof(uint64_t), max_entries};
+    map_ptr map;
+    {
+        ebpf_map_t* local_map;
+        cxplat_utf8_string_t map_name = {0};
+        REQUIRE(
+            ebpf_map_create(&map_name, &map_definition, (uintptr_t)ebpf_handle_invalid, &local_map) == EBPF_SUCCESS);
+        map.reset(local_map);
+    }
+
+    // Even values are added, odd values are not.
+    for (uint64_t value = 0; value < 2 * max_entries; value += 2) {
+        REQUIRE(ebpf_map_push_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) == EBPF_SUCCESS);
+    }
+
+    // A value that was added is always found, and the value passed in is left unchanged.
+    for (uint64_t value = 0; value < 2 * max_entries; value += 2) {
+        uint64_t test_value = value;
+        REQUIRE(
+            ebpf_map_peek_entry(map.get(), sizeof(test_value), reinterpret_cast<uint8_t*>(&test_value), 0) ==
+            EBPF_SUCCESS);
+        REQUIRE(test_value == value);
+    }
+
+    // Values that were not added are found at about the false positive rate the filter is sized for.
+    uint32_t false_positive_count = 0;
+    for (uint64_t value = 1; value < 2 * max_entries; value += 2) {
+        uint64_t test_value = value;
+        ebpf_result_t result =
+            ebpf_map_peek_entry(map.get(), sizeof(test_value), reinterpret_cast<uint8_t*>(&test_value), 0);
+        REQUIRE((result == EBPF_SUCCESS || result == EBPF_OBJECT_NOT_FOUND));
+        if (result == EBPF_SUCCESS) {
+            false_positive_count++;
+        }
+    }
+    REQUIRE(false_positive_count < max_entries / 10);
+
+    // A lookup from user mode passes the value to test as the key.
+    uint64_t value = 0;
+    uint64_t return_value = MAXUINT64;
+    REQUIRE(
+        ebpf_map_find_entry(
+            map.get(),
+            sizeof(value),
+            reinterpret_cast<uint8_t*>(&value),
+            sizeof(return_value),
+            reinterpret_cast<uint8_t*>(&return_value),
+            0) == EBPF_SUCCESS);
+    REQUIRE(return_value == value);
+
+    // Negative tests.
+    REQUIRE(
+        ebpf_map_pop_entry(map.get(), sizeof(return_value), reinterpret_cast<uint8_t*>(&return_value), 0) ==
+        EBPF_OPERATION_NOT_SUPPORTED);
+
+    REQUIRE(
+        ebpf_map_push_entry(map.get(), sizeof(value) - 1, reinterpret_cast<uint8_t*>(&value), 0) ==
+        EBPF_INVALID_ARGUMENT);
+
+    REQUIRE(
+        ebpf_map_push_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), BPF_EXIST) ==
+        EBPF_INVALID_ARGUMENT);
+
+    REQUIRE(
+        ebpf_map_delete_entry(map.get(), sizeof(value), reinterpret_cast<uint8_t*>(&value), 0) ==
+        EBPF_INVALID_ARGUMENT);
+
+    REQUIRE(
+        ebpf_map_find_entry(
+            map.get(),
+            sizeof(value),
+            reinterpret_cast<uint8_t*>(&value),
+            sizeof(return_value),
+            reinterpret_cast<uint8_t*>(&return_value),
+            EBPF_MAP_FIND_FLAG_DELETE) == EBPF_OPERATION_NOT_SUPPORTED);
+}
+
 std::vector<GUID> _program_types = {
     EBPF_PROGRAM_TYPE_BIND, EBPF_PROGRAM_TYPE_CGROUP_SOCK_ADDR, EBPF_PROGRAM_TYPE_SOCK_OPS, EBPF_PROGRAM_TYPE_SAMPLE};
 
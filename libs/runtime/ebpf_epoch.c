@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "ebpf_epoch.h"
+#include "ebpf_statistics.h"
 #include "ebpf_tracelog.h"
 #include "ebpf_work_queue.h"
 
@@ -174,6 +175,7 @@ static KDPC _ebpf_epoch_timer_dpc;
  * There are two types of entries in the free list:
  * 1. Memory allocation. This is a block of memory that is returned to the memory pool.
  * 2. Work item. This is a work item that is invoked at the end of the epoch.
+ * Pool blocks are memory allocations that are returned to their ebpf_epoch_pool_t instead of the memory pool.
  */
 typedef enum _ebpf_epoch_allocation_type
 {
@@ -181,6 +183,7 @@ typedef enum _ebpf_epoch_allocation_type
     EBPF_EPOCH_ALLOCATION_WORK_ITEM,            ///< Work item.
     EBPF_EPOCH_ALLOCATION_SYNCHRONIZATION,      ///< Synchronization object.
     EBPF_EPOCH_ALLOCATION_MEMORY_CACHE_ALIGNED, ///< Memory allocation that is cache aligned.
+    EBPF_EPOCH_ALLOCATION_POOL_BLOCK,           ///< Block allocated from an ebpf_epoch_pool_t.
 } ebpf_epoch_allocation_type_t;
 
 /**
@@ -215,6 +218,44 @@ typedef struct _ebpf_epoch_synchronization
     KEVENT event;                          ///< Event to signal.
 } ebpf_epoch_synchronization_t;
 
+/**
+ * @brief Block in an ebpf_epoch_pool_t. The caller's memory immediately follows the header, so a pool block can be
+ * passed to ebpf_epoch_free like any other epoch allocation. While the block is free, the header's list entry links it
+ * into one of the pool's per-CPU free lists.
+ */
+typedef struct _ebpf_epoch_pool_block
+{
+    struct _ebpf_epoch_pool* pool;         ///< Pool the block belongs to.
+    ebpf_epoch_allocation_header_t header; ///< Header used to insert the block into the free list.
+} ebpf_epoch_pool_block_t;
+
+static_assert(
+    sizeof(ebpf_epoch_pool_block_t) ==
+        EBPF_OFFSET_OF(ebpf_epoch_pool_block_t, header) + sizeof(ebpf_epoch_allocation_header_t),
+    "Header must immediately precede the caller's memory");
+
+/**
+ * @brief Per-CPU free list of an ebpf_epoch_pool_t. Blocks are returned to the list of the CPU on which their epoch
+ * ended and are allocated from the list of the current CPU, so the lock is normally only taken by one CPU.
+ */
+typedef __declspec(align(EBPF_CACHE_LINE_SIZE)) struct _ebpf_epoch_pool_cpu_entry
+{
+    ebpf_lock_t lock;            ///< Lock protecting the free list.
+    ebpf_list_entry_t free_list; ///< Blocks that are available for allocation.
+    bool destroying;             ///< Set once destroy drained the list; released blocks then drop their reference.
+} ebpf_epoch_pool_cpu_entry_t;
+
+struct _ebpf_epoch_pool
+{
+    size_t block_size;   ///< Size of the caller's part of each block.
+    size_t block_stride; ///< Distance between consecutive blocks.
+    size_t block_count;  ///< Count of blocks in the pool.
+    uint32_t cpu_count;  ///< Count of per-CPU free lists.
+    volatile int64_t reference_count; ///< One for the owner plus one for each block not yet seen by destroy.
+    uint8_t* blocks;                  ///< Reserved blocks.
+    _Field_size_(cpu_count) ebpf_epoch_pool_cpu_entry_t* cpu_entries; ///< Per-CPU free lists.
+};
+
 /**
  * @brief Rundown reference used to wait for all work items to complete.
  */
@@ -238,6 +279,9 @@ _ebpf_epoch_send_message_async(_In_ ebpf_epoch_cpu_message_t* message, uint32_t
 _IRQL_requires_same_ static void
 _ebpf_epoch_insert_in_free_list(_In_ ebpf_epoch_allocation_header_t* header);
 
+static void
+_ebpf_epoch_pool_release_block(_Inout_ ebpf_epoch_allocation_header_t* header);
+
 static _IRQL_requires_(DISPATCH_LEVEL) void _ebpf_epoch_arm_timer_if_needed(ebpf_epoch_cpu_entry_t* cpu_entry);
 
 static void
@@ -472,7 +516,11 @@ ebpf_epoch_free(_Frees_ptr_opt_ void* memory)
 
     // Pool corruption or double free.
     EBPF_EPOCH_FAIL_FAST(FAST_FAIL_HEAP_METADATA_CORRUPTION, header->freed_epoch == 0);
-    header->entry_type = EBPF_EPOCH_ALLOCATION_MEMORY;
+
+    // Blocks from an ebpf_epoch_pool_t keep their type so that they are returned to the pool once the epoch ends.
+    if (header->entry_type != EBPF_EPOCH_ALLOCATION_POOL_BLOCK) {
+        header->entry_type = EBPF_EPOCH_ALLOCATION_MEMORY;
+    }
 
     _ebpf_epoch_insert_in_free_list(header);
 }
@@ -581,6 +629,200 @@ ebpf_epoch_is_free_list_empty(uint32_t cpu_id)
     return message.message.is_free_list_empty.is_empty;
 }
 
+/**
+ * @brief Free the memory backing a pool once the owner and every block have released their reference.
+ *
+ * @param[in] pool Pool to release the reference on.
+ * @param[in] count Count of references to release.
+ */
+static void
+_ebpf_epoch_pool_release_reference(_Inout_ ebpf_epoch_pool_t* pool, int64_t count)
+{
+    int64_t old_count;
+    int64_t new_count;
+
+    if (count == 0) {
+        return;
+    }
+    do {
+        old_count = pool->reference_count;
+        new_count = old_count - count;
+    } while (ebpf_interlocked_compare_exchange_int64(&pool->reference_count, new_count, old_count) != old_count);
+    if (new_count != 0) {
+        return;
+    }
+
+    for (uint32_t cpu_id = 0; cpu_id < pool->cpu_count; cpu_id++) {
+        ebpf_lock_destroy(&pool->cpu_entries[cpu_id].lock);
+    }
+    ebpf_free_cache_aligned(pool->cpu_entries);
+    ebpf_free(pool->blocks);
+    ebpf_free(pool);
+}
+
+/**
+ * @brief Return a block whose epoch has ended to the free list of the current CPU.
+ *
+ * @param[in] header Header of the block to return.
+ */
+static void
+_ebpf_epoch_pool_release_block(_Inout_ ebpf_epoch_allocation_header_t* header)
+{
+    ebpf_epoch_pool_block_t* block = CONTAINING_RECORD(header, ebpf_epoch_pool_block_t, header);
+    ebpf_epoch_pool_t* pool = block->pool;
+    bool destroying;
+
+    // Allow the block to be freed again once it has been reallocated.
+    header->freed_epoch = 0;
+
+    KIRQL old_irql = ebpf_raise_irql_to_dispatch_if_needed();
+    ebpf_epoch_pool_cpu_entry_t* cpu_entry = &pool->cpu_entries[ebpf_get_current_cpu() % pool->cpu_count];
+    ebpf_lock_state_t state = ebpf_lock_lock(&cpu_entry->lock);
+    destroying = cpu_entry->destroying;
+    if (!destroying) {
+        ebpf_list_insert_tail(&cpu_entry->free_list, &header->list_entry);
+    }
+    ebpf_lock_unlock(&cpu_entry->lock, state);
+    ebpf_lower_irql_from_dispatch_if_needed(old_irql);
+
+    // Once destroy has drained this CPU's free list, each released block drops the reference it holds on the pool.
+    if (destroying) {
+        _ebpf_epoch_pool_release_reference(pool, 1);
+    }
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_epoch_pool_create(_Outptr_ ebpf_epoch_pool_t** pool, size_t block_size, size_t block_count, uint32_t tag)
+{
+    ebpf_result_t result;
+    ebpf_epoch_pool_t* local_pool = NULL;
+    size_t block_stride;
+    size_t blocks_size;
+    uint32_t cpu_count = ebpf_get_cpu_count();
+
+    ebpf_assert(block_size);
+
+    result = ebpf_safe_size_t_add(sizeof(ebpf_epoch_pool_block_t), EBPF_PAD_8(block_size), &block_stride);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+    result = ebpf_safe_size_t_multiply(block_stride, block_count, &blocks_size);
+    if (result != EBPF_SUCCESS) {
+        goto Done;
+    }
+
+    local_pool = (ebpf_epoch_pool_t*)ebpf_allocate_with_tag(sizeof(ebpf_epoch_pool_t), tag);
+    if (!local_pool) {
+        result = EBPF_NO_MEMORY;
+        goto Done;
+    }
+    local_pool->block_size = block_size;
+    local_pool->block_stride = block_stride;
+    local_pool->block_count = block_count;
+    local_pool->cpu_count = cpu_count;
+    local_pool->reference_count = (int64_t)block_count + 1;
+
+    local_pool->cpu_entries = (ebpf_epoch_pool_cpu_entry_t*)ebpf_allocate_cache_aligned_with_tag(
+        sizeof(ebpf_epoch_pool_cpu_entry_t) * cpu_count, tag);
+    if (!local_pool->cpu_entries) {
+        result = EBPF_NO_MEMORY;
+        goto Done;
+    }
+    for (uint32_t cpu_id = 0; cpu_id < cpu_count; cpu_id++) {
+        ebpf_lock_create(&local_pool->cpu_entries[cpu_id].lock);
+        ebpf_list_initialize(&local_pool->cpu_entries[cpu_id].free_list);
+    }
+
+    if (blocks_size) {
+        local_pool->blocks = (uint8_t*)ebpf_allocate_with_tag(blocks_size, tag);
+        if (!local_pool->blocks) {
+            result = EBPF_NO_MEMORY;
+            goto Done;
+        }
+    }
+
+    // Spread the blocks evenly across the per-CPU free lists.
+    for (size_t index = 0; index < block_count; index++) {
+        ebpf_epoch_pool_block_t* block = (ebpf_epoch_pool_block_t*)(local_pool->blocks + index * block_stride);
+        block->pool = local_pool;
+        block->header.entry_type = EBPF_EPOCH_ALLOCATION_POOL_BLOCK;
+        ebpf_list_insert_tail(&local_pool->cpu_entries[index % cpu_count].free_list, &block->header.list_entry);
+    }
+
+    *pool = local_pool;
+    local_pool = NULL;
+    result = EBPF_SUCCESS;
+
+Done:
+    if (local_pool) {
+        if (local_pool->cpu_entries) {
+            for (uint32_t cpu_id = 0; cpu_id < cpu_count; cpu_id++) {
+                ebpf_lock_destroy(&local_pool->cpu_entries[cpu_id].lock);
+            }
+            ebpf_free_cache_aligned(local_pool->cpu_entries);
+        }
+        ebpf_free(local_pool->blocks);
+        ebpf_free(local_pool);
+    }
+    return result;
+}
+
+void
+ebpf_epoch_pool_destroy(_In_opt_ _Post_ptr_invalid_ ebpf_epoch_pool_t* pool)
+{
+    int64_t released_blocks = 0;
+
+    if (!pool) {
+        return;
+    }
+
+    // Drain each free list and mark it so that blocks whose epoch ends later drop their reference instead of being
+    // kept. Each block is therefore counted exactly once, either here or in _ebpf_epoch_pool_release_block.
+    for (uint32_t cpu_id = 0; cpu_id < pool->cpu_count; cpu_id++) {
+        ebpf_epoch_pool_cpu_entry_t* cpu_entry = &pool->cpu_entries[cpu_id];
+        ebpf_lock_state_t state = ebpf_lock_lock(&cpu_entry->lock);
+        cpu_entry->destroying = true;
+        while (!ebpf_list_is_empty(&cpu_entry->free_list)) {
+            ebpf_list_remove_entry(cpu_entry->free_list.Flink);
+            released_blocks++;
+        }
+        ebpf_lock_unlock(&cpu_entry->lock, state);
+    }
+
+    _ebpf_epoch_pool_release_reference(pool, released_blocks + 1);
+}
+
+_Must_inspect_result_ _Ret_maybenull_ void*
+ebpf_epoch_pool_allocate(_Inout_ ebpf_epoch_pool_t* pool)
+{
+    ebpf_epoch_pool_block_t* block = NULL;
+
+    KIRQL old_irql = ebpf_raise_irql_to_dispatch_if_needed();
+    uint32_t current_cpu = ebpf_get_current_cpu();
+
+    // Prefer the current CPU's free list and only take another CPU's lock once it is empty.
+    for (uint32_t offset = 0; offset < pool->cpu_count && !block; offset++) {
+        ebpf_epoch_pool_cpu_entry_t* cpu_entry = &pool->cpu_entries[(current_cpu + offset) % pool->cpu_count];
+        ebpf_lock_state_t state = ebpf_lock_lock(&cpu_entry->lock);
+        if (!ebpf_list_is_empty(&cpu_entry->free_list)) {
+            ebpf_list_entry_t* entry = cpu_entry->free_list.Flink;
+            ebpf_list_remove_entry(entry);
+            block = CONTAINING_RECORD(entry, ebpf_epoch_pool_block_t, header.list_entry);
+        }
+        ebpf_lock_unlock(&cpu_entry->lock, state);
+    }
+
+    ebpf_lower_irql_from_dispatch_if_needed(old_irql);
+
+    if (!block) {
+        return NULL;
+    }
+
+    memset(&block->header.list_entry, 0, sizeof(block->header.list_entry));
+    memset(block + 1, 0, pool->block_size);
+    return block + 1;
+}
+
 /**
  * @brief Release any memory that is associated with expired epochs.
  * @param[in] cpu_entry CPU entry to release memory for.
@@ -598,6 +840,7 @@ _ebpf_epoch_release_free_list(_Inout_ ebpf_epoch_cpu_entry_t* cpu_entry, int64_t
         header = CONTAINING_RECORD(entry, ebpf_epoch_allocation_header_t, list_entry);
         if (header->freed_epoch <= released_epoch) {
             ebpf_list_remove_entry(entry);
+            EBPF_STATISTICS_INCREMENT(epoch_free_list_release_count);
             PrefetchForWrite(entry->Flink->Flink);
             switch (header->entry_type) {
             case EBPF_EPOCH_ALLOCATION_MEMORY:
@@ -617,6 +860,9 @@ _ebpf_epoch_release_free_list(_Inout_ ebpf_epoch_cpu_entry_t* cpu_entry, int64_t
             case EBPF_EPOCH_ALLOCATION_MEMORY_CACHE_ALIGNED:
                 ebpf_free_cache_aligned(header);
                 break;
+            case EBPF_EPOCH_ALLOCATION_POOL_BLOCK:
+                _ebpf_epoch_pool_release_block(header);
+                break;
             default:
                 // Pool corruption or internal error.
                 EBPF_EPOCH_FAIL_FAST(FAST_FAIL_CORRUPT_LIST_ENTRY, !"Invalid entry type");
@@ -693,6 +939,9 @@ _ebpf_epoch_insert_in_free_list(_In_ ebpf_epoch_allocation_header_t* header)
             KeSetEvent(&synchronization->event, 0, false);
             break;
         }
+        case EBPF_EPOCH_ALLOCATION_POOL_BLOCK:
+            _ebpf_epoch_pool_release_block(header);
+            break;
         default:
             ebpf_assert(!"Invalid entry type");
         }
@@ -706,6 +955,7 @@ _ebpf_epoch_insert_in_free_list(_In_ ebpf_epoch_allocation_header_t* header)
     header->freed_epoch = (int64_t)max(published_epoch, local_epoch);
 
     ebpf_list_insert_tail(&cpu_entry->free_list, &header->list_entry);
+    EBPF_STATISTICS_INCREMENT(epoch_free_list_insert_count);
 
     _ebpf_epoch_arm_timer_if_needed(cpu_entry);
 
@@ -785,6 +1035,7 @@ _ebpf_epoch_messenger_propose_release_epoch(
     // First CPU updates the current epoch and proposes the release epoch.
     if (current_cpu == 0) {
         int64_t new_epoch = ebpf_interlocked_increment_int64(&_ebpf_epoch_published_current_epoch);
+        EBPF_STATISTICS_INCREMENT(epoch_advance_count);
         cpu_entry->current_epoch = new_epoch;
         message->message.propose_epoch.current_epoch = (uint64_t)new_epoch;
         message->message.propose_epoch.proposed_release_epoch = (uint64_t)new_epoch;
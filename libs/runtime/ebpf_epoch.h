@@ -11,6 +11,7 @@ extern "C"
 #endif
 
     typedef struct _ebpf_epoch_work_item ebpf_epoch_work_item_t;
+    typedef struct _ebpf_epoch_pool ebpf_epoch_pool_t;
     typedef struct _ebpf_epoch_state
     {
         LIST_ENTRY epoch_list_entry; /// List entry for the epoch list.
@@ -76,7 +77,8 @@ extern "C"
         _Ret_writes_maybenull_(size) void* ebpf_epoch_allocate_with_tag(size_t size, uint32_t tag);
 
     /**
-     * @brief Free memory under epoch control.
+     * @brief Free memory under epoch control. Blocks allocated from an
+     * ebpf_epoch_pool_t are returned to their pool rather than released.
      * @param[in] memory Allocation to be freed once epoch ends.
      */
     void
@@ -125,6 +127,45 @@ extern "C"
     void
     ebpf_epoch_cancel_work_item(_In_opt_ _Frees_ptr_opt_ ebpf_epoch_work_item_t* work_item);
 
+    /**
+     * @brief Create a pool of fixed size blocks under epoch control. All blocks
+     * are allocated up front and spread across per-CPU free lists, so that
+     * allocating from the pool never calls into the system allocator. Blocks
+     * are returned with ebpf_epoch_free and become available again once the
+     * epoch in which they were freed ends.
+     *
+     * @param[out] pool Pointer to memory that will contain the pool on success.
+     * @param[in] block_size Size in bytes of each block.
+     * @param[in] block_count Count of blocks to reserve.
+     * @param[in] tag Pool tag to use for the reservation.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_NO_MEMORY Unable to allocate resources for this
+     *  operation.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_epoch_pool_create(_Outptr_ ebpf_epoch_pool_t** pool, size_t block_size, size_t block_count, uint32_t tag);
+
+    /**
+     * @brief Destroy a pool. The caller must already have freed every block it
+     * allocated from the pool. Blocks that are still waiting for their epoch to
+     * end keep the reservation alive until they are released.
+     *
+     * @param[in] pool Pool to destroy.
+     */
+    void
+    ebpf_epoch_pool_destroy(_In_opt_ _Post_ptr_invalid_ ebpf_epoch_pool_t* pool);
+
+    /**
+     * @brief Allocate a zeroed block from a pool. The block is taken from the
+     * current CPU's free list if possible and from another CPU's otherwise.
+     *
+     * @param[in, out] pool Pool to allocate from.
+     * @returns Pointer to the block, or NULL if every block is in use or
+     *  waiting for its epoch to end.
+     */
+    _Must_inspect_result_ _Ret_maybenull_ void*
+    ebpf_epoch_pool_allocate(_Inout_ ebpf_epoch_pool_t* pool);
+
     /**
      * @brief Check the state of the free list on a CPU.
      *
@@ -70,6 +70,23 @@ extern "C"
         uint32_t file_id,
         uint32_t line);
 
+    /**
+     * @brief Find the handle in the handle table and return the object it refers
+     *  to without acquiring a reference. Objects are only freed once all epochs
+     *  active at the time of their final release have exited, so the caller must
+     *  be in an epoch and must not use the object after leaving it.
+     *
+     * @param[in] handle Handle to find in table.
+     * @param[out] object Pointer to memory that contains object success.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_OBJECT The provided handle is not valid.
+     */
+    _IRQL_requires_max_(PASSIVE_LEVEL) ebpf_result_t ebpf_borrow_base_object_by_handle(
+        ebpf_handle_t handle,
+        _In_opt_ ebpf_compare_object_t compare_function,
+        _In_opt_ const void* context,
+        _Outptr_ struct _ebpf_base_object** object);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,7 @@
 #include "ebpf_epoch.h"
 #include "ebpf_hash_table.h"
 #include "ebpf_random.h"
+#include "ebpf_statistics.h"
 
 #include <intrin.h>
 
@@ -47,6 +48,22 @@ typedef struct _ebpf_hash_bucket_header_and_lock
     ebpf_lock_t lock;
 } ebpf_hash_bucket_header_and_lock_t;
 
+/**
+ * @brief Occupancy counters kept by each CPU. Counters are only changed while holding a bucket lock, so each CPU's
+ * values can go negative when an entry is inserted on one CPU and deleted on another; only the sum over all CPUs is
+ * meaningful.
+ */
+typedef __declspec(align(EBPF_CACHE_LINE_SIZE)) struct _ebpf_hash_table_cpu_statistics
+{
+    volatile int64_t entry_count; // Entries inserted minus entries deleted.
+    int64_t memory_bytes;         // Bytes allocated for values and buckets, including backup buckets.
+    volatile int64_t bucket_length_count[EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT]; // Non-empty buckets by length.
+} ebpf_hash_table_cpu_statistics_t;
+
+static_assert(
+    sizeof(ebpf_hash_table_cpu_statistics_t) % EBPF_CACHE_LINE_SIZE == 0,
+    "ebpf_hash_table_cpu_statistics_t must not share a cache line with another CPU's entry.");
+
 /**
  * @brief The ebpf_hash_table_t structure represents a hash table. It contains an array of pointers to buckets and a
  * a per bucket lock.
@@ -66,10 +83,15 @@ struct _ebpf_hash_table
     ebpf_hash_table_free free;         // Function to free memory.
     ebpf_hash_table_extract_function extract; // Function to extract bytes to hash from key.
     uint32_t allocation_tag;                  // Pool tag to use for allocations.
+    ebpf_epoch_pool_t* value_pool;  // Values reserved at creation or NULL if the table isn't preallocated.
+    ebpf_epoch_pool_t* bucket_pool; // Buckets reserved at creation or NULL if the table isn't preallocated.
 
     void* notification_context; //< Context to pass to notification functions.
     ebpf_hash_table_notification_function notification_callback;
     ebpf_hash_table_notification_type_t notification_flags;                   //< Bitmask of enabled notification types.
+    uint32_t cpu_count;                                                       //< Count of per-CPU statistics blocks.
+    _Field_size_(cpu_count) ebpf_hash_table_cpu_statistics_t* cpu_statistics; //< Per-CPU occupancy counters.
+    void* cpu_statistics_allocation; //< Allocation holding cpu_statistics, freed with the table's free function.
     _Field_size_(bucket_count) ebpf_hash_bucket_header_and_lock_t buckets[1]; // Pointer to array of buckets.
 };
 
@@ -371,6 +393,49 @@ _ebpf_hash_table_set_bucket(
     WriteSizeTRelease((ULONG_PTR*)&(hash_table->buckets[bucket_index].header), (ULONG_PTR)bucket);
 }
 
+/**
+ * @brief Allocate memory for a value, preferring the values reserved when the table was created.
+ *
+ * @param[in] hash_table Hash table the value belongs to.
+ * @return Pointer to the value or NULL on failure.
+ */
+static inline uint8_t*
+_ebpf_hash_table_allocate_value(_In_ const ebpf_hash_table_t* hash_table)
+{
+    uint8_t* data = NULL;
+    if (hash_table->value_pool) {
+        data = ebpf_epoch_pool_allocate(hash_table->value_pool);
+    }
+    if (!data) {
+        data = hash_table->allocate(
+            hash_table->value_size + hash_table->supplemental_value_size, hash_table->allocation_tag);
+    }
+    return data;
+}
+
+/**
+ * @brief Allocate memory for a bucket, preferring the buckets reserved when the table was created. Reserved buckets
+ * hold up to EBPF_HASH_TABLE_PREALLOCATED_BUCKET_CAPACITY entries, larger buckets always come from the allocator.
+ *
+ * @param[in] hash_table Hash table the bucket belongs to.
+ * @param[in] count Count of entries the bucket must hold.
+ * @return Pointer to the bucket or NULL on failure.
+ */
+static inline ebpf_hash_bucket_header_t*
+_ebpf_hash_table_allocate_bucket(_In_ const ebpf_hash_table_t* hash_table, size_t count)
+{
+    ebpf_hash_bucket_header_t* bucket = NULL;
+    size_t entry_size = EBPF_OFFSET_OF(ebpf_hash_bucket_entry_t, key) + hash_table->key_size;
+    if (hash_table->bucket_pool && count <= EBPF_HASH_TABLE_PREALLOCATED_BUCKET_CAPACITY) {
+        bucket = ebpf_epoch_pool_allocate(hash_table->bucket_pool);
+    }
+    if (!bucket) {
+        bucket = hash_table->allocate(
+            entry_size * count + sizeof(ebpf_hash_bucket_header_t), hash_table->allocation_tag);
+    }
+    return bucket;
+}
+
 /**
  * @brief Build a replacement bucket with the given entry inserted at the end.
  * Caller must free the old bucket.
@@ -395,8 +460,6 @@ _ebpf_hash_table_bucket_insert(
     ebpf_result_t result;
     size_t entry_size = EBPF_OFFSET_OF(ebpf_hash_bucket_entry_t, key) + hash_table->key_size;
     size_t old_bucket_size = old_bucket ? entry_size * old_bucket->count + sizeof(ebpf_hash_bucket_header_t) : 0;
-    size_t new_bucket_size =
-        entry_size * ((old_bucket ? old_bucket->count : 0) + 1) + sizeof(ebpf_hash_bucket_header_t);
     ebpf_hash_bucket_header_t* local_new_bucket = NULL;
     ebpf_hash_bucket_header_t* backup_bucket = NULL;
 
@@ -409,7 +472,7 @@ _ebpf_hash_table_bucket_insert(
     }
 
     // Allocate new bucket.
-    local_new_bucket = hash_table->allocate(new_bucket_size, hash_table->allocation_tag);
+    local_new_bucket = _ebpf_hash_table_allocate_bucket(hash_table, (old_bucket ? old_bucket->count : 0) + 1);
     if (!local_new_bucket) {
         result = EBPF_NO_MEMORY;
         goto Done;
@@ -417,7 +480,7 @@ _ebpf_hash_table_bucket_insert(
 
     // Allocate a new backup bucket.
     if (old_bucket_size) {
-        backup_bucket = hash_table->allocate(old_bucket_size, hash_table->allocation_tag);
+        backup_bucket = _ebpf_hash_table_allocate_bucket(hash_table, old_bucket->count);
         if (!backup_bucket) {
             result = EBPF_NO_MEMORY;
             goto Done;
@@ -553,7 +616,7 @@ _ebpf_hash_table_bucket_update(
     ebpf_hash_bucket_header_t* local_new_bucket = NULL;
 
     // Allocate new bucket.
-    local_new_bucket = hash_table->allocate(old_bucket_size, hash_table->allocation_tag);
+    local_new_bucket = _ebpf_hash_table_allocate_bucket(hash_table, old_bucket->count);
     if (!local_new_bucket) {
         result = EBPF_NO_MEMORY;
         goto Done;
@@ -575,6 +638,57 @@ Done:
     return result;
 }
 
+/**
+ * @brief Compute the memory held by a bucket with the given count of entries. A bucket with N entries carries backup
+ * buckets of 1 to N - 1 entries, so the live bucket and its backups hold N headers and N * (N + 1) / 2 entries.
+ *
+ * @param[in] hash_table Hash table the bucket belongs to.
+ * @param[in] count Count of entries in the bucket.
+ * @return Bytes held by the bucket and its backups.
+ */
+static inline int64_t
+_ebpf_hash_table_bucket_memory_bytes(_In_ const ebpf_hash_table_t* hash_table, size_t count)
+{
+    size_t entry_size = EBPF_OFFSET_OF(ebpf_hash_bucket_entry_t, key) + hash_table->key_size;
+    return (int64_t)(count * sizeof(ebpf_hash_bucket_header_t) + entry_size * count * (count + 1) / 2);
+}
+
+/**
+ * @brief Update the current CPU's occupancy counters after a bucket was replaced. Caller must hold the bucket lock.
+ * The entry and bucket length counters use uncontended interlocked operations on the CPU's own cache line, so that
+ * their sum is exact once the table is idle.
+ *
+ * @param[in, out] hash_table Hash table the bucket belongs to.
+ * @param[in] old_count Count of entries in the bucket before the operation.
+ * @param[in] new_count Count of entries in the bucket after the operation.
+ */
+static inline void
+_ebpf_hash_table_record_bucket_change(_Inout_ ebpf_hash_table_t* hash_table, size_t old_count, size_t new_count)
+{
+    if (old_count == new_count) {
+        return;
+    }
+    ebpf_hash_table_cpu_statistics_t* statistics = &hash_table->cpu_statistics[ebpf_get_current_cpu()];
+    int64_t value_bytes = (int64_t)(hash_table->value_size + hash_table->supplemental_value_size);
+    if (new_count > old_count) {
+        ebpf_interlocked_increment_int64_no_fence(&statistics->entry_count);
+        statistics->memory_bytes += value_bytes;
+    } else {
+        ebpf_interlocked_decrement_int64_no_fence(&statistics->entry_count);
+        statistics->memory_bytes -= value_bytes;
+    }
+    statistics->memory_bytes += _ebpf_hash_table_bucket_memory_bytes(hash_table, new_count) -
+                                _ebpf_hash_table_bucket_memory_bytes(hash_table, old_count);
+    if (old_count) {
+        ebpf_interlocked_decrement_int64_no_fence(
+            &statistics->bucket_length_count[min(old_count, EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT - 1)]);
+    }
+    if (new_count) {
+        ebpf_interlocked_increment_int64_no_fence(
+            &statistics->bucket_length_count[min(new_count, EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT - 1)]);
+    }
+}
+
 /**
  * @brief Perform an atomic replacement of a bucket in the hash table.
  * Operations include insert, update and delete of elements.
@@ -617,8 +731,7 @@ _ebpf_hash_table_replace_bucket(
 
     // Make a copy of the value to insert.
     if (operation != EBPF_HASH_BUCKET_OPERATION_DELETE) {
-        new_data = hash_table->allocate(
-            hash_table->value_size + hash_table->supplemental_value_size, hash_table->allocation_tag);
+        new_data = _ebpf_hash_table_allocate_value(hash_table);
         if (!new_data) {
             result = EBPF_NO_MEMORY;
             goto Done;
@@ -716,6 +829,7 @@ _ebpf_hash_table_replace_bucket(
     }
 
     // If a value was inserted and deleted, the count of values in the hash table did not change.
+    _ebpf_hash_table_record_bucket_change(hash_table, old_bucket_count, new_bucket ? new_bucket->count : 0);
 
     // Update the bucket in the hash table.
     // From this point on the new bucket is immutable.
@@ -772,6 +886,13 @@ ebpf_hash_table_create(_Out_ ebpf_hash_table_t** hash_table, _In_ const ebpf_has
     ebpf_hash_table_allocate allocate = options->allocate ? options->allocate : ebpf_epoch_allocate_with_tag;
     ebpf_hash_table_free free = options->free ? options->free : ebpf_epoch_free;
     uint32_t allocation_tag = options->allocation_tag ? options->allocation_tag : EBPF_POOL_TAG_EPOCH;
+    size_t preallocated_count = 0;
+
+    // Reserved blocks are returned to their pool by ebpf_epoch_free, so they can't be mixed with custom allocators.
+    if (options->preallocated_entries && (options->allocate || options->free)) {
+        retval = EBPF_INVALID_ARGUMENT;
+        goto Done;
+    }
 
     // Increase bucket_count to next power of 2.
     unsigned long msb_index;
@@ -795,6 +916,55 @@ ebpf_hash_table_create(_Out_ ebpf_hash_table_t** hash_table, _In_ const ebpf_has
         retval = EBPF_NO_MEMORY;
         goto Done;
     }
+    table->value_pool = NULL;
+    table->bucket_pool = NULL;
+
+    // The counters are updated by readers that only hold the epoch, so they are allocated and freed the same way as
+    // the table itself. The allocation is padded by a cache line so that the blocks can be aligned within it.
+    table->cpu_count = ebpf_get_cpu_count();
+    table->cpu_statistics_allocation = allocate(
+        table->cpu_count * sizeof(ebpf_hash_table_cpu_statistics_t) + EBPF_CACHE_LINE_SIZE, allocation_tag);
+    if (table->cpu_statistics_allocation == NULL) {
+        retval = EBPF_NO_MEMORY;
+        goto Done;
+    }
+    table->cpu_statistics =
+        (ebpf_hash_table_cpu_statistics_t*)EBPF_CACHE_ALIGN_POINTER(table->cpu_statistics_allocation);
+    memset(table->cpu_statistics, 0, table->cpu_count * sizeof(ebpf_hash_table_cpu_statistics_t));
+
+    if (options->preallocated_entries) {
+        // Values and buckets freed by an update only return to the pool once the epoch ends, so reserve some extra
+        // blocks per CPU for updates made within one epoch.
+        retval = ebpf_safe_size_t_add(
+            options->preallocated_entries,
+            (size_t)ebpf_get_cpu_count() * EBPF_HASH_TABLE_PREALLOCATED_RESERVE_PER_CPU,
+            &preallocated_count);
+        if (retval != EBPF_SUCCESS) {
+            goto Done;
+        }
+
+        retval = ebpf_epoch_pool_create(
+            &table->value_pool,
+            options->value_size + options->supplemental_value_size,
+            preallocated_count,
+            allocation_tag);
+        if (retval != EBPF_SUCCESS) {
+            goto Done;
+        }
+
+        // A bucket with N entries carries backup buckets of 1 to N - 1 entries, so live buckets and their backups
+        // need one block per entry.
+        retval = ebpf_epoch_pool_create(
+            &table->bucket_pool,
+            (EBPF_OFFSET_OF(ebpf_hash_bucket_entry_t, key) + options->key_size) *
+                    EBPF_HASH_TABLE_PREALLOCATED_BUCKET_CAPACITY +
+                sizeof(ebpf_hash_bucket_header_t),
+            preallocated_count,
+            allocation_tag);
+        if (retval != EBPF_SUCCESS) {
+            goto Done;
+        }
+    }
 
     table->key_size = options->key_size;
     table->value_size = options->value_size;
@@ -830,8 +1000,17 @@ ebpf_hash_table_create(_Out_ ebpf_hash_table_t** hash_table, _In_ const ebpf_has
     table->notification_flags = notification_flags;
 
     *hash_table = table;
+    table = NULL;
     retval = EBPF_SUCCESS;
 Done:
+    if (table) {
+        ebpf_epoch_pool_destroy(table->value_pool);
+        ebpf_epoch_pool_destroy(table->bucket_pool);
+        if (table->cpu_statistics_allocation) {
+            free(table->cpu_statistics_allocation);
+        }
+        free(table);
+    }
     return retval;
 }
 
@@ -857,6 +1036,9 @@ ebpf_hash_table_destroy(_In_opt_ _Post_ptr_invalid_ ebpf_hash_table_t* hash_tabl
             hash_table->buckets[index].header = NULL;
         }
     }
+    ebpf_epoch_pool_destroy(hash_table->value_pool);
+    ebpf_epoch_pool_destroy(hash_table->bucket_pool);
+    hash_table->free(hash_table->cpu_statistics_allocation);
     hash_table->free(hash_table);
 }
 
@@ -877,10 +1059,12 @@ ebpf_hash_table_find(_In_ const ebpf_hash_table_t* hash_table, _In_ const uint8_
     bucket_index = _ebpf_hash_table_compute_bucket_index(hash_table, key);
     bucket = _ebpf_hash_table_get_bucket(hash_table, bucket_index);
     if (!bucket) {
+        EBPF_STATISTICS_INCREMENT(hash_chain_length[0]);
         retval = EBPF_KEY_NOT_FOUND;
         goto Done;
     }
 
+    EBPF_STATISTICS_INCREMENT(hash_chain_length[min(bucket->count, EBPF_STATISTICS_HASH_CHAIN_LENGTH_BUCKETS - 1)]);
     for (index = 0; index < bucket->count; index++) {
         ebpf_hash_bucket_entry_t* entry = _ebpf_hash_table_bucket_entry(hash_table->key_size, bucket, index);
         if (_ebpf_hash_table_compare(hash_table, key, entry->key) == 0) {
@@ -1077,16 +1261,47 @@ ebpf_hash_table_key_count(_In_ const ebpf_hash_table_t* hash_table)
     if (hash_table->max_entry_count != EBPF_HASH_TABLE_NO_LIMIT) {
         return hash_table->entry_count;
     } else {
-        // Otherwise, count the keys in the hash table.
-        size_t count = 0;
-        for (size_t i = 0; i < hash_table->bucket_count; i++) {
-            ebpf_hash_bucket_header_t* bucket = hash_table->buckets[i].header;
-            if (bucket) {
-                count += bucket->count;
-            }
+        // Otherwise, sum the per-CPU counters rather than walking every bucket.
+        int64_t count = 0;
+        for (uint32_t cpu_id = 0; cpu_id < hash_table->cpu_count; cpu_id++) {
+            count += hash_table->cpu_statistics[cpu_id].entry_count;
         }
-        return count;
+        return count > 0 ? (size_t)count : 0;
+    }
+}
+
+void
+ebpf_hash_table_get_statistics(
+    _In_ const ebpf_hash_table_t* hash_table, _Out_ ebpf_hash_table_statistics_t* statistics)
+{
+    int64_t entry_count = 0;
+    int64_t memory_bytes = 0;
+    int64_t bucket_length_count[EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT] = {0};
+
+    for (uint32_t cpu_id = 0; cpu_id < hash_table->cpu_count; cpu_id++) {
+        const ebpf_hash_table_cpu_statistics_t* cpu_statistics = &hash_table->cpu_statistics[cpu_id];
+        entry_count += cpu_statistics->entry_count;
+        memory_bytes += cpu_statistics->memory_bytes;
+        for (size_t length = 1; length < EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT; length++) {
+            bucket_length_count[length] += cpu_statistics->bucket_length_count[length];
+        }
+    }
+
+    // Counters are read while other CPUs may be updating them, so clamp transient negative sums.
+    statistics->entry_count = entry_count > 0 ? (size_t)entry_count : 0;
+    statistics->memory_bytes = EBPF_OFFSET_OF(ebpf_hash_table_t, buckets) +
+                               hash_table->bucket_count * sizeof(ebpf_hash_bucket_header_and_lock_t) +
+                               hash_table->cpu_count * sizeof(ebpf_hash_table_cpu_statistics_t) +
+                               (memory_bytes > 0 ? (size_t)memory_bytes : 0);
+    statistics->bucket_count = hash_table->bucket_count;
+    size_t used_bucket_count = 0;
+    for (size_t length = 1; length < EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT; length++) {
+        statistics->bucket_length_count[length] =
+            bucket_length_count[length] > 0 ? (size_t)bucket_length_count[length] : 0;
+        used_bucket_count += statistics->bucket_length_count[length];
     }
+    statistics->bucket_length_count[0] =
+        used_bucket_count < hash_table->bucket_count ? hash_table->bucket_count - used_bucket_count : 0;
 }
 
 _Must_inspect_result_ ebpf_result_t
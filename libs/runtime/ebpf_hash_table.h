@@ -11,6 +11,9 @@ extern "C"
 
 #define EBPF_HASH_TABLE_NO_LIMIT 0
 #define EBPF_HASH_TABLE_DEFAULT_BUCKET_COUNT 64
+#define EBPF_HASH_TABLE_PREALLOCATED_BUCKET_CAPACITY 4
+#define EBPF_HASH_TABLE_PREALLOCATED_RESERVE_PER_CPU 32
+#define EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT 8
 
     typedef enum _ebpf_hash_table_operations
     {
@@ -74,17 +77,28 @@ extern "C"
         ebpf_hash_table_notification_function
             notification_callback; //< Function to call when value storage is allocated or freed.
         ebpf_hash_table_notification_type_t notification_flags; //< Bitmask of notification types to enable.
+        size_t preallocated_entries; //< Count of entries whose value and bucket memory is reserved at creation, so
+                                     // that updates don't call the allocator - defaults to 0. Requires the default
+                                     // allocate and free functions.
     } ebpf_hash_table_creation_options_t;
 
     /**
      * @brief Allocate and initialize a hash table.
      *
+     * If options->preallocated_entries is set, memory for that many values and
+     * buckets of up to EBPF_HASH_TABLE_PREALLOCATED_BUCKET_CAPACITY entries is
+     * reserved in per-CPU free lists, plus EBPF_HASH_TABLE_PREALLOCATED_RESERVE_PER_CPU
+     * of each per CPU to cover memory that is waiting for its epoch to end.
+     * Updates only fall back to the allocator once the reservation is exhausted.
+     *
      * @param[out] hash_table Pointer to memory that will contain hash table on
      *   success.
      * @param[in] options Options to control hash table creation.
      * @retval EBPF_SUCCESS The operation was successful.
      * @retval EBPF_NO_MEMORY Unable to allocate resources for this
      *  hash table.
+     * @retval EBPF_INVALID_ARGUMENT Preallocation was requested together with
+     *  custom allocate or free functions.
      */
     _Must_inspect_result_ ebpf_result_t
     ebpf_hash_table_create(
@@ -229,6 +243,31 @@ extern "C"
     size_t
     ebpf_hash_table_key_count(_In_ const ebpf_hash_table_t* hash_table);
 
+    /**
+     * @brief Occupancy of a hash table, summed from per-CPU counters.
+     */
+    typedef struct _ebpf_hash_table_statistics
+    {
+        size_t entry_count;  //< Count of entries in the hash table.
+        size_t memory_bytes; //< Bytes allocated for the table, its buckets and values. Blocks reserved by a
+                             // preallocated table are only counted once they hold an entry.
+        size_t bucket_count; //< Count of buckets.
+        size_t bucket_length_count[EBPF_HASH_TABLE_BUCKET_LENGTH_COUNT]; //< Count of buckets holding N entries,
+                                                                         // with the last element counting buckets
+                                                                         // holding N or more entries.
+    } ebpf_hash_table_statistics_t;
+
+    /**
+     * @brief Get the occupancy of the hash table without walking its buckets. Counters are read without
+     * synchronization, so the result is a close approximation while the table is being modified.
+     *
+     * @param[in] hash_table Hash-table to query.
+     * @param[out] statistics Occupancy of the hash table.
+     */
+    void
+    ebpf_hash_table_get_statistics(
+        _In_ const ebpf_hash_table_t* hash_table, _Out_ ebpf_hash_table_statistics_t* statistics);
+
     /**
      * @brief Returns the next (key, value) pair in the hash table in lexicographical order.
      * The keys are sorted using the supplied comparison function and filtered using the supplied filter function.
@@ -568,3 +568,9 @@ ebpf_object_reference_by_handle(
     return ebpf_reference_base_object_by_handle(
         handle, _ebpf_object_compare, &object_type, (ebpf_base_object_t**)object, file_id, line);
 }
+
+ebpf_result_t
+ebpf_object_borrow_by_handle(ebpf_handle_t handle, ebpf_object_type_t object_type, _Outptr_ ebpf_core_object_t** object)
+{
+    return ebpf_borrow_base_object_by_handle(handle, _ebpf_object_compare, &object_type, (ebpf_base_object_t**)object);
+}
@@ -324,6 +324,23 @@ extern "C"
         ebpf_file_id_t file_id,
         uint32_t line);
 
+    /**
+     * @brief Find the corresponding handle in the handle table, verify the type matches,
+     *  and return the object without acquiring a reference. This avoids writing to the
+     *  object's shared reference count on hot paths. The caller must be in an epoch
+     *  for the whole time it uses the object, must not keep a pointer to it after
+     *  leaving the epoch and must not release it.
+     *
+     * @param[in] handle Handle to find in table.
+     * @param[in] object_type Object type to match.
+     * @param[out] object Pointer to memory that contains object success.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_OBJECT The provided handle is not valid.
+     */
+    ebpf_result_t
+    ebpf_object_borrow_by_handle(
+        ebpf_handle_t handle, ebpf_object_type_t object_type, _Outptr_ struct _ebpf_core_object** object);
+
 #ifdef __cplusplus
 }
 #endif
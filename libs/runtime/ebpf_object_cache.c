@@ -0,0 +1,238 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#include "ebpf_object_cache.h"
+
+/**
+ * @brief Number of operations on a CPU's free list after which the objects that stayed on the list for the whole
+ * interval are returned to the system allocator. This lets the cache shrink back once a burst of connections ends.
+ */
+#define EBPF_OBJECT_CACHE_TRIM_INTERVAL 4096
+
+/**
+ * @brief Free object on a per-CPU free list. The link overlays the start of the object.
+ */
+typedef struct _ebpf_object_cache_free_entry
+{
+    struct _ebpf_object_cache_free_entry* next;
+} ebpf_object_cache_free_entry_t;
+
+typedef __declspec(align(EBPF_CACHE_LINE_SIZE)) struct _ebpf_object_cache_cpu_entry
+{
+    KSPIN_LOCK lock;                                              ///< Lock protecting this entry.
+    _Guarded_by_(lock) ebpf_object_cache_free_entry_t* free_list; ///< Free objects.
+    _Guarded_by_(lock) uint32_t free_count;                       ///< Number of objects on free_list.
+    _Guarded_by_(lock) uint32_t idle_count;        ///< Lowest free_count seen in the current trim interval.
+    _Guarded_by_(lock) uint32_t operation_count;   ///< Operations in the current trim interval.
+    _Guarded_by_(lock) uint64_t allocate_count;    ///< Objects allocated on this CPU.
+    _Guarded_by_(lock) uint64_t hit_count;         ///< Allocations served from free_list.
+    _Guarded_by_(lock) uint64_t free_object_count; ///< Objects freed on this CPU.
+    _Guarded_by_(lock) uint64_t trimmed_count;     ///< Objects released from free_list to the system allocator.
+} ebpf_object_cache_cpu_entry_t;
+
+static_assert(
+    sizeof(ebpf_object_cache_cpu_entry_t) % EBPF_CACHE_LINE_SIZE == 0,
+    "ebpf_object_cache_cpu_entry_t must not share a cache line with another CPU's entry.");
+
+struct _ebpf_object_cache
+{
+    size_t object_size;          ///< Size in bytes of each object.
+    uint32_t max_cached_per_cpu; ///< Maximum number of objects on each free list.
+    uint32_t tag;                ///< Pool tag of the cache and its objects.
+    uint32_t cpu_count;          ///< Number of entries in cpu_entries.
+    _Field_size_(cpu_count) ebpf_object_cache_cpu_entry_t* cpu_entries; ///< Cache aligned per-CPU free lists.
+};
+
+static void
+_ebpf_object_cache_release_objects(_In_opt_ ebpf_object_cache_free_entry_t* list)
+{
+    while (list != NULL) {
+        ebpf_object_cache_free_entry_t* next = list->next;
+        ExFreePool(list);
+        list = next;
+    }
+}
+
+/**
+ * @brief Detach the objects that stayed on the free list for a whole trim interval.
+ *
+ * @param[in, out] cpu_entry Entry to account the operation to. The entry's lock must be held.
+ * @returns List of objects the caller must release after dropping the lock.
+ */
+_Requires_lock_held_(cpu_entry->lock) static ebpf_object_cache_free_entry_t* _ebpf_object_cache_end_operation(
+    _Inout_ ebpf_object_cache_cpu_entry_t* cpu_entry)
+{
+    ebpf_object_cache_free_entry_t* trimmed = NULL;
+
+    if (cpu_entry->free_count < cpu_entry->idle_count) {
+        cpu_entry->idle_count = cpu_entry->free_count;
+    }
+    if (++cpu_entry->operation_count < EBPF_OBJECT_CACHE_TRIM_INTERVAL) {
+        return NULL;
+    }
+
+    // The free list never dropped below idle_count objects in this interval, so that many were not needed.
+    for (uint32_t index = 0; index < cpu_entry->idle_count; index++) {
+        ebpf_object_cache_free_entry_t* entry = cpu_entry->free_list;
+        cpu_entry->free_list = entry->next;
+        entry->next = trimmed;
+        trimmed = entry;
+    }
+    cpu_entry->free_count -= cpu_entry->idle_count;
+    cpu_entry->trimmed_count += cpu_entry->idle_count;
+    cpu_entry->idle_count = cpu_entry->free_count;
+    cpu_entry->operation_count = 0;
+    return trimmed;
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_object_cache_create(
+    _Outptr_ ebpf_object_cache_t** cache, size_t object_size, uint32_t max_cached_per_cpu, uint32_t tag)
+{
+    *cache = NULL;
+    if (object_size == 0) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    uint32_t cpu_count = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    size_t header_size = EBPF_PAD_CACHE(sizeof(ebpf_object_cache_t));
+    size_t cache_size = header_size + cpu_count * sizeof(ebpf_object_cache_cpu_entry_t) + EBPF_CACHE_LINE_SIZE;
+    ebpf_object_cache_t* local_cache =
+        (ebpf_object_cache_t*)ExAllocatePoolUninitialized(NonPagedPoolNx, cache_size, tag);
+    if (local_cache == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    memset(local_cache, 0, cache_size);
+
+    // Objects on a free list hold the link, so they can be no smaller than it.
+    if (object_size < sizeof(ebpf_object_cache_free_entry_t)) {
+        object_size = sizeof(ebpf_object_cache_free_entry_t);
+    }
+    local_cache->object_size = EBPF_PAD_8(object_size);
+    local_cache->max_cached_per_cpu = max_cached_per_cpu;
+    local_cache->tag = tag;
+    local_cache->cpu_count = cpu_count;
+    local_cache->cpu_entries =
+        (ebpf_object_cache_cpu_entry_t*)EBPF_CACHE_ALIGN_POINTER((uint8_t*)local_cache + header_size);
+    for (uint32_t cpu_id = 0; cpu_id < cpu_count; cpu_id++) {
+        KeInitializeSpinLock(&local_cache->cpu_entries[cpu_id].lock);
+    }
+
+    *cache = local_cache;
+    return EBPF_SUCCESS;
+}
+
+void
+ebpf_object_cache_destroy(_In_opt_ _Post_ptr_invalid_ ebpf_object_cache_t* cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    ebpf_object_cache_trim(cache);
+
+    // Objects still allocated would be leaked, or freed to a cache that no longer exists.
+    ebpf_object_cache_statistics_t statistics;
+    ebpf_object_cache_get_statistics(cache, &statistics);
+    ASSERT(statistics.allocate_count == statistics.free_count);
+
+    ExFreePool(cache);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL) _Must_inspect_result_ _Ret_maybenull_ void* ebpf_object_cache_allocate(
+    _Inout_ ebpf_object_cache_t* cache)
+{
+    // Raise to DISPATCH_LEVEL first so that the thread stays on the CPU whose entry it picks.
+    KIRQL old_irql = KeRaiseIrqlToDpcLevel();
+    ebpf_object_cache_cpu_entry_t* cpu_entry =
+        &cache->cpu_entries[KeGetCurrentProcessorNumberEx(NULL) % cache->cpu_count];
+
+    KeAcquireSpinLockAtDpcLevel(&cpu_entry->lock);
+    ebpf_object_cache_free_entry_t* object = cpu_entry->free_list;
+    if (object != NULL) {
+        cpu_entry->free_list = object->next;
+        cpu_entry->free_count--;
+        cpu_entry->hit_count++;
+    }
+    cpu_entry->allocate_count++;
+    ebpf_object_cache_free_entry_t* trimmed = _ebpf_object_cache_end_operation(cpu_entry);
+    KeReleaseSpinLockFromDpcLevel(&cpu_entry->lock);
+
+    _ebpf_object_cache_release_objects(trimmed);
+    if (object == NULL) {
+        object = (ebpf_object_cache_free_entry_t*)ExAllocatePoolUninitialized(
+            NonPagedPoolNx, cache->object_size, cache->tag);
+        if (object == NULL) {
+            // Keep allocate_count and free_count balanced for the failed allocation.
+            KeAcquireSpinLockAtDpcLevel(&cpu_entry->lock);
+            cpu_entry->allocate_count--;
+            KeReleaseSpinLockFromDpcLevel(&cpu_entry->lock);
+        }
+    }
+    KeLowerIrql(old_irql);
+    return object;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL) void ebpf_object_cache_free(
+    _Inout_ ebpf_object_cache_t* cache, _Frees_ptr_opt_ void* object)
+{
+    if (object == NULL) {
+        return;
+    }
+
+    KIRQL old_irql = KeRaiseIrqlToDpcLevel();
+    ebpf_object_cache_cpu_entry_t* cpu_entry =
+        &cache->cpu_entries[KeGetCurrentProcessorNumberEx(NULL) % cache->cpu_count];
+    ebpf_object_cache_free_entry_t* entry = (ebpf_object_cache_free_entry_t*)object;
+
+    KeAcquireSpinLockAtDpcLevel(&cpu_entry->lock);
+    cpu_entry->free_object_count++;
+    if (cpu_entry->free_count < cache->max_cached_per_cpu) {
+        entry->next = cpu_entry->free_list;
+        cpu_entry->free_list = entry;
+        cpu_entry->free_count++;
+        entry = NULL;
+    }
+    ebpf_object_cache_free_entry_t* trimmed = _ebpf_object_cache_end_operation(cpu_entry);
+    KeReleaseSpinLockFromDpcLevel(&cpu_entry->lock);
+
+    if (entry != NULL) {
+        ExFreePool(entry);
+    }
+    _ebpf_object_cache_release_objects(trimmed);
+    KeLowerIrql(old_irql);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL) void ebpf_object_cache_trim(_Inout_ ebpf_object_cache_t* cache)
+{
+    for (uint32_t cpu_id = 0; cpu_id < cache->cpu_count; cpu_id++) {
+        ebpf_object_cache_cpu_entry_t* cpu_entry = &cache->cpu_entries[cpu_id];
+        KIRQL old_irql;
+
+        KeAcquireSpinLock(&cpu_entry->lock, &old_irql);
+        ebpf_object_cache_free_entry_t* trimmed = cpu_entry->free_list;
+        cpu_entry->trimmed_count += cpu_entry->free_count;
+        cpu_entry->free_list = NULL;
+        cpu_entry->free_count = 0;
+        cpu_entry->idle_count = 0;
+        cpu_entry->operation_count = 0;
+        KeReleaseSpinLock(&cpu_entry->lock, old_irql);
+
+        _ebpf_object_cache_release_objects(trimmed);
+    }
+}
+
+void
+ebpf_object_cache_get_statistics(
+    _In_ const ebpf_object_cache_t* cache, _Out_ ebpf_object_cache_statistics_t* statistics)
+{
+    memset(statistics, 0, sizeof(*statistics));
+    for (uint32_t cpu_id = 0; cpu_id < cache->cpu_count; cpu_id++) {
+        const volatile ebpf_object_cache_cpu_entry_t* cpu_entry = &cache->cpu_entries[cpu_id];
+        statistics->allocate_count += cpu_entry->allocate_count;
+        statistics->hit_count += cpu_entry->hit_count;
+        statistics->free_count += cpu_entry->free_object_count;
+        statistics->cached_count += cpu_entry->free_count;
+        statistics->trimmed_count += cpu_entry->trimmed_count;
+    }
+}
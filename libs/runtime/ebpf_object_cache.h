@@ -0,0 +1,98 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "framework.h"
+#include "ebpf_shared_framework.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Cache of fixed size objects, used for objects that are allocated and freed at a high rate such as
+     * per-connection contexts. Each CPU keeps its own list of free objects so that a free followed by an allocate
+     * on the same CPU reuses the object without calling into the system allocator.
+     *
+     * The module only depends on the NT kernel API so that extensions can compile it in directly.
+     */
+    typedef struct _ebpf_object_cache ebpf_object_cache_t;
+
+    typedef struct _ebpf_object_cache_statistics
+    {
+        uint64_t allocate_count; ///< Number of objects allocated.
+        uint64_t hit_count;      ///< Number of allocations served from a per-CPU free list.
+        uint64_t free_count;     ///< Number of objects freed.
+        uint64_t cached_count;   ///< Number of objects currently held in the per-CPU free lists.
+        uint64_t trimmed_count;  ///< Number of cached objects returned to the system allocator.
+    } ebpf_object_cache_statistics_t;
+
+    /**
+     * @brief Create an object cache.
+     *
+     * @param[out] cache Pointer to memory that will contain the cache on success.
+     * @param[in] object_size Size in bytes of each object.
+     * @param[in] max_cached_per_cpu Maximum number of free objects kept on each CPU. Objects freed to a full list are
+     *  returned to the system allocator.
+     * @param[in] tag Pool tag to use for the cache and its objects.
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_INVALID_ARGUMENT The object size is zero.
+     * @retval EBPF_NO_MEMORY Unable to allocate resources for this
+     *  operation.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_object_cache_create(
+        _Outptr_ ebpf_object_cache_t** cache, size_t object_size, uint32_t max_cached_per_cpu, uint32_t tag);
+
+    /**
+     * @brief Destroy an object cache and release the objects it holds. Every object allocated from the cache must
+     * already have been freed.
+     *
+     * @param[in] cache Cache to destroy.
+     */
+    void
+    ebpf_object_cache_destroy(_In_opt_ _Post_ptr_invalid_ ebpf_object_cache_t* cache);
+
+    /**
+     * @brief Allocate an object. The object is taken from the current CPU's free list if possible and from the
+     * system allocator otherwise. The contents of the object are not initialized.
+     *
+     * @param[in, out] cache Cache to allocate from.
+     * @returns Pointer to the object, or NULL on failure.
+     */
+    _IRQL_requires_max_(DISPATCH_LEVEL) _Must_inspect_result_ _Ret_maybenull_ void* ebpf_object_cache_allocate(
+        _Inout_ ebpf_object_cache_t* cache);
+
+    /**
+     * @brief Free an object allocated from the cache. The object is kept on the current CPU's free list unless the
+     * list is full.
+     *
+     * @param[in, out] cache Cache the object was allocated from.
+     * @param[in] object Object to free.
+     */
+    _IRQL_requires_max_(DISPATCH_LEVEL) void ebpf_object_cache_free(
+        _Inout_ ebpf_object_cache_t* cache, _Frees_ptr_opt_ void* object);
+
+    /**
+     * @brief Return every cached object to the system allocator.
+     *
+     * @param[in, out] cache Cache to trim.
+     */
+    _IRQL_requires_max_(DISPATCH_LEVEL) void ebpf_object_cache_trim(_Inout_ ebpf_object_cache_t* cache);
+
+    /**
+     * @brief Sum the counters of all CPUs. Counters are read without synchronization, so the result is a close
+     * approximation while the cache is in use.
+     *
+     * @param[in] cache Cache to query.
+     * @param[out] statistics Sum of the counters of all CPUs.
+     */
+    void
+    ebpf_object_cache_get_statistics(
+        _In_ const ebpf_object_cache_t* cache, _Out_ ebpf_object_cache_statistics_t* statistics);
+
+#ifdef __cplusplus
+}
+#endif
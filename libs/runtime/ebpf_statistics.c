@@ -0,0 +1,81 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#include "ebpf_epoch.h"
+#include "ebpf_statistics.h"
+
+typedef __declspec(align(EBPF_CACHE_LINE_SIZE)) struct _ebpf_statistics_cpu_entry
+{
+    ebpf_runtime_statistics_t statistics;
+} ebpf_statistics_cpu_entry_t;
+
+static_assert(
+    sizeof(ebpf_statistics_cpu_entry_t) % EBPF_CACHE_LINE_SIZE == 0,
+    "ebpf_statistics_cpu_entry_t must not share a cache line with another CPU's entry.");
+static_assert(
+    sizeof(ebpf_runtime_statistics_t) % sizeof(uint64_t) == 0,
+    "ebpf_statistics_query sums ebpf_runtime_statistics_t as an array of uint64_t counters.");
+
+// Pointer to cache aligned array of per-CPU counters.
+static _Writable_elements_(_ebpf_statistics_cpu_count) ebpf_statistics_cpu_entry_t* _ebpf_statistics_cpu_table = NULL;
+static uint32_t _ebpf_statistics_cpu_count = 0;
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_statistics_initiate()
+{
+    uint32_t cpu_count = ebpf_get_cpu_count();
+    size_t table_size = cpu_count * sizeof(ebpf_statistics_cpu_entry_t);
+    ebpf_statistics_cpu_entry_t* cpu_table =
+        (ebpf_statistics_cpu_entry_t*)ebpf_epoch_allocate_cache_aligned_with_tag(table_size, EBPF_POOL_TAG_STATISTICS);
+    if (cpu_table == NULL) {
+        return EBPF_NO_MEMORY;
+    }
+    memset(cpu_table, 0, table_size);
+
+    _ebpf_statistics_cpu_count = cpu_count;
+    _ebpf_statistics_cpu_table = cpu_table;
+    return EBPF_SUCCESS;
+}
+
+void
+ebpf_statistics_terminate()
+{
+    ebpf_statistics_cpu_entry_t* cpu_table = _ebpf_statistics_cpu_table;
+    if (cpu_table == NULL) {
+        return;
+    }
+    _ebpf_statistics_cpu_table = NULL;
+    _ebpf_statistics_cpu_count = 0;
+    // Callers that read the table pointer before it was cleared may still increment through it until the epoch ends.
+    ebpf_epoch_free_cache_aligned(cpu_table);
+}
+
+_Ret_maybenull_ ebpf_runtime_statistics_t*
+ebpf_statistics_get_current_cpu_block()
+{
+    ebpf_statistics_cpu_entry_t* cpu_table = _ebpf_statistics_cpu_table;
+    if (cpu_table == NULL) {
+        return NULL;
+    }
+    return &cpu_table[ebpf_get_current_cpu()].statistics;
+}
+
+void
+ebpf_statistics_query(_Out_ ebpf_runtime_statistics_t* statistics)
+{
+    memset(statistics, 0, sizeof(*statistics));
+    ebpf_statistics_cpu_entry_t* cpu_table = _ebpf_statistics_cpu_table;
+    if (cpu_table == NULL) {
+        return;
+    }
+
+    // Every field is a uint64_t, so the blocks can be summed as arrays of counters.
+    const size_t counter_count = sizeof(*statistics) / sizeof(uint64_t);
+    uint64_t* total = (uint64_t*)statistics;
+    for (uint32_t cpu_id = 0; cpu_id < _ebpf_statistics_cpu_count; cpu_id++) {
+        const volatile uint64_t* counters = (const volatile uint64_t*)&cpu_table[cpu_id].statistics;
+        for (size_t index = 0; index < counter_count; index++) {
+            total[index] += counters[index];
+        }
+    }
+}
@@ -0,0 +1,71 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "ebpf_core_structs.h"
+#include "ebpf_platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Initialize the runtime statistics module. The counters are always
+     * on; each CPU has its own cache aligned block so that recording an event
+     * is a plain increment with no interlocked operation or shared cache line.
+     * Must be called after ebpf_epoch_initiate.
+     *
+     * @retval EBPF_SUCCESS The operation was successful.
+     * @retval EBPF_NO_MEMORY Unable to allocate resources for this
+     *  operation.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_statistics_initiate();
+
+    /**
+     * @brief Terminate the runtime statistics module. The counter blocks are
+     * released through the epoch, because a CPU may still be incrementing a
+     * counter it looked up before the call, so this must be called before
+     * ebpf_epoch_terminate.
+     */
+    void
+    ebpf_statistics_terminate();
+
+    /**
+     * @brief Get the counter block of the current CPU.
+     *
+     * @returns Pointer to the counter block, or NULL if the module is not
+     *  initialized.
+     */
+    _Ret_maybenull_ ebpf_runtime_statistics_t*
+    ebpf_statistics_get_current_cpu_block();
+
+    /**
+     * @brief Sum the counter blocks of all CPUs. Counters are read without
+     * synchronization, so the result is a close approximation while events are
+     * being recorded.
+     *
+     * @param[out] statistics Sum of the counters of all CPUs.
+     */
+    void
+    ebpf_statistics_query(_Out_ ebpf_runtime_statistics_t* statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @brief Record an event in the current CPU's counter block. Callers running
+ * below DISPATCH_LEVEL may be preempted between picking the block and the
+ * increment, in which case an event is occasionally lost; that is accepted to
+ * keep the data path free of interlocked operations.
+ */
+#define EBPF_STATISTICS_INCREMENT(counter)                                                \
+    do {                                                                                  \
+        ebpf_runtime_statistics_t* _statistics = ebpf_statistics_get_current_cpu_block(); \
+        if (_statistics != NULL) {                                                        \
+            _statistics->counter++;                                                       \
+        }                                                                                 \
+    } while (0)
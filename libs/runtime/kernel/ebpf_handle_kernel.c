@@ -150,3 +150,52 @@ Done:
     }
     return return_value;
 }
+
+_IRQL_requires_max_(PASSIVE_LEVEL) ebpf_result_t ebpf_borrow_base_object_by_handle(
+    ebpf_handle_t handle,
+    _In_opt_ ebpf_compare_object_t compare_function,
+    _In_opt_ const void* context,
+    _Outptr_ struct _ebpf_base_object** object)
+{
+    ebpf_result_t return_value;
+    NTSTATUS status;
+    FILE_OBJECT* file_object = NULL;
+    ebpf_base_object_t* local_object;
+
+    // The file object holds a reference on the eBPF object until it is closed, so the eBPF
+    // object's reference count is at least one here. Only the file object, which is private
+    // to this handle, is referenced, and only for the duration of the lookup.
+    status = ObReferenceObjectByHandle((HANDLE)handle, 0, NULL, UserMode, &file_object, NULL);
+    if (!NT_SUCCESS(status)) {
+        EBPF_LOG_NTSTATUS_API_FAILURE(EBPF_TRACELOG_KEYWORD_BASE, ObReferenceObjectByHandle, status);
+        return_value = EBPF_INVALID_OBJECT;
+        goto Done;
+    }
+
+    if (file_object->DeviceObject != ebpf_driver_get_device_object()) {
+        return_value = EBPF_INVALID_OBJECT;
+        goto Done;
+    }
+
+    local_object = (ebpf_base_object_t*)file_object->FsContext2;
+    if (local_object == NULL) {
+        return_value = EBPF_INVALID_OBJECT;
+        goto Done;
+    }
+
+    if (compare_function) {
+        if (!compare_function(local_object, context)) {
+            return_value = EBPF_INVALID_OBJECT;
+            goto Done;
+        }
+    }
+
+    *object = local_object;
+    return_value = EBPF_SUCCESS;
+
+Done:
+    if (file_object) {
+        ObDereferenceObject(file_object);
+    }
+    return return_value;
+}
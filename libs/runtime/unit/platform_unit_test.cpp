@@ -10,6 +10,7 @@
 #include "ebpf_epoch.h"
 #include "ebpf_hash_table.h"
 #include "ebpf_nethooks.h"
+#include "ebpf_object_cache.h"
 #include "ebpf_pinning_table.h"
 #include "ebpf_platform.h"
 #include "ebpf_program_types.h"
@@ -17,6 +18,7 @@
 #include "ebpf_ring_buffer.h"
 #include "ebpf_serialize.h"
 #include "ebpf_state.h"
+#include "ebpf_statistics.h"
 #include "ebpf_work_queue.h"
 #include "helpers.h"
 #include "kissfft.hh"
@@ -201,6 +203,7 @@ class _test_helper
         REQUIRE(ebpf_random_initiate() == EBPF_SUCCESS);
         REQUIRE(ebpf_epoch_initiate() == EBPF_SUCCESS);
         epoch_initiated = true;
+        REQUIRE(ebpf_statistics_initiate() == EBPF_SUCCESS);
         REQUIRE(ebpf_object_tracking_initiate() == EBPF_SUCCESS);
         object_tracking_initiated = true;
         REQUIRE(ebpf_async_initiate() == EBPF_SUCCESS);
@@ -220,6 +223,7 @@ class _test_helper
             ebpf_object_tracking_terminate();
         }
         if (epoch_initiated) {
+            ebpf_statistics_terminate();
             ebpf_epoch_synchronize();
             ebpf_epoch_terminate();
         }
@@ -470,6 +474,253 @@ TEST_CASE("hash_table_test", "[platform]")
     REQUIRE(ebpf_hash_table_key_count(table.get()) == 0);
 }
 
+TEST_CASE("hash_table_preallocated_test", "[platform]")
+{
+    _test_helper test_helper;
+    test_helper.initialize();
+
+    const size_t entry_count = 16;
+    ebpf_hash_table_creation_options_t options = {
+        .key_size = sizeof(uint32_t),
+        .value_size = sizeof(uint64_t),
+        .allocate = ebpf_allocate_with_tag,
+        .free = ebpf_free,
+        .minimum_bucket_count = 1,
+        .preallocated_entries = entry_count,
+    };
+
+    // Preallocated tables require the default allocator.
+    ebpf_hash_table_t* raw_ptr = nullptr;
+    REQUIRE(ebpf_hash_table_create(&raw_ptr, &options) == EBPF_INVALID_ARGUMENT);
+
+    options.allocate = nullptr;
+    options.free = nullptr;
+    REQUIRE(ebpf_hash_table_create(&raw_ptr, &options) == EBPF_SUCCESS);
+    ebpf_hash_table_ptr table(raw_ptr);
+
+    // A single bucket forces chains longer than the reserved bucket capacity, which fall back to the allocator.
+    for (size_t round = 0; round < 4; round++) {
+        ebpf_epoch_scope_t epoch_scope;
+        for (uint32_t key = 0; key < entry_count; key++) {
+            uint64_t value = static_cast<uint64_t>(key) + round;
+            REQUIRE(
+                ebpf_hash_table_update(
+                    table.get(),
+                    nullptr,
+                    reinterpret_cast<const uint8_t*>(&key),
+                    reinterpret_cast<const uint8_t*>(&value),
+                    EBPF_HASH_TABLE_OPERATION_ANY) == EBPF_SUCCESS);
+        }
+        REQUIRE(ebpf_hash_table_key_count(table.get()) == entry_count);
+
+        for (uint32_t key = 0; key < entry_count; key++) {
+            uint8_t* returned_value = nullptr;
+            REQUIRE(
+                ebpf_hash_table_find(table.get(), reinterpret_cast<const uint8_t*>(&key), &returned_value) ==
+                EBPF_SUCCESS);
+            REQUIRE(*reinterpret_cast<uint64_t*>(returned_value) == static_cast<uint64_t>(key) + round);
+        }
+
+        // Delete every other key so that the next round both inserts and updates.
+        for (uint32_t key = 0; key < entry_count; key += 2) {
+            REQUIRE(
+                ebpf_hash_table_delete(table.get(), nullptr, reinterpret_cast<const uint8_t*>(&key)) == EBPF_SUCCESS);
+        }
+        REQUIRE(ebpf_hash_table_key_count(table.get()) == entry_count / 2);
+        epoch_scope.exit();
+        ebpf_epoch_synchronize();
+    }
+}
+
+TEST_CASE("hash_table_occupancy", "[platform]")
+{
+    _test_helper test_helper;
+    test_helper.initialize();
+
+    ebpf_hash_table_creation_options_t options = {
+        .key_size = sizeof(uint32_t),
+        .value_size = sizeof(uint64_t),
+        .minimum_bucket_count = 1,
+    };
+    ebpf_hash_table_t* raw_ptr = nullptr;
+    REQUIRE(ebpf_hash_table_create(&raw_ptr, &options) == EBPF_SUCCESS);
+    ebpf_hash_table_ptr table(raw_ptr);
+
+    ebpf_hash_table_statistics_t empty;
+    ebpf_hash_table_get_statistics(table.get(), &empty);
+    REQUIRE(empty.entry_count == 0);
+    REQUIRE(empty.bucket_count == 1);
+    REQUIRE(empty.bucket_length_count[0] == 1);
+    REQUIRE(empty.memory_bytes > 0);
+
+    // With a single bucket, every key lands in the same chain.
+    const uint32_t entry_count = 3;
+    ebpf_epoch_scope_t epoch_scope;
+    for (uint32_t key = 0; key < entry_count; key++) {
+        uint64_t value = key;
+        REQUIRE(
+            ebpf_hash_table_update(
+                table.get(),
+                nullptr,
+                reinterpret_cast<const uint8_t*>(&key),
+                reinterpret_cast<const uint8_t*>(&value),
+                EBPF_HASH_TABLE_OPERATION_ANY) == EBPF_SUCCESS);
+    }
+
+    ebpf_hash_table_statistics_t full;
+    ebpf_hash_table_get_statistics(table.get(), &full);
+    REQUIRE(full.entry_count == entry_count);
+    REQUIRE(ebpf_hash_table_key_count(table.get()) == entry_count);
+    REQUIRE(full.bucket_length_count[0] == 0);
+    REQUIRE(full.bucket_length_count[entry_count] == 1);
+    REQUIRE(full.memory_bytes > empty.memory_bytes + entry_count * sizeof(uint64_t));
+
+    // Updating an existing key doesn't change the occupancy.
+    uint32_t key = 0;
+    uint64_t value = 42;
+    REQUIRE(
+        ebpf_hash_table_update(
+            table.get(),
+            nullptr,
+            reinterpret_cast<const uint8_t*>(&key),
+            reinterpret_cast<const uint8_t*>(&value),
+            EBPF_HASH_TABLE_OPERATION_REPLACE) == EBPF_SUCCESS);
+    ebpf_hash_table_statistics_t updated;
+    ebpf_hash_table_get_statistics(table.get(), &updated);
+    REQUIRE(memcmp(&updated, &full, sizeof(updated)) == 0);
+
+    for (key = 0; key < entry_count; key++) {
+        REQUIRE(ebpf_hash_table_delete(table.get(), nullptr, reinterpret_cast<const uint8_t*>(&key)) == EBPF_SUCCESS);
+    }
+    epoch_scope.exit();
+
+    ebpf_hash_table_statistics_t drained;
+    ebpf_hash_table_get_statistics(table.get(), &drained);
+    REQUIRE(memcmp(&drained, &empty, sizeof(drained)) == 0);
+    REQUIRE(ebpf_hash_table_key_count(table.get()) == 0);
+}
+
+TEST_CASE("statistics_test", "[platform]")
+{
+    _test_helper test_helper;
+    test_helper.initialize();
+
+    ebpf_runtime_statistics_t before;
+    ebpf_statistics_query(&before);
+
+    ebpf_hash_table_creation_options_t options = {
+        .key_size = sizeof(uint32_t),
+        .value_size = sizeof(uint64_t),
+        .minimum_bucket_count = 1,
+    };
+    ebpf_hash_table_t* raw_ptr = nullptr;
+    REQUIRE(ebpf_hash_table_create(&raw_ptr, &options) == EBPF_SUCCESS);
+    ebpf_hash_table_ptr table(raw_ptr);
+
+    // With a single bucket, every lookup searches a bucket holding all of the keys.
+    const uint32_t entry_count = 3;
+    {
+        ebpf_epoch_scope_t epoch_scope;
+        for (uint32_t key = 0; key < entry_count; key++) {
+            uint64_t value = key;
+            REQUIRE(
+                ebpf_hash_table_update(
+                    table.get(),
+                    nullptr,
+                    reinterpret_cast<const uint8_t*>(&key),
+                    reinterpret_cast<const uint8_t*>(&value),
+                    EBPF_HASH_TABLE_OPERATION_ANY) == EBPF_SUCCESS);
+        }
+        for (uint32_t key = 0; key < entry_count; key++) {
+            uint8_t* returned_value = nullptr;
+            REQUIRE(
+                ebpf_hash_table_find(table.get(), reinterpret_cast<const uint8_t*>(&key), &returned_value) ==
+                EBPF_SUCCESS);
+        }
+
+        void* memory = ebpf_epoch_allocate(10);
+        REQUIRE(memory != nullptr);
+        ebpf_epoch_free(memory);
+    }
+    ebpf_epoch_synchronize();
+
+    ebpf_runtime_statistics_t after;
+    ebpf_statistics_query(&after);
+    REQUIRE(after.hash_chain_length[entry_count] - before.hash_chain_length[entry_count] == entry_count);
+    REQUIRE(after.epoch_advance_count > before.epoch_advance_count);
+    REQUIRE(after.epoch_free_list_insert_count > before.epoch_free_list_insert_count);
+    REQUIRE(after.epoch_free_list_release_count > before.epoch_free_list_release_count);
+}
+
+TEST_CASE("object_cache_test", "[platform]")
+{
+    _test_helper test_helper;
+    test_helper.initialize();
+
+    const uint32_t max_cached_per_cpu = 4;
+    ebpf_object_cache_t* cache = nullptr;
+    REQUIRE(ebpf_object_cache_create(&cache, 0, max_cached_per_cpu, EBPF_POOL_TAG_DEFAULT) == EBPF_INVALID_ARGUMENT);
+    REQUIRE(ebpf_object_cache_create(&cache, 24, max_cached_per_cpu, EBPF_POOL_TAG_DEFAULT) == EBPF_SUCCESS);
+
+    // Objects are kept on the list of the CPU that frees them, so run on a single CPU.
+    std::thread worker([cache]() {
+        SetThreadAffinityMask(GetCurrentThread(), 1);
+        ebpf_object_cache_statistics_t statistics;
+
+        std::vector<void*> objects;
+        for (uint32_t index = 0; index < 2 * max_cached_per_cpu; index++) {
+            void* object = ebpf_object_cache_allocate(cache);
+            REQUIRE(object != nullptr);
+            memset(object, 0xff, 24);
+            objects.push_back(object);
+        }
+        ebpf_object_cache_get_statistics(cache, &statistics);
+        REQUIRE(statistics.allocate_count == 2 * max_cached_per_cpu);
+        REQUIRE(statistics.hit_count == 0);
+
+        // Only max_cached_per_cpu objects are kept, the others are released right away.
+        for (auto object : objects) {
+            ebpf_object_cache_free(cache, object);
+        }
+        objects.clear();
+        ebpf_object_cache_get_statistics(cache, &statistics);
+        REQUIRE(statistics.free_count == 2 * max_cached_per_cpu);
+        REQUIRE(statistics.cached_count == max_cached_per_cpu);
+
+        // Cached objects are reused.
+        for (uint32_t index = 0; index < max_cached_per_cpu; index++) {
+            objects.push_back(ebpf_object_cache_allocate(cache));
+            REQUIRE(objects.back() != nullptr);
+        }
+        ebpf_object_cache_get_statistics(cache, &statistics);
+        REQUIRE(statistics.hit_count == max_cached_per_cpu);
+        REQUIRE(statistics.cached_count == 0);
+        for (auto object : objects) {
+            ebpf_object_cache_free(cache, object);
+        }
+
+        // Churn on a single object leaves the other cached objects idle, so they are trimmed once a whole trim
+        // interval has passed without them being used.
+        for (uint32_t index = 0; index < 10000; index++) {
+            void* object = ebpf_object_cache_allocate(cache);
+            REQUIRE(object != nullptr);
+            ebpf_object_cache_free(cache, object);
+        }
+        ebpf_object_cache_get_statistics(cache, &statistics);
+        REQUIRE(statistics.trimmed_count == max_cached_per_cpu - 1);
+        REQUIRE(statistics.cached_count == 1);
+
+        ebpf_object_cache_trim(cache);
+        ebpf_object_cache_get_statistics(cache, &statistics);
+        REQUIRE(statistics.trimmed_count == max_cached_per_cpu);
+        REQUIRE(statistics.cached_count == 0);
+        REQUIRE(statistics.allocate_count == statistics.free_count);
+    });
+    worker.join();
+
+    ebpf_object_cache_destroy(cache);
+}
+
 void
 run_in_epoch(std::function<void()> function)
 {
@@ -660,6 +911,52 @@ TEST_CASE("epoch_test_single_epoch_cache_aligned", "[platform]")
     ebpf_epoch_synchronize();
 }
 
+TEST_CASE("epoch_test_pool", "[platform]")
+{
+    _test_helper test_helper;
+    test_helper.initialize();
+
+    const size_t block_count = 4;
+    ebpf_epoch_pool_t* pool = nullptr;
+    REQUIRE(ebpf_epoch_pool_create(&pool, 10, block_count, EBPF_POOL_TAG_DEFAULT) == EBPF_SUCCESS);
+
+    ebpf_epoch_scope_t epoch_scope;
+    std::vector<void*> blocks;
+    for (size_t index = 0; index < block_count; index++) {
+        void* block = ebpf_epoch_pool_allocate(pool);
+        REQUIRE(block != nullptr);
+        // Blocks are zeroed and must not overlap.
+        for (size_t offset = 0; offset < 10; offset++) {
+            REQUIRE(static_cast<uint8_t*>(block)[offset] == 0);
+        }
+        memset(block, 0xff, 10);
+        blocks.push_back(block);
+    }
+
+    // The pool is exhausted.
+    REQUIRE(ebpf_epoch_pool_allocate(pool) == nullptr);
+
+    // Freed blocks only return to the pool once the epoch ends.
+    for (auto block : blocks) {
+        ebpf_epoch_free(block);
+    }
+    REQUIRE(ebpf_epoch_pool_allocate(pool) == nullptr);
+    epoch_scope.exit();
+
+    // The epoch ends on each CPU in turn, so retry until the blocks are back.
+    void* block = nullptr;
+    for (size_t attempt = 0; attempt < 10 && block == nullptr; attempt++) {
+        ebpf_epoch_synchronize();
+        block = ebpf_epoch_pool_allocate(pool);
+    }
+    REQUIRE(block != nullptr);
+
+    // Destroy the pool while the block is waiting for the epoch to end.
+    ebpf_epoch_free(block);
+    ebpf_epoch_pool_destroy(pool);
+    ebpf_epoch_synchronize();
+}
+
 TEST_CASE("epoch_test_two_threads", "[platform]")
 {
     _test_helper test_helper;
@@ -125,3 +125,30 @@ _IRQL_requires_max_(PASSIVE_LEVEL) ebpf_result_t ebpf_reference_base_object_by_h
     ebpf_lock_unlock(&_ebpf_handle_table_lock, state);
     return return_value;
 }
+
+_IRQL_requires_max_(PASSIVE_LEVEL) ebpf_result_t ebpf_borrow_base_object_by_handle(
+    ebpf_handle_t handle,
+    _In_opt_ ebpf_compare_object_t compare_function,
+    _In_opt_ const void* context,
+    _Outptr_ struct _ebpf_base_object** object)
+{
+    ebpf_result_t return_value;
+    ebpf_lock_state_t state;
+
+    if (handle >= EBPF_COUNT_OF(_ebpf_handle_table)) {
+        EBPF_LOG_MESSAGE_UINT64(EBPF_TRACELOG_LEVEL_CRITICAL, EBPF_TRACELOG_KEYWORD_BASE, "Invalid handle", handle);
+        return EBPF_INVALID_OBJECT;
+    }
+
+    state = ebpf_lock_lock(&_ebpf_handle_table_lock);
+    if (_ebpf_handle_table[handle] != NULL &&
+        (compare_function == NULL || compare_function(_ebpf_handle_table[handle], context))) {
+        *object = _ebpf_handle_table[handle];
+        return_value = EBPF_SUCCESS;
+    } else {
+        return_value = EBPF_INVALID_OBJECT;
+    }
+
+    ebpf_lock_unlock(&_ebpf_handle_table_lock, state);
+    return return_value;
+}
@@ -0,0 +1,164 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#include "hash.h"
+#include "verification_cache.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+
+// Maximum number of verification results kept in the cache. Each entry only
+// holds a hash, so the cap bounds memory use rather than lookup cost.
+#define EBPF_VERIFICATION_CACHE_MAX_ENTRIES 4096
+
+// Bump this whenever the set or order of fields hashed into the key changes.
+#define EBPF_VERIFICATION_CACHE_KEY_VERSION 1
+
+static std::mutex _ebpf_verification_cache_mutex;
+
+// Keys ordered from most recently to least recently used.
+_Guarded_by_(_ebpf_verification_cache_mutex) static std::list<ebpf_verification_cache_key_t>
+    _ebpf_verification_cache_lru;
+_Guarded_by_(_ebpf_verification_cache_mutex) static std::
+    map<ebpf_verification_cache_key_t, std::list<ebpf_verification_cache_key_t>::iterator> _ebpf_verification_cache;
+
+static void
+_append_helper_prototypes(
+    _Inout_ hash_t::byte_range_t& byte_range,
+    uint32_t count,
+    _In_reads_opt_(count) const ebpf_helper_function_prototype_t* prototypes)
+{
+    hash_t::append_byte_range(byte_range, count);
+    if (prototypes == nullptr) {
+        return;
+    }
+
+    for (uint32_t index = 0; index < count; index++) {
+        const ebpf_helper_function_prototype_t& prototype = prototypes[index];
+        hash_t::append_byte_range(byte_range, prototype.helper_id);
+        if (prototype.name != nullptr) {
+            hash_t::append_byte_range(byte_range, prototype.name);
+        }
+        hash_t::append_byte_range(byte_range, prototype.return_type);
+        for (size_t argument = 0; argument < _countof(prototype.arguments); argument++) {
+            hash_t::append_byte_range(byte_range, prototype.arguments[argument]);
+        }
+        hash_t::append_byte_range(byte_range, prototype.flags);
+        hash_t::append_byte_range(byte_range, prototype.implicit_context);
+    }
+}
+
+ebpf_verification_cache_key_t
+ebpf_verification_cache_compute_key(
+    _In_ const ebpf_program_type_t* program_type,
+    _In_ const ebpf_program_info_t* program_info,
+    _In_reads_(instruction_count) const ebpf_inst* instructions,
+    uint32_t instruction_count,
+    _In_ const std::vector<map_cache_t>& map_descriptors,
+    _In_ const prevail::ebpf_verifier_options_t& options) noexcept(false)
+{
+    const ebpf_program_type_descriptor_t* descriptor = program_info->program_type_descriptor;
+    if (descriptor == nullptr || descriptor->context_descriptor == nullptr) {
+        throw std::runtime_error("Program type descriptor not found.");
+    }
+
+    // The hashed values are locals copied into the byte range by address, so
+    // they must stay alive until the hash is computed.
+    const uint32_t key_version = EBPF_VERIFICATION_CACHE_KEY_VERSION;
+    const bool check_for_termination = options.cfg_opts.check_for_termination;
+    const bool must_have_exit = options.cfg_opts.must_have_exit;
+    const bool mock_map_fds = options.mock_map_fds;
+    const bool strict = options.strict;
+    const bool allow_division_by_zero = options.allow_division_by_zero;
+    const bool setup_constraints = options.setup_constraints;
+    const bool big_endian = options.big_endian;
+
+    hash_t::byte_range_t byte_range;
+    hash_t::append_byte_range(byte_range, key_version);
+
+    // Verifier options that affect the outcome of the analysis. Verbosity
+    // options only affect the report and are deliberately not included.
+    hash_t::append_byte_range(byte_range, check_for_termination);
+    hash_t::append_byte_range(byte_range, must_have_exit);
+    hash_t::append_byte_range(byte_range, mock_map_fds);
+    hash_t::append_byte_range(byte_range, strict);
+    hash_t::append_byte_range(byte_range, allow_division_by_zero);
+    hash_t::append_byte_range(byte_range, setup_constraints);
+    hash_t::append_byte_range(byte_range, big_endian);
+
+    // Program information, including every helper prototype, so that a provider
+    // changing a prototype invalidates all entries verified against the old one.
+    hash_t::append_byte_range(byte_range, *program_type);
+    hash_t::append_byte_range(byte_range, descriptor->name);
+    hash_t::append_byte_range(byte_range, *descriptor->context_descriptor);
+    hash_t::append_byte_range(byte_range, descriptor->program_type);
+    hash_t::append_byte_range(byte_range, descriptor->bpf_prog_type);
+    hash_t::append_byte_range(byte_range, descriptor->is_privileged);
+    _append_helper_prototypes(
+        byte_range,
+        program_info->count_of_program_type_specific_helpers,
+        program_info->program_type_specific_helper_prototype);
+    _append_helper_prototypes(byte_range, program_info->count_of_global_helpers, program_info->global_helper_prototype);
+
+    // Map definitions, in the order the verifier will see them.
+    size_t map_count = map_descriptors.size();
+    hash_t::append_byte_range(byte_range, map_count);
+    for (const auto& map : map_descriptors) {
+        const prevail::EbpfMapDescriptor& map_descriptor = map.verifier_map_descriptor;
+        hash_t::append_byte_range(byte_range, map_descriptor.original_fd);
+        hash_t::append_byte_range(byte_range, map_descriptor.type);
+        hash_t::append_byte_range(byte_range, map_descriptor.key_size);
+        hash_t::append_byte_range(byte_range, map_descriptor.value_size);
+        hash_t::append_byte_range(byte_range, map_descriptor.max_entries);
+        hash_t::append_byte_range(byte_range, map_descriptor.inner_map_fd);
+    }
+
+    // Instruction bytes, before map fds are relocated to addresses.
+    hash_t::append_byte_range(byte_range, instruction_count);
+    byte_range.push_back(
+        {reinterpret_cast<const uint8_t*>(instructions), static_cast<size_t>(instruction_count) * sizeof(ebpf_inst)});
+
+    hash_t hash("SHA256");
+    return hash.hash_byte_ranges(byte_range);
+}
+
+bool
+ebpf_verification_cache_lookup(_In_ const ebpf_verification_cache_key_t& key) noexcept
+{
+    std::unique_lock lock(_ebpf_verification_cache_mutex);
+    auto it = _ebpf_verification_cache.find(key);
+    if (it == _ebpf_verification_cache.end()) {
+        return false;
+    }
+
+    // Move the entry to the front of the LRU list.
+    _ebpf_verification_cache_lru.splice(_ebpf_verification_cache_lru.begin(), _ebpf_verification_cache_lru, it->second);
+    return true;
+}
+
+void
+ebpf_verification_cache_insert(_In_ const ebpf_verification_cache_key_t& key) noexcept
+{
+    try {
+        std::unique_lock lock(_ebpf_verification_cache_mutex);
+        if (_ebpf_verification_cache.find(key) != _ebpf_verification_cache.end()) {
+            return;
+        }
+
+        if (_ebpf_verification_cache.size() >= EBPF_VERIFICATION_CACHE_MAX_ENTRIES) {
+            _ebpf_verification_cache.erase(_ebpf_verification_cache_lru.back());
+            _ebpf_verification_cache_lru.pop_back();
+        }
+
+        _ebpf_verification_cache_lru.push_front(key);
+        try {
+            _ebpf_verification_cache[key] = _ebpf_verification_cache_lru.begin();
+        } catch (...) {
+            _ebpf_verification_cache_lru.pop_front();
+            throw;
+        }
+    } catch (...) {
+        // The cache is an optimization only, so failing to insert is not an error.
+    }
+}
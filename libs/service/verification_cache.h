@@ -0,0 +1,67 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "api_common.hpp"
+#include "config.hpp"
+#include "ebpf_program_types.h"
+#include "platform.hpp"
+
+#include <vector>
+
+/**
+ * @file
+ * This file implements a content-addressed cache of verification results.
+ * Each entry is keyed by a SHA256 hash over everything the verifier looks at
+ * when analyzing a program: the instruction bytes, the program information
+ * (program type descriptor plus all helper prototypes), the map descriptors
+ * referenced by original fd and the verifier options. Any change to one of
+ * these inputs, including a provider updating a helper prototype, produces a
+ * different key, so stale entries are never hit and simply age out.
+ *
+ * Only successful verifications are cached. The cache lives in the process
+ * that runs the verifier (the eBPF service), so it survives restarts of the
+ * applications that load programs.
+ */
+
+typedef std::vector<uint8_t> ebpf_verification_cache_key_t;
+
+/**
+ * @brief Compute the verification cache key for a program.
+ *
+ * @param[in] program_type Program type the program is being verified as.
+ * @param[in] program_info Program information used by the verifier.
+ * @param[in] instructions Instructions of the program, before map relocation.
+ * @param[in] instruction_count Count of instructions.
+ * @param[in] map_descriptors Map descriptors the verifier resolves map fds against.
+ * @param[in] options Verifier options used for the analysis.
+ * @returns Key for the verification cache.
+ * @throws std::runtime_error if the key could not be computed.
+ */
+ebpf_verification_cache_key_t
+ebpf_verification_cache_compute_key(
+    _In_ const ebpf_program_type_t* program_type,
+    _In_ const ebpf_program_info_t* program_info,
+    _In_reads_(instruction_count) const ebpf_inst* instructions,
+    uint32_t instruction_count,
+    _In_ const std::vector<map_cache_t>& map_descriptors,
+    _In_ const prevail::ebpf_verifier_options_t& options) noexcept(false);
+
+/**
+ * @brief Check whether a program with the given key previously passed verification.
+ *
+ * @param[in] key Key computed by ebpf_verification_cache_compute_key().
+ * @retval true The program previously passed verification.
+ * @retval false The program is not in the cache.
+ */
+bool
+ebpf_verification_cache_lookup(_In_ const ebpf_verification_cache_key_t& key) noexcept;
+
+/**
+ * @brief Record that a program with the given key passed verification.
+ *
+ * @param[in] key Key computed by ebpf_verification_cache_compute_key().
+ */
+void
+ebpf_verification_cache_insert(_In_ const ebpf_verification_cache_key_t& key) noexcept;
@@ -7,6 +7,8 @@
 #include "ebpf_shared_framework.h"
 #include "ebpf_verifier_wrapper.hpp"
 #include "platform.hpp"
+#include "verification_cache.h"
+#include "windows_platform_common.hpp"
 #include "windows_platform_service.hpp"
 
 #include <filesystem>
@@ -67,7 +69,35 @@ verify_byte_code(
         return EBPF_VERIFICATION_FAILED;
     }
 
+    // Skip the analysis entirely if an identical program was already verified
+    // against the same program information, maps and options.
+    ebpf_verification_cache_key_t cache_key;
+    const ebpf_program_info_t* program_info = nullptr;
+    if (get_program_type_info_from_tls(&program_info, program_type) == EBPF_SUCCESS) {
+        try {
+            cache_key = ebpf_verification_cache_compute_key(
+                program_type,
+                program_info,
+                instruction_array,
+                instruction_count,
+                get_all_map_descriptors(),
+                ebpf_get_default_verifier_options());
+        } catch (const std::exception&) {
+            // Fall back to verifying without the cache.
+            cache_key.clear();
+        }
+    }
+    if (!cache_key.empty() && ebpf_verification_cache_lookup(cache_key)) {
+        *error_message = nullptr;
+        *error_message_size = 0;
+        return EBPF_SUCCESS;
+    }
+
     prevail::RawProgram raw_prog{file, section, 0, {}, instructions, info};
 
-    return _analyze(raw_prog, error_message, error_message_size);
+    ebpf_result_t result = _analyze(raw_prog, error_message, error_message_size);
+    if (result == EBPF_SUCCESS && !cache_key.empty()) {
+        ebpf_verification_cache_insert(cache_key);
+    }
+    return result;
 }
@@ -671,3 +671,50 @@ Exit:
 
     EBPF_RETURN_RESULT(result);
 }
+
+void
+ebpf_map_image_header_initialize(
+    _In_ const ebpf_map_definition_in_memory_t* definition, uint32_t cpu_count, _Out_ ebpf_map_image_header_t* header)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic = EBPF_MAP_IMAGE_MAGIC;
+    header->version = EBPF_MAP_IMAGE_VERSION;
+    header->header_size = sizeof(*header);
+    header->map_type = definition->type;
+    header->key_size = definition->key_size;
+    header->value_size = definition->value_size;
+    header->max_entries = definition->max_entries;
+    header->cpu_count = BPF_MAP_TYPE_PER_CPU(definition->type) ? cpu_count : 1;
+}
+
+_Must_inspect_result_ ebpf_result_t
+ebpf_map_image_header_validate(_In_ const ebpf_map_image_header_t* header, _Out_ size_t* record_size)
+{
+    ebpf_result_t result;
+    size_t value_size;
+
+    *record_size = 0;
+
+    if (header->magic != EBPF_MAP_IMAGE_MAGIC || header->version != EBPF_MAP_IMAGE_VERSION ||
+        header->header_size != sizeof(*header) || header->reserved != 0) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    if (header->key_size == 0 || header->value_size == 0 || header->cpu_count == 0) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+
+    if (BPF_MAP_TYPE_PER_CPU(header->map_type)) {
+        result = ebpf_safe_size_t_multiply(EBPF_PAD_8((size_t)header->value_size), header->cpu_count, &value_size);
+        if (result != EBPF_SUCCESS) {
+            return result;
+        }
+    } else {
+        if (header->cpu_count != 1) {
+            return EBPF_INVALID_ARGUMENT;
+        }
+        value_size = header->value_size;
+    }
+
+    return ebpf_safe_size_t_add(header->key_size, value_size, record_size);
+}
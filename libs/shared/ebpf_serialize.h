@@ -125,6 +125,71 @@ extern "C"
         _In_reads_bytes_(input_buffer_length) const uint8_t* input_buffer,
         _Outptr_ ebpf_program_info_t** program_info);
 
+    /**
+     * @brief Magic number at the start of a map image ("EMAP").
+     */
+#define EBPF_MAP_IMAGE_MAGIC 0x50414d45
+
+    /**
+     * @brief Current version of the map image format.
+     */
+#define EBPF_MAP_IMAGE_VERSION 1
+
+    /**
+     * @brief Header of a map image, the serialized contents of a map.
+     *
+     * The header is followed by a sequence of chunks, each of which is an \ref ebpf_map_image_chunk_header_t
+     * followed by record_count records. A record is a key followed by its value, where the value of a per-CPU map
+     * holds one 8-byte aligned slot per CPU. A chunk with a record_count of zero ends the image, so the image can be
+     * written and read as a stream without knowing the number of entries up front.
+     */
+    typedef struct _ebpf_map_image_header
+    {
+        uint32_t magic;       ///< EBPF_MAP_IMAGE_MAGIC.
+        uint16_t version;     ///< EBPF_MAP_IMAGE_VERSION.
+        uint16_t header_size; ///< Size of this header, for forward compatibility.
+        uint32_t map_type;    ///< Type of the map the image was taken from.
+        uint32_t key_size;    ///< Key size of the map.
+        uint32_t value_size;  ///< Value size of the map, for a single CPU in the case of a per-CPU map.
+        uint32_t max_entries; ///< Maximum number of entries of the map.
+        uint32_t cpu_count;   ///< Number of value slots in the records of a per-CPU map, 1 otherwise.
+        uint32_t reserved;    ///< Must be zero.
+    } ebpf_map_image_header_t;
+
+    /**
+     * @brief Header of a chunk of records in a map image.
+     */
+    typedef struct _ebpf_map_image_chunk_header
+    {
+        uint32_t record_count; ///< Number of records following this header, or zero at the end of the image.
+    } ebpf_map_image_chunk_header_t;
+
+    /**
+     * @brief Initialize the header of an image of the given map.
+     *
+     * @param[in] definition Definition of the map.
+     * @param[in] cpu_count Number of CPUs the values of a per-CPU map are laid out for.
+     * @param[out] header Header to initialize.
+     */
+    void
+    ebpf_map_image_header_initialize(
+        _In_ const ebpf_map_definition_in_memory_t* definition,
+        uint32_t cpu_count,
+        _Out_ ebpf_map_image_header_t* header);
+
+    /**
+     * @brief Validate the header of a map image and compute the size of its records.
+     *
+     * @param[in] header Header to validate.
+     * @param[out] record_size Size in bytes of each record in the image.
+     *
+     * @retval EBPF_SUCCESS The header is valid.
+     * @retval EBPF_INVALID_ARGUMENT The header is not a supported map image header.
+     * @retval EBPF_ARITHMETIC_OVERFLOW The record size overflows.
+     */
+    _Must_inspect_result_ ebpf_result_t
+    ebpf_map_image_header_validate(_In_ const ebpf_map_image_header_t* header, _Out_ size_t* record_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,8 @@ extern "C"
 #define EBPF_TRACELOG_EVENT_GENERIC_ERROR "EbpfGenericError"
 #define EBPF_TRACELOG_EVENT_GENERIC_MESSAGE "EbpfGenericMessage"
 #define EBPF_TRACELOG_EVENT_API_ERROR "EbpfApiError"
+#define EBPF_TRACELOG_EVENT_PRINTK "EbpfPrintk"
+#define EBPF_TRACELOG_EVENT_PRINTK_FORMAT "EbpfPrintkFormat"
 
 #define EBPF_TRACELOG_KEYWORD_FUNCTION_ENTRY_EXIT 0x1
 #define EBPF_TRACELOG_KEYWORD_BASE 0x2
@@ -37,6 +39,9 @@ extern "C"
 #define EBPF_TRACELOG_KEYWORD_API 0x100
 #define EBPF_TRACELOG_KEYWORD_PRINTK 0x200
 #define EBPF_TRACELOG_KEYWORD_NATIVE 0x400
+// Binary bpf_printk events, formatted by the consumer. Only used by ebpf_log_printk*() so it has no
+// ebpf_tracelog_keyword_t value.
+#define EBPF_TRACELOG_KEYWORD_PRINTK_DEFERRED 0x800
 
 #define EBPF_TRACELOG_LEVEL_LOG_ALWAYS WINEVENT_LEVEL_LOG_ALWAYS
 #define EBPF_TRACELOG_LEVEL_CRITICAL WINEVENT_LEVEL_CRITICAL
@@ -393,6 +398,28 @@ extern "C"
         ebpf_log_ntstatus_wstring_api(_##keyword##, wstring, #api, status); \
     }
 
+    /**
+     * @brief Log the format string that a bpf_printk format ID refers to.
+     *
+     * @param[in] format_id ID of the interned format string.
+     * @param[in] format Format string, with any trailing newline removed.
+     */
+    void
+    ebpf_log_printk_format(uint32_t format_id, _In_z_ const char* format);
+
+    /**
+     * @brief Log a bpf_printk call as a format ID plus its arguments, without formatting it.
+     *
+     * @param[in] format_id ID of the interned format string, see ebpf_log_printk_format().
+     * @param[in] argument_count Count of arguments that are valid.
+     * @param[in] argument1 First argument, or 0.
+     * @param[in] argument2 Second argument, or 0.
+     * @param[in] argument3 Third argument, or 0.
+     */
+    void
+    ebpf_log_printk(
+        uint32_t format_id, uint32_t argument_count, uint64_t argument1, uint64_t argument2, uint64_t argument3);
+
 #define EBPF_LOG_MESSAGE_POINTER_ENUM(trace_level, keyword, message, pointer, enum)  \
     if (TraceLoggingProviderEnabled(ebpf_tracelog_provider, trace_level, keyword)) { \
         TraceLoggingWrite(                                                           \
@@ -0,0 +1,172 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+#pragma once
+
+/**
+ * @file
+ * Read-only, zero-copy views of ELF files for user mode tools.
+ *
+ * mapped_file_t maps a file into the address space instead of reading it into
+ * a heap buffer, so that only the pages that are actually touched (typically
+ * the ELF headers, the program sections being processed and .BTF) are faulted
+ * in. memory_istream_t exposes any contiguous byte range, mapped or not, as a
+ * seekable std::istream so that ELFIO and the verifier's ELF reader can parse
+ * it without first copying it into a std::stringstream.
+ */
+
+#include <windows.h>
+#include <cstdint>
+#include <istream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+typedef class _mapped_file
+{
+  public:
+    _mapped_file(const std::string& path)
+    {
+        // Only share reads. A write in place would show up in the view, so the bytes could change between being
+        // validated or hashed and being parsed. A writer fails instead while the file is open.
+        file_handle = CreateFileA(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error(std::string("No such file or directory opening ") + path);
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size)) {
+            close();
+            throw std::runtime_error(std::string("Failed to read file: ") + path);
+        }
+        if (static_cast<unsigned long long>(file_size.QuadPart) > SIZE_MAX) {
+            close();
+            throw std::runtime_error(std::string("File too large: ") + path);
+        }
+        view_size = static_cast<size_t>(file_size.QuadPart);
+
+        // A zero length file can't be mapped, so represent it as an empty view.
+        if (view_size == 0) {
+            return;
+        }
+
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_handle == nullptr) {
+            close();
+            throw std::runtime_error(std::string("Failed to map file: ") + path);
+        }
+
+        view = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (view == nullptr) {
+            close();
+            throw std::runtime_error(std::string("Failed to map file: ") + path);
+        }
+    }
+    ~_mapped_file() { close(); }
+
+    _mapped_file(const _mapped_file&) = delete;
+    _mapped_file&
+    operator=(const _mapped_file&) = delete;
+
+    const char*
+    data() const
+    {
+        // Return a valid pointer for empty files so callers can form empty ranges.
+        return (view != nullptr) ? view : "";
+    }
+
+    size_t
+    size() const
+    {
+        return view_size;
+    }
+
+  private:
+    void
+    close()
+    {
+        if (view != nullptr) {
+            UnmapViewOfFile(view);
+            view = nullptr;
+        }
+        if (mapping_handle != nullptr) {
+            CloseHandle(mapping_handle);
+            mapping_handle = nullptr;
+        }
+        if (file_handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_handle);
+            file_handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = nullptr;
+    const char* view = nullptr;
+    size_t view_size = 0;
+} mapped_file_t;
+
+/**
+ * @brief Read-only stream buffer over a caller owned byte range. The range
+ * must outlive the buffer and any stream or parser reading from it.
+ */
+typedef class _memory_streambuf : public std::streambuf
+{
+  public:
+    _memory_streambuf(_In_reads_(size) const char* data, size_t size)
+    {
+        // std::streambuf only hands out mutable pointers, but nothing in this
+        // class writes through them: there is no put area and pbackfail is not
+        // overridden, so putback of a differing character fails.
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+
+  protected:
+    pos_type
+    seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+
+        off_type base;
+        switch (direction) {
+        case std::ios_base::beg:
+            base = 0;
+            break;
+        case std::ios_base::cur:
+            base = gptr() - eback();
+            break;
+        case std::ios_base::end:
+            base = egptr() - eback();
+            break;
+        default:
+            return pos_type(off_type(-1));
+        }
+
+        off_type position = base + offset;
+        if (position < 0 || position > egptr() - eback()) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + position, egptr());
+        return pos_type(position);
+    }
+
+    pos_type
+    seekpos(pos_type position, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(position), std::ios_base::beg, which);
+    }
+} memory_streambuf_t;
+
+/**
+ * @brief std::istream over a caller owned byte range, without copying it.
+ */
+typedef class _memory_istream : private memory_streambuf_t, public std::istream
+{
+  public:
+    _memory_istream(_In_reads_(size) const char* data, size_t size)
+        : memory_streambuf_t(data, size), std::istream(static_cast<std::streambuf*>(this))
+    {
+    }
+} memory_istream_t;
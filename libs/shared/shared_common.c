@@ -135,7 +135,10 @@ size_t _ebpf_map_provider_dispatch_table_supported_size[] = {EBPF_BASE_MAP_PROVI
 
 #define EBPF_BASE_MAP_PROVIDER_PROPERTIES_SIZE_0 \
     EBPF_SIZE_INCLUDING_FIELD(ebpf_base_map_provider_properties_t, updates_original_value)
-size_t _ebpf_map_provider_properties_supported_size[] = {EBPF_BASE_MAP_PROVIDER_PROPERTIES_SIZE_0};
+#define EBPF_BASE_MAP_PROVIDER_PROPERTIES_SIZE_1 \
+    EBPF_SIZE_INCLUDING_FIELD(ebpf_base_map_provider_properties_t, direct_value_access)
+size_t _ebpf_map_provider_properties_supported_size[] = {
+    EBPF_BASE_MAP_PROVIDER_PROPERTIES_SIZE_0, EBPF_BASE_MAP_PROVIDER_PROPERTIES_SIZE_1};
 
 #define EBPF_BASE_MAP_CLIENT_DISPATCH_TABLE_SIZE_0 \
     EBPF_SIZE_INCLUDING_FIELD(ebpf_base_map_client_dispatch_table_t, epoch_free_cache_aligned)
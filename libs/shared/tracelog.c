@@ -1223,6 +1223,33 @@ ebpf_log_message_error(
     }
 }
 
+__declspec(noinline) void
+ebpf_log_printk_format(uint32_t format_id, _In_z_ const char* format)
+{
+    TraceLoggingWrite(
+        ebpf_tracelog_provider,
+        EBPF_TRACELOG_EVENT_PRINTK_FORMAT,
+        TraceLoggingLevel(EBPF_TRACELOG_LEVEL_INFO),
+        TraceLoggingKeyword(EBPF_TRACELOG_KEYWORD_PRINTK_DEFERRED),
+        TraceLoggingUInt32(format_id, "FormatId"),
+        TraceLoggingString(format, "Format"));
+}
+
+__declspec(noinline) void
+ebpf_log_printk(uint32_t format_id, uint32_t argument_count, uint64_t argument1, uint64_t argument2, uint64_t argument3)
+{
+    TraceLoggingWrite(
+        ebpf_tracelog_provider,
+        EBPF_TRACELOG_EVENT_PRINTK,
+        TraceLoggingLevel(EBPF_TRACELOG_LEVEL_INFO),
+        TraceLoggingKeyword(EBPF_TRACELOG_KEYWORD_PRINTK_DEFERRED),
+        TraceLoggingUInt32(format_id, "FormatId"),
+        TraceLoggingUInt32(argument_count, "ArgumentCount"),
+        TraceLoggingUInt64(argument1, "Argument1"),
+        TraceLoggingUInt64(argument2, "Argument2"),
+        TraceLoggingUInt64(argument3, "Argument3"));
+}
+
 #define _EBPF_LOG_NTSTATUS_WSTRING_API(keyword, wstring, api, status) \
     TraceLoggingWrite(                                                \
         ebpf_tracelog_provider,                                       \
@@ -211,6 +211,45 @@ static HANDLE _fwp_engine_handle;
 // WFP component management related utility functions.
 //
 
+/**
+ * @brief Fill a client array with a set of hook NPI clients and build its dispatcher.
+ *
+ * @param[out] client_array Client array to fill. It must not be published.
+ * @param[in] provider_context Hook provider the clients are attached to.
+ * @param[in] clients Array of pointers to hook NPI clients.
+ * @param[in] client_count Number of hook NPI clients.
+ */
+static void
+_net_ebpf_ext_build_client_array(
+    _Inout_ net_ebpf_extension_hook_client_array_t* client_array,
+    _In_ const net_ebpf_extension_hook_provider_t* provider_context,
+    _In_reads_(client_count) net_ebpf_extension_hook_client_t* const* clients,
+    uint32_t client_count)
+{
+    memset(client_array->clients, 0, sizeof(client_array->clients));
+    memset(client_array->dispatch, 0, sizeof(client_array->dispatch));
+    memcpy(client_array->clients, clients, client_count * sizeof(net_ebpf_extension_hook_client_t*));
+    client_array->client_count = client_count;
+    client_array->process_verdict = provider_context->dispatch.process_verdict;
+
+    // A single program gains nothing from a batch, as its invoke function already enters the epoch only once.
+    bool batch = (client_count > 1);
+    for (uint32_t index = 0; index < client_count; index++) {
+        const net_ebpf_extension_hook_client_t* client = clients[index];
+        client_array->dispatch[index].client_binding_context = client->client_binding_context;
+        client_array->dispatch[index].invoke_program = client->invoke_program;
+        client_array->dispatch[index].batch_invoke = client->batch_invoke;
+
+        // All the programs must be able to run in the batch begun by the first one.
+        if (client->batch_begin == NULL || client->batch_invoke == NULL || client->batch_end == NULL ||
+            client->batch_begin != clients[0]->batch_begin || client->batch_end != clients[0]->batch_end) {
+            batch = false;
+        }
+    }
+    client_array->batch_begin = batch ? clients[0]->batch_begin : NULL;
+    client_array->batch_end = batch ? clients[0]->batch_end : NULL;
+}
+
 _Must_inspect_result_ ebpf_result_t
 net_ebpf_extension_wfp_filter_context_create(
     size_t filter_context_size,
@@ -222,6 +261,8 @@ net_ebpf_extension_wfp_filter_context_create(
     ebpf_result_t result = EBPF_SUCCESS;
     net_ebpf_extension_wfp_filter_context_t* local_filter_context = NULL;
     uint32_t client_context_count_max = NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_SINGLE_ATTACH;
+    net_ebpf_extension_hook_client_array_t* client_array = NULL;
+    net_ebpf_extension_hook_client_array_t* spare_client_array = NULL;
 
     NET_EBPF_EXT_LOG_ENTRY();
 
@@ -240,34 +281,30 @@ net_ebpf_extension_wfp_filter_context_create(
 
     memset(local_filter_context, 0, filter_context_size);
 
-    local_filter_context->client_contexts = (net_ebpf_extension_hook_client_t**)ExAllocatePoolUninitialized(
-        NonPagedPoolNx,
-        client_context_count_max * sizeof(net_ebpf_extension_hook_client_t*),
-        NET_EBPF_EXTENSION_POOL_TAG);
-    NET_EBPF_EXT_BAIL_ON_ALLOC_FAILURE_RESULT(
-        NET_EBPF_EXT_TRACELOG_KEYWORD_EXTENSION,
-        local_filter_context->client_contexts,
-        "local_filter_context - client_contexts",
-        result);
-
-    memset(
-        local_filter_context->client_contexts, 0, client_context_count_max * sizeof(net_ebpf_extension_hook_client_t*));
     local_filter_context->client_context_count_max = client_context_count_max;
     local_filter_context->context_deleting = FALSE;
     InitializeListHead(&local_filter_context->link);
     local_filter_context->reference_count = 1; // Initial reference.
 
-    // Set the first client context.
-    local_filter_context->client_contexts[0] = (net_ebpf_extension_hook_client_t*)client_context;
-    local_filter_context->client_context_count = 1;
+    // Set the provider context.
+    local_filter_context->provider_context = provider_context;
+
+    // Publish the first client context.
+    client_array = &local_filter_context->client_arrays[0];
+    net_ebpf_ext_init_hook_rundown(&client_array->rundown);
+    _net_ebpf_ext_build_client_array(
+        client_array, provider_context, (net_ebpf_extension_hook_client_t* const*)&client_context, 1);
+    local_filter_context->client_array = client_array;
+
+    // The spare client array is kept run down until it is filled and published.
+    spare_client_array = &local_filter_context->client_arrays[1];
+    net_ebpf_ext_init_hook_rundown(&spare_client_array->rundown);
+    _ebpf_ext_wait_for_rundown(&spare_client_array->rundown);
 
     // Set filter context as provider data in the hook client.
     net_ebpf_extension_hook_client_set_provider_data(
         (net_ebpf_extension_hook_client_t*)client_context, local_filter_context);
 
-    // Set the provider context.
-    local_filter_context->provider_context = provider_context;
-
     // Open the WFP engine handle.
     status = FwpmEngineOpen(NULL, RPC_C_AUTHN_WINNT, NULL, NULL, &local_filter_context->wfp_engine_handle);
     if (!NT_SUCCESS(status)) {
@@ -1017,20 +1054,59 @@ net_ebpf_ext_unregister_providers()
     NET_EBPF_EXT_LOG_EXIT();
 }
 
+void
+net_ebpf_ext_uninitialize_object_caches()
+{
+    net_ebpf_ext_bind_uninitialize_object_cache();
+    net_ebpf_ext_sock_addr_uninitialize_object_cache();
+    net_ebpf_ext_sock_ops_uninitialize_object_cache();
+}
+
+/**
+ * @brief Publish a new set of hook NPI clients for a filter context. The clients are copied to the spare client array,
+ * which then replaces the published one. Once no invocation uses the replaced array any more, it becomes the spare.
+ *
+ * @param[in, out] filter_context Filter context to publish the clients for.
+ * @param[in] clients Array of pointers to hook NPI clients.
+ * @param[in] client_count Number of hook NPI clients.
+ */
+_IRQL_requires_max_(APC_LEVEL) static void _net_ebpf_ext_publish_client_array(
+    _Inout_ net_ebpf_extension_wfp_filter_context_t* filter_context,
+    _In_reads_(client_count) net_ebpf_extension_hook_client_t* const* clients,
+    uint32_t client_count)
+{
+    net_ebpf_extension_hook_client_array_t* old_client_array = filter_context->client_array;
+    net_ebpf_extension_hook_client_array_t* new_client_array = (old_client_array == &filter_context->client_arrays[0])
+                                                                   ? &filter_context->client_arrays[1]
+                                                                   : &filter_context->client_arrays[0];
+
+    ASSERT(client_count <= filter_context->client_context_count_max);
+    ASSERT(new_client_array->rundown.rundown_occurred);
+
+    _net_ebpf_ext_build_client_array(new_client_array, filter_context->provider_context, clients, client_count);
+    ExReInitializeRundownProtection(&new_client_array->rundown.protection);
+    new_client_array->rundown.rundown_occurred = FALSE;
+
+    // Invocations that read the old array after this point retry with the new one.
+    InterlockedExchangePointer((void* volatile*)&filter_context->client_array, new_client_array);
+
+    // Wait for the invocations that are still using the old array.
+    _ebpf_ext_wait_for_rundown(&old_client_array->rundown);
+}
+
 ebpf_result_t
 net_ebpf_ext_add_client_context(
     _Inout_ net_ebpf_extension_wfp_filter_context_t* filter_context,
     _In_ const struct _net_ebpf_extension_hook_client* hook_client)
 {
     ebpf_result_t result = EBPF_SUCCESS;
-    KIRQL old_irql;
+    const net_ebpf_extension_hook_client_array_t* client_array = filter_context->client_array;
+    net_ebpf_extension_hook_client_t* clients[NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH];
 
     NET_EBPF_EXT_LOG_ENTRY();
 
-    old_irql = ExAcquireSpinLockExclusive(&filter_context->lock);
-
     // Check if we have reached max capacity.
-    if (filter_context->client_context_count == filter_context->client_context_count_max) {
+    if (client_array->client_count == filter_context->client_context_count_max) {
         NET_EBPF_EXT_LOG_MESSAGE(
             NET_EBPF_EXT_TRACELOG_LEVEL_ERROR,
             NET_EBPF_EXT_TRACELOG_KEYWORD_EXTENSION,
@@ -1039,17 +1115,16 @@ net_ebpf_ext_add_client_context(
         goto Exit;
     }
 
-    // Append the client context to the end.
-    filter_context->client_contexts[filter_context->client_context_count] =
-        (struct _net_ebpf_extension_hook_client*)hook_client;
-    filter_context->client_context_count++;
-
-    // Add filter_context as provider data for the client.
+    // Add filter_context as provider data for the client before it can be invoked.
     net_ebpf_extension_hook_client_set_provider_data(
         (struct _net_ebpf_extension_hook_client*)hook_client, (void*)filter_context);
 
+    // Append the client context to the end.
+    memcpy(clients, client_array->clients, client_array->client_count * sizeof(net_ebpf_extension_hook_client_t*));
+    clients[client_array->client_count] = (struct _net_ebpf_extension_hook_client*)hook_client;
+    _net_ebpf_ext_publish_client_array(filter_context, clients, client_array->client_count + 1);
+
 Exit:
-    ExReleaseSpinLockExclusive(&filter_context->lock, old_irql);
     NET_EBPF_EXT_RETURN_RESULT(result);
 }
 
@@ -1058,31 +1133,22 @@ net_ebpf_ext_remove_client_context(
     _Inout_ net_ebpf_extension_wfp_filter_context_t* filter_context,
     _In_ const struct _net_ebpf_extension_hook_client* hook_client)
 {
-    KIRQL old_irql;
-    uint32_t index;
+    const net_ebpf_extension_hook_client_array_t* client_array = filter_context->client_array;
+    net_ebpf_extension_hook_client_t* clients[NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH];
+    uint32_t client_count = 0;
     bool found = FALSE;
 
-    old_irql = ExAcquireSpinLockExclusive(&filter_context->lock);
-
-    for (index = 0; index < filter_context->client_context_count; index++) {
-        if (filter_context->client_contexts[index] == hook_client) {
-            filter_context->client_contexts[index] = NULL;
-            filter_context->client_context_count--;
+    // Copy all clients other than the one being removed, preserving their order.
+    for (uint32_t index = 0; index < client_array->client_count; index++) {
+        if (client_array->clients[index] == hook_client) {
             found = TRUE;
-            break;
+            continue;
         }
+        clients[client_count++] = client_array->clients[index];
     }
     ASSERT(found == TRUE);
-    if (index != filter_context->client_context_count) {
-        memcpy(
-            &filter_context->client_contexts[index],
-            &filter_context->client_contexts[index + 1],
-            (filter_context->client_context_count - index) * sizeof(net_ebpf_extension_hook_client_t*));
-
-        filter_context->client_contexts[filter_context->client_context_count] = NULL;
-    }
 
-    ExReleaseSpinLockExclusive(&filter_context->lock, old_irql);
+    _net_ebpf_ext_publish_client_array(filter_context, clients, client_count);
 }
 
 void
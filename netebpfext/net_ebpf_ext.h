@@ -8,6 +8,7 @@
  */
 
 #include "ebpf_nethooks.h"
+#include "ebpf_object_cache.h"
 #include "ebpf_program_attach_type_guids.h"
 #include "ebpf_program_types.h"
 #include "ebpf_shared_framework.h"
@@ -27,16 +28,17 @@
 #define NET_EBPF_EXTENSION_NPI_PROVIDER_VERSION 0
 
 // Note: The maximum number of clients that can attach per-hook in multi-attach case has been currently capped to
-// a constant value to keep the implementation simple. Keeping the max limit constant allows allocating the memory
-// required for creating a copy of list of clients on the stack itself. In the future, if there is a need to increase
-// this maximum count, the value can be simply increased as long as the required memory can still be allocated on stack.
-// If the required memory becomes too large, we may need to switch to a different design to handle this. One option is
-// to use epoch based memory management for the list of clients. This eliminates the need to create a copy of programs
-// per-invocation. Another option can be to always invoke the programs while holding the socket context lock, but that
-// comes with a side effect of every program invocation now happening at DISPATCH_LEVEL.
+// a constant value to keep the implementation simple. Keeping the max limit constant allows the client arrays of a
+// filter context to be embedded in the filter context itself, so that attach and detach never allocate memory to
+// publish a new list of clients. In the future, if there is a need to increase this maximum count, the client arrays
+// can be allocated separately with a size that matches the attach capability of the hook.
 #define NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH 16
 #define NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_SINGLE_ATTACH 1
 
+// Maximum number of free per-connection contexts each CPU keeps for reuse. Contexts are allocated and freed for every
+// connection, so keeping a few per CPU avoids a pool allocation on most connections.
+#define NET_EBPF_EXT_OBJECT_CACHE_MAX_PER_CPU 64
+
 CONST IN6_ADDR DECLSPEC_SELECTANY in6addr_v4mappedprefix = IN6ADDR_V4MAPPEDPREFIX_INIT;
 
 #define _ACQUIRE_PUSH_LOCK(lock, mode) \
@@ -124,16 +126,46 @@ typedef struct _net_ebpf_ext_wfp_filter_id
     NTSTATUS error_code;
 } net_ebpf_ext_wfp_filter_id_t;
 
+/**
+ * @brief Invocation of one attached eBPF program, copied from its hook NPI client when a client array is built.
+ */
+typedef struct _net_ebpf_extension_hook_dispatch_entry
+{
+    const void* client_binding_context;                ///< Client supplied context passed when invoking the program.
+    ebpf_program_invoke_function_t invoke_program;     ///< Invokes the program on its own.
+    ebpf_program_batch_invoke_function_t batch_invoke; ///< Invokes the program within a batch, or NULL.
+} net_ebpf_extension_hook_dispatch_entry_t;
+
+/**
+ * @brief Immutable array of the hook NPI clients attached to a filter context. Each filter context has two of these:
+ * the published array, which the invoke path reads without taking a lock, and a spare array. Attach and detach fill
+ * the spare array, publish it, and then wait for the rundown of the array it replaced, which becomes the new spare.
+ *
+ * Building the array also builds the dispatcher for the attach point: the programs to invoke in order, the verdict
+ * callback of the hook, and, when every client supports it, the batch functions that let all the programs run in a
+ * single epoch.
+ */
+typedef struct _net_ebpf_extension_hook_client_array
+{
+    net_ebpf_ext_hook_rundown_t rundown; ///< Rundown protection held by invocations that use this array.
+    uint32_t client_count;               ///< Number of hook NPI clients in the array.
+    struct _net_ebpf_extension_hook_client*
+        clients[NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH]; ///< Array of pointers to hook NPI clients.
+    net_ebpf_extension_hook_dispatch_entry_t
+        dispatch[NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH]; ///< Programs to invoke, in order.
+    ebpf_program_batch_begin_invoke_function_t batch_begin;  ///< Begins a batch, or NULL to invoke programs alone.
+    ebpf_program_batch_end_invoke_function_t batch_end;      ///< Ends the batch begun with batch_begin.
+    net_ebpf_extension_hook_process_verdict process_verdict; ///< Verdict callback of the hook, or NULL.
+} net_ebpf_extension_hook_client_array_t;
+
 typedef struct _net_ebpf_extension_wfp_filter_context
 {
     LIST_ENTRY link;                   ///< Entry in the list of filter contexts.
     volatile long reference_count;     ///< Reference count.
-    EX_SPIN_LOCK lock;                 ///< Lock to protect the client context array.
     uint32_t client_context_count_max; ///< Maximum number of hook NPI clients.
-    _Guarded_by_(
-        lock) struct _net_ebpf_extension_hook_client** client_contexts; ///< Array of pointers to hook NPI clients.
-    _Guarded_by_(lock) uint32_t client_context_count;                   ///< Current number of hook NPI clients.
-    const struct _net_ebpf_extension_hook_provider* provider_context;   ///< Pointer to provider binding context.
+    net_ebpf_extension_hook_client_array_t client_arrays[2]; ///< Published and spare arrays of hook NPI clients.
+    net_ebpf_extension_hook_client_array_t* volatile client_array; ///< Published array of hook NPI clients.
+    const struct _net_ebpf_extension_hook_provider* provider_context; ///< Pointer to provider binding context.
 
     net_ebpf_ext_wfp_filter_id_t* filter_ids; ///< Array of WFP filter Ids.
     uint32_t filter_ids_count;                ///< Number of WFP filter Ids.
@@ -157,25 +189,12 @@ typedef struct _net_ebpf_extension_wfp_cleanup_state
     KEVENT wfp_filter_cleanup_event;    ///< Event to signal when no remaining WFP filters require a deletion callback.
 } net_ebpf_extension_wfp_cleanup_state_t;
 
-// Macro definition of warning suppression for 26100. This is only used in the cleanup context, for which
-// we are the only reference of the memory
-#define PRAGMA_WARNING_PUSH _Pragma("warning(push)")
-// Warning 26100: Variable should be protected by a lock.
-#define PRAGMA_WARNING_SUPPRESS_26100 _Pragma("warning(suppress: 26100)")
-#define PRAGMA_WARNING_POP _Pragma("warning(pop)")
-
 #define CLEAN_UP_FILTER_CONTEXT(filter_context)                             \
     ASSERT((filter_context) != NULL);                                       \
     net_ebpf_ext_remove_filter_context_from_cleanup_list((filter_context)); \
     if ((filter_context)->filter_ids != NULL) {                             \
         ExFreePool((filter_context)->filter_ids);                           \
     }                                                                       \
-    PRAGMA_WARNING_PUSH                                                     \
-    PRAGMA_WARNING_SUPPRESS_26100                                           \
-    if ((filter_context)->client_contexts != NULL) {                        \
-        ExFreePool((filter_context)->client_contexts);                      \
-    }                                                                       \
-    PRAGMA_WARNING_POP                                                      \
     if ((filter_context)->wfp_engine_handle != NULL) {                      \
         FwpmEngineClose((filter_context)->wfp_engine_handle);               \
     }                                                                       \
@@ -374,12 +393,22 @@ net_ebpf_ext_register_providers();
 void
 net_ebpf_ext_unregister_providers();
 
+/**
+ * @brief Destroy the object caches used by the hooks. Must be called after
+ * net_ebpf_extension_uninitialize_wfp_components.
+ *
+ */
+void
+net_ebpf_ext_uninitialize_object_caches();
+
 NTSTATUS
 net_ebpf_ext_filter_change_notify(
     FWPS_CALLOUT_NOTIFY_TYPE callout_notification_type, _In_ const GUID* filter_key, _Inout_ FWPS_FILTER* filter);
 
 /**
- * @brief Remove the client context from the filter context.
+ * @brief Remove the client context from the filter context. Publishes a new client array without the client and waits
+ * for in progress invocations that can still see the client to complete. Attach / detach operations on the filter
+ * context must be serialized by the caller.
  *
  * @param filter_context Filter context to remove the client from.
  * @param hook_client Hook client to remove.
@@ -390,7 +419,8 @@ net_ebpf_ext_remove_client_context(
     _In_ const struct _net_ebpf_extension_hook_client* hook_client);
 
 /**
- * @brief Add a client context to the filter context.
+ * @brief Add a client context to the filter context. Publishes a new client array with the client appended. Attach /
+ * detach operations on the filter context must be serialized by the caller.
  *
  * @param filter_context Filter context to add the client to.
  * @param hook_client Hook client to add.
@@ -77,6 +77,9 @@ NPI_MODULEID DECLSPEC_SELECTANY _ebpf_bind_program_info_provider_moduleid = {
 
 static net_ebpf_extension_program_info_provider_t* _ebpf_bind_program_info_provider_context = NULL;
 
+// Cache of the contexts created for each batch of a test run.
+static ebpf_object_cache_t* _ebpf_bind_context_cache = NULL;
+
 //
 // Bind Hook NPI Provider.
 //
@@ -182,6 +185,17 @@ net_ebpf_ext_bind_register_providers()
         .delete_filter_context = _net_ebpf_ext_bind_delete_filter_context,
         .validate_client_data = _net_ebpf_ext_bind_validate_client_data};
 
+    if (ebpf_object_cache_create(
+            &_ebpf_bind_context_cache,
+            sizeof(bind_context_header_t),
+            NET_EBPF_EXT_OBJECT_CACHE_MAX_PER_CPU,
+            NET_EBPF_EXTENSION_POOL_TAG) != EBPF_SUCCESS) {
+        status = STATUS_NO_MEMORY;
+        NET_EBPF_EXT_LOG_MESSAGE_NTSTATUS(
+            NET_EBPF_EXT_TRACELOG_LEVEL_ERROR, NET_EBPF_EXT_TRACELOG_KEYWORD_BIND, "ebpf_object_cache_create", status);
+        goto Exit;
+    }
+
     status = net_ebpf_extension_program_info_provider_register(
         &program_info_provider_parameters, &_ebpf_bind_program_info_provider_context);
     if (!NT_SUCCESS(status)) {
@@ -228,6 +242,13 @@ net_ebpf_ext_bind_unregister_providers()
     }
 }
 
+void
+net_ebpf_ext_bind_uninitialize_object_cache()
+{
+    ebpf_object_cache_destroy(_ebpf_bind_context_cache);
+    _ebpf_bind_context_cache = NULL;
+}
+
 //
 // WFP Classify Callbacks.
 //
@@ -492,8 +513,7 @@ _ebpf_bind_context_create(
         goto Exit;
     }
 
-    bind_context_header = (bind_context_header_t*)ExAllocatePoolUninitialized(
-        NonPagedPoolNx, sizeof(bind_context_header_t), NET_EBPF_EXTENSION_POOL_TAG);
+    bind_context_header = (bind_context_header_t*)ebpf_object_cache_allocate(_ebpf_bind_context_cache);
     NET_EBPF_EXT_BAIL_ON_ALLOC_FAILURE_RESULT(
         NET_EBPF_EXT_TRACELOG_KEYWORD_BIND, bind_context_header, "bind_context_header", result);
 
@@ -516,7 +536,7 @@ _ebpf_bind_context_create(
 
 Exit:
     if (bind_context_header) {
-        ExFreePool(bind_context_header);
+        ebpf_object_cache_free(_ebpf_bind_context_cache, bind_context_header);
         bind_context_header = NULL;
     }
     NET_EBPF_EXT_RETURN_RESULT(result);
@@ -562,7 +582,7 @@ _ebpf_bind_context_destroy(
         *data_size_out = 0;
     }
 
-    ExFreePool(bind_context_header);
+    ebpf_object_cache_free(_ebpf_bind_context_cache, bind_context_header);
 
 Exit:
     NET_EBPF_EXT_LOG_EXIT();
@@ -102,6 +102,14 @@ net_ebpf_ext_resource_release_classify(
 void
 net_ebpf_ext_bind_unregister_providers();
 
+/**
+ * @brief Destroy the object cache used by the BIND hooks. WFP classify and flow delete callbacks may still
+ * allocate from or free to the cache until the callouts are unregistered, so this is called after
+ * net_ebpf_extension_uninitialize_wfp_components.
+ */
+void
+net_ebpf_ext_bind_uninitialize_object_cache();
+
 /**
  * @brief Register BIND NPI providers.
  *
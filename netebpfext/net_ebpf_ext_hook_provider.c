@@ -11,8 +11,8 @@
  *
  * @param[in, out] rundown Pointer to the rundown object to initialize.
  */
-static void
-_ebpf_ext_init_hook_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown)
+void
+net_ebpf_ext_init_hook_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown)
 {
     ASSERT(rundown->rundown_initialized == FALSE);
 
@@ -21,39 +21,6 @@ _ebpf_ext_init_hook_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown)
     rundown->rundown_initialized = TRUE;
 }
 
-/**
- * @brief Initialize the hook client rundown state.
- *
- * @param[in, out] hook_client Pointer to the attached hook NPI client.
- *
- * @retval STATUS_SUCCESS Operation succeeded.
- * @retval STATUS_INSUFFICIENT_RESOURCES IO work item could not be allocated.
- */
-static NTSTATUS
-_ebpf_ext_attach_init_rundown(net_ebpf_extension_hook_client_t* hook_client)
-{
-    NTSTATUS status = STATUS_SUCCESS;
-    net_ebpf_ext_hook_rundown_t* rundown = &hook_client->rundown;
-
-    NET_EBPF_EXT_LOG_ENTRY();
-
-    //
-    // Allocate work item for client detach processing.
-    //
-    hook_client->detach_work_item = IoAllocateWorkItem(_net_ebpf_ext_driver_device_object);
-    if (hook_client->detach_work_item == NULL) {
-        status = STATUS_INSUFFICIENT_RESOURCES;
-        NET_EBPF_EXT_LOG_NTSTATUS_API_FAILURE(NET_EBPF_EXT_TRACELOG_KEYWORD_EXTENSION, "IoAllocateWorkItem", status);
-        goto Exit;
-    }
-
-    // Initialize the rundown and disable new references.
-    _ebpf_ext_init_hook_rundown(rundown);
-
-Exit:
-    NET_EBPF_EXT_RETURN_NTSTATUS(status);
-}
-
 /**
  * @brief Block execution of the thread until all invocations are completed.
  *
@@ -72,49 +39,6 @@ _ebpf_ext_wait_for_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown)
     NET_EBPF_EXT_LOG_EXIT();
 }
 
-IO_WORKITEM_ROUTINE _net_ebpf_extension_detach_client_completion;
-#if !defined(__cplusplus)
-#pragma alloc_text(PAGE, _net_ebpf_extension_detach_client_completion)
-#endif
-
-/**
- * @brief IO work item routine callback that waits on client rundown to complete.
- *
- * @param[in] device_object IO Device object.
- * @param[in] context Pointer to work item context.
- *
- */
-void
-_net_ebpf_extension_detach_client_completion(_In_ DEVICE_OBJECT* device_object, _In_opt_ void* context)
-{
-    net_ebpf_extension_hook_client_t* hook_client = (net_ebpf_extension_hook_client_t*)context;
-    PIO_WORKITEM work_item;
-
-    PAGED_CODE();
-    UNREFERENCED_PARAMETER(device_object);
-
-    NET_EBPF_EXT_LOG_ENTRY();
-
-    ASSERT(hook_client != NULL);
-    _Analysis_assume_(hook_client != NULL);
-
-    work_item = hook_client->detach_work_item;
-
-    // The NMR model is async, but the only Windows run-down protection API available is a blocking API, so the
-    // following call will block until all using threads are complete. This should be fixed in the future.
-    // Issue: https://github.com/microsoft/ebpf-for-windows/issues/1854
-
-    // Wait for any in progress callbacks to complete.
-    _ebpf_ext_wait_for_rundown(&hook_client->rundown);
-
-    IoFreeWorkItem(work_item);
-
-    // Note: This frees the provider binding context (hook_client).
-    NmrProviderDetachClientComplete(hook_client->nmr_binding_handle);
-
-    NET_EBPF_EXT_LOG_EXIT();
-}
-
 _Must_inspect_result_ bool
 _net_ebpf_ext_enter_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown)
 {
@@ -129,18 +53,6 @@ _net_ebpf_ext_leave_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown)
     ExReleaseRundownProtection(&rundown->protection);
 }
 
-_Must_inspect_result_ bool
-net_ebpf_extension_hook_client_enter_rundown(_Inout_ net_ebpf_extension_hook_client_t* hook_client)
-{
-    return _net_ebpf_ext_enter_rundown(&hook_client->rundown);
-}
-
-void
-net_ebpf_extension_hook_client_leave_rundown(_Inout_ net_ebpf_extension_hook_client_t* hook_client)
-{
-    _net_ebpf_ext_leave_rundown(&hook_client->rundown);
-}
-
 _Must_inspect_result_ bool
 net_ebpf_extension_hook_provider_enter_rundown(_Inout_ net_ebpf_extension_hook_provider_t* provider_context)
 {
@@ -183,26 +95,28 @@ net_ebpf_extension_hook_provider_get_attach_capability(_In_ const net_ebpf_exten
     return provider_context->attach_capability;
 }
 
-__forceinline _Must_inspect_result_ static ebpf_result_t
-_net_ebpf_extension_hook_invoke_single_program(
-    _In_ const net_ebpf_extension_hook_client_t* client, _Inout_ void* context, _Out_ uint32_t* result)
-{
-    ebpf_program_invoke_function_t invoke_program = client->invoke_program;
-    const void* client_binding_context = client->client_binding_context;
-
-    return invoke_program(client_binding_context, context, result);
-}
-
-static void
-_net_ebpf_extension_release_rundown_for_clients(
-    _Inout_ net_ebpf_extension_hook_client_t** hook_clients, uint32_t client_count)
+/**
+ * @brief Acquire rundown protection on the published client array of a filter context.
+ *
+ * @param[in] filter_context Filter context to get the client array from.
+ *
+ * @returns Pointer to the client array. The caller must release its rundown protection once done.
+ */
+__forceinline static net_ebpf_extension_hook_client_array_t*
+_net_ebpf_extension_hook_acquire_client_array(_In_ const net_ebpf_extension_wfp_filter_context_t* filter_context)
 {
-    for (uint32_t i = 0; i < client_count; i++) {
-        if (hook_clients[i] == NULL) {
-            continue;
+    for (;;) {
+        net_ebpf_extension_hook_client_array_t* client_array = (net_ebpf_extension_hook_client_array_t*)
+            ReadPointerAcquire((void* const volatile*)&filter_context->client_array);
+
+        // Acquiring rundown fails if the array was replaced and run down after it was read. If it succeeds, the array
+        // may still have been replaced and refilled in between, so it is only used if it is still the published one.
+        if (_net_ebpf_ext_enter_rundown(&client_array->rundown)) {
+            if (ReadPointerAcquire((void* const volatile*)&filter_context->client_array) == client_array) {
+                return client_array;
+            }
+            _net_ebpf_ext_leave_rundown(&client_array->rundown);
         }
-        net_ebpf_extension_hook_client_leave_rundown(hook_clients[i]);
-        hook_clients[i] = NULL;
     }
 }
 
@@ -210,68 +124,52 @@ ebpf_result_t
 net_ebpf_extension_hook_invoke_programs(
     _Inout_ void* program_context, _In_ net_ebpf_extension_wfp_filter_context_t* filter_context, _Out_ uint32_t* result)
 {
-    ebpf_result_t program_result = EBPF_SUCCESS;
-    KIRQL old_irql = PASSIVE_LEVEL;
-    bool lock_acquired = FALSE;
-    uint32_t client_count = 0;
-    net_ebpf_extension_hook_client_t* clients[NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH] = {0};
-    const net_ebpf_extension_hook_process_verdict process_verdict =
-        filter_context->provider_context->dispatch.process_verdict;
+    ebpf_result_t program_result = EBPF_OBJECT_NOT_FOUND;
+    ebpf_execution_context_state_t state;
 
     *result = 0;
 
-    // Acquire shared filter context lock.
-    old_irql = ExAcquireSpinLockShared(&filter_context->lock);
-    lock_acquired = TRUE;
-
-    // Create a local copy of the client contexts.
-    client_count = filter_context->client_context_count;
-    for (uint32_t i = 0; i < client_count; i++) {
-        // Acquire rundown protection for the client. Rundown for a client only starts once the client has been removed
-        // from the list of clients in the filter context. So we should not expect any failure in acquiring rundown
-        // here. If acquiring rundown fails, bail.
-        if (!net_ebpf_extension_hook_client_enter_rundown(filter_context->client_contexts[i])) {
-            NET_EBPF_EXT_LOG_MESSAGE(
-                NET_EBPF_EXT_TRACELOG_LEVEL_ERROR,
-                NET_EBPF_EXT_TRACELOG_KEYWORD_EXTENSION,
-                "net_ebpf_extension_hook_invoke_programs: Rundown failed for client");
+    // The published client array is immutable, and attach / detach wait for its rundown before reusing it, so it can
+    // be used without holding any lock for the duration of the invocation.
+    net_ebpf_extension_hook_client_array_t* client_array =
+        _net_ebpf_extension_hook_acquire_client_array(filter_context);
+    const net_ebpf_extension_hook_process_verdict process_verdict = client_array->process_verdict;
+    const bool batch = (client_array->batch_begin != NULL);
+
+    // Programs in a batch share a single epoch, instead of each program entering its own.
+    if (batch) {
+        program_result = client_array->batch_begin(sizeof(state), &state);
+        if (program_result != EBPF_SUCCESS) {
             goto Exit;
         }
-        clients[i] = filter_context->client_contexts[i];
     }
 
-    // Release the shared filter context lock.
-    ExReleaseSpinLockShared(&filter_context->lock, old_irql);
-    lock_acquired = FALSE;
-    filter_context = NULL;
-
-    program_result = EBPF_OBJECT_NOT_FOUND;
-
     // Iterate over all the programs in the array.
-    for (uint32_t i = 0; i < client_count; i++) {
-        ASSERT(clients[i] != NULL);
+    for (uint32_t i = 0; i < client_array->client_count; i++) {
+        const net_ebpf_extension_hook_dispatch_entry_t* entry = &client_array->dispatch[i];
 
-        program_result = _net_ebpf_extension_hook_invoke_single_program(clients[i], program_context, result);
+        program_result = batch ? entry->batch_invoke(entry->client_binding_context, program_context, result, &state)
+                               : entry->invoke_program(entry->client_binding_context, program_context, result);
         if (program_result != EBPF_SUCCESS) {
             // If we failed to invoke an eBPF program, stop processing and return the error code.
-            goto Exit;
+            break;
         }
 
         // Invoke callback to see if we should continue processing.
         if (process_verdict != NULL) {
             if (!process_verdict(program_context, *result)) {
                 program_result = EBPF_SUCCESS;
-                goto Exit;
+                break;
             }
         }
     }
 
-Exit:
-    if (lock_acquired) {
-        ExReleaseSpinLockShared(&filter_context->lock, old_irql);
+    if (batch) {
+        (void)client_array->batch_end(&state);
     }
 
-    _net_ebpf_extension_release_rundown_for_clients(clients, client_count);
+Exit:
+    _net_ebpf_ext_leave_rundown(&client_array->rundown);
     return program_result;
 }
 
@@ -334,10 +232,12 @@ _Requires_lock_held_(provider_context->lock)
             (net_ebpf_extension_wfp_filter_context_t*)CONTAINING_RECORD(
                 link, net_ebpf_extension_wfp_filter_context_t, link);
 
-        ASSERT(next_context->client_context_count != 0);
+        // The client array of a filter context is only replaced by attach / detach, which hold the provider lock.
+        const net_ebpf_extension_hook_client_array_t* next_client_array = next_context->client_array;
+        ASSERT(next_client_array->client_count != 0);
 
         // Get client data from the first client in the filter context.
-        const ebpf_extension_data_t* next_context_data = next_context->client_contexts[0]->client_data;
+        const ebpf_extension_data_t* next_context_data = next_client_array->clients[0]->client_data;
         const void* next_context_attach_parameter = next_context_data->data;
         // Either both the attach parameters should be NULL or they should match.
         if (attach_parameter == NULL && next_context_attach_parameter == NULL) {
@@ -360,9 +260,6 @@ void
 _net_ebpf_extension_hook_client_cleanup(_In_opt_ _Frees_ptr_opt_ net_ebpf_extension_hook_client_t* hook_client)
 {
     if (hook_client != NULL) {
-        if (hook_client->detach_work_item != NULL) {
-            IoFreeWorkItem(hook_client->detach_work_item);
-        }
         ExFreePool(hook_client);
     }
 }
@@ -437,7 +334,6 @@ _net_ebpf_extension_hook_provider_attach_client(
 
     memset(hook_client, 0, sizeof(net_ebpf_extension_hook_client_t));
 
-    hook_client->detach_work_item = NULL;
     hook_client->nmr_binding_handle = nmr_binding_handle;
     hook_client->client_module_id = client_registration_instance->ModuleId->Guid;
     hook_client->client_binding_context = client_binding_context;
@@ -452,15 +348,10 @@ _net_ebpf_extension_hook_provider_attach_client(
         goto Exit;
     }
     hook_client->invoke_program = client_dispatch_table->ebpf_program_invoke_function;
-
-    status = _ebpf_ext_attach_init_rundown(hook_client);
-    if (!NT_SUCCESS(status)) {
-        NET_EBPF_EXT_LOG_MESSAGE_NTSTATUS(
-            NET_EBPF_EXT_TRACELOG_LEVEL_ERROR,
-            NET_EBPF_EXT_TRACELOG_KEYWORD_EXTENSION,
-            "_ebpf_ext_attach_init_rundown failed. Attach attempt rejected.",
-            status);
-        goto Exit;
+    if (client_dispatch_table->count >= EBPF_LINK_DISPATCH_TABLE_FUNCTION_COUNT_1) {
+        hook_client->batch_begin = client_dispatch_table->ebpf_program_batch_begin_invoke_function;
+        hook_client->batch_invoke = client_dispatch_table->ebpf_program_batch_invoke_function;
+        hook_client->batch_end = client_dispatch_table->ebpf_program_batch_end_invoke_function;
     }
 
     // Acquire passive lock to serialize attach / detach operations.
@@ -610,13 +501,12 @@ _Requires_exclusive_lock_held_(provider_context->lock) static void _net_ebpf_ext
  *
  * @param[in] provider_binding_context Provider module's context for binding with the client.
  * @retval STATUS_SUCCESS The operation succeeded.
- * @retval STATUS_PENDING The operation is pending completion.
  * @retval STATUS_INVALID_PARAMETER One or more parameters are invalid.
  */
 static NTSTATUS
 _net_ebpf_extension_hook_provider_detach_client(_In_ const void* provider_binding_context)
 {
-    NTSTATUS status = STATUS_PENDING;
+    NTSTATUS status = STATUS_SUCCESS;
     net_ebpf_extension_hook_provider_t* local_provider_context = NULL;
     bool provider_lock_acquired = FALSE;
     net_ebpf_extension_wfp_filter_context_t* filter_context = NULL;
@@ -642,23 +532,17 @@ _net_ebpf_extension_hook_provider_detach_client(_In_ const void* provider_bindin
     ACQUIRE_PUSH_LOCK_EXCLUSIVE(&local_provider_context->lock);
     provider_lock_acquired = TRUE;
 
-    // Remove the client from the filter context.
+    // Remove the client from the filter context. This waits for any in progress invocations that can still see the
+    // client to complete, so the detach completes synchronously.
     net_ebpf_ext_remove_client_context(filter_context, local_client_context);
 
     // If the filter context is empty, remove it from the list of filter contexts.
-    // Note that we can access client_context_count as we still have push lock acquired which serializes
+    // Note that we can access the client array as we still have push lock acquired which serializes
     // all attach/detach operations on this provider.
-    if (filter_context->client_context_count == 0) {
+    if (filter_context->client_array->client_count == 0) {
         _net_ebpf_ext_remove_filter_context_from_provider(local_provider_context, filter_context);
     }
 
-    // Queue a work item to delete the client context.
-    IoQueueWorkItem(
-        local_client_context->detach_work_item,
-        _net_ebpf_extension_detach_client_completion,
-        DelayedWorkQueue,
-        (void*)local_client_context);
-
 Exit:
     if (local_provider_context) {
         if (provider_lock_acquired) {
@@ -723,7 +607,7 @@ net_ebpf_extension_hook_provider_register(
     memset(local_provider_context, 0, sizeof(net_ebpf_extension_hook_provider_t));
     ExInitializePushLock(&local_provider_context->lock);
     InitializeListHead(&local_provider_context->filter_context_list);
-    _ebpf_ext_init_hook_rundown(&local_provider_context->rundown);
+    net_ebpf_ext_init_hook_rundown(&local_provider_context->rundown);
 
     characteristics = &local_provider_context->characteristics;
     characteristics->Length = sizeof(NPI_PROVIDER_CHARACTERISTICS);
@@ -119,6 +119,14 @@ net_ebpf_extension_hook_expand_stack_and_invoke_programs(
 net_ebpf_extension_hook_attach_capability_t
 net_ebpf_extension_hook_provider_get_attach_capability(_In_ const net_ebpf_extension_hook_provider_t* provider_context);
 
+/**
+ * @brief Initialize the hook rundown state.
+ *
+ * @param[in, out] rundown Pointer to the rundown object to initialize.
+ */
+void
+net_ebpf_ext_init_hook_rundown(_Inout_ net_ebpf_ext_hook_rundown_t* rundown);
+
 /**
  * @brief Block execution of the thread until all invocations are completed.
  *
@@ -284,8 +284,15 @@ typedef struct _net_ebpf_ext_sock_addr_connection_contexts
     // This list is used in place of the table under low memory conditions, when we fail to allocate entries.
     _Guarded_by_(lock) LIST_ENTRY low_memory_context_list;
     uint32_t low_memory_context_count;
+
+    // Cache of the entries allocated by context_table.
+    ebpf_object_cache_t* table_entry_cache;
 } net_ebpf_ext_sock_addr_connection_contexts_t;
 
+// The AVL table stores each connection context after its node header, which it aligns to 8 bytes.
+#define NET_EBPF_EXT_SOCK_ADDR_TABLE_ENTRY_SIZE \
+    (EBPF_PAD_8(sizeof(RTL_BALANCED_LINKS)) + sizeof(net_ebpf_extension_connection_context_t))
+
 static net_ebpf_ext_sock_addr_connection_contexts_t _net_ebpf_ext_sock_addr_contexts = {0};
 
 static SECURITY_DESCRIPTOR* _net_ebpf_ext_security_descriptor_admin = NULL;
@@ -888,7 +895,13 @@ _Function_class_(RTL_AVL_ALLOCATE_ROUTINE) static PVOID
 {
     UNREFERENCED_PARAMETER(table);
 
-    PVOID buffer = ExAllocatePoolUninitialized(NonPagedPoolNx, buffer_size, NET_EBPF_EXTENSION_POOL_TAG);
+    // The table only ever stores connection contexts, so every entry fits in an object from the cache.
+    ASSERT(buffer_size <= NET_EBPF_EXT_SOCK_ADDR_TABLE_ENTRY_SIZE);
+    if (buffer_size > NET_EBPF_EXT_SOCK_ADDR_TABLE_ENTRY_SIZE) {
+        return NULL;
+    }
+
+    PVOID buffer = ebpf_object_cache_allocate(_net_ebpf_ext_sock_addr_contexts.table_entry_cache);
     if (buffer) {
         memset(buffer, 0, buffer_size);
     }
@@ -900,7 +913,7 @@ _Function_class_(RTL_AVL_FREE_ROUTINE) static VOID
 {
     UNREFERENCED_PARAMETER(table);
 
-    ExFreePool(buffer);
+    ebpf_object_cache_free(_net_ebpf_ext_sock_addr_contexts.table_entry_cache, buffer);
 }
 
 static NTSTATUS
@@ -908,6 +921,14 @@ _net_ebpf_sock_addr_initialize_connection_contexts()
 {
     NTSTATUS status = STATUS_SUCCESS;
 
+    if (ebpf_object_cache_create(
+            &_net_ebpf_ext_sock_addr_contexts.table_entry_cache,
+            NET_EBPF_EXT_SOCK_ADDR_TABLE_ENTRY_SIZE,
+            NET_EBPF_EXT_OBJECT_CACHE_MAX_PER_CPU,
+            NET_EBPF_EXTENSION_POOL_TAG) != EBPF_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+
     RtlInitializeGenericTableAvl(
         &_net_ebpf_ext_sock_addr_contexts.context_table,
         _net_ebpf_sock_addr_context_avl_compare_routine,
@@ -1333,6 +1354,13 @@ net_ebpf_ext_sock_addr_unregister_providers()
     _net_ebpf_sock_addr_clean_up_security_descriptor();
 }
 
+void
+net_ebpf_ext_sock_addr_uninitialize_object_cache()
+{
+    ebpf_object_cache_destroy(_net_ebpf_ext_sock_addr_contexts.table_entry_cache);
+    _net_ebpf_ext_sock_addr_contexts.table_entry_cache = NULL;
+}
+
 typedef enum _net_ebpf_extension_sock_addr_connection_direction
 {
     EBPF_HOOK_SOCK_ADDR_INGRESS = 0,
@@ -144,6 +144,14 @@ net_ebpf_extension_sock_addr_redirect_connection_classify(
 void
 net_ebpf_ext_sock_addr_unregister_providers();
 
+/**
+ * @brief Destroy the object cache used by the CGROUP_SOCK_ADDR hooks. WFP classify and flow delete callbacks may still
+ * allocate from or free to the cache until the callouts are unregistered, so this is called after
+ * net_ebpf_extension_uninitialize_wfp_components.
+ */
+void
+net_ebpf_ext_sock_addr_uninitialize_object_cache();
+
 /**
  * @brief Register CGROUP_SOCK_ADDR NPI providers.
  *
@@ -172,6 +172,9 @@ NPI_MODULEID DECLSPEC_SELECTANY _ebpf_sock_ops_hook_provider_moduleid = {
 
 static net_ebpf_extension_hook_provider_t* _ebpf_sock_ops_hook_provider_context = NULL;
 
+// Cache of flow contexts, one of which is allocated for every flow established while a program is attached.
+static ebpf_object_cache_t* _net_ebpf_ext_sock_ops_flow_context_cache = NULL;
+
 //
 // NMR Registration Helper Routines.
 //
@@ -349,6 +352,20 @@ net_ebpf_ext_sock_ops_register_providers()
 
     NET_EBPF_EXT_LOG_ENTRY();
 
+    if (ebpf_object_cache_create(
+            &_net_ebpf_ext_sock_ops_flow_context_cache,
+            sizeof(net_ebpf_extension_sock_ops_wfp_flow_context_t),
+            NET_EBPF_EXT_OBJECT_CACHE_MAX_PER_CPU,
+            NET_EBPF_EXTENSION_POOL_TAG) != EBPF_SUCCESS) {
+        status = STATUS_NO_MEMORY;
+        NET_EBPF_EXT_LOG_MESSAGE_NTSTATUS(
+            NET_EBPF_EXT_TRACELOG_LEVEL_ERROR,
+            NET_EBPF_EXT_TRACELOG_KEYWORD_SOCK_OPS,
+            "ebpf_object_cache_create failed.",
+            status);
+        goto Exit;
+    }
+
     status = net_ebpf_extension_program_info_provider_register(
         &program_info_provider_parameters, &_ebpf_sock_ops_program_info_provider_context);
     if (!NT_SUCCESS(status)) {
@@ -397,6 +414,13 @@ net_ebpf_ext_sock_ops_unregister_providers()
     }
 }
 
+void
+net_ebpf_ext_sock_ops_uninitialize_object_cache()
+{
+    ebpf_object_cache_destroy(_net_ebpf_ext_sock_ops_flow_context_cache);
+    _net_ebpf_ext_sock_ops_flow_context_cache = NULL;
+}
+
 wfp_ale_layer_fields_t wfp_flow_established_fields[] = {
     // EBPF_HOOK_ALE_FLOW_ESTABLISHED_V4
     {FWPS_FIELD_ALE_FLOW_ESTABLISHED_V4_IP_LOCAL_ADDRESS,
@@ -513,8 +537,8 @@ net_ebpf_extension_sock_ops_flow_established_classify(
         goto Exit;
     }
 
-    local_flow_context = (net_ebpf_extension_sock_ops_wfp_flow_context_t*)ExAllocatePoolUninitialized(
-        NonPagedPoolNx, sizeof(net_ebpf_extension_sock_ops_wfp_flow_context_t), NET_EBPF_EXTENSION_POOL_TAG);
+    local_flow_context = (net_ebpf_extension_sock_ops_wfp_flow_context_t*)ebpf_object_cache_allocate(
+        _net_ebpf_ext_sock_ops_flow_context_cache);
     NET_EBPF_EXT_BAIL_ON_ALLOC_FAILURE_RESULT(
         NET_EBPF_EXT_TRACELOG_KEYWORD_SOCK_OPS, local_flow_context, "flow_context", result);
     memset(local_flow_context, 0, sizeof(net_ebpf_extension_sock_ops_wfp_flow_context_t));
@@ -599,7 +623,7 @@ Exit:
         if (local_flow_context->filter_context != NULL) {
             DEREFERENCE_FILTER_CONTEXT(&local_flow_context->filter_context->base);
         }
-        ExFreePool(local_flow_context);
+        ebpf_object_cache_free(_net_ebpf_ext_sock_ops_flow_context_cache, local_flow_context);
     }
 }
 
@@ -654,7 +678,7 @@ Exit:
     }
 
     if (local_flow_context != NULL) {
-        ExFreePool(local_flow_context);
+        ebpf_object_cache_free(_net_ebpf_ext_sock_ops_flow_context_cache, local_flow_context);
     }
 }
 
@@ -63,6 +63,14 @@ net_ebpf_extension_sock_ops_flow_delete(uint16_t layer_id, uint32_t callout_id,
 void
 net_ebpf_ext_sock_ops_unregister_providers();
 
+/**
+ * @brief Destroy the object cache used by the SOCK_OPS hooks. WFP classify and flow delete callbacks may still
+ * allocate from or free to the cache until the callouts are unregistered, so this is called after
+ * net_ebpf_extension_uninitialize_wfp_components.
+ */
+void
+net_ebpf_ext_sock_ops_uninitialize_object_cache();
+
 /**
  * @brief Register SOCK_OPS NPI providers.
  *
@@ -0,0 +1,78 @@
+# Copyright (c) eBPF for Windows contributors
+# SPDX-License-Identifier: MIT
+
+# Compare two sets of results written by ebpf_performance.exe when EBPF_PERFORMANCE_RESULTS_FILE is set.
+# Each file holds one JSON object per line. Measurements are matched on test name, preemptible and mode, and
+# a measurement regresses if any of the compared metrics grew by more than the threshold. The script exits
+# with 1 if any measurement regressed, so it can gate a pipeline.
+#
+# Example:
+#   $env:EBPF_PERFORMANCE_RESULTS_FILE = "baseline.json"; .\ebpf_performance.exe
+#   $env:EBPF_PERFORMANCE_RESULTS_FILE = "current.json"; .\ebpf_performance.exe
+#   .\Compare-PerformanceResults.ps1 -BaselinePath baseline.json -CurrentPath current.json
+
+param(
+    [Parameter(Mandatory=$true)] [string] $BaselinePath,
+    [Parameter(Mandatory=$true)] [string] $CurrentPath,
+    [Parameter(Mandatory=$false)] [string[]] $Metrics = @("average_ns", "p99_ns"),
+    [Parameter(Mandatory=$false)] [double] $ThresholdPercent = 10)
+
+function Read-Results([string] $Path) {
+    $results = @{}
+    foreach ($line in Get-Content -Path $Path) {
+        if ([string]::IsNullOrWhiteSpace($line)) {
+            continue
+        }
+        $result = $line | ConvertFrom-Json
+        $key = "$($result.test),$($result.preemptible),$($result.mode)"
+        # If a test was run more than once, the last result wins.
+        $results[$key] = $result
+    }
+    return $results
+}
+
+$baseline = Read-Results $BaselinePath
+$current = Read-Results $CurrentPath
+
+$comparisons = @()
+$regression_count = 0
+foreach ($key in ($current.Keys | Sort-Object)) {
+    if (!$baseline.ContainsKey($key)) {
+        Write-Output "New measurement without baseline: $key"
+        continue
+    }
+    foreach ($metric in $Metrics) {
+        $old = [double]$baseline[$key].$metric
+        $new = [double]$current[$key].$metric
+        $change = if ($old -gt 0) { ($new - $old) * 100 / $old } else { 0 }
+        $regressed = $change -gt $ThresholdPercent
+        if ($regressed) {
+            $regression_count++
+        }
+        $comparisons += [PSCustomObject]@{
+            Test = $current[$key].test
+            Preemptible = $current[$key].preemptible
+            Mode = $current[$key].mode
+            Metric = $metric
+            Baseline = $old
+            Current = $new
+            ChangePercent = [math]::Round($change, 1)
+            Regressed = $regressed
+        }
+    }
+}
+
+foreach ($key in ($baseline.Keys | Sort-Object)) {
+    if (!$current.ContainsKey($key)) {
+        Write-Output "Measurement missing from current results: $key"
+    }
+}
+
+$comparisons | Format-Table -AutoSize | Out-String -Width 4096 | Write-Output
+
+if ($regression_count -gt 0) {
+    Write-Output "$regression_count metric(s) regressed by more than $ThresholdPercent%."
+    exit 1
+}
+Write-Output "No metric regressed by more than $ThresholdPercent%."
+exit 0
@@ -1497,6 +1497,105 @@ TEST_CASE("ioctl_stress", "[stress]")
     _close(test_map_fd);
 }
 
+#define MAP_LOOKUP_SCALING_ITERATIONS 100000
+
+static void
+_map_lookup_scaling_benchmark(bpf_map_type map_type)
+{
+    fd_t map_fd = bpf_map_create(map_type, "scaling_map", sizeof(uint32_t), sizeof(uint64_t), 1, nullptr);
+    REQUIRE(map_fd > 0);
+
+    uint32_t key = 0;
+    uint64_t value = 0;
+    REQUIRE(bpf_map_update_elem(map_fd, &key, &value, 0) == 0);
+
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+
+    // Every thread looks up the same key in the same map, so any contention on the map object itself shows up as a
+    // per-lookup cost that grows with the thread count.
+    for (DWORD thread_count = 1; thread_count <= sysinfo.dwNumberOfProcessors; thread_count *= 2) {
+        std::atomic<size_t> failure_count = 0;
+        std::atomic<DWORD> ready_count = 0;
+        std::atomic<bool> start = false;
+        std::vector<std::jthread> threads;
+        for (DWORD i = 0; i < thread_count; i++) {
+            threads.emplace_back([&]() {
+                uint32_t thread_key = 0;
+                uint64_t thread_value;
+                ready_count++;
+                while (!start) {
+                    std::this_thread::yield();
+                }
+                for (uint32_t iteration = 0; iteration < MAP_LOOKUP_SCALING_ITERATIONS; iteration++) {
+                    if (bpf_map_lookup_elem(map_fd, &thread_key, &thread_value) != 0) {
+                        failure_count++;
+                    }
+                }
+            });
+        }
+
+        while (ready_count < thread_count) {
+            std::this_thread::yield();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+        REQUIRE(failure_count == 0);
+
+        uint64_t total_lookups = static_cast<uint64_t>(thread_count) * MAP_LOOKUP_SCALING_ITERATIONS;
+        std::cout << "map type " << map_type << ", " << thread_count << " threads: "
+                  << (total_lookups * 1000000000ull) / std::max<uint64_t>(elapsed.count(), 1) << " lookups/s, "
+                  << elapsed.count() / MAP_LOOKUP_SCALING_ITERATIONS << "ns per lookup per thread" << std::endl;
+    }
+
+    _close(map_fd);
+}
+
+TEST_CASE("map_lookup_scaling_benchmark", "[benchmark]")
+{
+    _map_lookup_scaling_benchmark(BPF_MAP_TYPE_HASH);
+    _map_lookup_scaling_benchmark(BPF_MAP_TYPE_ARRAY);
+}
+
+#define NATIVE_LOAD_LATENCY_ITERATIONS 20
+
+// Measure how long loading a native module takes when the same module is reloaded repeatedly. The first load
+// resolves helper functions and hashes the program information for every program, later loads of the same programs
+// can use the results cached by the execution context.
+TEST_CASE("native_load_latency_benchmark", "[benchmark]")
+{
+    std::chrono::nanoseconds first_load{};
+    std::chrono::nanoseconds reload_total{};
+
+    for (uint32_t iteration = 0; iteration < NATIVE_LOAD_LATENCY_ITERATIONS; iteration++) {
+        // Each iteration loads a fresh copy of the module, as a rollout of a new build would.
+        native_module_helper_t native_helper;
+        native_helper.initialize("tail_call_multiple", EBPF_EXECUTION_NATIVE);
+
+        struct bpf_object* object = bpf_object__open(native_helper.get_file_name().c_str());
+        REQUIRE(object != nullptr);
+
+        auto begin = std::chrono::steady_clock::now();
+        int result = bpf_object__load(object);
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+        bpf_object__close(object);
+        REQUIRE(result == 0);
+
+        if (iteration == 0) {
+            first_load = elapsed;
+        } else {
+            reload_total += elapsed;
+        }
+    }
+
+    std::cout << "native load: first " << first_load.count() << "ns, reload average "
+              << reload_total.count() / (NATIVE_LOAD_LATENCY_ITERATIONS - 1) << "ns" << std::endl;
+}
+
 typedef struct _ring_buffer_test_context
 {
     uint32_t event_count = 0;
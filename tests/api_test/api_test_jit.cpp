@@ -13,8 +13,12 @@
 #include "socket_helper.h"
 
 #define _NTDEF_ // UNICODE_STRING is already defined.
+#include <chrono>
+#include <iostream>
 #include <ntsecapi.h>
 
+#define VERIFICATION_CACHE_BENCHMARK_ITERATIONS 10
+
 void
 tailcall_load_test(_In_z_ const char* file_name)
 {
@@ -172,6 +176,39 @@ divide_by_zero_test_km(ebpf_execution_type_t execution_type)
     // If we don't bug-check, the test passed.
 }
 
+// Measures the time to reload the same object repeatedly, as an agent does on
+// every restart. The first load may run the verifier; subsequent loads of the
+// unchanged object are expected to be served from the service's verification cache.
+static void
+verification_cache_load_benchmark(_In_z_ const char* file_name, ebpf_execution_type_t execution_type)
+{
+    std::chrono::nanoseconds first_load_time{};
+    std::chrono::nanoseconds reload_time{};
+
+    for (uint32_t iteration = 0; iteration < VERIFICATION_CACHE_BENCHMARK_ITERATIONS; iteration++) {
+        struct bpf_object* object = nullptr;
+        fd_t program_fd;
+
+        auto start = std::chrono::steady_clock::now();
+        int result = program_load_helper(file_name, BPF_PROG_TYPE_UNSPEC, execution_type, &object, &program_fd);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        REQUIRE(result == 0);
+        bpf_object__close(object);
+
+        if (iteration == 0) {
+            first_load_time = elapsed;
+        } else {
+            reload_time += elapsed;
+        }
+    }
+
+    std::cout << file_name << ": first load "
+              << std::chrono::duration_cast<std::chrono::microseconds>(first_load_time).count() << "us, average reload "
+              << std::chrono::duration_cast<std::chrono::microseconds>(reload_time).count() /
+                     (VERIFICATION_CACHE_BENCHMARK_ITERATIONS - 1)
+              << "us" << std::endl;
+}
+
 int32_t
 get_expected_jit_result(int32_t expected_result)
 {
@@ -202,6 +239,12 @@ TEST_CASE("divide_by_zero_jit", "[divide_by_zero]") { divide_by_zero_test_km(EBP
 TEST_CASE("tailcall_load_test_jit", "[tailcall_load_test]") { tailcall_load_test("tail_call_multiple.o"); }
 
 TEST_CASE("bpf_user_helpers_test_jit", "[api_test]") { bpf_user_helpers_test(EBPF_EXECUTION_JIT); }
+
+TEST_CASE("verification_cache_load_benchmark_jit", "[benchmark]")
+{
+    verification_cache_load_benchmark("bindmonitor.o", EBPF_EXECUTION_JIT);
+    verification_cache_load_benchmark("tail_call_multiple.o", EBPF_EXECUTION_JIT);
+}
 #endif
 
 #if !defined(CONFIG_BPF_INTERPRETER_DISABLED)
@@ -210,4 +253,9 @@ TEST_CASE("ringbuf_api_interpret", "[test_ringbuf_api][ring_buffer]")
     ring_buffer_api_test(EBPF_EXECUTION_INTERPRET);
 }
 TEST_CASE("divide_by_zero_interpret", "[divide_by_zero]") { divide_by_zero_test_km(EBPF_EXECUTION_INTERPRET); }
+
+TEST_CASE("verification_cache_load_benchmark_interpret", "[benchmark]")
+{
+    verification_cache_load_benchmark("bindmonitor.o", EBPF_EXECUTION_INTERPRET);
+}
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "bpf2c.h"
 #include "test_helpers.h"
 
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <map>
@@ -25,11 +26,11 @@ main(int argc, char** argv)
     std::vector<uint8_t> mem;
 
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " expected_result data" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " expected_result data [invoke_count]" << std::endl;
         return -1;
     }
     expected_result = strtoull(argv[1], NULL, 16);
-    if (argc == 3) {
+    if (argc >= 3) {
         std::string byte;
         std::stringstream data_string(argv[2]);
         while (std::getline(data_string, byte, ' ')) {
@@ -87,5 +88,20 @@ main(int argc, char** argv)
                   << std::endl;
         return 1;
     }
+
+    // When an invoke count is given, time that many invocations and print the average in nanoseconds.
+    if (argc >= 4) {
+        uint64_t invoke_count = strtoull(argv[3], NULL, 10);
+        if (invoke_count == 0) {
+            return 0;
+        }
+        volatile uint64_t sink = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint64_t i = 0; i < invoke_count; i++) {
+            sink = program_entries[0].function(mem.data(), &runtime_contexts[0]);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << std::chrono::duration<double, std::nano>(end - start).count() / invoke_count << std::endl;
+    }
     return 0;
 }
@@ -9,6 +9,9 @@
 #include "capture_helper.hpp"
 #include "catch_wrapper.hpp"
 
+#include <Windows.h>
+#include <psapi.h>
+#include <chrono>
 #include <filesystem>
 #include <map>
 #include <optional>
@@ -23,6 +26,10 @@
 
 #define INDENT "    "
 
+#define ELF_LOAD_BENCHMARK_ITERATIONS 10
+
+#pragma comment(lib, "Psapi.lib")
+
 template <typename stream_t>
 std::vector<std::string>
 read_contents(const std::string& source, std::vector<std::function<std::string(const std::string&)>> transforms)
@@ -205,6 +212,7 @@ DECLARE_TEST("bindmonitor_bpf2bpf", _test_mode::Verify)
 DECLARE_TEST("bindmonitor_ringbuf", _test_mode::Verify)
 DECLARE_TEST("bindmonitor_tailcall", _test_mode::Verify)
 DECLARE_TEST("bindmonitor_mt_tailcall", _test_mode::Verify)
+DECLARE_TEST("bloom_filter", _test_mode::UseHash)
 DECLARE_TEST_CUSTOM_PROGRAM_TYPE("bpf", _test_mode::Verify, std::string("bind"))
 DECLARE_TEST_CUSTOM_PROGRAM_TYPE("bpf", _test_mode::FileOutput, std::string("bind"))
 DECLARE_TEST("bpf_call", _test_mode::Verify)
@@ -380,3 +388,218 @@ TEST_CASE("Verbose output", "[bpf2c_cli]")
     REQUIRE(result_value == 0);
     REQUIRE(err.empty());
 }
+
+static size_t
+_get_peak_working_set_size()
+{
+    PROCESS_MEMORY_COUNTERS counters = {};
+    REQUIRE(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)));
+    return counters.PeakWorkingSetSize;
+}
+
+TEST_CASE("elf load benchmark", "[benchmark]")
+{
+    // Sample objects ranging from a single program to many programs sharing
+    // BTF-described maps, so that both per-object and per-program costs show up.
+    const std::vector<std::string> files = {
+        "bindmonitor.o",
+        "bindmonitor_ringbuf.o",
+        "cgroup_sock_addr.o",
+        "map_in_map_btf.o",
+        "tail_call_multiple.o",
+        "test_sample_ebpf.o",
+    };
+
+    for (const auto& file : files) {
+        std::vector<const char*> argv;
+        argv.push_back("bpf2c.exe");
+        argv.push_back("--bpf");
+        argv.push_back(file.c_str());
+
+        size_t peak_working_set_before = _get_peak_working_set_size();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t iteration = 0; iteration < ELF_LOAD_BENCHMARK_ITERATIONS; iteration++) {
+            auto [out, err, result_value] = run_test_main(argv);
+            REQUIRE(result_value == 0);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        size_t peak_working_set_after = _get_peak_working_set_size();
+
+        auto average = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() /
+                       ELF_LOAD_BENCHMARK_ITERATIONS;
+        std::cout << file << ": " << average << "us per load, peak working set " << peak_working_set_after / 1024
+                  << "KB (+" << (peak_working_set_after - peak_working_set_before) / 1024 << "KB)" << std::endl;
+    }
+}
+
+// Objects that bpf2c translates successfully, used by the tests that compare code generation modes.
+static const std::vector<std::string> _code_generation_corpus = {
+    "atomic_instruction_fetch_add.o",
+    "bindmonitor.o",
+    "bindmonitor_bpf2bpf.o",
+    "bindmonitor_mt_tailcall.o",
+    "bindmonitor_ringbuf.o",
+    "bindmonitor_tailcall.o",
+    "bpf_call.o",
+    "cgroup_sock_addr.o",
+    "cgroup_sock_addr2.o",
+    "decap_permit_packet.o",
+    "map_in_map_btf.o",
+    "printk.o",
+    "sockops.o",
+    "tail_call_multiple.o",
+    "test_sample_ebpf.o",
+    "test_utility_helpers.o",
+};
+
+static std::string
+_generate_code(const std::string& file, const std::vector<const char*>& options)
+{
+    std::vector<const char*> argv;
+    argv.push_back("bpf2c.exe");
+    argv.push_back("--bpf");
+    argv.push_back(file.c_str());
+    argv.insert(argv.end(), options.begin(), options.end());
+    auto [out, err, result_value] = run_test_main(argv);
+    REQUIRE(result_value == 0);
+    return out;
+}
+
+TEST_CASE("parallel code generation", "[bpf2c_cli]")
+{
+    // Encoding programs concurrently must not change the generated code.
+    for (const auto& file : _code_generation_corpus) {
+        std::string serial_output = _generate_code(file, {"--raw"});
+        std::string parallel_output = _generate_code(file, {"--raw", "--jobs", "4"});
+        REQUIRE(serial_output == parallel_output);
+    }
+}
+
+TEST_CASE("split code generation", "[bpf2c_cli]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "bpf2c_split_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::string output_file = (directory / "tail_call_multiple_raw.c").string();
+
+    auto get_program_files = [&]() {
+        std::map<std::string, std::filesystem::file_time_type> program_files;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            std::string name = entry.path().filename().string();
+            if (name.starts_with("tail_call_multiple_raw_program_")) {
+                program_files[name] = std::filesystem::last_write_time(entry.path());
+            }
+        }
+        return program_files;
+    };
+
+    _generate_code("tail_call_multiple.o", {"--raw", output_file.c_str(), "--split"});
+    auto first_run = get_program_files();
+    REQUIRE(first_run.size() > 1);
+
+    // The main file only refers to the programs, whose code lives in the program files.
+    std::vector<std::string> main_file = read_contents<std::ifstream>(output_file, {});
+    for (const auto& line : main_file) {
+        REQUIRE(line.find("// Prologue.") == std::string::npos);
+    }
+    for (const auto& [name, _] : first_run) {
+        std::vector<std::string> program_file = read_contents<std::ifstream>((directory / name).string(), {});
+        REQUIRE(std::find(program_file.begin(), program_file.end(), INDENT "// Prologue.") != program_file.end());
+    }
+
+    // Regenerating the same object must leave every program file untouched.
+    _generate_code("tail_call_multiple.o", {"--raw", output_file.c_str(), "--split", "--jobs", "4"});
+    REQUIRE(get_program_files() == first_run);
+
+    // The manifest lists exactly the program files.
+    std::vector<std::string> manifest =
+        read_contents<std::ifstream>((directory / "tail_call_multiple_raw_programs.txt").string(), {});
+    REQUIRE(manifest.size() == first_run.size());
+    for (const auto& name : manifest) {
+        REQUIRE(first_run.contains(name));
+    }
+
+    // A program file left truncated by an earlier failed run is rewritten.
+    std::string truncated_name = first_run.begin()->first;
+    std::ofstream((directory / truncated_name).string(), std::ios::trunc).close();
+    _generate_code("tail_call_multiple.o", {"--raw", output_file.c_str(), "--split"});
+    REQUIRE(std::filesystem::file_size(directory / truncated_name) > 0);
+
+    // Files that bpf2c listed in an earlier manifest are removed; files it never wrote are left alone.
+    std::string stale_name = "tail_call_multiple_raw_program_0000000000000000.c";
+    std::string foreign_name = "tail_call_multiple_raw_program_ffffffffffffffff.c";
+    std::ofstream((directory / stale_name).string()) << "stale";
+    std::ofstream((directory / foreign_name).string()) << "foreign";
+    std::ofstream((directory / "tail_call_multiple_raw_programs.txt").string(), std::ios::app) << stale_name << "\n";
+    _generate_code("tail_call_multiple.o", {"--raw", output_file.c_str(), "--split"});
+    REQUIRE(!std::filesystem::exists(directory / stale_name));
+    REQUIRE(std::filesystem::exists(directory / foreign_name));
+    std::filesystem::remove(directory / foreign_name);
+    auto last_run = get_program_files();
+    REQUIRE(last_run.size() == first_run.size());
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("code generation benchmark", "[benchmark]")
+{
+    auto measure = [&](const std::vector<const char*>& options) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& file : _code_generation_corpus) {
+            (void)_generate_code(file, options);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    };
+
+    auto serial = measure({"--raw"});
+    auto parallel = measure({"--raw", "--jobs", "0"});
+    std::cout << "bpf2c over " << _code_generation_corpus.size() << " objects: " << serial << "ms serial, "
+              << parallel << "ms parallel" << std::endl;
+}
+
+TEST_CASE("optimized code generation", "[bpf2c_cli]")
+{
+    // Optimization only changes the program code. The maps, helpers, program table
+    // and program info hashes must be the same as without it.
+    const std::string program_table = "static program_entry_t _programs[] = {";
+    for (const auto& file : _code_generation_corpus) {
+        std::string output = _generate_code(file, {"--raw"});
+        std::string optimized_output = _generate_code(file, {"--raw", "--optimize"});
+        size_t program_table_offset = output.find(program_table);
+        size_t optimized_program_table_offset = optimized_output.find(program_table);
+        REQUIRE(program_table_offset != std::string::npos);
+        REQUIRE(optimized_program_table_offset != std::string::npos);
+        REQUIRE(output.substr(program_table_offset) == optimized_output.substr(optimized_program_table_offset));
+
+        // Encoding programs concurrently gives the same optimized code.
+        REQUIRE(optimized_output == _generate_code(file, {"--raw", "--optimize", "--jobs", "4"}));
+    }
+}
+
+TEST_CASE("optimized code size benchmark", "[benchmark]")
+{
+    auto count = [](const std::string& output, const std::string& pattern) {
+        size_t occurrences = 0;
+        for (size_t offset = output.find(pattern); offset != std::string::npos;
+             offset = output.find(pattern, offset + pattern.size())) {
+            occurrences++;
+        }
+        return occurrences;
+    };
+
+    size_t total_size = 0;
+    size_t total_optimized_size = 0;
+    for (const auto& file : _code_generation_corpus) {
+        std::string output = _generate_code(file, {"--raw"});
+        std::string optimized_output = _generate_code(file, {"--raw", "--optimize"});
+        total_size += output.size();
+        total_optimized_size += optimized_output.size();
+        std::cout << file << ": " << output.size() << " -> " << optimized_output.size() << " bytes, "
+                  << count(output, "if (") << " -> " << count(optimized_output, "if (") << " branches, "
+                  << count(output, " ? ") << " -> " << count(optimized_output, " ? ") << " division checks"
+                  << std::endl;
+    }
+    std::cout << "bpf2c over " << _code_generation_corpus.size() << " objects: " << total_size << " bytes, "
+              << total_optimized_size << " bytes optimized" << std::endl;
+}
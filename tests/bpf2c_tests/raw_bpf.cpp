@@ -203,19 +203,33 @@ run_ubpf_interpret_test(const std::string& data_file)
 }
 #endif
 
-void
-run_bpf_code_generator_test(const std::string& data_file)
+/**
+ * @brief Generate C code for a test file and compile it with the bpf_test.cpp harness.
+ *
+ * @param[in] data_file Test file to build.
+ * @param[in] optimize Whether to run the bpf2c optimization pass.
+ * @param[in] suffix Suffix added to the name of the generated files, so that builds with different flags don't clash.
+ * @param[in] extra_cxxflags Compiler flags added to CXXFLAGS.
+ * @returns Executable name, expected result and memory of the test.
+ */
+static std::tuple<std::string, std::string, std::string>
+_build_bpf_code_generator_test(
+    const std::string& data_file, bool optimize, const std::string& suffix, const std::string& extra_cxxflags)
 {
     std::string cc = env_or_default("CC", "cl.exe");
-    std::string cxxflags = env_or_default("CXXFLAGS", "/EHsc /nologo");
+    std::string cxxflags = env_or_default("CXXFLAGS", "/EHsc /nologo") + extra_cxxflags;
 
     auto [prefix, mem, result, instructions] = parse_test_file(data_file);
+    if (optimize) {
+        prefix += "_optimized";
+    }
+    prefix += suffix;
 
     std::ofstream c_file(std::string(prefix) + std::string(".c"));
     c_file << "#define WIN32_LEAN_AND_MEAN // Exclude rarely-used stuff from Windows headers" << std::endl;
     c_file << "#include <windows.h>" << std::endl;
     try {
-        bpf_code_generator code("test", instructions);
+        bpf_code_generator code("test", instructions, optimize);
         code.emit_c_code(c_file);
     } catch (std::runtime_error& err) {
         REQUIRE(err.what() == NULL);
@@ -228,6 +242,13 @@ run_bpf_code_generator_test(const std::string& data_file)
                                   std::string(prefix) + std::string(".c ") + std::string(" bpf_test.cpp >") +
                                   std::string(prefix) + std::string(".log 2>&1");
     REQUIRE(system(compile_command.c_str()) == 0);
+    return {prefix, result, mem};
+}
+
+void
+run_bpf_code_generator_test(const std::string& data_file, bool optimize)
+{
+    auto [prefix, result, mem] = _build_bpf_code_generator_test(data_file, optimize, "", "");
     std::string test_command = std::string("." SEPARATOR) + std::string(prefix) + std::string(" ") +
                                std::string(result) + std::string(" \"") + std::string(mem) + std::string("\"");
     REQUIRE(system(test_command.c_str()) == 0);
@@ -241,8 +262,12 @@ run_bpf_code_generator_test(const std::string& data_file)
     ".." SEPARATOR ".." SEPARATOR "external" SEPARATOR "ubpf" SEPARATOR "external" SEPARATOR \
     "bpf_conformance" SEPARATOR "tests" SEPARATOR
 
-#define DECLARE_NATIVE_TEST_PATH(FILE, PATH) \
-    TEST_CASE(FILE "_native", "[bpf_code_generator]") { run_bpf_code_generator_test(PATH "" FILE ".data"); }
+#define DECLARE_NATIVE_TEST_PATH(FILE, PATH)                                                                    \
+    TEST_CASE(FILE "_native", "[bpf_code_generator]") { run_bpf_code_generator_test(PATH "" FILE ".data", false); } \
+    TEST_CASE(FILE "_native_optimized", "[bpf_code_generator]")                                                 \
+    {                                                                                                           \
+        run_bpf_code_generator_test(PATH "" FILE ".data", true);                                                \
+    }
 
 #if !defined(CONFIG_BPF_JIT_DISABLED)
 #define DECLARE_JIT_TEST_PATH(FILE, PATH) \
@@ -499,3 +524,104 @@ TEST_CASE("invalid ELF stream", "[raw_bpf_code_gen][negative]")
         REQUIRE(ex.what() == std::string("can't process ELF file test"));
     }
 }
+
+static std::string
+_emit_c_code(const std::vector<ebpf_inst>& instructions, bool optimize)
+{
+    bpf_code_generator code("test", instructions, optimize);
+    std::ostringstream output;
+    code.emit_c_code(output);
+    return output.str();
+}
+
+TEST_CASE("optimize shift by known amount", "[raw_bpf_code_gen]")
+{
+    std::vector<ebpf_inst> instructions = {
+        {EBPF_OP_MOV64_IMM, 2, 0, 0, 5},
+        {EBPF_OP_LSH64_REG, 1, 2, 0, 0},
+        {EBPF_OP_MOV64_REG, 0, 1, 0, 0},
+        {EBPF_OP_EXIT, 0, 0, 0, 0},
+    };
+    REQUIRE(_emit_c_code(instructions, false).find("r1 <<= (r2 & 63);") != std::string::npos);
+    std::string optimized = _emit_c_code(instructions, true);
+    REQUIRE(optimized.find("r1 <<= 5;") != std::string::npos);
+    REQUIRE(optimized.find("& 63") == std::string::npos);
+}
+
+TEST_CASE("optimize division by checked divisor", "[raw_bpf_code_gen]")
+{
+    // r2 is only used as a divisor after the jump proves it isn't zero.
+    std::vector<ebpf_inst> instructions = {
+        {EBPF_OP_MOV64_IMM, 0, 0, 0, 0},
+        {EBPF_OP_JEQ_IMM, 2, 0, 2, 0},
+        {EBPF_OP_DIV64_REG, 1, 2, 0, 0},
+        {EBPF_OP_MOV64_REG, 0, 1, 0, 0},
+        {EBPF_OP_EXIT, 0, 0, 0, 0},
+    };
+    REQUIRE(_emit_c_code(instructions, false).find("r1 = r2 ? (r1 / r2) : 0;") != std::string::npos);
+    REQUIRE(_emit_c_code(instructions, true).find("r1 = r1 / r2;") != std::string::npos);
+
+    // Without the check the divisor may be zero, so the generated code must still handle it.
+    std::vector<ebpf_inst> unchecked = {
+        {EBPF_OP_DIV64_REG, 1, 2, 0, 0},
+        {EBPF_OP_MOV64_REG, 0, 1, 0, 0},
+        {EBPF_OP_EXIT, 0, 0, 0, 0},
+    };
+    REQUIRE(_emit_c_code(unchecked, true).find("r1 = r2 ? (r1 / r2) : 0;") != std::string::npos);
+}
+
+TEST_CASE("optimize branch with known outcome", "[raw_bpf_code_gen]")
+{
+    std::vector<ebpf_inst> instructions = {
+        {EBPF_OP_MOV64_IMM, 0, 0, 0, 1},
+        {EBPF_OP_JNE_IMM, 0, 0, 1, 0},
+        {EBPF_OP_MOV64_IMM, 0, 0, 0, 2},
+        {EBPF_OP_EXIT, 0, 0, 0, 0},
+    };
+    REQUIRE(_emit_c_code(instructions, false).find("r0 = IMMEDIATE(2);") != std::string::npos);
+    std::string optimized = _emit_c_code(instructions, true);
+    REQUIRE(optimized.find("r0 = IMMEDIATE(2);") == std::string::npos);
+    REQUIRE(optimized.find("if (") == std::string::npos);
+    REQUIRE(optimized.find("goto label_1;") != std::string::npos);
+}
+
+TEST_CASE("optimized code invoke benchmark", "[benchmark]")
+{
+    // Programs from the conformance corpus with shifts, divisions and branches that the optimization pass can
+    // simplify. Each is built with the C compiler's optimizations on, with and without the bpf2c pass, and run
+    // through the same harness so that only the generated code differs.
+    const std::vector<std::string> corpus = {
+        CONFORMANCE_TEST_PATH "alu64-arith.data",
+        CONFORMANCE_TEST_PATH "alu64-bit.data",
+        UBPF_TEST_PATH "arsh64.data",
+        CONFORMANCE_TEST_PATH "div64-reg.data",
+        CONFORMANCE_TEST_PATH "mod64.data",
+        CONFORMANCE_TEST_PATH "jeq-reg.data",
+        UBPF_TEST_PATH "mul-loop.data",
+        CONFORMANCE_TEST_PATH "prime.data",
+        UBPF_TEST_PATH "rsh-reg.data",
+        CONFORMANCE_TEST_PATH "subnet.data",
+    };
+    const std::string invoke_count = "1000000";
+
+    auto run = [&](const std::string& data_file, bool optimize) {
+        auto [prefix, result, mem] = _build_bpf_code_generator_test(data_file, optimize, "_benchmark", " /O2");
+        std::string output_file = prefix + std::string(".out");
+        std::string test_command = std::string("." SEPARATOR) + prefix + std::string(" ") + result +
+                                   std::string(" \"") + mem + std::string("\" ") + invoke_count +
+                                   std::string(" >") + output_file;
+        REQUIRE(system(test_command.c_str()) == 0);
+        double nanoseconds = 0;
+        std::ifstream output(output_file);
+        output >> nanoseconds;
+        REQUIRE(!output.fail());
+        return nanoseconds;
+    };
+
+    for (const auto& data_file : corpus) {
+        double nanoseconds = run(data_file, false);
+        double optimized_nanoseconds = run(data_file, true);
+        std::cout << data_file.substr(data_file.find_last_of(SEPARATOR) + 1) << ": " << nanoseconds << " -> "
+                  << optimized_nanoseconds << " ns per invocation" << std::endl;
+    }
+}
@@ -24,6 +24,7 @@ namespace ebpf {
 #include "net/udp.h"
 }; // namespace ebpf
 #include "cxplat_passed_test_log.h"
+#include "performance_measure.h"
 #include "platform.h"
 #include "sample_test_common.h"
 #include "test_helper.hpp"
@@ -32,13 +33,16 @@ namespace ebpf {
 
 #include <WinSock2.h>
 #include <in6addr.h>
+#include <algorithm>
 #include <array>
 #include <cguid.h>
 #include <chrono>
 #include <lsalookup.h>
 #include <mutex>
+#include <numeric>
 #define _NTDEF_ // UNICODE_STRING is already defined
 #include <ntsecapi.h>
+#include <sstream>
 #include <thread>
 
 using namespace Platform;
@@ -1066,6 +1070,36 @@ TEST_CASE("verify program", "[end_to_end]")
     ebpf_free_string(report);
 }
 
+TEST_CASE("verify bloom filter program", "[end_to_end]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    const char* error_message = nullptr;
+    const char* report = nullptr;
+    uint32_t result;
+    program_info_provider_t sample_test_program_info;
+    REQUIRE(sample_test_program_info.initialize(EBPF_PROGRAM_TYPE_SAMPLE) == EBPF_SUCCESS);
+
+    // The verifier accepts bpf_map_push_elem and bpf_map_peek_elem on a bloom filter map.
+    ebpf_api_verifier_stats_t stats;
+    REQUIRE(
+        (result = ebpf_api_elf_verify_program_from_file(
+             SAMPLE_PATH "bloom_filter.o",
+             "sample_ext",
+             "bloom_filter_test",
+             nullptr,
+             EBPF_VERIFICATION_VERBOSITY_NORMAL,
+             &report,
+             &error_message,
+             &stats),
+         ebpf_free_string(error_message),
+         error_message = nullptr,
+         result == 0));
+    REQUIRE(report != nullptr);
+    ebpf_free_string(report);
+}
+
 TEST_CASE("verify program with invalid program type", "[end_to_end]")
 {
     _test_helper_end_to_end test_helper;
@@ -1744,6 +1778,70 @@ TEST_CASE("printk", "[end_to_end]")
 }
 #endif
 
+#if !defined(CONFIG_BPF_INTERPRETER_DISABLED)
+TEST_CASE("printk_deferred", "[end_to_end]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    single_instance_hook_t hook(EBPF_PROGRAM_TYPE_BIND, EBPF_ATTACH_TYPE_BIND);
+    REQUIRE(hook.initialize() == EBPF_SUCCESS);
+    program_info_provider_t bind_program_info;
+    REQUIRE(bind_program_info.initialize(EBPF_PROGRAM_TYPE_BIND) == EBPF_SUCCESS);
+    uint32_t ifindex = 0;
+    program_load_attach_helper_t program_helper;
+    program_helper.initialize(
+        SAMPLE_PATH "printk.o", BPF_PROG_TYPE_BIND, "func", EBPF_EXECUTION_INTERPRET, &ifindex, sizeof(ifindex), hook);
+
+    SOCKADDR_IN addr = {AF_INET};
+    addr.sin_port = htons(80);
+    INITIALIZE_BIND_CONTEXT
+    ctx->process_id = GetCurrentProcessId();
+    ctx->protocol = 2;
+    ctx->socket_address_length = sizeof(addr);
+    memcpy(&ctx->socket_address, &addr, ctx->socket_address_length);
+
+    // Fire the hook once with each printk keyword, twice for deferred events
+    // so that the second run uses the formats cached by the first.
+    std::string output;
+    uint32_t formatted_result = 0;
+    uint32_t deferred_result[2] = {};
+    capture_helper_t capture;
+    errno_t error = capture.begin_capture();
+    if (error == NO_ERROR) {
+        usersim_trace_logging_set_enabled(true, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK);
+        REQUIRE(hook.fire(ctx, &formatted_result) == EBPF_SUCCESS);
+        usersim_trace_logging_set_enabled(true, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK_DEFERRED);
+        REQUIRE(hook.fire(ctx, &deferred_result[0]) == EBPF_SUCCESS);
+        REQUIRE(hook.fire(ctx, &deferred_result[1]) == EBPF_SUCCESS);
+        usersim_trace_logging_set_enabled(false, 0, 0);
+
+        output = capture.get_stdout_contents();
+    }
+
+    // Deferred events are not formatted, so only the first run logs text messages.
+    std::vector<std::string> messages = capture.buffer_to_printk_vector(output);
+    REQUIRE(messages.size() == 8);
+
+    // Each of the eight valid calls logs one event per run, and each valid format is logged once.
+    size_t event_count = 0;
+    size_t format_count = 0;
+    std::istringstream stream(output);
+    for (std::string line; std::getline(stream, line, '\n');) {
+        if (line.starts_with("{" EBPF_TRACELOG_EVENT_PRINTK ",")) {
+            event_count++;
+        } else if (line.starts_with("{" EBPF_TRACELOG_EVENT_PRINTK_FORMAT ",")) {
+            format_count++;
+        }
+    }
+    REQUIRE(event_count == 16);
+    REQUIRE(format_count == 8);
+
+    // The return values match those of formatted output.
+    REQUIRE(deferred_result[0] == formatted_result);
+    REQUIRE(deferred_result[1] == formatted_result);
+}
+#endif
+
 #if !defined(CONFIG_BPF_INTERPRETER_DISABLED)
 TEST_CASE("link_tests", "[end_to_end]")
 {
@@ -3516,6 +3614,82 @@ test_map_synchronized_update(ebpf_execution_type_t execution_type)
 
 DECLARE_ALL_TEST_CASES("test_map_synchronized_update", "[end_to_end]", test_map_synchronized_update);
 
+/**
+ * @brief Run the bloom_filter sample program once.
+ *
+ * @param[in] program_fd The program to run.
+ * @param[in] value The value to add or test.
+ * @param[in] push True to add the value, false to test it.
+ * @returns The return value of the program.
+ */
+static uint32_t
+_run_bloom_filter_program(fd_t program_fd, uint32_t value, bool push)
+{
+    sample_program_context_t ctx = {};
+    ctx.uint32_data = value;
+    ctx.uint16_data = push ? 1 : 0;
+    bpf_test_run_opts opts = {};
+    opts.ctx_in = &ctx;
+    opts.ctx_size_in = sizeof(ctx);
+    opts.ctx_out = &ctx;
+    opts.ctx_size_out = sizeof(ctx);
+    REQUIRE(bpf_prog_test_run_opts(program_fd, &opts) == 0);
+    return opts.retval;
+}
+
+/**
+ * @brief Test that a program can add values to a bloom filter with bpf_map_push_elem and test them with
+ * bpf_map_peek_elem, and that user mode sees the same set.
+ *
+ * @param[in] execution_type The execution type for the eBPF program (JIT, Interpreter, or Native).
+ */
+static void
+test_bloom_filter_program(ebpf_execution_type_t execution_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    const char* error_message = nullptr;
+    int result;
+    bpf_object_ptr unique_object;
+    fd_t program_fd;
+
+    program_info_provider_t sample_program_info;
+    REQUIRE(sample_program_info.initialize(EBPF_PROGRAM_TYPE_SAMPLE) == EBPF_SUCCESS);
+
+    const char* file_name = (execution_type == EBPF_EXECUTION_NATIVE ? "bloom_filter_um.dll" : "bloom_filter.o");
+    result =
+        ebpf_program_load(file_name, BPF_PROG_TYPE_UNSPEC, execution_type, &unique_object, &program_fd, &error_message);
+    if (error_message) {
+        printf("ebpf_program_load failed with %s\n", error_message);
+        ebpf_free((void*)error_message);
+    }
+    REQUIRE(result == 0);
+
+    fd_t map_fd = bpf_object__find_map_fd_by_name(unique_object.get(), "bloom_filter_map");
+    REQUIRE(map_fd > 0);
+
+    // Values added by the program are found by the program and by user mode.
+    for (uint32_t value = 0; value < 50; value++) {
+        REQUIRE(_run_bloom_filter_program(program_fd, value, true) == 0);
+    }
+    for (uint32_t value = 0; value < 50; value++) {
+        REQUIRE(_run_bloom_filter_program(program_fd, value, false) == 1);
+        uint32_t lookup_value = value;
+        REQUIRE(bpf_map_lookup_elem(map_fd, nullptr, &lookup_value) == 0);
+    }
+
+    // Values added by user mode are found by the program.
+    for (uint32_t value = 1000; value < 1050; value++) {
+        REQUIRE(bpf_map_update_elem(map_fd, nullptr, &value, BPF_ANY) == 0);
+        REQUIRE(_run_bloom_filter_program(program_fd, value, false) == 1);
+    }
+
+    bpf_object__close(unique_object.release());
+}
+
+DECLARE_ALL_TEST_CASES("test_bloom_filter_program", "[end_to_end]", test_bloom_filter_program);
+
 /**
  * @brief This function tests that reference from outer map to inner map is maintained
  * even when the inner map FD is closed. Also, when the outer map FD id closed, the inner
@@ -4058,6 +4232,141 @@ TEST_CASE("custom_maps_user_apis", "[custom_maps]")
     _test_custom_maps_user_apis(BPF_MAP_TYPE_SAMPLE_HASH_MAP, false, false);
 }
 
+// This test validates user APIs on custom maps based on array maps.
+static void
+_test_custom_maps_array_base_user_apis(uint32_t base_map_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    uint32_t map_size = 10;
+    int result;
+
+    program_info_provider_t sample_program_info;
+    REQUIRE(sample_program_info.initialize(EBPF_PROGRAM_TYPE_SAMPLE) == EBPF_SUCCESS);
+    test_sample_map_provider_t sample_map_provider;
+    REQUIRE(
+        sample_map_provider.initialize(BPF_MAP_TYPE_SAMPLE_HASH_MAP, false, true, base_map_type) == EBPF_SUCCESS);
+
+    // Array based maps require 32-bit keys.
+    fd_t invalid_map_fd = bpf_map_create(
+        BPF_MAP_TYPE_SAMPLE_HASH_MAP, "invalid_map", sizeof(uint64_t), sizeof(uint32_t), map_size, nullptr);
+    REQUIRE(invalid_map_fd < 0);
+
+    fd_t custom_map_fd = bpf_map_create(
+        BPF_MAP_TYPE_SAMPLE_HASH_MAP, "custom_map", sizeof(uint32_t), sizeof(uint32_t), map_size, nullptr);
+    REQUIRE(custom_map_fd > 0);
+
+    auto require_and_close = [](bool condition, fd_t fd) {
+        if (condition == false) {
+            Platform::_close(fd);
+        }
+        REQUIRE(condition);
+    };
+
+    // Every entry exists and is initially zero.
+    for (uint32_t i = 0; i < map_size; i++) {
+        uint32_t key = i;
+        uint32_t value = 1;
+        result = bpf_map_lookup_elem(custom_map_fd, &key, &value);
+        require_and_close((result == 0), custom_map_fd);
+        require_and_close((value == 0), custom_map_fd);
+    }
+
+    for (uint32_t i = 0; i < map_size; i++) {
+        uint32_t key = i;
+        uint32_t value = i + 100;
+        result = bpf_map_update_elem(custom_map_fd, &key, &value, 0);
+        require_and_close((result == 0), custom_map_fd);
+    }
+
+    // Per-CPU maps replicate a single value to every CPU, so a lookup returns it regardless of which copy is read.
+    for (uint32_t i = 0; i < map_size; i++) {
+        uint32_t key = i;
+        uint32_t value = 0;
+        result = bpf_map_lookup_elem(custom_map_fd, &key, &value);
+        require_and_close((result == 0), custom_map_fd);
+        require_and_close((value == i + 100), custom_map_fd);
+    }
+
+    // Keys outside the array and inserts of new keys are rejected.
+    {
+        uint32_t key = map_size;
+        uint32_t value = 0;
+        result = bpf_map_update_elem(custom_map_fd, &key, &value, 0);
+        require_and_close((result != 0), custom_map_fd);
+        result = bpf_map_lookup_elem(custom_map_fd, &key, &value);
+        require_and_close((result != 0), custom_map_fd);
+
+        key = 0;
+        result = bpf_map_update_elem(custom_map_fd, &key, &value, BPF_NOEXIST);
+        require_and_close((result != 0), custom_map_fd);
+    }
+
+    // Deleting an entry resets it to zero.
+    {
+        uint32_t key = 0;
+        uint32_t value = 1;
+        result = bpf_map_delete_elem(custom_map_fd, &key);
+        require_and_close((result == 0), custom_map_fd);
+        result = bpf_map_lookup_elem(custom_map_fd, &key, &value);
+        require_and_close((result == 0), custom_map_fd);
+        require_and_close((value == 0), custom_map_fd);
+
+        result = bpf_map_lookup_and_delete_elem(custom_map_fd, &key, &value);
+        require_and_close((result != 0), custom_map_fd);
+    }
+
+    // Enumerate all keys.
+    uint32_t count = 0;
+    uint32_t next_key;
+    uint32_t* prev_key = nullptr;
+    while (bpf_map_get_next_key(custom_map_fd, prev_key, &next_key) == 0) {
+        require_and_close((next_key == count), custom_map_fd);
+        count++;
+        prev_key = &next_key;
+    }
+    require_and_close((count == map_size), custom_map_fd);
+
+    Platform::_close(custom_map_fd);
+}
+
+TEST_CASE("custom_maps_array_base_user_apis", "[custom_maps]")
+{
+    _test_custom_maps_array_base_user_apis(BPF_MAP_TYPE_ARRAY);
+    _test_custom_maps_array_base_user_apis(BPF_MAP_TYPE_PERCPU_ARRAY);
+}
+
+TEST_CASE("custom_maps_invalid_provider_properties", "[custom_maps]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    program_info_provider_t sample_program_info;
+    REQUIRE(sample_program_info.initialize(EBPF_PROGRAM_TYPE_SAMPLE) == EBPF_SUCCESS);
+
+    {
+        // Direct value access can't be combined with a provider that transforms stored values.
+        test_sample_map_provider_t sample_map_provider;
+        REQUIRE(
+            sample_map_provider.initialize(BPF_MAP_TYPE_SAMPLE_HASH_MAP, true, true, BPF_MAP_TYPE_HASH, true) ==
+            EBPF_SUCCESS);
+        fd_t map_fd = bpf_map_create(
+            BPF_MAP_TYPE_SAMPLE_HASH_MAP, "custom_map", sizeof(uint32_t), sizeof(uint32_t), 10, nullptr);
+        REQUIRE(map_fd < 0);
+    }
+
+    {
+        // Per-CPU values can't be transformed by the provider.
+        test_sample_map_provider_t sample_map_provider;
+        REQUIRE(
+            sample_map_provider.initialize(BPF_MAP_TYPE_SAMPLE_HASH_MAP, true, true, BPF_MAP_TYPE_PERCPU_ARRAY) ==
+            EBPF_SUCCESS);
+        fd_t map_fd = bpf_map_create(
+            BPF_MAP_TYPE_SAMPLE_HASH_MAP, "custom_map", sizeof(uint32_t), sizeof(uint32_t), 10, nullptr);
+        REQUIRE(map_fd < 0);
+    }
+}
+
 TEST_CASE("custom_maps_invalid_map_type", "[custom_maps]")
 {
     _test_helper_end_to_end test_helper;
@@ -4392,6 +4701,83 @@ _test_custom_maps_program_load(ebpf_execution_type_t execution_type)
 
 DECLARE_ALL_TEST_CASES("custom_maps_program_load", "[end_to_end][custom_maps]", _test_custom_maps_program_load);
 
+// This test validates that lookups from BPF programs on a custom map with direct value access return the stored value
+// without calling into the map provider.
+static void
+_test_custom_maps_direct_value_access(ebpf_execution_type_t execution_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    bpf_object_ptr unique_object;
+    int result;
+    const char* error_message = nullptr;
+    fd_t program_fd;
+    int iteration = 10;
+
+    program_info_provider_t sample_program_info;
+    REQUIRE(sample_program_info.initialize(EBPF_PROGRAM_TYPE_SAMPLE) == EBPF_SUCCESS);
+    test_sample_map_provider_t sample_hash_map_provider;
+    REQUIRE(
+        sample_hash_map_provider.initialize(BPF_MAP_TYPE_SAMPLE_HASH_MAP, false, true, BPF_MAP_TYPE_HASH, true) ==
+        EBPF_SUCCESS);
+
+    const char* file_name =
+        (execution_type == EBPF_EXECUTION_NATIVE) ? "custom_map_basic_um.dll" : "custom_map_basic.o";
+    result =
+        ebpf_program_load(file_name, BPF_PROG_TYPE_UNSPEC, execution_type, &unique_object, &program_fd, &error_message);
+    if (error_message) {
+        printf("ebpf_program_load failed with %s\n", error_message);
+        ebpf_free((void*)error_message);
+    }
+    REQUIRE(result == 0);
+
+    auto require_and_close_object = [&](bool condition) {
+        if (!condition) {
+            bpf_object__close(unique_object.release());
+        }
+        REQUIRE(condition);
+    };
+
+    fd_t sample_map_fd = bpf_object__find_map_fd_by_name(unique_object.get(), "sample_hash_map");
+    require_and_close_object(sample_map_fd > 0);
+    fd_t config_map_fd = bpf_object__find_map_fd_by_name(unique_object.get(), "config_map");
+    require_and_close_object(config_map_fd > 0);
+
+    uint32_t key = 0;
+    uint32_t config_value = 2;
+    require_and_close_object((bpf_map_update_elem(config_map_fd, &key, &config_value, 0) == 0));
+    uint32_t value = 1234;
+    require_and_close_object((bpf_map_update_elem(sample_map_fd, &key, &value, 0) == 0));
+
+    bpf_test_run_opts opts = {};
+    sample_program_context_t ctx = {};
+    opts.batch_size = 1;
+    opts.repeat = iteration;
+    opts.ctx_in = &ctx;
+    opts.ctx_size_in = sizeof(sample_program_context_t);
+    opts.ctx_out = &ctx;
+    opts.ctx_size_out = sizeof(sample_program_context_t);
+
+    // The program increments the value in place, so it must see the stored value and not a copy.
+    uint32_t find_count = sample_hash_map_provider.find_count();
+    program_fd = bpf_program__fd(bpf_object__find_program_by_name(unique_object.get(), "test_map_read_increment"));
+    require_and_close_object(program_fd > 0);
+    result = bpf_prog_test_run_opts(program_fd, &opts);
+    require_and_close_object(result == 0);
+    require_and_close_object(sample_hash_map_provider.find_count() == find_count);
+
+    // Lookups from user mode still go through the provider.
+    uint32_t map_value = 0;
+    require_and_close_object(bpf_map_lookup_elem(sample_map_fd, &key, &map_value) == 0);
+    require_and_close_object(map_value == value + iteration);
+    require_and_close_object(sample_hash_map_provider.find_count() == find_count + 1);
+
+    bpf_object__close(unique_object.release());
+}
+
+DECLARE_ALL_TEST_CASES(
+    "custom_maps_direct_value_access", "[end_to_end][custom_maps]", _test_custom_maps_direct_value_access);
+
 static void
 _test_custom_maps_invalid(ebpf_execution_type_t execution_type)
 {
@@ -4424,3 +4810,335 @@ _test_custom_maps_invalid(ebpf_execution_type_t execution_type)
 }
 
 DECLARE_ALL_TEST_CASES("custom_maps_invalid", "[end_to_end][custom_maps][!mayfail]", _test_custom_maps_invalid);
+
+// Program throughput benchmarks. Each one loads a sample program, replays a small corpus of synthetic contexts
+// through test_run on every CPU at once and prints "<test>,<ns per invocation>,<instructions per second>". They are
+// hidden so that they only run when selected, e.g. "unit_tests.exe [program_performance]".
+
+#define PROGRAM_PERFORMANCE_REPEAT_COUNT 100000
+
+typedef struct _program_test_run_input
+{
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> context;
+} program_test_run_input_t;
+
+template <typename context_t>
+static program_test_run_input_t
+_make_test_run_input(const context_t& context, const std::vector<uint8_t>& data = {})
+{
+    const uint8_t* context_bytes = reinterpret_cast<const uint8_t*>(&context);
+    return {data, std::vector<uint8_t>(context_bytes, context_bytes + sizeof(context))};
+}
+
+static const char*
+_execution_type_to_string(ebpf_execution_type_t execution_type)
+{
+    switch (execution_type) {
+    case EBPF_EXECUTION_JIT:
+        return "jit";
+    case EBPF_EXECUTION_INTERPRET:
+        return "interpret";
+    case EBPF_EXECUTION_NATIVE:
+        return "native";
+    default:
+        return "any";
+    }
+}
+
+static bpf_object_ptr
+_load_program_for_benchmark(_In_z_ const char* file_name, ebpf_execution_type_t execution_type)
+{
+    std::string path = file_name;
+    path += (execution_type == EBPF_EXECUTION_NATIVE) ? "_um.dll" : ".o";
+
+    bpf_object_ptr unique_object;
+    fd_t program_fd;
+    const char* error_message = nullptr;
+    int result = ebpf_program_load(
+        path.c_str(), BPF_PROG_TYPE_UNSPEC, execution_type, &unique_object, &program_fd, &error_message);
+    if (error_message) {
+        printf("ebpf_program_load failed with %s\n", error_message);
+        ebpf_free((void*)error_message);
+    }
+    REQUIRE(result == 0);
+    return unique_object;
+}
+
+/**
+ * @brief Count the instructions in a program's byte code. Native modules don't
+ * carry byte code, so the count always comes from the ELF file, which keeps
+ * instructions per second comparable across execution types. This is the
+ * static size of the program, not the number of instructions executed on any
+ * particular path.
+ */
+static size_t
+_get_program_instruction_count(_In_z_ const char* file_name, _In_z_ const char* program_name)
+{
+    std::string path = file_name;
+    path += ".o";
+    bpf_object* object = bpf_object__open(path.c_str());
+    REQUIRE(object != nullptr);
+    bpf_program* program = bpf_object__find_program_by_name(object, program_name);
+    size_t instruction_count = (program != nullptr) ? bpf_program__insn_cnt(program) : 0;
+    bpf_object__close(object);
+    REQUIRE(instruction_count != 0);
+    return instruction_count;
+}
+
+/**
+ * @brief Run every input in the corpus PROGRAM_PERFORMANCE_REPEAT_COUNT times
+ * on each CPU concurrently and report the average duration of an invocation
+ * across CPUs and inputs.
+ */
+static void
+_measure_program_throughput(
+    _In_z_ const char* program_label,
+    ebpf_execution_type_t execution_type,
+    fd_t program_fd,
+    size_t instruction_count,
+    _In_ const std::vector<program_test_run_input_t>& corpus)
+{
+    uint32_t cpu_count = static_cast<uint32_t>(libbpf_num_possible_cpus());
+    std::vector<double> durations(cpu_count);
+    std::vector<int> results(cpu_count);
+    std::vector<std::thread> threads;
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++) {
+        threads.emplace_back([&, cpu]() {
+            double total_duration = 0;
+            for (const auto& input : corpus) {
+                std::vector<uint8_t> data_out(input.data.size());
+                std::vector<uint8_t> context_out(input.context.size());
+                bpf_test_run_opts opts = {};
+                opts.data_in = input.data.empty() ? nullptr : input.data.data();
+                opts.data_size_in = static_cast<uint32_t>(input.data.size());
+                opts.data_out = data_out.empty() ? nullptr : data_out.data();
+                opts.data_size_out = static_cast<uint32_t>(data_out.size());
+                opts.ctx_in = input.context.data();
+                opts.ctx_size_in = static_cast<uint32_t>(input.context.size());
+                opts.ctx_out = context_out.data();
+                opts.ctx_size_out = static_cast<uint32_t>(context_out.size());
+                opts.repeat = PROGRAM_PERFORMANCE_REPEAT_COUNT;
+                opts.cpu = cpu;
+                results[cpu] = bpf_prog_test_run_opts(program_fd, &opts);
+                if (results[cpu] != 0) {
+                    return;
+                }
+                // test_run reports the average duration of an invocation in whole nanoseconds.
+                total_duration += opts.duration;
+            }
+            durations[cpu] = total_duration / corpus.size();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // Catch2 assertions are not thread safe, so the results are only checked once every thread is done.
+    for (int result : results) {
+        REQUIRE(result == 0);
+    }
+
+    double average_duration = std::accumulate(durations.begin(), durations.end(), 0.0) / cpu_count;
+    double maximum_duration = *std::max_element(durations.begin(), durations.end());
+    double instructions_per_second = (average_duration > 0) ? instruction_count * 1e9 / average_duration : 0;
+
+    std::string test_name = "program_test_run<";
+    test_name += program_label;
+    test_name += ",";
+    test_name += _execution_type_to_string(execution_type);
+    test_name += ">";
+    printf("%s,%.1f,%.0f\n", test_name.c_str(), average_duration, instructions_per_second);
+    // Results go to the same file as ebpf_performance.exe, so that both sets can be compared with
+    // scripts\Compare-PerformanceResults.ps1. max_ns is the average invocation on the slowest CPU.
+    char extra_fields[128];
+    sprintf_s(
+        extra_fields, ",\"max_ns\":%.1f,\"instructions_per_second\":%.0f", maximum_duration, instructions_per_second);
+    performance_measure_write_result(
+        test_name.c_str(),
+        false,
+        "test_run",
+        cpu_count,
+        PROGRAM_PERFORMANCE_REPEAT_COUNT * corpus.size(),
+        cpu_count,
+        average_duration,
+        extra_fields);
+}
+
+static void
+_droppacket_throughput_test(ebpf_execution_type_t execution_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    program_info_provider_t xdp_program_info;
+    REQUIRE(xdp_program_info.initialize(EBPF_PROGRAM_TYPE_XDP) == EBPF_SUCCESS);
+
+    bpf_object_ptr unique_object = _load_program_for_benchmark("droppacket", execution_type);
+    fd_t program_fd = bpf_program__fd(bpf_object__find_program_by_name(unique_object.get(), "DropPacket"));
+    REQUIRE(program_fd > 0);
+
+    fd_t interface_index_map_fd = bpf_object__find_map_fd_by_name(unique_object.get(), "interface_index_map");
+    uint32_t key = 0;
+    uint32_t if_index = TEST_IFINDEX;
+    REQUIRE(bpf_map_update_elem(interface_index_map_fd, &key, &if_index, EBPF_ANY) == EBPF_SUCCESS);
+
+    // Zero length UDP packets on the filtered interface are dropped and counted. Everything else, including
+    // packets on other interfaces, passes.
+    std::vector<program_test_run_input_t> corpus;
+    for (uint32_t ingress_ifindex : {TEST_IFINDEX, TEST_IFINDEX + 1}) {
+        xdp_md_t context = {};
+        context.ingress_ifindex = ingress_ifindex;
+        corpus.push_back(_make_test_run_input(context, prepare_udp_packet(0, ETHERNET_TYPE_IPV4)));
+        corpus.push_back(_make_test_run_input(context, prepare_udp_packet(10, ETHERNET_TYPE_IPV4)));
+        corpus.push_back(_make_test_run_input(context, prepare_udp_packet(0, ETHERNET_TYPE_IPV6)));
+    }
+
+    _measure_program_throughput(
+        "droppacket",
+        execution_type,
+        program_fd,
+        _get_program_instruction_count("droppacket", "DropPacket"),
+        corpus);
+}
+
+static void
+_cgroup_sock_addr_throughput_test(ebpf_execution_type_t execution_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    program_info_provider_t sock_addr_program_info;
+    REQUIRE(sock_addr_program_info.initialize(EBPF_PROGRAM_TYPE_CGROUP_SOCK_ADDR) == EBPF_SUCCESS);
+
+    bpf_object_ptr unique_object = _load_program_for_benchmark("cgroup_sock_addr", execution_type);
+
+    // Connections to a spread of destinations, so that the program both inserts into and updates the socket cookie
+    // map, and finds no policy for any of them.
+    for (int family : {AF_INET, AF_INET6}) {
+        const char* program_name = (family == AF_INET) ? "authorize_connect4" : "authorize_connect6";
+        fd_t program_fd = bpf_program__fd(bpf_object__find_program_by_name(unique_object.get(), program_name));
+        REQUIRE(program_fd > 0);
+
+        std::vector<program_test_run_input_t> corpus;
+        for (uint32_t destination = 1; destination <= 8; destination++) {
+            bpf_sock_addr_t context = {};
+            context.family = family;
+            if (family == AF_INET) {
+                context.msg_src_ip4 = htonl(0x0a000001);
+                context.user_ip4 = htonl(0x0a000100 + destination);
+            } else {
+                context.msg_src_ip6[3] = htonl(1);
+                context.user_ip6[3] = htonl(0x100 + destination);
+            }
+            context.msg_src_port = htons(static_cast<uint16_t>(50000 + destination));
+            context.user_port = htons(443);
+            context.protocol = (destination % 2) ? IPPROTO_TCP : IPPROTO_UDP;
+            corpus.push_back(_make_test_run_input(context));
+        }
+
+        std::string label = "cgroup_sock_addr/";
+        label += program_name;
+        _measure_program_throughput(
+            label.c_str(),
+            execution_type,
+            program_fd,
+            _get_program_instruction_count("cgroup_sock_addr", program_name),
+            corpus);
+    }
+}
+
+static void
+_bindmonitor_tailcall_throughput_test(ebpf_execution_type_t execution_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    program_info_provider_t bind_program_info;
+    REQUIRE(bind_program_info.initialize(EBPF_PROGRAM_TYPE_BIND) == EBPF_SUCCESS);
+
+    bpf_object_ptr unique_object = _load_program_for_benchmark("bindmonitor_tailcall", execution_type);
+    fd_t program_fd = bpf_program__fd(bpf_object__find_program_by_name(unique_object.get(), "BindMonitor"));
+    REQUIRE(program_fd > 0);
+
+    // Every invocation tail calls through both callees before applying the bind limit.
+    fd_t prog_map_fd = bpf_object__find_map_fd_by_name(unique_object.get(), "prog_array_map");
+    REQUIRE(prog_map_fd > 0);
+    const char* callee_names[] = {"BindMonitor_Callee0", "BindMonitor_Callee1"};
+    for (uint32_t index = 0; index < _countof(callee_names); index++) {
+        fd_t callee_fd = bpf_program__fd(bpf_object__find_program_by_name(unique_object.get(), callee_names[index]));
+        REQUIRE(callee_fd > 0);
+        REQUIRE(bpf_map_update_elem(prog_map_fd, &index, &callee_fd, 0) == 0);
+    }
+    fd_t limit_map_fd = bpf_object__find_map_fd_by_name(unique_object.get(), "limits_map");
+    REQUIRE(limit_map_fd > 0);
+    set_bind_limit(limit_map_fd, 2);
+
+    // Binds and unbinds from several processes. Repeated binds from a process soon exceed the limit and are denied.
+    std::vector<program_test_run_input_t> corpus;
+    for (uint64_t process_id = 1; process_id <= 4; process_id++) {
+        std::string app_id = "fake_app_" + std::to_string(process_id);
+        std::vector<uint8_t> app_id_bytes(app_id.begin(), app_id.end());
+        for (bind_operation_t operation : {BIND_OPERATION_BIND, BIND_OPERATION_UNBIND}) {
+            bind_md_t context = {};
+            context.process_id = process_id;
+            context.operation = operation;
+            context.protocol = IPPROTO_TCP;
+            corpus.push_back(_make_test_run_input(context, app_id_bytes));
+        }
+    }
+
+    _measure_program_throughput(
+        "bindmonitor_tailcall",
+        execution_type,
+        program_fd,
+        _get_program_instruction_count("bindmonitor_tailcall", "BindMonitor"),
+        corpus);
+}
+
+static void
+_sockops_throughput_test(ebpf_execution_type_t execution_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    program_info_provider_t sock_ops_program_info;
+    REQUIRE(sock_ops_program_info.initialize(EBPF_PROGRAM_TYPE_SOCK_OPS) == EBPF_SUCCESS);
+
+    bpf_object_ptr unique_object = _load_program_for_benchmark("sockops", execution_type);
+    fd_t program_fd = bpf_program__fd(bpf_object__find_program_by_name(unique_object.get(), "connection_monitor"));
+    REQUIRE(program_fd > 0);
+
+    // Connection events for IPv4 and IPv6. None of the connections is in connection_map, so the program builds the
+    // audit entry and looks it up but does not write to the ring buffer, which has no consumer here.
+    std::vector<program_test_run_input_t> corpus;
+    for (int family : {AF_INET, AF_INET6}) {
+        for (bpf_sock_op_type_t op :
+             {BPF_SOCK_OPS_ACTIVE_ESTABLISHED_CB,
+              BPF_SOCK_OPS_PASSIVE_ESTABLISHED_CB,
+              BPF_SOCK_OPS_CONNECTION_DELETED_CB}) {
+            bpf_sock_ops_t context = {};
+            context.op = op;
+            context.family = family;
+            if (family == AF_INET) {
+                context.local_ip4 = htonl(0x0a000001);
+                context.remote_ip4 = htonl(0x0a000101);
+            } else {
+                context.local_ip6[3] = htonl(1);
+                context.remote_ip6[3] = htonl(0x101);
+            }
+            context.local_port = htons(50000);
+            context.remote_port = htons(443);
+            context.protocol = IPPROTO_TCP;
+            corpus.push_back(_make_test_run_input(context));
+        }
+    }
+
+    _measure_program_throughput(
+        "sockops",
+        execution_type,
+        program_fd,
+        _get_program_instruction_count("sockops", "connection_monitor"),
+        corpus);
+}
+
+DECLARE_ALL_TEST_CASES("droppacket_throughput", "[.][program_performance]", _droppacket_throughput_test);
+DECLARE_ALL_TEST_CASES("cgroup_sock_addr_throughput", "[.][program_performance]", _cgroup_sock_addr_throughput_test);
+DECLARE_ALL_TEST_CASES(
+    "bindmonitor_tailcall_throughput", "[.][program_performance]", _bindmonitor_tailcall_throughput_test);
+DECLARE_ALL_TEST_CASES("sockops_throughput", "[.][program_performance]", _sockops_throughput_test);
@@ -29,6 +29,7 @@ typedef LARGE_INTEGER PHYSICAL_ADDRESS, *PPHYSICAL_ADDRESS;
 #pragma warning(disable : 4324) // structure was padded due to alignment specifier
 #include <ndis/nbl.h>
 #endif
+#include <atomic>
 #include <vector>
 
 #define CONCAT(s1, s2) s1 s2
@@ -203,7 +204,7 @@ static ebpf_base_map_provider_dispatch_table_t _test_sample_hash_map_dispatch_ta
     .preprocess_map_delete_element = _test_sample_hash_map_delete_entry};
 
 static ebpf_base_map_provider_properties_t _test_sample_hash_map_provider_properties = {
-    EBPF_BASE_MAP_PROVIDER_PROPERTIES_HEADER, true};
+    EBPF_BASE_MAP_PROVIDER_PROPERTIES_HEADER, true, false};
 
 static ebpf_map_provider_data_t _test_sample_hash_map_provider_data = {
     EBPF_MAP_PROVIDER_DATA_HEADER,
@@ -231,7 +232,12 @@ typedef class _test_sample_map_provider
     }
 
     ebpf_result_t
-    initialize(uint32_t map_type, bool object_map, bool register_crud_apis = true)
+    initialize(
+        uint32_t map_type,
+        bool object_map,
+        bool register_crud_apis = true,
+        uint32_t base_map_type = BPF_MAP_TYPE_HASH,
+        bool direct_value_access = false)
     {
         _object_map = object_map;
         if (map_type == BPF_MAP_TYPE_SAMPLE_HASH_MAP || map_type == BPF_MAP_TYPE_SAMPLE_HASH_MAP_UNREGISTERED) {
@@ -242,7 +248,9 @@ typedef class _test_sample_map_provider
             return EBPF_INVALID_ARGUMENT;
         }
 
+        _test_sample_hash_map_provider_data.base_map_type = base_map_type;
         _test_sample_hash_map_provider_data.base_properties->updates_original_value = object_map ? true : false;
+        _test_sample_hash_map_provider_data.base_properties->direct_value_access = direct_value_access;
 
         if (!register_crud_apis) {
             _test_sample_hash_map_provider_data.base_provider_table->postprocess_map_find_element = nullptr;
@@ -333,6 +341,18 @@ typedef class _test_sample_map_provider
         return _object_map;
     }
 
+    void
+    increment_find_count()
+    {
+        _find_count++;
+    }
+
+    uint32_t
+    find_count() const
+    {
+        return _find_count;
+    }
+
     // NMR Provider infrastructure
   private:
     HANDLE _map_provider_handle = INVALID_HANDLE_VALUE;
@@ -349,6 +369,7 @@ typedef class _test_sample_map_provider
 
     static uint64_t _map_context_offset;
     bool _object_map = false;
+    std::atomic<uint32_t> _find_count = 0;
 } test_sample_map_provider_t;
 
 // Definition of the static member variable - inline to avoid multiple definition errors.
@@ -651,6 +672,8 @@ _Success_(return == EBPF_SUCCESS) static ebpf_result_t _test_sample_hash_map_fin
     UNREFERENCED_PARAMETER(in_value_size);
     UNREFERENCED_PARAMETER(flags);
 
+    provider->increment_find_count();
+
     // Allocate dummy memory to trigger fault injection if enabled.
     void* dummy_memory = ebpf_allocate_with_tag(16, EBPF_POOL_TAG_DEFAULT);
     if (dummy_memory == NULL) {
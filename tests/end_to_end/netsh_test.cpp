@@ -751,6 +751,38 @@ TEST_CASE("show maps", "[netsh][maps]")
                   "=======  ==================  ====  =====  =======  =====  ====  ========\n");
 }
 
+TEST_CASE("show statistics", "[netsh][statistics]")
+{
+    _test_helper_netsh test_helper;
+    test_helper.initialize();
+
+    fd_t map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "test_map", sizeof(uint32_t), sizeof(uint32_t), 10, nullptr);
+    REQUIRE(map_fd > 0);
+
+    // One miss, one update, one hit and one delete.
+    uint32_t key = 0;
+    uint32_t value = 0;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) < 0);
+    REQUIRE(bpf_map_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+    REQUIRE(bpf_map_delete_elem(map_fd, &key) == 0);
+
+    int result;
+    std::string output = _run_netsh_command(handle_ebpf_show_statistics, nullptr, nullptr, nullptr, &result);
+    REQUIRE(result == NO_ERROR);
+    REQUIRE(
+        output.find("          Map Type       Lookups          Hits        Misses       Updates       Deletes\n"
+                    "==================  ============  ============  ============  ============  ============\n") !=
+        std::string::npos);
+    REQUIRE(output.find("              hash             2             1             1             1             1\n") !=
+            std::string::npos);
+    REQUIRE(output.find("Hash bucket length       Lookups\n") != std::string::npos);
+    REQUIRE(output.find("Epoch advances               : ") != std::string::npos);
+    REQUIRE(output.find("Tail calls                   : 0\n") != std::string::npos);
+
+    Platform::_close(map_fd);
+}
+
 TEST_CASE("show links", "[netsh][links]")
 {
     _test_helper_netsh test_helper;
@@ -12,6 +12,7 @@
 #include "pins.h"
 #include "processes.h"
 #include "programs.h"
+#include "statistics.h"
 
 #include <windows.h>
 #include <netsh.h>
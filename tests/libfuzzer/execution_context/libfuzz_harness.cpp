@@ -184,6 +184,24 @@ static std::vector<std::pair<std::string, ebpf_map_definition_in_memory_t>> _map
             10,
         },
     },
+    {
+        "BPF_MAP_TYPE_HASH_TTL",
+        {
+            BPF_MAP_TYPE_HASH_TTL,
+            4,
+            20,
+            10,
+        },
+    },
+    {
+        "BPF_MAP_TYPE_BLOOM_FILTER",
+        {
+            BPF_MAP_TYPE_BLOOM_FILTER,
+            0,
+            20,
+            10,
+        },
+    },
 };
 
 static std::mutex _ebpf_fuzzer_async_mutex;
@@ -393,6 +393,15 @@ template <typename context_type> class fuzz_helper_function
                 10,
             },
         },
+        {
+            "BPF_MAP_TYPE_BLOOM_FILTER",
+            {
+                BPF_MAP_TYPE_BLOOM_FILTER,
+                0,
+                4,
+                10,
+            },
+        },
         {
             "BPF_MAP_TYPE_RINGBUF",
             {
@@ -99,6 +99,8 @@ _netebpf_ext_helper::_netebpf_ext_helper(
 
 _netebpf_ext_helper::~_netebpf_ext_helper()
 {
+    additional_hook_clients.clear();
+
     if (nmr_hook_client_handle) {
         nmr_hook_client_handle.reset(nullptr);
     }
@@ -115,6 +117,8 @@ _netebpf_ext_helper::~_netebpf_ext_helper()
         net_ebpf_extension_uninitialize_wfp_components();
     }
 
+    net_ebpf_ext_uninitialize_object_caches();
+
     if (ndis_handle_initialized) {
         net_ebpf_ext_uninitialize_ndis_handles();
     }
@@ -128,6 +132,27 @@ _netebpf_ext_helper::~_netebpf_ext_helper()
     }
 }
 
+void
+_netebpf_ext_helper::add_hook_client(
+    _In_opt_ const void* npi_specific_characteristics,
+    _Inout_ netebpfext_helper_base_client_context_t* client_context)
+{
+    auto additional_hook_client = std::make_unique<additional_hook_client_t>();
+
+    // Give each hook client its own module id, derived from the module id of the helper.
+    additional_hook_client->module_id = module_id;
+    additional_hook_client->module_id.Guid.Data1 += static_cast<unsigned long>(additional_hook_clients.size() + 1);
+    additional_hook_client->characteristics = hook_client;
+    additional_hook_client->characteristics.ClientRegistrationInstance.ModuleId = &additional_hook_client->module_id;
+    additional_hook_client->characteristics.ClientRegistrationInstance.NpiSpecificCharacteristics =
+        npi_specific_characteristics;
+
+    client_context->helper = this;
+    additional_hook_client->registration =
+        std::make_unique<nmr_client_registration_t>(&additional_hook_client->characteristics, client_context);
+    additional_hook_clients.push_back(std::move(additional_hook_client));
+}
+
 std::vector<GUID>
 _netebpf_ext_helper::program_info_provider_guids()
 {
@@ -211,10 +236,15 @@ _netebpf_ext_helper::_hook_client_attach_provider(
         return STATUS_ACCESS_DENIED;
     }
 
+    const void* client_dispatch = &client_dispatch_table;
+    if (base_client_context->program_dispatch_table != nullptr) {
+        client_dispatch = base_client_context->program_dispatch_table;
+    }
+
     return NmrClientAttachProvider(
         nmr_binding_handle,
         client_context, // Client binding context.
-        &client_dispatch_table,
+        client_dispatch,
         &base_client_context->provider_binding_context,
         &provider_dispatch_table);
 }
@@ -26,6 +26,8 @@ typedef struct _netebpfext_helper_base_client_context
     class _netebpf_ext_helper* helper;
     void* provider_binding_context;
     bpf_attach_type_t desired_attach_type; // BPF_ATTACH_TYPE_UNSPEC for any allowed.
+    // Optional dispatch table to attach with instead of one holding only the helper's dispatch function.
+    const ebpf_extension_program_dispatch_table_t* program_dispatch_table;
 } netebpfext_helper_base_client_context_t;
 
 typedef class _netebpf_ext_helper
@@ -41,6 +43,13 @@ typedef class _netebpf_ext_helper
         bool initialize_platform = true);
     ~_netebpf_ext_helper();
 
+    // Attach another hook client that uses the dispatch function passed to the constructor. Each hook client is
+    // registered as a separate NMR client, so multiple programs can be attached to the same hook.
+    void
+    add_hook_client(
+        _In_opt_ const void* npi_specific_characteristics,
+        _Inout_ netebpfext_helper_base_client_context_t* client_context);
+
     std::vector<GUID>
     program_info_provider_guids();
 
@@ -216,6 +225,14 @@ typedef class _netebpf_ext_helper
     std::unique_ptr<nmr_client_registration_t> nmr_program_info_client_handle;
     std::unique_ptr<nmr_client_registration_t> nmr_hook_client_handle;
 
+    typedef struct _additional_hook_client
+    {
+        NPI_MODULEID module_id;
+        NPI_CLIENT_CHARACTERISTICS characteristics;
+        std::unique_ptr<nmr_client_registration_t> registration;
+    } additional_hook_client_t;
+    std::vector<std::unique_ptr<additional_hook_client_t>> additional_hook_clients;
+
 } netebpf_ext_helper_t;
 
 void
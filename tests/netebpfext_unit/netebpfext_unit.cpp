@@ -810,6 +810,188 @@ TEST_CASE("sock_addr_context", "[netebpfext]")
     REQUIRE(output_context.compartment_id == 0x12345679);
     REQUIRE(output_context.interface_luid == 0x1234567890abcdee);
 }
+
+#define SOCK_ADDR_INVOKE_COST_ITERATION_COUNT 100000
+
+typedef struct test_sock_addr_counting_client_context_t
+{
+    netebpfext_helper_base_client_context_t base;
+    size_t invocation_count;
+} test_sock_addr_counting_client_context_t;
+
+typedef struct test_sock_addr_counting_client_context_header_t
+{
+    EBPF_CONTEXT_HEADER;
+    test_sock_addr_counting_client_context_t context;
+} test_sock_addr_counting_client_context_header_t;
+
+_Must_inspect_result_ ebpf_result_t
+netebpfext_unit_invoke_counting_sock_addr_program(
+    _In_ const void* client_binding_context, _In_ const void* context, _Out_ uint32_t* result)
+{
+    auto client_context = (test_sock_addr_counting_client_context_t*)client_binding_context;
+    UNREFERENCED_PARAMETER(context);
+    client_context->invocation_count++;
+
+    // Let the remaining programs run as well.
+    *result = BPF_SOCK_ADDR_VERDICT_PROCEED_SOFT;
+    return EBPF_SUCCESS;
+}
+
+static void
+_test_sock_addr_invoke_cost(uint32_t client_count)
+{
+    ebpf_extension_data_t npi_specific_characteristics = {
+        .header = EBPF_ATTACH_CLIENT_DATA_HEADER_VERSION,
+    };
+    std::vector<test_sock_addr_counting_client_context_header_t> client_context_headers(client_count);
+    fwp_classify_parameters_t parameters = {};
+
+    // Attach every program to the same (wildcard) connect hook.
+    for (auto& client_context_header : client_context_headers) {
+        client_context_header.context.base.desired_attach_type = BPF_CGROUP_INET4_CONNECT;
+    }
+
+    netebpf_ext_helper_t helper(
+        &npi_specific_characteristics,
+        (_ebpf_extension_dispatch_function)netebpfext_unit_invoke_counting_sock_addr_program,
+        (netebpfext_helper_base_client_context_t*)&client_context_headers[0].context);
+    for (uint32_t i = 1; i < client_count; i++) {
+        helper.add_hook_client(
+            &npi_specific_characteristics,
+            (netebpfext_helper_base_client_context_t*)&client_context_headers[i].context);
+    }
+
+    netebpfext_initialize_fwp_classify_parameters(&parameters);
+
+    // Make sure all the programs are attached before measuring.
+    REQUIRE(helper.test_cgroup_inet4_connect(&parameters) == FWP_ACTION_PERMIT);
+    for (const auto& client_context_header : client_context_headers) {
+        REQUIRE(client_context_header.context.invocation_count == 1);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < SOCK_ADDR_INVOKE_COST_ITERATION_COUNT; i++) {
+        (void)helper.test_cgroup_inet4_connect(&parameters);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (const auto& client_context_header : client_context_headers) {
+        REQUIRE(client_context_header.context.invocation_count == SOCK_ADDR_INVOKE_COST_ITERATION_COUNT + 1);
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    printf(
+        "sock_addr connect classify with %u attached programs: %lld ns per classify\n",
+        client_count,
+        static_cast<long long>(duration / SOCK_ADDR_INVOKE_COST_ITERATION_COUNT));
+}
+
+// Measure the cost of a classify as the number of programs attached to the hook grows.
+TEST_CASE("sock_addr_invoke_cost", "[netebpfext_performance]")
+{
+    _test_sock_addr_invoke_cost(1);
+    _test_sock_addr_invoke_cost(4);
+    _test_sock_addr_invoke_cost(NET_EBPF_EXT_MAX_CLIENTS_PER_HOOK_MULTI_ATTACH);
+}
+
+typedef struct _test_batch_invoke_state
+{
+    size_t begin_count;
+    size_t end_count;
+    bool in_batch;
+} test_batch_invoke_state_t;
+
+static test_batch_invoke_state_t _test_batch_invoke_state;
+
+static ebpf_result_t
+_test_batch_begin(size_t state_size, _Out_writes_(state_size) void* state)
+{
+    memset(state, 0, state_size);
+    if (state_size < sizeof(ebpf_execution_context_state_t) || _test_batch_invoke_state.in_batch) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+    _test_batch_invoke_state.in_batch = true;
+    _test_batch_invoke_state.begin_count++;
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_test_batch_invoke(
+    _In_ const void* client_binding_context, _Inout_ void* context, _Out_ uint32_t* result, _In_ const void* state)
+{
+    UNREFERENCED_PARAMETER(state);
+    if (!_test_batch_invoke_state.in_batch) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+    return netebpfext_unit_invoke_counting_sock_addr_program(client_binding_context, context, result);
+}
+
+static ebpf_result_t
+_test_batch_end(_Inout_ void* state)
+{
+    UNREFERENCED_PARAMETER(state);
+    _test_batch_invoke_state.in_batch = false;
+    _test_batch_invoke_state.end_count++;
+    return EBPF_SUCCESS;
+}
+
+// Programs that support batch invocation are invoked back to back in a single batch per classify.
+TEST_CASE("sock_addr_invoke_batch", "[netebpfext]")
+{
+    ebpf_extension_data_t npi_specific_characteristics = {
+        .header = EBPF_ATTACH_CLIENT_DATA_HEADER_VERSION,
+    };
+    const ebpf_extension_program_dispatch_table_t program_dispatch_table = {
+        .version = EBPF_LINK_DISPATCH_TABLE_VERSION_CURRENT,
+        .count = EBPF_LINK_DISPATCH_TABLE_FUNCTION_COUNT_CURRENT,
+        .ebpf_program_invoke_function =
+            (ebpf_program_invoke_function_t)netebpfext_unit_invoke_counting_sock_addr_program,
+        .ebpf_program_batch_begin_invoke_function = _test_batch_begin,
+        .ebpf_program_batch_invoke_function = _test_batch_invoke,
+        .ebpf_program_batch_end_invoke_function = _test_batch_end,
+    };
+    const uint32_t client_count = 3;
+    std::vector<test_sock_addr_counting_client_context_header_t> client_context_headers(client_count);
+    fwp_classify_parameters_t parameters = {};
+
+    _test_batch_invoke_state = {};
+    for (auto& client_context_header : client_context_headers) {
+        client_context_header.context.base.desired_attach_type = BPF_CGROUP_INET4_CONNECT;
+        client_context_header.context.base.program_dispatch_table = &program_dispatch_table;
+    }
+
+    netebpf_ext_helper_t helper(
+        &npi_specific_characteristics,
+        (_ebpf_extension_dispatch_function)netebpfext_unit_invoke_counting_sock_addr_program,
+        (netebpfext_helper_base_client_context_t*)&client_context_headers[0].context);
+
+    netebpfext_initialize_fwp_classify_parameters(&parameters);
+
+    // A single program is invoked on its own.
+    REQUIRE(helper.test_cgroup_inet4_connect(&parameters) == FWP_ACTION_PERMIT);
+    REQUIRE(client_context_headers[0].context.invocation_count == 1);
+    REQUIRE(_test_batch_invoke_state.begin_count == 0);
+
+    for (uint32_t i = 1; i < client_count; i++) {
+        helper.add_hook_client(
+            &npi_specific_characteristics,
+            (netebpfext_helper_base_client_context_t*)&client_context_headers[i].context);
+    }
+
+    // Once more programs are attached, each classify invokes all of them in one batch.
+    const size_t classify_count = 10;
+    for (size_t i = 0; i < classify_count; i++) {
+        REQUIRE(helper.test_cgroup_inet4_connect(&parameters) == FWP_ACTION_PERMIT);
+    }
+    REQUIRE(_test_batch_invoke_state.begin_count == classify_count);
+    REQUIRE(_test_batch_invoke_state.end_count == classify_count);
+    REQUIRE(!_test_batch_invoke_state.in_batch);
+    REQUIRE(client_context_headers[0].context.invocation_count == classify_count + 1);
+    for (uint32_t i = 1; i < client_count; i++) {
+        REQUIRE(client_context_headers[i].context.invocation_count == classify_count);
+    }
+}
 #pragma endregion cgroup_sock_addr
 #pragma region sock_ops
 
@@ -1149,4 +1331,44 @@ TEST_CASE("sock_ops_invoke_concurrent2", "[netebpfext_concurrent]")
 
     REQUIRE(failure_count == 0);
 }
+
+#define SOCK_OPS_FLOW_CHURN_ITERATION_COUNT 100000
+
+// Measure the cost of a flow that is established and deleted right away, as seen with many short-lived connections.
+TEST_CASE("sock_ops_flow_churn", "[netebpfext_performance]")
+{
+    ebpf_extension_data_t npi_specific_characteristics = {
+        .header = EBPF_ATTACH_CLIENT_DATA_HEADER_VERSION,
+    };
+    test_sock_ops_client_context_header_t client_context_header = {0};
+    test_sock_ops_client_context_t* client_context = &client_context_header.context;
+    fwp_classify_parameters_t parameters = {};
+
+    netebpf_ext_helper_t helper(
+        &npi_specific_characteristics,
+        (_ebpf_extension_dispatch_function)netebpfext_unit_invoke_sock_ops_program,
+        (netebpfext_helper_base_client_context_t*)client_context);
+
+    netebpfext_initialize_fwp_classify_parameters(&parameters);
+    client_context->sock_ops_action = SOCK_OPS_TEST_ACTION_PERMIT;
+
+    size_t failure_count = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < SOCK_OPS_FLOW_CHURN_ITERATION_COUNT; i++) {
+        uint64_t flow_id = 0;
+        if (helper.test_sock_ops_v4(&parameters, &flow_id) != FWP_ACTION_PERMIT || flow_id == 0) {
+            failure_count++;
+            continue;
+        }
+        helper.test_sock_ops_v4_remove_flow_context(flow_id);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    REQUIRE(failure_count == 0);
+
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    printf(
+        "sock_ops flow established and deleted: %lld ns per flow\n",
+        static_cast<long long>(duration / SOCK_OPS_FLOW_CHURN_ITERATION_COUNT));
+}
 #pragma endregion sock_ops
@@ -5,6 +5,7 @@
 
 #define TEST_AREA "ExecutionContext"
 
+#include "ebpf_tracelog.h"
 #include "performance.h"
 
 extern "C"
@@ -12,8 +13,11 @@ extern "C"
 #include "ubpf.h"
 }
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <optional>
+#include <random>
 
 typedef class _ebpf_program_test_state
 {
@@ -48,14 +52,44 @@ typedef class _ebpf_program_test_state
         // Disable read-only bytecode feature as it uses mmap which is not implemented in the Windows shim.
         ubpf_toggle_readonly_bytecode(vm, false);
 
+        // Resolve helpers the same way the service does: each call is renumbered to an index into the
+        // program's helper function table and the JIT is given the address for each index.
+        std::vector<ebpf_instruction_t> jit_byte_code = byte_code;
+        std::vector<uint32_t> helper_function_ids;
+        for (auto& instruction : jit_byte_code) {
+            if (instruction.opcode != EBPF_OP_CALL) {
+                continue;
+            }
+            uint32_t helper_function_id = static_cast<uint32_t>(instruction.imm);
+            auto it = std::find(helper_function_ids.begin(), helper_function_ids.end(), helper_function_id);
+            if (it == helper_function_ids.end()) {
+                it = helper_function_ids.insert(it, helper_function_id);
+            }
+            instruction.imm = static_cast<int32_t>(it - helper_function_ids.begin());
+        }
+        if (!helper_function_ids.empty()) {
+            REQUIRE(
+                ebpf_program_set_helper_function_ids(
+                    program, helper_function_ids.size(), helper_function_ids.data()) == EBPF_SUCCESS);
+            std::vector<helper_function_address_t> addresses(helper_function_ids.size());
+            REQUIRE(
+                ebpf_program_get_helper_function_addresses(program, addresses.size(), addresses.data()) ==
+                EBPF_SUCCESS);
+            for (uint32_t index = 0; index < addresses.size(); index++) {
+                REQUIRE(
+                    ubpf_register(
+                        vm, index, nullptr, reinterpret_cast<external_function_t>(addresses[index].address)) >= 0);
+            }
+        }
+
         char* error_message = nullptr;
         std::vector<uint8_t> machine_code(1024);
         size_t machine_code_size = machine_code.size();
         REQUIRE(
             ubpf_load(
                 vm,
-                reinterpret_cast<uint8_t*>(byte_code.data()),
-                static_cast<uint32_t>(byte_code.size() * sizeof(ebpf_instruction_t)),
+                reinterpret_cast<uint8_t*>(jit_byte_code.data()),
+                static_cast<uint32_t>(jit_byte_code.size() * sizeof(ebpf_instruction_t)),
                 &error_message) == 0);
         REQUIRE(ubpf_translate(vm, machine_code.data(), &machine_code_size, &error_message) == 0);
         machine_code.resize(machine_code_size);
@@ -99,7 +133,7 @@ typedef class _ebpf_program_test_state
 typedef class _ebpf_map_test_state
 {
   public:
-    _ebpf_map_test_state(ebpf_map_type_t type, std::optional<uint32_t> map_size = {})
+    _ebpf_map_test_state(ebpf_map_type_t type, std::optional<uint32_t> map_size = {}, uint32_t map_flags = 0)
     {
         // Since this is perf test, not checking the result.
 
@@ -107,6 +141,7 @@ typedef class _ebpf_map_test_state
         REQUIRE(ebpf_core_initiate() == EBPF_SUCCESS);
         ebpf_map_definition_in_memory_t definition{
             type, sizeof(uint32_t), sizeof(uint64_t), map_size.has_value() ? map_size.value() : ebpf_get_cpu_count()};
+        definition.map_flags = map_flags;
 
         (void)ebpf_map_create(&name, &definition, ebpf_handle_invalid, &map);
 
@@ -164,6 +199,17 @@ typedef class _ebpf_map_test_state
         ebpf_epoch_exit(&epoch_state);
     }
 
+    void
+    test_update_shared_key()
+    {
+        uint32_t key = 0;
+        uint64_t value = 0;
+        ebpf_epoch_state_t epoch_state;
+        ebpf_epoch_enter(&epoch_state);
+        (void)ebpf_map_update_entry(map, 0, (uint8_t*)&key, 0, (uint8_t*)&value, EBPF_ANY, EBPF_MAP_FLAG_HELPER);
+        ebpf_epoch_exit(&epoch_state);
+    }
+
     void
     test_update_lru()
     {
@@ -285,9 +331,361 @@ typedef class _ebpf_map_lpm_trie_test_state
     std::vector<std::pair<uint32_t, uint32_t>> ipv4_routes;
 } ebpf_map_lpm_trie_test_state_t;
 
+typedef enum _map_workload
+{
+    MAP_WORKLOAD_READ_MOSTLY, ///< 95% lookups and 5% updates, Zipfian keys, on every CPU.
+    MAP_WORKLOAD_BALANCED,    ///< 50% lookups, 40% updates and 10% deletes, Zipfian keys, on every CPU.
+    MAP_WORKLOAD_UNIFORM,     ///< 90% lookups and 10% updates, uniformly distributed keys, on every CPU.
+    MAP_WORKLOAD_ONE_WRITER,  ///< CPU 0 issues 80% updates and 20% deletes, the other CPUs only look up, Zipfian keys.
+} map_workload_t;
+
+typedef struct _map_workload_definition
+{
+    uint32_t lookup_percent;
+    uint32_t update_percent;
+    uint32_t delete_percent;
+    double zipfian_skew;       ///< 0 for uniformly distributed keys, otherwise the Zipfian exponent (not 1).
+    uint32_t writer_cpu_count; ///< 0 to run the mix on every CPU, otherwise CPUs [0, count) only write.
+} map_workload_definition_t;
+
+static const map_workload_definition_t _map_workload_definitions[] = {
+    {95, 5, 0, 0.99, 0},
+    {50, 40, 10, 0.99, 0},
+    {90, 10, 0, 0.0, 0},
+    {0, 80, 20, 0.99, 1},
+};
+
+// Count of operations generated for each CPU. Workers cycle through them, so
+// the random number generator and the Zipfian sampling stay out of the timed
+// path. Must be a power of 2.
+#define MAP_WORKLOAD_OPERATION_COUNT (1024 * 256)
+
+/**
+ * @brief Draws keys in [0, key_space) with a Zipfian distribution, using the
+ * method from Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases". Rank r is then scattered to a key with a multiplicative hash,
+ * so that the hottest keys are not also adjacent in array maps.
+ */
+typedef class _zipfian_key_generator
+{
+  public:
+    _zipfian_key_generator(uint32_t key_space, double skew) : key_space(key_space), skew(skew)
+    {
+        if (skew == 0.0) {
+            return;
+        }
+        zeta_n = zeta(key_space);
+        alpha = 1.0 / (1.0 - skew);
+        eta = (1.0 - pow(2.0 / key_space, 1.0 - skew)) / (1.0 - zeta(2) / zeta_n);
+    }
+
+    uint32_t
+    next(std::mt19937_64& generator) const
+    {
+        if (skew == 0.0) {
+            return static_cast<uint32_t>(generator() % key_space);
+        }
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+        double uz = u * zeta_n;
+        uint64_t rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < 1.0 + pow(0.5, skew)) {
+            rank = 1;
+        } else {
+            rank = static_cast<uint64_t>(key_space * pow(eta * u - eta + 1.0, alpha));
+        }
+        if (rank >= key_space) {
+            rank = key_space - 1;
+        }
+        // 2654435761 is prime, so this is a permutation of [0, key_space) unless key_space is a multiple of it.
+        return static_cast<uint32_t>((rank * 2654435761ull) % key_space);
+    }
+
+  private:
+    double
+    zeta(uint32_t count) const
+    {
+        double sum = 0.0;
+        for (uint32_t i = 1; i <= count; i++) {
+            sum += 1.0 / pow(static_cast<double>(i), skew);
+        }
+        return sum;
+    }
+
+    uint32_t key_space;
+    double skew;
+    double zeta_n = 0.0;
+    double alpha = 0.0;
+    double eta = 0.0;
+} zipfian_key_generator_t;
+
+/**
+ * @brief Runs a mix of lookups, updates and deletes against a map holding
+ * key_space entries. Each CPU replays its own pre-generated sequence of
+ * operations, so the mix, the key distribution and the split between reader
+ * and writer CPUs are fixed per run and reproducible across builds.
+ */
+typedef class _ebpf_map_workload_test_state
+{
+  public:
+    _ebpf_map_workload_test_state(ebpf_map_type_t type, map_workload_t workload, uint32_t key_space)
+        : lpm_trie(type == BPF_MAP_TYPE_LPM_TRIE),
+          // Array maps can't delete entries, so the delete share of the mix is issued as updates.
+          array(type == BPF_MAP_TYPE_ARRAY || type == BPF_MAP_TYPE_PERCPU_ARRAY),
+          cpus(ebpf_get_cpu_count())
+    {
+        cxplat_utf8_string_t name{(uint8_t*)"test", 4};
+        REQUIRE(ebpf_core_initiate() == EBPF_SUCCESS);
+        uint32_t key_size = static_cast<uint32_t>(lpm_trie ? sizeof(uint32_t) * 2 : sizeof(uint32_t));
+        ebpf_map_definition_in_memory_t definition{type, key_size, sizeof(uint64_t), key_space};
+        REQUIRE(ebpf_map_create(&name, &definition, ebpf_handle_invalid, &map) == EBPF_SUCCESS);
+
+        for (uint32_t i = 0; i < key_space; i++) {
+            uint32_t key[2];
+            uint64_t value = i;
+            const uint8_t* key_bytes = format_key(i, key);
+            REQUIRE(
+                ebpf_map_update_entry(map, 0, key_bytes, 0, (uint8_t*)&value, EBPF_ANY, EBPF_MAP_FLAG_HELPER) ==
+                EBPF_SUCCESS);
+        }
+
+        const map_workload_definition_t& mix = _map_workload_definitions[workload];
+        zipfian_key_generator_t key_generator(key_space, mix.zipfian_skew);
+        for (uint32_t cpu_id = 0; cpu_id < cpus.size(); cpu_id++) {
+            uint32_t lookup_percent = mix.lookup_percent;
+            uint32_t update_percent = mix.update_percent;
+            if (mix.writer_cpu_count != 0 && cpu_id >= mix.writer_cpu_count) {
+                lookup_percent = 100;
+                update_percent = 0;
+            }
+            // Seed with the CPU so that every run of a workload replays the same operations.
+            std::mt19937_64 generator(cpu_id);
+            auto& operations = cpus[cpu_id].operations;
+            operations.resize(MAP_WORKLOAD_OPERATION_COUNT);
+            for (auto& operation : operations) {
+                uint32_t percent = static_cast<uint32_t>(generator() % 100);
+                if (percent < lookup_percent) {
+                    operation.type = MAP_OPERATION_LOOKUP;
+                } else if (percent < lookup_percent + update_percent || array) {
+                    operation.type = MAP_OPERATION_UPDATE;
+                } else {
+                    operation.type = MAP_OPERATION_DELETE;
+                }
+                operation.key = key_generator.next(generator);
+            }
+        }
+    }
+    ~_ebpf_map_workload_test_state()
+    {
+        EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
+        ebpf_core_terminate();
+    }
+
+    void
+    test_workload(uint32_t cpu_id)
+    {
+        per_cpu_state_t& cpu = cpus[cpu_id];
+        const map_operation_t& operation = cpu.operations[cpu.next++ & (MAP_WORKLOAD_OPERATION_COUNT - 1)];
+        uint32_t key[2];
+        const uint8_t* key_bytes = format_key(operation.key, key);
+        ebpf_epoch_state_t epoch_state;
+        ebpf_epoch_enter(&epoch_state);
+        switch (operation.type) {
+        case MAP_OPERATION_LOOKUP: {
+            volatile uint64_t* value = nullptr;
+            // The key may have been deleted by another CPU.
+            if (ebpf_map_find_entry(map, 0, key_bytes, 0, (uint8_t*)&value, EBPF_MAP_FLAG_HELPER) == EBPF_SUCCESS) {
+                uint64_t local = *value;
+                UNREFERENCED_PARAMETER(local);
+            }
+            break;
+        }
+        case MAP_OPERATION_UPDATE: {
+            uint64_t value = operation.key;
+            (void)ebpf_map_update_entry(map, 0, key_bytes, 0, (uint8_t*)&value, EBPF_ANY, EBPF_MAP_FLAG_HELPER);
+            break;
+        }
+        case MAP_OPERATION_DELETE:
+            (void)ebpf_map_delete_entry(map, 0, key_bytes, EBPF_MAP_FLAG_HELPER);
+            break;
+        }
+        ebpf_epoch_exit(&epoch_state);
+    }
+
+  private:
+    typedef enum _map_operation_type : uint32_t
+    {
+        MAP_OPERATION_LOOKUP,
+        MAP_OPERATION_UPDATE,
+        MAP_OPERATION_DELETE,
+    } map_operation_type_t;
+
+    typedef struct _map_operation
+    {
+        map_operation_type_t type;
+        uint32_t key;
+    } map_operation_t;
+
+    // Cache aligned so that advancing one CPU's position doesn't invalidate another CPU's cache line.
+    typedef struct alignas(EBPF_CACHE_LINE_SIZE) _per_cpu_state
+    {
+        std::vector<map_operation_t> operations;
+        size_t next = 0;
+    } per_cpu_state_t;
+
+    /**
+     * @brief Build the map key for a key index. LPM trie keys are full length
+     * IPv4 prefixes, so that every lookup is an exact match.
+     */
+    const uint8_t*
+    format_key(uint32_t key_index, _Out_writes_(2) uint32_t* key) const
+    {
+        if (lpm_trie) {
+            key[0] = 32;
+            key[1] = key_index;
+        } else {
+            key[0] = key_index;
+        }
+        return reinterpret_cast<const uint8_t*>(key);
+    }
+
+    ebpf_map_t* map = nullptr;
+    bool lpm_trie;
+    bool array;
+    std::vector<per_cpu_state_t> cpus;
+} ebpf_map_workload_test_state_t;
+
+// Number of values in the maps of the membership tests, and number of lookups generated per CPU.
+#define MAP_MEMBERSHIP_ENTRY_COUNT (1024 * 64)
+#define MAP_MEMBERSHIP_LOOKUP_COUNT (1024 * 64)
+
+/**
+ * @brief Tests whether keys are in a set held by a hash map or a bloom filter,
+ * where 1% of the keys tested were added. This is the case a bloom filter in
+ * front of a slower lookup is meant for: most tests are negative, and the
+ * filter answers them from a single cache line.
+ */
+typedef class _ebpf_map_membership_test_state
+{
+  public:
+    _ebpf_map_membership_test_state(ebpf_map_type_t type)
+        : bloom_filter(type == BPF_MAP_TYPE_BLOOM_FILTER), cpus(ebpf_get_cpu_count())
+    {
+        cxplat_utf8_string_t name{(uint8_t*)"test", 4};
+        REQUIRE(ebpf_core_initiate() == EBPF_SUCCESS);
+        // A bloom filter has no key, and holds the keys of the set as its values.
+        uint32_t key_size = static_cast<uint32_t>(bloom_filter ? 0 : sizeof(uint32_t));
+        uint32_t value_size = static_cast<uint32_t>(bloom_filter ? sizeof(uint32_t) : sizeof(uint64_t));
+        ebpf_map_definition_in_memory_t definition{type, key_size, value_size, MAP_MEMBERSHIP_ENTRY_COUNT};
+        REQUIRE(ebpf_map_create(&name, &definition, ebpf_handle_invalid, &map) == EBPF_SUCCESS);
+
+        for (uint32_t key = 0; key < MAP_MEMBERSHIP_ENTRY_COUNT; key++) {
+            uint64_t value = key;
+            if (bloom_filter) {
+                REQUIRE(ebpf_map_push_entry(map, 0, (uint8_t*)&key, EBPF_MAP_FLAG_HELPER) == EBPF_SUCCESS);
+            } else {
+                REQUIRE(
+                    ebpf_map_update_entry(
+                        map, 0, (uint8_t*)&key, 0, (uint8_t*)&value, EBPF_ANY, EBPF_MAP_FLAG_HELPER) == EBPF_SUCCESS);
+            }
+        }
+
+        // Seed with the CPU so that the hash map and the bloom filter are tested with the same keys.
+        for (uint32_t cpu_id = 0; cpu_id < cpus.size(); cpu_id++) {
+            std::mt19937_64 generator(cpu_id);
+            auto& keys = cpus[cpu_id].keys;
+            keys.resize(MAP_MEMBERSHIP_LOOKUP_COUNT);
+            for (auto& key : keys) {
+                key = static_cast<uint32_t>(generator() % MAP_MEMBERSHIP_ENTRY_COUNT);
+                if (generator() % 100 != 0) {
+                    // Keys at or above MAP_MEMBERSHIP_ENTRY_COUNT were never added.
+                    key += MAP_MEMBERSHIP_ENTRY_COUNT;
+                }
+            }
+        }
+    }
+    ~_ebpf_map_membership_test_state()
+    {
+        EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
+        ebpf_core_terminate();
+    }
+
+    void
+    test_membership(uint32_t cpu_id)
+    {
+        per_cpu_state_t& cpu = cpus[cpu_id];
+        uint32_t key = cpu.keys[cpu.next++ & (MAP_MEMBERSHIP_LOOKUP_COUNT - 1)];
+        ebpf_epoch_state_t epoch_state;
+        ebpf_epoch_enter(&epoch_state);
+        if (bloom_filter) {
+            (void)ebpf_map_peek_entry(map, 0, (uint8_t*)&key, EBPF_MAP_FLAG_HELPER);
+        } else {
+            uint8_t* value = nullptr;
+            (void)ebpf_map_find_entry(map, 0, (uint8_t*)&key, 0, (uint8_t*)&value, EBPF_MAP_FLAG_HELPER);
+        }
+        ebpf_epoch_exit(&epoch_state);
+    }
+
+  private:
+    // Cache aligned so that advancing one CPU's position doesn't invalidate another CPU's cache line.
+    typedef struct alignas(EBPF_CACHE_LINE_SIZE) _per_cpu_state
+    {
+        std::vector<uint32_t> keys;
+        size_t next = 0;
+    } per_cpu_state_t;
+
+    ebpf_map_t* map = nullptr;
+    bool bloom_filter;
+    std::vector<per_cpu_state_t> cpus;
+} ebpf_map_membership_test_state_t;
+
+/**
+ * @brief Hands values between CPUs through a queue or stack map. Every
+ * invocation pushes a value and pops one, so the map stays half full and
+ * producers and consumers contend on every CPU.
+ */
+typedef class _ebpf_map_push_pop_test_state
+{
+  public:
+    _ebpf_map_push_pop_test_state(ebpf_map_type_t type)
+    {
+        cxplat_utf8_string_t name{(uint8_t*)"test", 4};
+        REQUIRE(ebpf_core_initiate() == EBPF_SUCCESS);
+        uint32_t max_entries = ebpf_get_cpu_count() * 1024;
+        ebpf_map_definition_in_memory_t definition{type, 0, sizeof(uint64_t), max_entries};
+        REQUIRE(ebpf_map_create(&name, &definition, ebpf_handle_invalid, &map) == EBPF_SUCCESS);
+        for (uint64_t value = 0; value < max_entries / 2; value++) {
+            REQUIRE(ebpf_map_push_entry(map, 0, (uint8_t*)&value, EBPF_MAP_FLAG_HELPER) == EBPF_SUCCESS);
+        }
+    }
+    ~_ebpf_map_push_pop_test_state()
+    {
+        EBPF_OBJECT_RELEASE_REFERENCE((ebpf_core_object_t*)map);
+        ebpf_core_terminate();
+    }
+
+    void
+    test_push_pop(uint32_t cpu_id)
+    {
+        uint64_t value = cpu_id;
+        ebpf_epoch_state_t epoch_state;
+        ebpf_epoch_enter(&epoch_state);
+        (void)ebpf_map_push_entry(map, 0, (uint8_t*)&value, EBPF_MAP_FLAG_HELPER);
+        (void)ebpf_map_pop_entry(map, 0, (uint8_t*)&value, EBPF_MAP_FLAG_HELPER);
+        ebpf_epoch_exit(&epoch_state);
+    }
+
+  private:
+    ebpf_map_t* map = nullptr;
+} ebpf_map_push_pop_test_state_t;
+
 static ebpf_program_test_state_t* _ebpf_program_test_state_instance = nullptr;
 static ebpf_map_test_state_t* _ebpf_map_test_state_instance = nullptr;
 static ebpf_map_lpm_trie_test_state_t* _ebpf_map_lpm_trie_test_state_instance = nullptr;
+static ebpf_map_workload_test_state_t* _ebpf_map_workload_test_state_instance = nullptr;
+static ebpf_map_push_pop_test_state_t* _ebpf_map_push_pop_test_state_instance = nullptr;
+static ebpf_map_membership_test_state_t* _ebpf_map_membership_test_state_instance = nullptr;
 
 #if !defined(CONFIG_BPF_JIT_DISABLED) || !defined(CONFIG_BPF_INTERPRETER_DISABLED)
 static void
@@ -320,6 +718,12 @@ _map_update_test(uint32_t cpu_id)
     _ebpf_map_test_state_instance->test_update(cpu_id);
 }
 
+static void
+_map_update_shared_key_test()
+{
+    _ebpf_map_test_state_instance->test_update_shared_key();
+}
+
 static void
 _map_update_lru_test()
 {
@@ -338,6 +742,24 @@ _lpm_trie_ipv4_find()
     _ebpf_map_lpm_trie_test_state_instance->test_find_ipv4_route();
 }
 
+static void
+_map_workload_test(uint32_t cpu_id)
+{
+    _ebpf_map_workload_test_state_instance->test_workload(cpu_id);
+}
+
+static void
+_map_push_pop_test(uint32_t cpu_id)
+{
+    _ebpf_map_push_pop_test_state_instance->test_push_pop(cpu_id);
+}
+
+static void
+_map_membership_test(uint32_t cpu_id)
+{
+    _ebpf_map_membership_test_state_instance->test_membership(cpu_id);
+}
+
 static const char*
 _ebpf_map_type_t_to_string(ebpf_map_type_t type)
 {
@@ -360,8 +782,20 @@ _ebpf_map_type_t_to_string(ebpf_map_type_t type)
         return "BPF_MAP_TYPE_ARRAY_OF_MAPS";
     case BPF_MAP_TYPE_LRU_HASH:
         return "BPF_MAP_TYPE_LRU_HASH";
+    case BPF_MAP_TYPE_LPM_TRIE:
+        return "BPF_MAP_TYPE_LPM_TRIE";
+    case BPF_MAP_TYPE_QUEUE:
+        return "BPF_MAP_TYPE_QUEUE";
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+        return "BPF_MAP_TYPE_LRU_PERCPU_HASH";
+    case BPF_MAP_TYPE_STACK:
+        return "BPF_MAP_TYPE_STACK";
     case BPF_MAP_TYPE_RINGBUF:
         return "BPF_MAP_TYPE_RINGBUF";
+    case BPF_MAP_TYPE_PERF_EVENT_ARRAY:
+        return "BPF_MAP_TYPE_PERF_EVENT_ARRAY";
+    case BPF_MAP_TYPE_BLOOM_FILTER:
+        return "BPF_MAP_TYPE_BLOOM_FILTER";
     default:
         return "Error";
     }
@@ -410,6 +844,46 @@ test_bpf_map_update_elem(bool preemptible)
     name += ">";
     _performance_measure measure(name.c_str(), preemptible, _map_update_test, iterations);
     measure.run_test();
+    measure.run_latency_test();
+
+    // For per-CPU maps, also report how updates to a single key shared by all CPUs scale with the CPU count. Each
+    // CPU only writes its own copy of the value, so the cost of an update should not grow as CPUs are added.
+    if constexpr (map_type == BPF_MAP_TYPE_PERCPU_HASH || map_type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+        uint32_t maximum_cpu_count = ebpf_get_cpu_count();
+        for (uint32_t cpu_count = 1;; cpu_count *= 2) {
+            if (cpu_count > maximum_cpu_count) {
+                cpu_count = maximum_cpu_count;
+            }
+            std::string scaling_name = __FUNCTION__;
+            scaling_name += "_shared_key<";
+            scaling_name += _ebpf_map_type_t_to_string(map_type);
+            scaling_name += ",";
+            scaling_name += std::to_string(cpu_count);
+            scaling_name += ">";
+            _performance_measure scaling_measure(
+                scaling_name.c_str(), preemptible, _map_update_shared_key_test, iterations, cpu_count);
+            scaling_measure.run_test();
+            if (cpu_count == maximum_cpu_count) {
+                break;
+            }
+        }
+    }
+}
+
+template <ebpf_map_type_t map_type>
+void
+test_bpf_map_update_elem_preallocated(bool preemptible)
+{
+    size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT;
+    ebpf_map_test_state_t map_test_state(map_type, {}, BPF_F_PREALLOC);
+    _ebpf_map_test_state_instance = &map_test_state;
+    std::string name = __FUNCTION__;
+    name += "<";
+    name += _ebpf_map_type_t_to_string(map_type);
+    name += ">";
+    _performance_measure measure(name.c_str(), preemptible, _map_update_test, iterations);
+    measure.run_test();
+    measure.run_latency_test();
 }
 
 #define LRU_MAP_SIZE 8192
@@ -427,6 +901,7 @@ test_bpf_map_update_lru_elem(bool preemptible)
     name += ">";
     _performance_measure measure(name.c_str(), preemptible, _map_update_lru_test, iterations);
     measure.run_test();
+    measure.run_latency_test();
 }
 
 template <ebpf_map_type_t map_type>
@@ -458,6 +933,41 @@ test_program_invoke_jit(bool preemptible)
     measure.run_test();
 }
 
+void
+test_program_invoke_jit_printk(bool preemptible)
+{
+    size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT * 10;
+    // bpf_printk("pkt %u", 42);
+    std::vector<ebpf_instruction_t> byte_code = {
+        {EBPF_OP_STW, 10, 0, -8, 0x20746b70}, // "pkt "
+        {EBPF_OP_STW, 10, 0, -4, 0x00007525}, // "%u\0\0"
+        {EBPF_OP_MOV64_REG, 1, 10},
+        {EBPF_OP_ADD64_IMM, 1, 0, 0, -8},
+        {EBPF_OP_MOV64_IMM, 2, 0, 0, 7},
+        {EBPF_OP_MOV64_IMM, 3, 0, 0, 42},
+        {EBPF_OP_CALL, 0, 0, 0, BPF_FUNC_trace_printk3},
+        {EBPF_OP_EXIT}};
+    _ebpf_program_test_state program_state(byte_code);
+    _ebpf_program_test_state_instance = &program_state;
+    program_state.prepare_jit_program();
+
+    // The cost depends on which printk keyword a trace session has enabled, so record it in the test name.
+    // For example, "tracelog -start printk -guid #394f321c-5cf4-404c-aa34-4df1428a7f9c -flag 0x800 -level 4"
+    // measures deferred printk events.
+    std::string name = __FUNCTION__;
+    if (TraceLoggingProviderEnabled(ebpf_tracelog_provider, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK)) {
+        name += "<formatted>";
+    } else if (TraceLoggingProviderEnabled(
+                   ebpf_tracelog_provider, EBPF_TRACELOG_LEVEL_INFO, EBPF_TRACELOG_KEYWORD_PRINTK_DEFERRED)) {
+        name += "<deferred>";
+    } else {
+        name += "<disabled>";
+    }
+
+    _performance_measure measure(name.c_str(), preemptible, _ebpf_program_invoke, iterations);
+    measure.run_test();
+}
+
 void
 test_program_invoke_interpret(bool preemptible)
 {
@@ -490,8 +1000,90 @@ test_lpm_trie_ipv4(bool preemptible)
     measure.run_test();
 }
 
+static const char*
+_map_workload_t_to_string(map_workload_t workload)
+{
+    switch (workload) {
+    case MAP_WORKLOAD_READ_MOSTLY:
+        return "read_mostly";
+    case MAP_WORKLOAD_BALANCED:
+        return "balanced";
+    case MAP_WORKLOAD_UNIFORM:
+        return "uniform";
+    case MAP_WORKLOAD_ONE_WRITER:
+        return "one_writer";
+    default:
+        return "Error";
+    }
+}
+
+template <ebpf_map_type_t map_type, map_workload_t workload, uint32_t key_space>
+void
+test_bpf_map_workload(bool preemptible)
+{
+    size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT;
+    ebpf_map_workload_test_state_t map_test_state(map_type, workload, key_space);
+    _ebpf_map_workload_test_state_instance = &map_test_state;
+    std::string name = __FUNCTION__;
+    name += "<";
+    name += _ebpf_map_type_t_to_string(map_type);
+    name += ",";
+    name += _map_workload_t_to_string(workload);
+    name += ",";
+    name += std::to_string(key_space);
+    name += ">";
+    _performance_measure measure(name.c_str(), preemptible, _map_workload_test, iterations);
+    measure.run_test();
+    measure.run_latency_test();
+}
+
+// Report how a push followed by a pop scales as CPUs are added, to show contention between producers and consumers.
+template <ebpf_map_type_t map_type>
+void
+test_bpf_map_push_pop_elem(bool preemptible)
+{
+    size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT;
+    uint32_t maximum_cpu_count = ebpf_get_cpu_count();
+    for (uint32_t cpu_count = 1;; cpu_count *= 2) {
+        if (cpu_count > maximum_cpu_count) {
+            cpu_count = maximum_cpu_count;
+        }
+        ebpf_map_push_pop_test_state_t map_test_state(map_type);
+        _ebpf_map_push_pop_test_state_instance = &map_test_state;
+        std::string name = __FUNCTION__;
+        name += "<";
+        name += _ebpf_map_type_t_to_string(map_type);
+        name += ",";
+        name += std::to_string(cpu_count);
+        name += ">";
+        _performance_measure measure(name.c_str(), preemptible, _map_push_pop_test, iterations, cpu_count);
+        measure.run_test();
+        if (cpu_count == maximum_cpu_count) {
+            break;
+        }
+    }
+}
+
+// Compare testing for keys in a hash map and in a bloom filter when 99% of the keys tested are not in the set.
+template <ebpf_map_type_t map_type>
+void
+test_bpf_map_membership(bool preemptible)
+{
+    size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT;
+    ebpf_map_membership_test_state_t map_test_state(map_type);
+    _ebpf_map_membership_test_state_instance = &map_test_state;
+    std::string name = __FUNCTION__;
+    name += "<";
+    name += _ebpf_map_type_t_to_string(map_type);
+    name += ">";
+    _performance_measure measure(name.c_str(), preemptible, _map_membership_test, iterations);
+    measure.run_test();
+    measure.run_latency_test();
+}
+
 #if !defined(CONFIG_BPF_JIT_DISABLED)
 PERF_TEST(test_program_invoke_jit);
+PERF_TEST(test_program_invoke_jit_printk);
 #endif
 #if !defined(CONFIG_BPF_INTERPRETER_DISABLED)
 PERF_TEST(test_program_invoke_interpret);
@@ -514,10 +1106,46 @@ PERF_TEST(test_bpf_map_update_elem<BPF_MAP_TYPE_PERCPU_HASH>);
 PERF_TEST(test_bpf_map_update_elem<BPF_MAP_TYPE_PERCPU_ARRAY>);
 PERF_TEST(test_bpf_map_update_elem<BPF_MAP_TYPE_LRU_HASH>);
 
+PERF_TEST(test_bpf_map_update_elem_preallocated<BPF_MAP_TYPE_HASH>);
+PERF_TEST(test_bpf_map_update_elem_preallocated<BPF_MAP_TYPE_LRU_HASH>);
+
 PERF_TEST(test_bpf_map_update_lru_elem<BPF_MAP_TYPE_LRU_HASH>);
 PERF_TEST(test_bpf_map_lookup_lru_elem<BPF_MAP_TYPE_LRU_HASH>);
 
+PERF_TEST(test_bpf_map_push_pop_elem<BPF_MAP_TYPE_QUEUE>);
+PERF_TEST(test_bpf_map_push_pop_elem<BPF_MAP_TYPE_STACK>);
+
+PERF_TEST(test_bpf_map_membership<BPF_MAP_TYPE_HASH>);
+PERF_TEST(test_bpf_map_membership<BPF_MAP_TYPE_BLOOM_FILTER>);
+
 PERF_TEST(test_lpm_trie_ipv4<1024>);
 PERF_TEST(test_lpm_trie_ipv4<1024 * 16>);
 PERF_TEST(test_lpm_trie_ipv4<1024 * 256>);
 PERF_TEST(test_lpm_trie_ipv4<1024 * 1024>);
+
+// Mixed workloads for every map type that stores caller supplied values under caller supplied keys. Maps of maps and
+// program arrays hold object references, and queues, stacks, ring buffers and perf event arrays have no keys.
+#define MAP_WORKLOAD_PERF_TESTS(map_type, key_space)                                 \
+    PERF_TEST(test_bpf_map_workload<map_type, MAP_WORKLOAD_READ_MOSTLY, key_space>); \
+    PERF_TEST(test_bpf_map_workload<map_type, MAP_WORKLOAD_BALANCED, key_space>);    \
+    PERF_TEST(test_bpf_map_workload<map_type, MAP_WORKLOAD_UNIFORM, key_space>);     \
+    PERF_TEST(test_bpf_map_workload<map_type, MAP_WORKLOAD_ONE_WRITER, key_space>);
+
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_HASH, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_HASH, 1024 * 1024)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_HASH, 1024 * 1024 * 16)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_ARRAY, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_ARRAY, 1024 * 1024)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_ARRAY, 1024 * 1024 * 16)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LRU_HASH, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LRU_HASH, 1024 * 1024)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LRU_HASH, 1024 * 1024 * 16)
+// Per-CPU maps hold a value for every CPU, so they stop at a million keys to bound memory use on large machines.
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_PERCPU_HASH, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_PERCPU_HASH, 1024 * 1024)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_PERCPU_ARRAY, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_PERCPU_ARRAY, 1024 * 1024)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LRU_PERCPU_HASH, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LRU_PERCPU_HASH, 1024 * 1024)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LPM_TRIE, 1024 * 4)
+MAP_WORKLOAD_PERF_TESTS(BPF_MAP_TYPE_LPM_TRIE, 1024 * 1024)
@@ -4,7 +4,10 @@
 
 #include "ebpf_platform.h"
 
+#include <array>
+#include <intrin.h>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -12,10 +15,186 @@
 #define PERFORMANCE_MEASURE_TIMEOUT 60000
 #define PERFORMANCE_MEASURE_BATCH_SIZE 1024
 
+// Latencies are recorded in a log-linear histogram: each power of two is split into 2^SUB_BUCKET_BITS buckets, which
+// bounds the error of a reported percentile to 1/16th of its value while keeping the histogram small enough to keep
+// one per CPU.
+#define PERFORMANCE_MEASURE_SUB_BUCKET_BITS 4
+#define PERFORMANCE_MEASURE_SUB_BUCKET_COUNT (1 << PERFORMANCE_MEASURE_SUB_BUCKET_BITS)
+#define PERFORMANCE_MEASURE_HISTOGRAM_SIZE (64 * PERFORMANCE_MEASURE_SUB_BUCKET_COUNT)
+
+// If set, every measurement is also appended to this file as one JSON object per line, so that the results of two
+// builds can be compared with scripts/Compare-PerformanceResults.ps1.
+#define PERFORMANCE_MEASURE_RESULTS_FILE_VARIABLE "EBPF_PERFORMANCE_RESULTS_FILE"
+
+/**
+ * @brief HDR style histogram of latencies. Values are counted in log-linear
+ * buckets, so the histogram has a fixed size regardless of the range of
+ * values recorded, and the exact maximum is kept on the side.
+ */
+typedef class _performance_histogram
+{
+  public:
+    /**
+     * @brief Record one value.
+     *
+     * @param[in] value Value to record, in arbitrary units.
+     */
+    void
+    record(uint64_t value)
+    {
+        buckets[bucket_index(value)]++;
+        count++;
+        if (value > maximum) {
+            maximum = value;
+        }
+    }
+
+    /**
+     * @brief Add the values recorded in another histogram to this one.
+     *
+     * @param[in] other Histogram to merge.
+     */
+    void
+    merge(const _performance_histogram& other)
+    {
+        for (size_t index = 0; index < buckets.size(); index++) {
+            buckets[index] += other.buckets[index];
+        }
+        count += other.count;
+        if (other.maximum > maximum) {
+            maximum = other.maximum;
+        }
+    }
+
+    /**
+     * @brief Find the value below which the given fraction of the recorded values fall.
+     *
+     * @param[in] fraction Fraction of values, e.g. 0.99.
+     * @return Smallest value of the bucket holding the percentile, or 0 if nothing was recorded.
+     */
+    uint64_t
+    percentile(double fraction) const
+    {
+        uint64_t rank = static_cast<uint64_t>(static_cast<double>(count) * fraction);
+        uint64_t seen = 0;
+        for (size_t index = 0; index < buckets.size(); index++) {
+            seen += buckets[index];
+            if (seen > rank) {
+                return bucket_value(index);
+            }
+        }
+        return maximum;
+    }
+
+    uint64_t
+    maximum_value() const
+    {
+        return maximum;
+    }
+
+    uint64_t
+    value_count() const
+    {
+        return count;
+    }
+
+  private:
+    static size_t
+    bucket_index(uint64_t value)
+    {
+        if (value < PERFORMANCE_MEASURE_SUB_BUCKET_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        unsigned long msb_index;
+        _BitScanReverse64(&msb_index, value);
+        size_t shift = msb_index - PERFORMANCE_MEASURE_SUB_BUCKET_BITS;
+        return (shift + 1) * PERFORMANCE_MEASURE_SUB_BUCKET_COUNT +
+               static_cast<size_t>((value >> shift) & (PERFORMANCE_MEASURE_SUB_BUCKET_COUNT - 1));
+    }
+
+    static uint64_t
+    bucket_value(size_t index)
+    {
+        if (index < PERFORMANCE_MEASURE_SUB_BUCKET_COUNT) {
+            return index;
+        }
+        size_t shift = index / PERFORMANCE_MEASURE_SUB_BUCKET_COUNT - 1;
+        uint64_t sub_bucket = index % PERFORMANCE_MEASURE_SUB_BUCKET_COUNT;
+        return (PERFORMANCE_MEASURE_SUB_BUCKET_COUNT + sub_bucket) << shift;
+    }
+
+    std::array<uint64_t, PERFORMANCE_MEASURE_HISTOGRAM_SIZE> buckets{};
+    uint64_t count = 0;
+    uint64_t maximum = 0;
+} performance_histogram_t;
+
+/**
+ * @brief Append a measurement to the results file named by
+ * PERFORMANCE_MEASURE_RESULTS_FILE_VARIABLE, if one is configured, as one JSON
+ * object per line.
+ *
+ * @param[in] test_name Name of the test.
+ * @param[in] preemptible Whether the test ran preemptible.
+ * @param[in] mode How the samples were collected, e.g. "batch" or "operation".
+ * @param[in] cpu_count Count of CPUs the test ran on.
+ * @param[in] iterations Count of iterations on each CPU.
+ * @param[in] samples Count of samples the statistics were computed from.
+ * @param[in] average Average duration of an invocation in nanoseconds.
+ * @param[in] extra_fields Further fields of the object, each preceded by a comma.
+ */
+inline void
+performance_measure_write_result(
+    _In_z_ const char* test_name,
+    bool preemptible,
+    _In_z_ const char* mode,
+    uint32_t cpu_count,
+    size_t iterations,
+    uint64_t samples,
+    double average,
+    const std::string& extra_fields)
+{
+    char* results_file_name = nullptr;
+    size_t results_file_name_size = 0;
+    if (_dupenv_s(&results_file_name, &results_file_name_size, PERFORMANCE_MEASURE_RESULTS_FILE_VARIABLE) != 0 ||
+        results_file_name == nullptr) {
+        return;
+    }
+
+    FILE* results_file = nullptr;
+    errno_t error = fopen_s(&results_file, results_file_name, "a");
+    free(results_file_name);
+    if (error != 0 || results_file == nullptr) {
+        return;
+    }
+
+    // Test names are C++ identifiers and template arguments, but escape them anyway to keep each line valid JSON.
+    std::string escaped_name;
+    for (const char* character = test_name; *character; character++) {
+        if (*character == '"' || *character == '\\') {
+            escaped_name += '\\';
+        }
+        escaped_name += *character;
+    }
+
+    fprintf(
+        results_file,
+        "{\"test\":\"%s\",\"preemptible\":%s,\"mode\":\"%s\",\"cpu_count\":%u,\"iterations\":%zu,"
+        "\"samples\":%llu,\"average_ns\":%.1f%s}\n",
+        escaped_name.c_str(),
+        preemptible ? "true" : "false",
+        mode,
+        cpu_count,
+        iterations,
+        samples,
+        average,
+        extra_fields.c_str());
+    fclose(results_file);
+}
+
 /**
  * @brief Test helper function that executes a provided method on each CPU
- * iterations times, measures elapsed time and returns average elapsed time
- * across all CPUs.
+ * (or on the first active_cpu_count CPUs) iterations times, measures elapsed time
+ * and returns average elapsed time across those CPUs.
  *
  * @tparam T The helper function to run.
  */
@@ -29,13 +208,16 @@ template <typename T> class _performance_measure
      * @param[in] preemptible Run the test function in preemptible mode.
      * @param[in] worker Function under test
      * @param[in] iterations Iteration count to run.
+     * @param[in] active_cpu_count Count of CPUs to run the worker on, starting at CPU 0. Must not exceed the
+     * CPU count.
      */
     _performance_measure(
         _In_z_ const char* test_name,
         bool preemptible,
         T worker,
-        size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT)
-        : cpu_count(ebpf_get_cpu_count()), iterations(iterations), counters(cpu_count), worker(worker),
+        size_t iterations = PERFORMANCE_MEASURE_ITERATION_COUNT,
+        uint32_t active_cpu_count = ebpf_get_cpu_count())
+        : cpu_count(active_cpu_count), iterations(iterations), counters(cpu_count), worker(worker),
           preemptible(preemptible), test_name(test_name)
     {
         start_event = CreateEvent(nullptr, true, false, nullptr);
@@ -43,17 +225,73 @@ template <typename T> class _performance_measure
     ~_performance_measure() { CloseHandle(start_event); }
 
     /**
-     * @brief Perform the measurement.
+     * @brief Perform the measurement and report the average duration as
+     * "<test_name>,<preemptible>,<average>". The duration of each batch of
+     * PERFORMANCE_MEASURE_BATCH_SIZE invocations is also recorded, and its
+     * percentiles are written to the results file if one is configured.
      *
      * @param[in] multiplier Count of tests each invocation of worker represents.
      */
     void
     run_test(size_t multiplier = 1)
+    {
+        run(multiplier, false);
+    }
+
+    /**
+     * @brief Measure the latency of each invocation of worker and report its
+     * percentiles in nanoseconds as
+     * "<test_name>_latency,<preemptible>,<p50>,<p90>,<p99>,<p999>,<max>". Each
+     * invocation is timed with the time stamp counter, so the reported
+     * latencies include the few cycles needed to read it.
+     *
+     * @param[in] multiplier Count of tests each invocation of worker represents.
+     */
+    void
+    run_latency_test(size_t multiplier = 1)
+    {
+        run(multiplier, true);
+    }
+
+  private:
+    /**
+     * @brief Append a measurement to the results file, if one is configured.
+     *
+     * @param[in] mode "batch" if the histogram holds the per-invocation average of each batch, "operation" if it
+     * holds individual invocations.
+     * @param[in] average Average duration of an invocation in nanoseconds.
+     * @param[in] histogram Histogram of durations.
+     * @param[in] nanoseconds_per_unit Conversion from histogram units to nanoseconds.
+     */
+    void
+    write_result(
+        _In_z_ const char* mode,
+        double average,
+        const performance_histogram_t& histogram,
+        double nanoseconds_per_unit) const
+    {
+        char extra_fields[256];
+        sprintf_s(
+            extra_fields,
+            ",\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"p999_ns\":%.1f,\"max_ns\":%.1f",
+            static_cast<double>(histogram.percentile(0.5)) * nanoseconds_per_unit,
+            static_cast<double>(histogram.percentile(0.9)) * nanoseconds_per_unit,
+            static_cast<double>(histogram.percentile(0.99)) * nanoseconds_per_unit,
+            static_cast<double>(histogram.percentile(0.999)) * nanoseconds_per_unit,
+            static_cast<double>(histogram.maximum_value()) * nanoseconds_per_unit);
+        performance_measure_write_result(
+            test_name, preemptible, mode, cpu_count, iterations, histogram.value_count(), average, extra_fields);
+    }
+
+    void
+    run(size_t multiplier, bool record_latency)
     {
         int32_t ready_count = 0;
+        counters.assign(cpu_count, {});
+        histograms.assign(cpu_count, {});
         std::vector<std::thread> threads;
         for (uint32_t i = 0; i < cpu_count; i++) {
-            threads.emplace_back(std::thread([i, this, &ready_count] {
+            threads.emplace_back(std::thread([i, this, &ready_count, record_latency] {
                 uint32_t local_cpu_id = i;
                 uintptr_t thread_mask = local_cpu_id;
                 thread_mask = static_cast<uintptr_t>(1) << thread_mask;
@@ -72,6 +310,9 @@ template <typename T> class _performance_measure
                     if (k % PERFORMANCE_MEASURE_BATCH_SIZE == 0) {
                         QueryPerformanceCounter(&end_time);
                         counters[local_cpu_id].QuadPart += end_time.QuadPart - start_time.QuadPart;
+                        if (k != 0 && !record_latency) {
+                            histograms[local_cpu_id].record(end_time.QuadPart - start_time.QuadPart);
+                        }
                         if (!preemptible) {
                             KeLowerIrql(old_irql);
                         }
@@ -80,14 +321,22 @@ template <typename T> class _performance_measure
                         }
                         QueryPerformanceCounter(&start_time);
                     }
+                    uint64_t begin_ticks = record_latency ? __rdtsc() : 0;
                     if constexpr (std::is_same<T, void(__cdecl*)(uint32_t)>::value) {
                         worker(local_cpu_id);
                     } else {
                         worker();
                     }
+                    if (record_latency) {
+                        histograms[local_cpu_id].record(__rdtsc() - begin_ticks);
+                    }
                 }
                 QueryPerformanceCounter(&end_time);
                 counters[local_cpu_id].QuadPart += end_time.QuadPart - start_time.QuadPart;
+                // Only full batches are recorded so that every value in the histogram covers the same work.
+                if (iterations % PERFORMANCE_MEASURE_BATCH_SIZE == 0 && iterations != 0 && !record_latency) {
+                    histograms[local_cpu_id].record(end_time.QuadPart - start_time.QuadPart);
+                }
                 if (!preemptible) {
                     KeLowerIrql(old_irql);
                 }
@@ -101,10 +350,17 @@ template <typename T> class _performance_measure
             }
             Sleep(1);
         }
+        // Calibrate the time stamp counter against the performance counter over the whole run.
+        LARGE_INTEGER run_start_time;
+        LARGE_INTEGER run_end_time;
+        QueryPerformanceCounter(&run_start_time);
+        uint64_t run_start_ticks = __rdtsc();
         SetEvent(start_event);
         for (auto& thread : threads) {
             thread.join();
         }
+        uint64_t run_end_ticks = __rdtsc();
+        QueryPerformanceCounter(&run_end_time);
         LARGE_INTEGER total_time{};
         LARGE_INTEGER frequency{};
         QueryPerformanceFrequency(&frequency);
@@ -117,14 +373,43 @@ template <typename T> class _performance_measure
         average_duration *= 1e9;
         average_duration /= static_cast<double>(frequency.QuadPart);
         average_duration /= multiplier;
-        printf("%s,%d,%.0f\n", test_name, preemptible, average_duration);
+
+        performance_histogram_t histogram;
+        for (const auto& cpu_histogram : histograms) {
+            histogram.merge(cpu_histogram);
+        }
+
+        if (!record_latency) {
+            printf("%s,%d,%.0f\n", test_name, preemptible, average_duration);
+            // Batches are timed with the performance counter; report the average invocation within each batch.
+            write_result(
+                "batch",
+                average_duration,
+                histogram,
+                1e9 / static_cast<double>(frequency.QuadPart) / PERFORMANCE_MEASURE_BATCH_SIZE / multiplier);
+            return;
+        }
+
+        double nanoseconds_per_tick = static_cast<double>(run_end_time.QuadPart - run_start_time.QuadPart) * 1e9 /
+                                      static_cast<double>(frequency.QuadPart) /
+                                      static_cast<double>(run_end_ticks - run_start_ticks) / multiplier;
+        printf(
+            "%s_latency,%d,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+            test_name,
+            preemptible,
+            static_cast<double>(histogram.percentile(0.5)) * nanoseconds_per_tick,
+            static_cast<double>(histogram.percentile(0.9)) * nanoseconds_per_tick,
+            static_cast<double>(histogram.percentile(0.99)) * nanoseconds_per_tick,
+            static_cast<double>(histogram.percentile(0.999)) * nanoseconds_per_tick,
+            static_cast<double>(histogram.maximum_value()) * nanoseconds_per_tick);
+        write_result("operation", average_duration, histogram, nanoseconds_per_tick);
     }
 
-  private:
     const uint32_t cpu_count;
     const size_t iterations;
     T worker;
     std::vector<LARGE_INTEGER> counters;
+    std::vector<performance_histogram_t> histograms;
     HANDLE start_event;
     bool preemptible;
     const char* test_name;
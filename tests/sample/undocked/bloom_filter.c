@@ -0,0 +1,43 @@
+// Copyright (c) eBPF for Windows contributors
+// SPDX-License-Identifier: MIT
+
+// Whenever this sample program changes, bpf2c_tests will fail unless the
+// expected files in tests\bpf2c_tests\expected are updated. The following
+// script can be used to regenerate the expected files:
+//     generate_expected_bpf2c_output.ps1
+//
+// Usage:
+// .\scripts\generate_expected_bpf2c_output.ps1 <build_output_path>
+// Example:
+// .\scripts\generate_expected_bpf2c_output.ps1 .\x64\Debug\
+
+// eBPF program for testing BPF_MAP_TYPE_BLOOM_FILTER. Depending on the context, the program either adds a value to
+// the filter with bpf_map_push_elem, or tests whether the value may have been added with bpf_map_peek_elem.
+
+#include "bpf_helpers.h"
+#include "sample_ext_helpers.h"
+
+// Leaving the map in the old map format due to https://github.com/vbpf/ebpf-verifier/issues/502, as the bloom filter
+// has no key.
+SEC("maps")
+struct _ebpf_map_definition_in_file bloom_filter_map = {
+    .type = BPF_MAP_TYPE_BLOOM_FILTER,
+    .key_size = 0,
+    .value_size = sizeof(uint32_t),
+    .max_entries = 100,
+};
+
+SEC("sample_ext")
+int
+bloom_filter_test(sample_program_context_t* context)
+{
+    uint32_t value = context->uint32_data;
+
+    // A non-zero uint16_data adds the value, and returns the result of the push.
+    if (context->uint16_data != 0) {
+        return (int)bpf_map_push_elem(&bloom_filter_map, &value, BPF_ANY);
+    }
+
+    // Otherwise return 1 if the value may have been added, and 0 if it certainly was not.
+    return (bpf_map_peek_elem(&bloom_filter_map, &value) == 0) ? 1 : 0;
+}
@@ -782,6 +782,34 @@ _test_libbpf_map(ebpf_execution_type_t execution_type)
 
 DECLARE_ALL_TEST_CASES("libbpf map", "[libbpf]", _test_libbpf_map);
 
+TEST_CASE("libbpf create preallocated map", "[libbpf]")
+{
+    _test_helper_libbpf test_helper;
+    test_helper.initialize();
+
+    LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = BPF_F_PREALLOC);
+    for (auto map_type : {BPF_MAP_TYPE_HASH, BPF_MAP_TYPE_LRU_HASH, BPF_MAP_TYPE_HASH_TTL}) {
+        CAPTURE(map_type);
+        int map_fd = bpf_map_create(map_type, "MapName", sizeof(uint32_t), sizeof(uint64_t), 16, &opts);
+        REQUIRE(map_fd > 0);
+
+        bpf_map_info info;
+        uint32_t info_size = sizeof(info);
+        REQUIRE(bpf_obj_get_info_by_fd(map_fd, &info, &info_size) == 0);
+        REQUIRE(info.map_flags == BPF_F_PREALLOC);
+
+        uint32_t key = 1;
+        uint64_t value = 2;
+        REQUIRE(bpf_map_update_elem(map_fd, &key, &value, 0) == 0);
+        REQUIRE(bpf_map_delete_elem(map_fd, &key) == 0);
+        Platform::_close(map_fd);
+    }
+
+    // Only hash based maps can be preallocated.
+    REQUIRE(bpf_map_create(BPF_MAP_TYPE_ARRAY, "MapName", sizeof(uint32_t), sizeof(uint64_t), 16, &opts) < 0);
+    REQUIRE(errno == EINVAL);
+}
+
 TEST_CASE("libbpf create queue", "[libbpf]")
 {
     _test_helper_libbpf test_helper;
@@ -835,6 +863,46 @@ TEST_CASE("libbpf create queue", "[libbpf]")
     Platform::_close(map_fd);
 }
 
+TEST_CASE("libbpf create bloom filter", "[libbpf]")
+{
+    _test_helper_libbpf test_helper;
+    test_helper.initialize();
+
+    bpf_map_create_opts opts = {0};
+    const uint32_t max_entries = 100;
+    const uint32_t value_size = sizeof(uint32_t);
+
+    // Key size must be 0.
+    int map_fd = bpf_map_create(BPF_MAP_TYPE_BLOOM_FILTER, "MapName", sizeof(uint32_t), value_size, max_entries, &opts);
+    REQUIRE(map_fd < 0);
+
+    map_fd = bpf_map_create(BPF_MAP_TYPE_BLOOM_FILTER, "MapName", 0, value_size, max_entries, &opts);
+    REQUIRE(map_fd > 0);
+
+    bpf_map_info info;
+    uint32_t info_size = sizeof(info);
+    REQUIRE(bpf_obj_get_info_by_fd(map_fd, &info, &info_size) == 0);
+    REQUIRE(info.type == BPF_MAP_TYPE_BLOOM_FILTER);
+    REQUIRE(info.key_size == 0);
+    REQUIRE(info.value_size == value_size);
+    REQUIRE(info.max_entries == max_entries);
+
+    uint32_t next_key;
+    REQUIRE(bpf_map_get_next_key(map_fd, NULL, &next_key) == -ENOTSUP);
+
+    // Add a value, then test for it. A lookup tests the value passed in.
+    uint32_t value = 1;
+    REQUIRE(bpf_map_update_elem(map_fd, nullptr, &value, BPF_ANY) == 0);
+    REQUIRE(bpf_map_lookup_elem(map_fd, nullptr, &value) == 0);
+    REQUIRE(value == 1);
+
+    // Values can't be removed.
+    REQUIRE(bpf_map_lookup_and_delete_elem(map_fd, nullptr, &value) == -ENOTSUP);
+    REQUIRE(bpf_map_update_elem(map_fd, nullptr, &value, BPF_EXIST) == -EINVAL);
+
+    Platform::_close(map_fd);
+}
+
 TEST_CASE("libbpf create ringbuf", "[libbpf]")
 {
     _test_helper_libbpf test_helper;
@@ -2102,7 +2170,7 @@ TEST_CASE("bad_tail_call-native", "[libbpf]")
 }
 
 static void
-_multiple_tail_calls_test(ebpf_execution_type_t execution_type)
+_test_multiple_tail_calls(_In_z_ const char* file_name)
 {
     _test_helper_end_to_end test_helper;
     test_helper.initialize();
@@ -2111,9 +2179,6 @@ _multiple_tail_calls_test(ebpf_execution_type_t execution_type)
     program_info_provider_t sample_program_info;
     REQUIRE(sample_program_info.initialize(EBPF_PROGRAM_TYPE_SAMPLE) == EBPF_SUCCESS);
 
-    const char* file_name =
-        (execution_type == EBPF_EXECUTION_NATIVE ? "tail_call_multiple_um.dll" : "tail_call_multiple.o");
-
     struct bpf_object* object = bpf_object__open(file_name);
     REQUIRE(object != nullptr);
 
@@ -2195,8 +2260,22 @@ _multiple_tail_calls_test(ebpf_execution_type_t execution_type)
     bpf_object__close(object);
 }
 
+static void
+_multiple_tail_calls_test(ebpf_execution_type_t execution_type)
+{
+    _test_multiple_tail_calls(
+        execution_type == EBPF_EXECUTION_NATIVE ? "tail_call_multiple_um.dll" : "tail_call_multiple.o");
+}
+
 DECLARE_JIT_TEST_CASES("multiple tail calls", "[libbpf]", _multiple_tail_calls_test);
 
+// tail_call_multiple_split_um.dll is built by Convert-BpfToNative -Incremental, so each program is compiled from
+// its own bpf2c --split source file and linked back into one image.
+TEST_CASE("multiple tail calls split native", "[libbpf]")
+{
+    _test_multiple_tail_calls("tail_call_multiple_split_um.dll");
+}
+
 static void
 _test_bind_fd_to_prog_array(ebpf_execution_type_t execution_type)
 {
@@ -3036,6 +3115,23 @@ _test_bpf_obj_get_info_by_fd(ebpf_execution_type_t execution_type)
         .pinned_path_count = 1};
     expected_map_info.id = map_info[0].id;
     expected_map_info.inner_map_id = inner_map_info.id;
+
+    // Hash based maps report their occupancy, and every bucket falls in one bin of the length histogram.
+    REQUIRE(map_info[0].hash_bucket_count > 0);
+    REQUIRE(map_info[0].current_entries <= map_info[0].max_entries);
+    REQUIRE(map_info[0].memory_bytes > 0);
+    uint32_t histogram_bucket_count = 0;
+    for (uint32_t count : map_info[0].hash_bucket_length_count) {
+        histogram_bucket_count += count;
+    }
+    REQUIRE(histogram_bucket_count == map_info[0].hash_bucket_count);
+    expected_map_info.current_entries = map_info[0].current_entries;
+    expected_map_info.hash_bucket_count = map_info[0].hash_bucket_count;
+    expected_map_info.memory_bytes = map_info[0].memory_bytes;
+    memcpy(
+        expected_map_info.hash_bucket_length_count,
+        map_info[0].hash_bucket_length_count,
+        sizeof(expected_map_info.hash_bucket_length_count));
     strcpy_s(expected_map_info.name, sizeof(expected_map_info.name), map_name);
     if (strlen(map_name) < sizeof(expected_map_info.name)) {
         memset(expected_map_info.name + strlen(map_name), 0, sizeof(expected_map_info.name) - strlen(map_name));
@@ -3059,6 +3155,10 @@ _test_bpf_obj_get_info_by_fd(ebpf_execution_type_t execution_type)
     expected_map_info.type = BPF_MAP_TYPE_ARRAY;
     expected_map_info.id = map_info[1].id;
     expected_map_info.inner_map_id = 0;
+    expected_map_info.current_entries = 0;
+    expected_map_info.hash_bucket_count = 0;
+    expected_map_info.memory_bytes = 0;
+    memset(expected_map_info.hash_bucket_length_count, 0, sizeof(expected_map_info.hash_bucket_length_count));
     strcpy_s(expected_map_info.name, sizeof(expected_map_info.name), map_name);
     if (strlen(map_name) < sizeof(expected_map_info.name)) {
         memset(expected_map_info.name + strlen(map_name), 0, sizeof(expected_map_info.name) - strlen(map_name));
@@ -3319,6 +3419,7 @@ TEST_CASE("libbpf map type names", "[libbpf]")
     REQUIRE(strcmp(libbpf_bpf_map_type_str(BPF_MAP_TYPE_STACK), "stack") == 0);
     REQUIRE(strcmp(libbpf_bpf_map_type_str(BPF_MAP_TYPE_RINGBUF), "ringbuf") == 0);
     REQUIRE(strcmp(libbpf_bpf_map_type_str(BPF_MAP_TYPE_PERF_EVENT_ARRAY), "perf_event_array") == 0);
+    REQUIRE(strcmp(libbpf_bpf_map_type_str(BPF_MAP_TYPE_BLOOM_FILTER), "bloom_filter") == 0);
     REQUIRE(libbpf_bpf_map_type_str((bpf_map_type)123) == nullptr);
 }
 
@@ -4273,6 +4374,329 @@ TEST_CASE("libbpf percpu hash map batch", "[libbpf]") { _test_maps_batch(BPF_MAP
 
 TEST_CASE("libbpf lru percpu hash map batch", "[libbpf]") { _test_maps_batch(BPF_MAP_TYPE_LRU_PERCPU_HASH); }
 
+typedef struct _map_image_reader
+{
+    const std::vector<uint8_t>* image;
+    size_t offset;
+} map_image_reader_t;
+
+static ebpf_result_t
+_write_map_image(_Inout_opt_ void* context, _In_reads_bytes_(data_length) const void* data, size_t data_length)
+{
+    auto image = reinterpret_cast<std::vector<uint8_t>*>(context);
+    image->insert(image->end(), (const uint8_t*)data, (const uint8_t*)data + data_length);
+    return EBPF_SUCCESS;
+}
+
+static ebpf_result_t
+_read_map_image(_Inout_opt_ void* context, _Out_writes_bytes_(data_length) void* data, size_t data_length)
+{
+    auto reader = reinterpret_cast<map_image_reader_t*>(context);
+    if (reader->image->size() - reader->offset < data_length) {
+        return EBPF_INVALID_ARGUMENT;
+    }
+    memcpy(data, reader->image->data() + reader->offset, data_length);
+    reader->offset += data_length;
+    return EBPF_SUCCESS;
+}
+
+void
+_test_map_snapshot_restore(bpf_map_type map_type)
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+    size_t value_count = 1;
+
+    if (BPF_MAP_TYPE_PER_CPU(map_type)) {
+        // Values are uint64_t, so each CPU's slot is already 8-byte aligned.
+        value_count = libbpf_num_possible_cpus();
+    }
+
+    union bpf_attr attr = {};
+    attr.map_create.map_type = map_type;
+    attr.map_create.key_size = sizeof(uint32_t);
+    attr.map_create.value_size = sizeof(uint64_t);
+    attr.map_create.max_entries = 64 * 1024;
+
+    fd_t map_fd = bpf(BPF_MAP_CREATE, &attr, sizeof(attr));
+    REQUIRE(map_fd > 0);
+
+    // Use more entries than fit in a single batch, so that the image has several chunks.
+    uint32_t entry_count = 20000;
+    std::vector<uint32_t> keys(entry_count);
+    std::vector<uint64_t> values(entry_count * value_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        keys[i] = i;
+        for (size_t cpu = 0; cpu < value_count; cpu++) {
+            values[i * value_count + cpu] = static_cast<uint64_t>(i) * 3 + cpu;
+        }
+    }
+    uint32_t update_count = entry_count;
+    REQUIRE(bpf_map_update_batch(map_fd, keys.data(), values.data(), &update_count, nullptr) == 0);
+    REQUIRE(update_count == entry_count);
+
+    std::vector<uint8_t> image;
+    REQUIRE(ebpf_map_snapshot(map_fd, _write_map_image, &image) == EBPF_SUCCESS);
+
+    // Restore into a new map with the same definition.
+    fd_t restored_map_fd = bpf(BPF_MAP_CREATE, &attr, sizeof(attr));
+    REQUIRE(restored_map_fd > 0);
+    map_image_reader_t reader = {&image, 0};
+    REQUIRE(ebpf_map_restore(restored_map_fd, _read_map_image, &reader) == EBPF_SUCCESS);
+    REQUIRE(reader.offset == image.size());
+
+    std::vector<uint64_t> value(value_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        REQUIRE(bpf_map_lookup_elem(restored_map_fd, &keys[i], value.data()) == 0);
+        REQUIRE(memcmp(value.data(), &values[i * value_count], value_count * sizeof(uint64_t)) == 0);
+    }
+
+    // A truncated image fails to restore.
+    std::vector<uint8_t> truncated_image(image.begin(), image.end() - 1);
+    map_image_reader_t truncated_reader = {&truncated_image, 0};
+    REQUIRE(ebpf_map_restore(restored_map_fd, _read_map_image, &truncated_reader) == EBPF_INVALID_ARGUMENT);
+
+    // An image does not restore into a map with a different definition.
+    attr.map_create.key_size = sizeof(uint64_t);
+    fd_t other_map_fd = bpf(BPF_MAP_CREATE, &attr, sizeof(attr));
+    REQUIRE(other_map_fd > 0);
+    reader.offset = 0;
+    REQUIRE(ebpf_map_restore(other_map_fd, _read_map_image, &reader) == EBPF_INVALID_ARGUMENT);
+
+    Platform::_close(map_fd);
+    Platform::_close(restored_map_fd);
+    Platform::_close(other_map_fd);
+}
+
+TEST_CASE("map snapshot restore hash", "[libbpf]") { _test_map_snapshot_restore(BPF_MAP_TYPE_HASH); }
+
+TEST_CASE("map snapshot restore array", "[libbpf]") { _test_map_snapshot_restore(BPF_MAP_TYPE_ARRAY); }
+
+TEST_CASE("map snapshot restore percpu hash", "[libbpf]") { _test_map_snapshot_restore(BPF_MAP_TYPE_PERCPU_HASH); }
+
+TEST_CASE("map snapshot restore lru hash", "[libbpf]") { _test_map_snapshot_restore(BPF_MAP_TYPE_LRU_HASH); }
+
+TEST_CASE("map snapshot rejects ttl hash", "[libbpf]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    fd_t map_fd = bpf_map_create(BPF_MAP_TYPE_HASH_TTL, "ttl", sizeof(uint32_t), sizeof(uint64_t), 1024, nullptr);
+    REQUIRE(map_fd > 0);
+
+    std::vector<uint8_t> image;
+    REQUIRE(ebpf_map_snapshot(map_fd, _write_map_image, &image) == EBPF_OPERATION_NOT_SUPPORTED);
+    REQUIRE(image.empty());
+
+    Platform::_close(map_fd);
+}
+
+TEST_CASE("map shadow publish", "[libbpf]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    fd_t map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "policy", sizeof(uint32_t), sizeof(uint64_t), 1024, nullptr);
+    REQUIRE(map_fd > 0);
+
+    uint32_t key;
+    uint64_t value;
+    for (key = 0; key < 10; key++) {
+        value = key;
+        REQUIRE(bpf_map_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+    }
+
+    // Stage a new policy in an empty shadow. The map is unchanged until the shadow is published.
+    fd_t shadow_fd = ebpf_fd_invalid;
+    REQUIRE(ebpf_map_create_shadow(map_fd, false, &shadow_fd) == EBPF_SUCCESS);
+    REQUIRE(shadow_fd > 0);
+    for (key = 100; key < 105; key++) {
+        value = key;
+        REQUIRE(bpf_map_update_elem(shadow_fd, &key, &value, BPF_ANY) == 0);
+    }
+    key = 0;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+    key = 100;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == -ENOENT);
+
+    REQUIRE(ebpf_map_publish_shadow(map_fd, shadow_fd) == EBPF_SUCCESS);
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+    REQUIRE(value == 100);
+    key = 0;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == -ENOENT);
+
+    // The shadow now holds the previous policy.
+    REQUIRE(bpf_map_lookup_elem(shadow_fd, &key, &value) == 0);
+    Platform::_close(shadow_fd);
+
+    // A copy-forward shadow starts with the current entries, so an incremental change only writes what changes.
+    REQUIRE(ebpf_map_create_shadow(map_fd, true, &shadow_fd) == EBPF_SUCCESS);
+    key = 100;
+    REQUIRE(bpf_map_delete_elem(shadow_fd, &key) == 0);
+    key = 200;
+    value = 200;
+    REQUIRE(bpf_map_update_elem(shadow_fd, &key, &value, BPF_ANY) == 0);
+    REQUIRE(ebpf_map_publish_shadow(map_fd, shadow_fd) == EBPF_SUCCESS);
+    Platform::_close(shadow_fd);
+
+    for (key = 101; key < 105; key++) {
+        REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+        REQUIRE(value == key);
+    }
+    key = 100;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == -ENOENT);
+    key = 200;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+    REQUIRE(value == 200);
+
+    // Only maps with the same definition can be published into each other.
+    fd_t other_map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "other", sizeof(uint32_t), sizeof(uint64_t), 16, nullptr);
+    REQUIRE(other_map_fd > 0);
+    REQUIRE(ebpf_map_publish_shadow(map_fd, other_map_fd) == EBPF_INVALID_ARGUMENT);
+    REQUIRE(ebpf_map_publish_shadow(map_fd, map_fd) == EBPF_INVALID_ARGUMENT);
+
+    // Map types that keep entries outside of the hash table don't support shadows.
+    fd_t array_map_fd = bpf_map_create(BPF_MAP_TYPE_ARRAY, "array", sizeof(uint32_t), sizeof(uint64_t), 16, nullptr);
+    REQUIRE(array_map_fd > 0);
+    REQUIRE(ebpf_map_create_shadow(array_map_fd, false, &shadow_fd) == EBPF_OPERATION_NOT_SUPPORTED);
+    REQUIRE(shadow_fd == ebpf_fd_invalid);
+
+    Platform::_close(map_fd);
+    Platform::_close(other_map_fd);
+    Platform::_close(array_map_fd);
+}
+
+TEST_CASE("map shadow publish with concurrent updates", "[libbpf]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    fd_t map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "policy", sizeof(uint32_t), sizeof(uint64_t), 1024, nullptr);
+    REQUIRE(map_fd > 0);
+
+    // Keep updating the map while shadows are published into it. Updates that race with a publish may land in the
+    // previous table and be replaced, but they must never fail or disturb the published entries.
+    std::atomic<size_t> failed_update_count{0};
+    std::jthread updater([map_fd, &failed_update_count](std::stop_token stop_token) {
+        uint64_t value = 0;
+        while (!stop_token.stop_requested()) {
+            uint32_t key = 1000 + (uint32_t)(value % 10);
+            if (bpf_map_update_elem(map_fd, &key, &value, BPF_ANY) != 0) {
+                failed_update_count++;
+            }
+            value++;
+        }
+    });
+
+    // Each generation is staged in a new shadow.
+    for (uint64_t generation = 0; generation < 100; generation++) {
+        fd_t shadow_fd = ebpf_fd_invalid;
+        REQUIRE(ebpf_map_create_shadow(map_fd, false, &shadow_fd) == EBPF_SUCCESS);
+        uint32_t key = 0;
+        uint64_t value = generation;
+        REQUIRE(bpf_map_update_elem(shadow_fd, &key, &value, BPF_ANY) == 0);
+        REQUIRE(ebpf_map_publish_shadow(map_fd, shadow_fd) == EBPF_SUCCESS);
+        Platform::_close(shadow_fd);
+
+        REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+        REQUIRE(value == generation);
+    }
+
+    updater.request_stop();
+    updater.join();
+    REQUIRE(failed_update_count == 0);
+
+    // Once the updates have stopped, the map keeps whatever is written to it.
+    uint32_t key = 1000;
+    uint64_t value = UINT64_MAX;
+    REQUIRE(bpf_map_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+    value = 0;
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+    REQUIRE(value == UINT64_MAX);
+
+    Platform::_close(map_fd);
+}
+
+TEST_CASE("map shadow can't be staged after publish", "[libbpf]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    fd_t map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "policy", sizeof(uint32_t), sizeof(uint64_t), 1024, nullptr);
+    REQUIRE(map_fd > 0);
+    uint32_t key = 0;
+    uint64_t value = 1;
+    REQUIRE(bpf_map_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+
+    fd_t shadow_fd = ebpf_fd_invalid;
+    REQUIRE(ebpf_map_create_shadow(map_fd, false, &shadow_fd) == EBPF_SUCCESS);
+    value = 2;
+    REQUIRE(bpf_map_update_elem(shadow_fd, &key, &value, BPF_ANY) == 0);
+    REQUIRE(ebpf_map_publish_shadow(map_fd, shadow_fd) == EBPF_SUCCESS);
+
+    // The published shadow holds the previous entries, which can't be staged or published again.
+    value = 3;
+    REQUIRE(bpf_map_update_elem(shadow_fd, &key, &value, BPF_ANY) != 0);
+    REQUIRE(bpf_map_delete_elem(shadow_fd, &key) != 0);
+    REQUIRE(ebpf_map_publish_shadow(map_fd, shadow_fd) == EBPF_INVALID_STATE);
+
+    // The previous entries can still be read, and the map is unchanged.
+    REQUIRE(bpf_map_lookup_elem(shadow_fd, &key, &value) == 0);
+    REQUIRE(value == 1);
+    REQUIRE(bpf_map_lookup_elem(map_fd, &key, &value) == 0);
+    REQUIRE(value == 2);
+
+    Platform::_close(shadow_fd);
+    Platform::_close(map_fd);
+}
+
+TEST_CASE("map shadow copy forward with concurrent deletes", "[libbpf]")
+{
+    _test_helper_end_to_end test_helper;
+    test_helper.initialize();
+
+    const uint32_t entry_count = 256;
+    fd_t map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "policy", sizeof(uint32_t), sizeof(uint64_t), entry_count, nullptr);
+    REQUIRE(map_fd > 0);
+    for (uint32_t key = 0; key < entry_count; key++) {
+        uint64_t value = key;
+        REQUIRE(bpf_map_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+    }
+
+    // Keep deleting and inserting entries again while the map is copied into shadows.
+    std::jthread deleter([map_fd, entry_count](std::stop_token stop_token) {
+        uint32_t key = 0;
+        while (!stop_token.stop_requested()) {
+            uint64_t value = key;
+            (void)bpf_map_delete_elem(map_fd, &key);
+            (void)bpf_map_update_elem(map_fd, &key, &value, BPF_ANY);
+            key = (key + 1) % entry_count;
+        }
+    });
+
+    for (int iteration = 0; iteration < 100; iteration++) {
+        fd_t shadow_fd = ebpf_fd_invalid;
+        REQUIRE(ebpf_map_create_shadow(map_fd, true, &shadow_fd) == EBPF_SUCCESS);
+        REQUIRE(shadow_fd > 0);
+        Platform::_close(shadow_fd);
+    }
+
+    deleter.request_stop();
+    deleter.join();
+
+    // Once the deletes have stopped, the copy holds every entry of the map.
+    fd_t shadow_fd = ebpf_fd_invalid;
+    REQUIRE(ebpf_map_create_shadow(map_fd, true, &shadow_fd) == EBPF_SUCCESS);
+    for (uint32_t key = 0; key < entry_count; key++) {
+        uint64_t value = UINT64_MAX;
+        REQUIRE(bpf_map_lookup_elem(shadow_fd, &key, &value) == 0);
+        REQUIRE(value == key);
+    }
+
+    Platform::_close(shadow_fd);
+    Platform::_close(map_fd);
+}
+
 void
 _hash_of_map_initial_value_test(ebpf_execution_type_t execution_type)
 {
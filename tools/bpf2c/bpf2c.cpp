@@ -5,16 +5,22 @@
 #include "ebpf_api.h"
 #include "ebpf_program_types.h"
 #include "hash.h"
+#include "mapped_file.h"
 
 #include <Windows.h>
 #include <ElfWrapper.h>
+#include <filesystem>
 #include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <regex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -41,22 +47,123 @@ emit_skeleton(std::ostream& out_stream, const std::string& c_name, const std::st
     out_stream << output << std::endl;
 }
 
-std::string
-load_file_to_memory(const std::string& path)
+/**
+ * @brief Atomically replace a file: write the contents to a temporary file
+ * next to it and rename that over the target. A failed write never leaves a
+ * truncated file behind under the final name.
+ *
+ * @param[in] path Path of the file to write.
+ * @param[in] contents Contents of the file.
+ */
+static void
+_write_file_atomically(const std::filesystem::path& path, const std::string& contents)
 {
-    struct stat st;
-    if (stat(path.c_str(), &st)) {
-        throw std::runtime_error(std::string("Failed to read file: ") + path);
+    std::filesystem::path temporary_path = path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        file << contents;
+        file.close();
+        if (!file) {
+            std::filesystem::remove(temporary_path);
+            throw std::runtime_error(std::string("Failed to write output file ") + path.string());
+        }
+    }
+    std::filesystem::rename(temporary_path, path);
+}
+
+/**
+ * @brief Check whether a file exists and holds exactly the given contents.
+ *
+ * @param[in] path Path of the file to check.
+ * @param[in] contents Expected contents.
+ * @retval true The file exists and matches.
+ * @retval false The file is missing or differs.
+ */
+static bool
+_file_has_contents(const std::filesystem::path& path, const std::string& contents)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::string existing((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return existing == contents;
+}
+
+/**
+ * @brief Write one file per program translation unit next to the main output
+ * file. Each file is named after a hash of its contents, so a program whose
+ * generated code did not change keeps both its name and its timestamp and
+ * isn't recompiled. The names are recorded in a manifest, <stem>_programs.txt,
+ * which the build reads to find the sources; files listed in the previous
+ * manifest but no longer produced are removed, and nothing else is touched.
+ *
+ * @param[in] output_file_name Name of the main output file.
+ * @param[in] file_header Header emitted at the top of each file.
+ * @param[in] program_units Code of each program translation unit.
+ */
+void
+write_program_units(
+    const std::string& output_file_name,
+    const std::string& file_header,
+    const std::map<std::string, std::string>& program_units)
+{
+    std::filesystem::path output_path(output_file_name);
+    std::filesystem::path directory = output_path.parent_path();
+    std::string prefix = output_path.stem().string() + "_program_";
+    std::filesystem::path manifest_path = directory / (output_path.stem().string() + "_programs.txt");
+
+    // Only names this function could have produced are trusted from an old manifest.
+    auto is_program_file_name = [&](const std::string& name) {
+        return name.starts_with(prefix) && name.ends_with(".c") &&
+               name.find_first_of("/\\:") == std::string::npos && name.find("..") == std::string::npos;
+    };
+
+    std::set<std::string> previous_files;
+    {
+        std::ifstream manifest(manifest_path);
+        std::string line;
+        while (std::getline(manifest, line)) {
+            if (is_program_file_name(line)) {
+                previous_files.insert(line);
+            }
+        }
+    }
+
+    std::set<std::string> current_files;
+    for (const auto& [program_name, code] : program_units) {
+        std::string contents = file_header + code;
+        hash_t hash("SHA256");
+        std::vector<uint8_t> digest = hash.hash_string(contents);
+        std::ostringstream name;
+        name << prefix;
+        for (size_t index = 0; index < 8; index++) {
+            name << std::hex << std::setw(2) << std::setfill('0') << static_cast<uint32_t>(digest[index]);
+        }
+        name << ".c";
+
+        std::filesystem::path path = directory / name.str();
+        current_files.insert(name.str());
+        if (_file_has_contents(path, contents)) {
+            continue;
+        }
+        _write_file_atomically(path, contents);
+    }
+
+    std::ostringstream manifest;
+    for (const auto& name : current_files) {
+        manifest << name << "\n";
+    }
+    if (!_file_has_contents(manifest_path, manifest.str())) {
+        _write_file_atomically(manifest_path, manifest.str());
     }
-    if (std::ifstream stream{path, std::ios::in | std::ios::binary}) {
-        std::string data;
-        data.resize(st.st_size);
-        if (!stream.read(data.data(), data.size())) {
-            throw std::runtime_error(std::string("Failed to read file: ") + path);
+
+    for (const auto& name : previous_files) {
+        if (current_files.find(name) == current_files.end()) {
+            std::filesystem::remove(directory / name);
         }
-        return data;
     }
-    throw std::runtime_error(std::string("Failed to read file: ") + path);
 }
 
 extern "C" void
@@ -143,6 +250,9 @@ main(int argc, char** argv)
         std::string output_file_name;
         std::string type_string = "";
         std::string hash_algorithm = EBPF_HASH_ALGORITHM;
+        size_t code_generation_threads = 1;
+        bool split_programs = false;
+        bool optimize = false;
         ebpf_verification_verbosity_t verbosity = EBPF_VERIFICATION_VERBOSITY_NORMAL;
         std::vector<std::string> parameters(argv + 1, argv + argc);
         auto iter = parameters.begin();
@@ -214,6 +324,37 @@ main(int argc, char** argv)
                       return true;
                   }
               }}},
+            {"--jobs",
+             {"Number of threads used to generate code, or 0 for one per processor",
+              [&]() {
+                  ++iter;
+                  if (iter == iter_end) {
+                      std::cerr << "Invalid --jobs option" << std::endl;
+                      return false;
+                  }
+                  try {
+                      code_generation_threads = std::stoul(*iter);
+                  } catch (const std::exception&) {
+                      std::cerr << "Invalid --jobs option" << std::endl;
+                      return false;
+                  }
+                  if (code_generation_threads == 0) {
+                      code_generation_threads = max(std::thread::hardware_concurrency(), 1u);
+                  }
+                  return true;
+              }}},
+            {"--split",
+             {"Emit each program in its own translation unit next to the output file",
+              [&]() {
+                  split_programs = true;
+                  return true;
+              }}},
+            {"--optimize",
+             {"Remove checks and code that analysis of the register values proves redundant",
+              [&]() {
+                  optimize = true;
+                  return true;
+              }}},
             {"--help",
              {"This help menu",
               [&]() {
@@ -266,17 +407,29 @@ main(int argc, char** argv)
             return 1;
         }
 
+        if (split_programs && output_file_name.empty()) {
+            std::cerr << "--split requires an output file name" << std::endl;
+            return 1;
+        }
+
         std::string c_name = file.substr(file.find_last_of("\\") + 1);
         c_name = c_name.substr(0, c_name.find("."));
-        auto data = load_file_to_memory(file);
+        // The object is mapped rather than read, and every consumer below (the
+        // hash, the ELF check, the code generator and the per-program
+        // verification) reads the same mapped view without copying it.
+        mapped_file_t data(file);
         std::optional<std::vector<uint8_t>> hash_value;
         if (hash_algorithm != "none") {
             _hash hash(hash_algorithm);
-            hash_value = hash.hash_string(data);
+            hash_value = hash.hash_byte_ranges({{reinterpret_cast<const uint8_t*>(data.data()), data.size()}});
         }
-        auto stream = std::stringstream(data);
+        memory_istream_t stream(data.data(), data.size());
 
-        if (!ElfCheckElf(data.size(), reinterpret_cast<uint8_t*>(data.data()), static_cast<uint32_t>(data.size()))) {
+        if (data.size() > UINT32_MAX ||
+            !ElfCheckElf(
+                data.size(),
+                reinterpret_cast<uint8_t*>(const_cast<char*>(data.data())),
+                static_cast<uint32_t>(data.size()))) {
             std::cerr << "ELF file is invalid" << std::endl;
             return 1;
         }
@@ -292,6 +445,8 @@ main(int argc, char** argv)
         }
 
         bpf_code_generator generator(stream, c_name, {hash_value});
+        generator.set_code_generation_threads(code_generation_threads);
+        generator.set_optimization(optimize);
 
         // Parse global data.
         generator.parse_global_data();
@@ -321,7 +476,7 @@ main(int argc, char** argv)
             const char* report = nullptr;
             ebpf_api_verifier_stats_t stats;
             if (ebpf_api_elf_verify_program_from_memory(
-                    data.c_str(),
+                    data.data(),
                     data.size(),
                     program->section_name,
                     program->program_name,
@@ -374,22 +529,35 @@ main(int argc, char** argv)
         }
         std::ostream& out_stream = output_file_name.empty() ? std::cout : output_file;
 
-        out_stream << copyright_notice << std::endl;
-        out_stream << "// Do not alter this generated file." << std::endl;
-        out_stream << "// This file was generated from " << file << std::endl << std::endl;
+        std::ostringstream file_header;
+        file_header << copyright_notice << std::endl;
+        file_header << "// Do not alter this generated file." << std::endl;
+        file_header << "// This file was generated from " << file << std::endl << std::endl;
+        out_stream << file_header.str();
+
+        // Headers the program translation units need, matching the skeleton for each output type.
+        std::string program_unit_preamble;
         switch (type) {
         case output_type::Bare:
             break;
         case output_type::KernelPE:
             emit_skeleton(out_stream, c_name, bpf2c_driver);
+            program_unit_preamble = "#include <guiddef.h>\n#include <wdm.h>\n";
             break;
         case output_type::UserPE:
             emit_skeleton(out_stream, c_name, bpf2c_dll);
+            program_unit_preamble = "#define WIN32_LEAN_AND_MEAN\n#include <windows.h>\n";
             break;
         default:
             throw std::runtime_error("Invalid output type");
         }
-        generator.emit_c_code(out_stream);
+        if (split_programs) {
+            std::map<std::string, std::string> program_units;
+            generator.emit_c_code(out_stream, program_unit_preamble, program_units);
+            write_program_units(output_file_name, file_header.str(), program_units);
+        } else {
+            generator.emit_c_code(out_stream);
+        }
     } catch (std::runtime_error err) {
         std::cerr << err.what() << std::endl;
         return 1;
@@ -24,11 +24,14 @@
 #undef ebpf_inst
 
 #include <windows.h>
+#include <atomic>
 #include <cassert>
 #include <format>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <utility>
 #include <vector>
 #undef max
 
@@ -263,7 +266,9 @@ bpf_code_generator::bpf_code_generator(
     const std::optional<std::vector<uint8_t>>& elf_file_hash)
     : c_name(file_name), path(path), elf_file_hash(elf_file_hash)
 {
-    if (!reader.load(stream)) {
+    // Load lazily so that only the headers are read up front. Section contents
+    // are read from the stream the first time each section is accessed.
+    if (!reader.load(stream, true)) {
         throw bpf_code_generator_exception("can't process ELF file " + file_name);
     }
 
@@ -274,8 +279,8 @@ bpf_code_generator::bpf_code_generator(
 // and so have no function names or symbols. We manufacture function names for
 // code generation purposes.
 bpf_code_generator::bpf_code_generator(
-    const bpf_code_generator::unsafe_string& c_name, const std::vector<ebpf_inst>& instructions)
-    : c_name(c_name)
+    const bpf_code_generator::unsafe_string& c_name, const std::vector<ebpf_inst>& instructions, bool optimize)
+    : c_name(c_name), optimize(optimize)
 {
     bpf_code_generator_program* current_program = add_program(c_name, c_name, 0);
     uint32_t offset = 0;
@@ -370,7 +375,75 @@ bpf_code_generator::generate(const bpf_code_generator::unsafe_string& program_na
 
     program.generate_labels();
     program.build_function_table();
-    program.encode_instructions(map_definitions, global_variable_sections);
+    if (code_generation_threads > 1) {
+        // Encoding is the expensive step and only touches this program, so
+        // defer it and encode all programs concurrently before emitting code.
+        if (std::find(pending_programs.begin(), pending_programs.end(), program_name) == pending_programs.end()) {
+            pending_programs.push_back(program_name);
+        }
+        return;
+    }
+    program.encode_instructions(map_definitions, global_variable_sections, optimize);
+}
+
+void
+bpf_code_generator::set_code_generation_threads(size_t thread_count)
+{
+    code_generation_threads = (thread_count == 0) ? 1 : thread_count;
+}
+
+void
+bpf_code_generator::set_optimization(bool enable)
+{
+    optimize = enable;
+}
+
+void
+bpf_code_generator::encode_pending_programs()
+{
+    if (pending_programs.empty()) {
+        return;
+    }
+
+    std::vector<bpf_code_generator_program*> pending;
+    for (const auto& program_name : pending_programs) {
+        pending.push_back(&programs[program_name]);
+    }
+    pending_programs.clear();
+
+    // Each worker claims the next unencoded program. Failures are recorded per
+    // program so that the error reported is the same one a serial run reports.
+    std::vector<std::exception_ptr> errors(pending.size());
+    std::atomic<size_t> next_program = 0;
+    auto worker = [&]() {
+        for (size_t index = next_program++; index < pending.size(); index = next_program++) {
+            try {
+                pending[index]->encode_instructions(map_definitions, global_variable_sections, optimize);
+            } catch (...) {
+                errors[index] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t thread_count = min(code_generation_threads, pending.size());
+    try {
+        for (size_t index = 1; index < thread_count; index++) {
+            threads.emplace_back(worker);
+        }
+    } catch (const std::system_error&) {
+        // Fall back to the threads already started, plus this one.
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
 }
 
 std::vector<int32_t>
@@ -512,17 +585,60 @@ vector_of(const ELFIO::section& sec)
     return {(T*)data, (T*)(data + size)};
 }
 
+// The .BTF section is used for line information, by every BTF map section and
+// by every global variable section. It is read once, and the type data and map
+// definitions are only parsed the first time a map section asks for them.
+struct bpf_code_generator::btf_cache_t
+{
+    typedef decltype(libbtf::parse_btf_map_section(std::declval<const libbtf::btf_type_data&>())) map_data_t;
+
+    const libbtf::btf_type_data&
+    get_type_data()
+    {
+        if (!type_data) {
+            type_data.emplace(data);
+        }
+        return type_data.value();
+    }
+
+    const map_data_t&
+    get_map_data()
+    {
+        if (!map_data) {
+            map_data = libbtf::parse_btf_map_section(get_type_data());
+        }
+        return map_data.value();
+    }
+
+    std::vector<std::byte> data;
+    std::optional<libbtf::btf_type_data> type_data;
+    std::optional<map_data_t> map_data;
+};
+
+bpf_code_generator::btf_cache_t&
+bpf_code_generator::get_btf_cache()
+{
+    if (!btf_cache) {
+        auto btf_section = get_required_section(".BTF");
+        auto cache = std::make_shared<btf_cache_t>();
+        cache->data = vector_of<std::byte>(*btf_section);
+        btf_cache = cache;
+    }
+    return *btf_cache;
+}
+
 // Parse a BTF maps section.
 void
 bpf_code_generator::parse_btf_maps_section(const unsafe_string& name)
 {
     auto map_section = get_optional_section(name);
     if (map_section) {
-        auto btf_section = get_required_section(".BTF");
-        std::optional<libbtf::btf_type_data> btf_data = vector_of<std::byte>(*btf_section);
+        btf_cache_t& btf = get_btf_cache();
+        const libbtf::btf_type_data* btf_data = &btf.get_type_data();
         std::vector<prevail::EbpfMapDescriptor> map_descriptors;
 
-        auto map_data = libbtf::parse_btf_map_section(btf_data.value());
+        // Anonymous maps are named below, so work on a copy of the cached definitions.
+        auto map_data = btf.get_map_data();
         std::map<std::string, size_t> map_offsets;
         size_t anonymous_map_count = 0;
         for (auto& map : map_data) {
@@ -727,11 +843,7 @@ _get_btf_global_var_map_name(
 void
 bpf_code_generator::parse_btf_global_variable_section(const unsafe_string& name)
 {
-    auto btf_section = get_required_section(".BTF");
-    std::optional<libbtf::btf_type_data> btf_data = vector_of<std::byte>(*btf_section);
-    std::vector<prevail::EbpfMapDescriptor> map_descriptors;
-
-    auto map_data = libbtf::parse_btf_map_section(btf_data.value());
+    const auto& map_data = get_btf_cache().get_map_data();
     uint32_t global_variable_map_value_size = 0;
 
     bool section_has_map = false;
@@ -990,9 +1102,7 @@ bpf_code_generator::extract_btf_information()
         return;
     }
 
-    std::vector<std::byte> btf_data(
-        reinterpret_cast<const std::byte*>(btf->get_data()),
-        reinterpret_cast<const std::byte*>(btf->get_data()) + btf->get_size());
+    const std::vector<std::byte>& btf_data = get_btf_cache().data;
     std::vector<std::byte> btf_ext_data(
         reinterpret_cast<const std::byte*>(btf_ext->get_data()),
         reinterpret_cast<const std::byte*>(btf_ext->get_data()) + btf_ext->get_size());
@@ -1012,11 +1122,436 @@ bpf_code_generator::extract_btf_information()
         });
 }
 
+/**
+ * @brief Compute the result of an ALU instruction whose operands are known.
+ *
+ * @param[in] instruction ALU instruction.
+ * @param[in] destination Value of the destination register.
+ * @param[in] source Value of the source register, or the sign extended immediate.
+ * @return Value of the destination register afterwards, or std::nullopt if it isn't computed.
+ */
+static std::optional<uint64_t>
+_evaluate_alu(const ebpf_inst& instruction, uint64_t destination, uint64_t source)
+{
+    bool is64bit = (instruction.opcode & INST_CLS_MASK) == INST_CLS_ALU64;
+    uint64_t shift_mask = is64bit ? 0x3F : 0x1F;
+    uint64_t result;
+    switch (static_cast<AluOperations>(instruction.opcode >> 4)) {
+    case AluOperations::Add:
+        result = destination + source;
+        break;
+    case AluOperations::Sub:
+        result = destination - source;
+        break;
+    case AluOperations::Mul:
+        result = destination * source;
+        break;
+    case AluOperations::Or:
+        result = destination | source;
+        break;
+    case AluOperations::And:
+        result = destination & source;
+        break;
+    case AluOperations::Xor:
+        result = destination ^ source;
+        break;
+    case AluOperations::Lsh:
+        result = destination << (source & shift_mask);
+        break;
+    case AluOperations::Rsh:
+        result = (is64bit ? destination : static_cast<uint32_t>(destination)) >> (source & shift_mask);
+        break;
+    case AluOperations::Arsh:
+        result = is64bit ? static_cast<uint64_t>(static_cast<int64_t>(destination) >> (source & shift_mask))
+                         : static_cast<uint64_t>(static_cast<int32_t>(destination) >> (source & shift_mask));
+        break;
+    case AluOperations::Neg:
+        result = 0 - destination;
+        break;
+    case AluOperations::Div:
+    case AluOperations::Mod: {
+        if (instruction.offset != 0) {
+            // Signed division isn't evaluated.
+            return std::nullopt;
+        }
+        uint64_t dividend = is64bit ? destination : static_cast<uint32_t>(destination);
+        uint64_t divisor = is64bit ? source : static_cast<uint32_t>(source);
+        if (static_cast<AluOperations>(instruction.opcode >> 4) == AluOperations::Div) {
+            result = divisor ? (dividend / divisor) : 0;
+        } else {
+            result = divisor ? (dividend % divisor) : dividend;
+        }
+    } break;
+    case AluOperations::Mov:
+        switch (instruction.offset) {
+        case 0:
+            result = source;
+            break;
+        case 8:
+            result = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int8_t>(source)));
+            break;
+        case 16:
+            result = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int16_t>(source)));
+            break;
+        case 32:
+            result = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(source)));
+            break;
+        default:
+            return std::nullopt;
+        }
+        break;
+    default:
+        return std::nullopt;
+    }
+    return is64bit ? result : static_cast<uint32_t>(result);
+}
+
+/**
+ * @brief Compute the outcome of a conditional jump whose operands are known.
+ *
+ * @param[in] opcode Jump opcode.
+ * @param[in] destination Value of the destination register.
+ * @param[in] source Value of the source register, or the sign extended immediate.
+ * @return Whether the jump is taken, or std::nullopt if the opcode isn't a conditional jump.
+ */
+static std::optional<bool>
+_evaluate_predicate(uint8_t opcode, uint64_t destination, uint64_t source)
+{
+    bool is32bit = IS_JMP32_CLASS_OPCODE(opcode);
+    uint64_t unsigned_destination = is32bit ? static_cast<uint32_t>(destination) : destination;
+    uint64_t unsigned_source = is32bit ? static_cast<uint32_t>(source) : source;
+    int64_t signed_destination =
+        is32bit ? static_cast<int32_t>(destination) : static_cast<int64_t>(destination);
+    int64_t signed_source = is32bit ? static_cast<int32_t>(source) : static_cast<int64_t>(source);
+    switch (opcode & 0xf0) {
+    case EBPF_MODE_JEQ:
+        return unsigned_destination == unsigned_source;
+    case EBPF_MODE_JGT:
+        return unsigned_destination > unsigned_source;
+    case EBPF_MODE_JGE:
+        return unsigned_destination >= unsigned_source;
+    case EBPF_MODE_JSET:
+        return (unsigned_destination & unsigned_source) != 0;
+    case EBPF_MODE_JNE:
+        return unsigned_destination != unsigned_source;
+    case EBPF_MODE_JSGT:
+        return signed_destination > signed_source;
+    case EBPF_MODE_JSGE:
+        return signed_destination >= signed_source;
+    case EBPF_MODE_JLT:
+        return unsigned_destination < unsigned_source;
+    case EBPF_MODE_JLE:
+        return unsigned_destination <= unsigned_source;
+    case EBPF_MODE_JSLT:
+        return signed_destination < signed_source;
+    case EBPF_MODE_JSLE:
+        return signed_destination <= signed_source;
+    default:
+        return std::nullopt;
+    }
+}
+
+/**
+ * @brief Compute the offset of a map value pointer after a 64-bit add or subtract.
+ *
+ * @param[in] instruction ALU instruction.
+ * @param[in] offset Offset of the pointer into its global variable section.
+ * @param[in] section_size Size of the global variable section.
+ * @param[in] source Value of the source register, or the sign extended immediate.
+ * @return The new offset, or std::nullopt if the pointer no longer points into the section.
+ */
+static std::optional<uint64_t>
+_offset_map_value(const ebpf_inst& instruction, uint64_t offset, size_t section_size, uint64_t source)
+{
+    if ((instruction.opcode & INST_CLS_MASK) != INST_CLS_ALU64) {
+        return std::nullopt;
+    }
+    AluOperations operation = static_cast<AluOperations>(instruction.opcode >> 4);
+    if (operation == AluOperations::Add) {
+        offset += source;
+    } else if (operation == AluOperations::Sub) {
+        offset -= source;
+    } else {
+        return std::nullopt;
+    }
+    // A pointer that moved before the start of the section wraps around to a large offset.
+    if (offset > section_size) {
+        return std::nullopt;
+    }
+    return offset;
+}
+
+std::optional<bool>
+bpf_code_generator::bpf_code_generator_program::get_branch_outcome(
+    const register_state_t& state, const ebpf_inst& instruction)
+{
+    std::optional<uint64_t> source;
+    if (instruction.opcode & INST_SRC_REG) {
+        if (state[instruction.src].kind == register_value_t::kind_t::constant) {
+            source = state[instruction.src].value;
+        }
+    } else {
+        source = static_cast<uint64_t>(static_cast<int64_t>(instruction.imm));
+    }
+    if (!source.has_value()) {
+        return std::nullopt;
+    }
+
+    const register_value_t& destination = state[instruction.dst];
+    if (destination.kind == register_value_t::kind_t::constant) {
+        return _evaluate_predicate(instruction.opcode, destination.value, *source);
+    }
+
+    // A register that is known to be non-zero, such as a pointer, compared against zero.
+    // Only the low 32 bits are compared by JMP32 instructions, and those may still be zero.
+    if (*source == 0 && !IS_JMP32_CLASS_OPCODE(instruction.opcode) && destination.is_nonzero()) {
+        switch (instruction.opcode & 0xf0) {
+        case EBPF_MODE_JEQ:
+        case EBPF_MODE_JLE:
+            return false;
+        case EBPF_MODE_JNE:
+        case EBPF_MODE_JGT:
+            return true;
+        default:
+            break;
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<std::optional<bpf_code_generator::register_state_t>>
+bpf_code_generator::bpf_code_generator_program::analyze_instructions(
+    const std::map<unsafe_string, global_variable_section_t>& global_variable_sections) const
+{
+    const std::vector<output_instruction_t>& program_output = output_instructions;
+    std::vector<std::optional<register_state_t>> states(program_output.size());
+    if (program_output.empty()) {
+        return {};
+    }
+
+    const register_value_t unknown;
+    const register_value_t nonzero{register_value_t::kind_t::nonzero};
+    auto constant = [](uint64_t value) { return register_value_t{register_value_t::kind_t::constant, value}; };
+
+    // Nothing is assumed about the arguments, as subprograms can be passed any value.
+    // The stack pointer is never null.
+    register_state_t entry_state;
+    entry_state[10] = nonzero;
+    states[0] = entry_state;
+
+    // Propagate register states along every edge until nothing changes. Registers that
+    // differ on incoming edges are widened to non-zero or unknown, so a register changes
+    // at most twice per instruction and the loop terminates even for programs with loops.
+    std::vector<size_t> worklist = {0};
+    bool analyzable = true;
+    auto propagate = [&](size_t target, const register_state_t& state) {
+        if (target >= program_output.size()) {
+            // Falling off the end of the program.
+            analyzable = false;
+            return;
+        }
+        if (!states[target].has_value()) {
+            states[target] = state;
+            worklist.push_back(target);
+            return;
+        }
+        register_state_t merged = *states[target];
+        for (size_t index = 0; index < merged.size(); index++) {
+            if (merged[index] == state[index]) {
+                continue;
+            }
+            merged[index] = (merged[index].is_nonzero() && state[index].is_nonzero()) ? nonzero : unknown;
+        }
+        if (merged != *states[target]) {
+            states[target] = merged;
+            worklist.push_back(target);
+        }
+    };
+
+    while (!worklist.empty() && analyzable) {
+        size_t i = worklist.back();
+        worklist.pop_back();
+        register_state_t state = *states[i];
+        const ebpf_inst& inst = program_output[i].instruction;
+        if (inst.dst >= state.size() || inst.src >= state.size()) {
+            // Invalid register, which the encoder reports.
+            return {};
+        }
+
+        switch (inst.opcode & INST_CLS_MASK) {
+        case INST_CLS_ALU:
+        case INST_CLS_ALU64: {
+            bool is64bit = (inst.opcode & INST_CLS_MASK) == INST_CLS_ALU64;
+            AluOperations operation = static_cast<AluOperations>(inst.opcode >> 4);
+            register_value_t& destination = state[inst.dst];
+            register_value_t source_value;
+            std::optional<uint64_t> source;
+            if (inst.opcode & INST_SRC_REG) {
+                source_value = state[inst.src];
+                if (source_value.kind == register_value_t::kind_t::constant) {
+                    source = source_value.value;
+                }
+            } else {
+                source = static_cast<uint64_t>(static_cast<int64_t>(inst.imm));
+                source_value = constant(*source);
+            }
+
+            if (operation == AluOperations::Mov && is64bit && inst.offset == 0) {
+                destination = source_value;
+            } else if (
+                source.has_value() &&
+                (operation == AluOperations::Mov || destination.kind == register_value_t::kind_t::constant)) {
+                std::optional<uint64_t> result = _evaluate_alu(inst, destination.value, *source);
+                destination = result.has_value() ? constant(*result) : unknown;
+            } else if (source.has_value() && destination.kind == register_value_t::kind_t::map_value) {
+                std::optional<uint64_t> offset =
+                    _offset_map_value(inst, destination.value, destination.section->initial_data.size(), *source);
+                if (offset.has_value()) {
+                    destination.value = *offset;
+                } else {
+                    destination = unknown;
+                }
+            } else if (
+                operation == AluOperations::Or && is64bit &&
+                (destination.is_nonzero() || source_value.is_nonzero())) {
+                destination = nonzero;
+            } else {
+                destination = unknown;
+            }
+            propagate(i + 1, state);
+        } break;
+        case INST_CLS_LD: {
+            if (inst.opcode != INST_OP_LDDW_IMM || i + 1 >= program_output.size()) {
+                return {};
+            }
+            uint32_t next_imm = static_cast<uint32_t>(program_output[i + 1].instruction.imm);
+            if (inst.src == INST_LD_MODE_IMM) {
+                state[inst.dst] = constant((static_cast<uint64_t>(next_imm) << 32) | static_cast<uint32_t>(inst.imm));
+            } else if (inst.src == INST_LD_MODE_MAP_FD) {
+                state[inst.dst] = nonzero;
+            } else if (inst.src == INST_LD_MODE_MAP_VALUE) {
+                auto global_section = global_variable_sections.find(program_output[i].relocation);
+                if (global_section != global_variable_sections.end() &&
+                    next_imm <= global_section->second.initial_data.size()) {
+                    state[inst.dst] = {register_value_t::kind_t::map_value, next_imm, &global_section->second};
+                } else {
+                    state[inst.dst] = unknown;
+                }
+            } else {
+                state[inst.dst] = unknown;
+            }
+            propagate(i + 2, state);
+        } break;
+        case INST_CLS_LDX:
+            state[inst.dst] = unknown;
+            propagate(i + 1, state);
+            break;
+        case INST_CLS_ST:
+        case INST_CLS_STX:
+            if ((inst.opcode & INST_MODE_MASK) == EBPF_MODE_ATOMIC) {
+                if (inst.imm == EBPF_ATOMIC_CMPXCHG) {
+                    state[0] = unknown;
+                } else if (inst.imm & EBPF_ATOMIC_FETCH) {
+                    state[inst.src] = unknown;
+                }
+            }
+            propagate(i + 1, state);
+            break;
+        case INST_CLS_JMP:
+        case INST_CLS_JMP32: {
+            if (inst.opcode == INST_OP_EXIT) {
+                break;
+            }
+            if (inst.opcode == INST_OP_CALL) {
+                // Calls return in r0 and don't preserve r1-r5.
+                for (size_t index = 0; index <= 5; index++) {
+                    state[index] = unknown;
+                }
+                propagate(i + 1, state);
+                break;
+            }
+            if (inst.opcode == INST_OP_JA16) {
+                propagate(i + inst.offset + 1, state);
+                break;
+            }
+            if (inst.opcode == INST_OP_JA32) {
+                propagate(i + inst.imm + 1, state);
+                break;
+            }
+
+            std::optional<bool> outcome = get_branch_outcome(state, inst);
+            register_state_t taken_state = state;
+            register_state_t not_taken_state = state;
+            std::optional<uint64_t> source;
+            if (!(inst.opcode & INST_SRC_REG)) {
+                source = static_cast<uint64_t>(static_cast<int64_t>(inst.imm));
+            } else if (state[inst.src].kind == register_value_t::kind_t::constant) {
+                source = state[inst.src].value;
+            }
+
+            // Refine the destination register along each edge of a comparison with a constant.
+            // Non-zero facts hold for JMP32 too, as a register with non-zero low 32 bits is non-zero.
+            register_value_t& taken = taken_state[inst.dst];
+            register_value_t& not_taken = not_taken_state[inst.dst];
+            bool is32bit = IS_JMP32_CLASS_OPCODE(inst.opcode);
+            if (source.has_value() && (is32bit ? static_cast<uint32_t>(*source) : *source) == 0) {
+                switch (inst.opcode & 0xf0) {
+                case EBPF_MODE_JEQ:
+                    if (not_taken.kind == register_value_t::kind_t::unknown) {
+                        not_taken = nonzero;
+                    }
+                    break;
+                case EBPF_MODE_JNE:
+                case EBPF_MODE_JGT:
+                    if (taken.kind == register_value_t::kind_t::unknown) {
+                        taken = nonzero;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+            if (source.has_value() && !is32bit) {
+                if ((inst.opcode & 0xf0) == EBPF_MODE_JEQ && taken.kind != register_value_t::kind_t::map_value) {
+                    taken = constant(*source);
+                } else if (
+                    (inst.opcode & 0xf0) == EBPF_MODE_JNE && not_taken.kind != register_value_t::kind_t::map_value) {
+                    not_taken = constant(*source);
+                }
+            }
+            if ((inst.opcode & 0xf0) == EBPF_MODE_JSET && taken.kind == register_value_t::kind_t::unknown) {
+                taken = nonzero;
+            }
+
+            if (outcome != false) {
+                propagate(i + inst.offset + 1, taken_state);
+            }
+            if (outcome != true) {
+                propagate(i + 1, not_taken_state);
+            }
+        } break;
+        default:
+            return {};
+        }
+    }
+
+    if (!analyzable) {
+        return {};
+    }
+    return states;
+}
+
 void
-bpf_code_generator::bpf_code_generator_program::generate_labels()
+bpf_code_generator::bpf_code_generator_program::generate_labels(
+    const std::vector<std::optional<register_state_t>>& states)
 {
     std::vector<output_instruction_t>& program_output = output_instructions;
 
+    for (auto& output_instruction : program_output) {
+        output_instruction.jump_target = false;
+        output_instruction.label.clear();
+    }
+
     // Tag jump targets.
     for (size_t i = 0; i < program_output.size(); i++) {
         auto& output_instruction = program_output[i];
@@ -1029,6 +1564,11 @@ bpf_code_generator::bpf_code_generator_program::generate_labels()
         if (output_instruction.instruction.opcode == INST_OP_EXIT) {
             continue;
         }
+        if (!states.empty() &&
+            (!states[i] || get_branch_outcome(*states[i], output_instruction.instruction) == false)) {
+            // No code is emitted for this jump.
+            continue;
+        }
         int32_t offset =
             ((output_instruction.instruction.opcode == INST_OP_JA32) ? output_instruction.instruction.imm
                                                                      : output_instruction.instruction.offset);
@@ -1076,18 +1616,42 @@ bpf_code_generator::bpf_code_generator_program::build_function_table()
 
 void
 bpf_code_generator::bpf_code_generator_program::encode_instructions(
-    std::map<unsafe_string, map_info_t>& map_definitions,
-    std::map<unsafe_string, global_variable_section_t>& global_variable_sections)
+    const std::map<unsafe_string, map_info_t>& map_definitions,
+    const std::map<unsafe_string, global_variable_section_t>& global_variable_sections,
+    bool optimize)
 {
     std::vector<output_instruction_t>& program_output = output_instructions;
     auto effective_program_name = !program_name.empty() ? program_name : elf_section_name;
     auto helper_array_prefix = "runtime_context->helper_data[{}]";
 
+    std::vector<std::optional<register_state_t>> states;
+    if (optimize) {
+        states = analyze_instructions(global_variable_sections);
+        if (!states.empty()) {
+            generate_labels(states);
+        }
+    }
+    optimized = !states.empty();
+
     // Encode instructions.
     for (size_t i = 0; i < program_output.size(); i++) {
         auto& output = program_output[i];
         auto& inst = output.instruction;
 
+        // Unreachable instructions are dropped. Map loads are still encoded and then discarded,
+        // so that the maps the program refers to are the same as without optimization.
+        const register_state_t* state = nullptr;
+        bool reachable = true;
+        if (optimized) {
+            if (states[i].has_value()) {
+                state = &*states[i];
+            } else if ((inst.opcode & INST_CLS_MASK) == INST_CLS_LD) {
+                reachable = false;
+            } else {
+                continue;
+            }
+        }
+
         switch (inst.opcode & INST_CLS_MASK) {
         case INST_CLS_ALU:
         case INST_CLS_ALU64: {
@@ -1103,19 +1667,73 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
             AluOperations operation = static_cast<AluOperations>(inst.opcode >> 4);
             std::string swap_function;
             std::string type;
+
+            // Facts about the source operand proven by analyze_instructions.
+            std::optional<uint64_t> known_source;
+            bool source_is_nonzero = false;
+            if (state != nullptr) {
+                if (inst.opcode & INST_SRC_REG) {
+                    const register_value_t& source_value = (*state)[inst.src];
+                    if (source_value.kind == register_value_t::kind_t::constant) {
+                        known_source = source_value.value;
+                    }
+                    source_is_nonzero = source_value.is_nonzero();
+                } else {
+                    known_source = static_cast<uint64_t>(static_cast<int64_t>(inst.imm));
+                    source_is_nonzero = (inst.imm != 0);
+                }
+            }
+            // Shift amounts proven to be less than the operand width don't need to be masked.
+            bool is_shift_in_range = known_source.has_value() && *known_source < static_cast<uint64_t>(bits);
+            // Divisors proven to be non-zero, and for signed division also not -1, don't need to be checked.
+            bool is_divisor_safe;
+            if (inst.offset == 1) {
+                int64_t signed_source = known_source.has_value()
+                                            ? (is64bit ? static_cast<int64_t>(*known_source)
+                                                       : static_cast<int32_t>(*known_source))
+                                            : 0;
+                is_divisor_safe = known_source.has_value() && signed_source != 0 && signed_source != -1;
+            } else if (is64bit) {
+                is_divisor_safe = source_is_nonzero;
+            } else {
+                is_divisor_safe = known_source.has_value() && static_cast<uint32_t>(*known_source) != 0;
+            }
+            // Adding a constant to a map value pointer folds into the address of the map value.
+            std::optional<uint64_t> map_value_offset;
+            if (state != nullptr && known_source.has_value() &&
+                (*state)[inst.dst].kind == register_value_t::kind_t::map_value) {
+                const register_value_t& pointer = (*state)[inst.dst];
+                map_value_offset =
+                    _offset_map_value(inst, pointer.value, pointer.section->initial_data.size(), *known_source);
+            }
+
             switch (operation) {
             case AluOperations::Add:
-                output.lines.push_back(std::format("{} += {};", destination, source));
-                break;
             case AluOperations::Sub:
-                output.lines.push_back(std::format("{} -= {};", destination, source));
+                if (map_value_offset.has_value()) {
+                    output.lines.push_back(std::format(
+                        "{} = POINTER(runtime_context->global_variable_section_data[{}].address_of_map_value + {});",
+                        destination,
+                        (*state)[inst.dst].section->index,
+                        *map_value_offset));
+                } else if (operation == AluOperations::Add) {
+                    output.lines.push_back(std::format("{} += {};", destination, source));
+                } else {
+                    output.lines.push_back(std::format("{} -= {};", destination, source));
+                }
                 break;
             case AluOperations::Mul:
                 output.lines.push_back(std::format("{} *= {};", destination, source));
                 break;
             case AluOperations::Div:
                 type = (is64bit) ? "" : "(uint32_t)";
-                if (inst.offset == 1) {
+                if (is_divisor_safe && inst.offset == 1) {
+                    output.lines.push_back(
+                        std::format("{} = (int{}_t){} / (int{}_t){};", destination, bits, destination, bits, source));
+                } else if (is_divisor_safe) {
+                    output.lines.push_back(
+                        std::format("{} = {}{} / {}{};", destination, type, destination, type, source));
+                } else if (inst.offset == 1) {
                     // Signed division.
                     output.lines.push_back(std::format(
                         "if (!((int{}_t){} == INT{}_MIN && (int{}_t){} == -1)) {{",
@@ -1147,7 +1765,9 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
                 output.lines.push_back(std::format("{} &= {};", destination, source));
                 break;
             case AluOperations::Lsh:
-                if (is64bit) {
+                if (is_shift_in_range) {
+                    output.lines.push_back(std::format("{} <<= {};", destination, *known_source));
+                } else if (is64bit) {
 
                     // Shifts of >= 64 bits on 64-bit values result in undefined behavior so mask off the msb of the
                     // shift size, i.e., the 'source' in this case.
@@ -1165,7 +1785,12 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
                 }
                 break;
             case AluOperations::Rsh:
-                if (is64bit) {
+                if (is_shift_in_range) {
+                    if (!is64bit) {
+                        output.lines.push_back(std::format("{} = (uint32_t){};", destination, destination));
+                    }
+                    output.lines.push_back(std::format("{} >>= {};", destination, *known_source));
+                } else if (is64bit) {
 
                     // Shifts of >= 64 bits on 64-bit values result in undefined behavior so mask off the msb of the
                     // shift size, i.e., the 'source' in this case.
@@ -1190,7 +1815,13 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
                 break;
             case AluOperations::Mod:
                 type = (is64bit) ? "" : "(uint32_t)";
-                if (inst.offset == 1) {
+                if (is_divisor_safe && inst.offset == 1) {
+                    output.lines.push_back(
+                        std::format("{} = (int{}_t){} % (int{}_t){};", destination, bits, destination, bits, source));
+                } else if (is_divisor_safe) {
+                    output.lines.push_back(
+                        std::format("{} = {}{} % {}{};", destination, type, destination, type, source));
+                } else if (inst.offset == 1) {
                     // Signed modulo.
                     output.lines.push_back(std::format(
                         "if ((int{}_t){} == INT{}_MIN && (int{}_t){} == -1) {{",
@@ -1251,7 +1882,14 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
                 }
                 break;
             case AluOperations::Arsh:
-                if (is64bit) {
+                if (is_shift_in_range) {
+                    type = (is64bit) ? "(int64_t)" : "(int32_t)";
+                    if (!is64bit) {
+                        output.lines.push_back(std::format("{} = (int32_t){};", destination, destination));
+                    }
+                    output.lines.push_back(
+                        std::format("{} = {}{} >> {};", destination, type, destination, *known_source));
+                } else if (is64bit) {
                     uint64_t shift_mask = 0x3F;
                     output.lines.push_back(std::format(
                         "{} = (int64_t){} >> (uint32_t)({} & {});", destination, destination, source, shift_mask));
@@ -1360,7 +1998,7 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
                 source =
                     std::format("runtime_context->map_data[{}].address", std::to_string(map_definition->second.index));
                 output.lines.push_back(std::format("{} = POINTER({});", destination, source));
-                referenced_map_indices.insert(map_definitions[output.relocation].index);
+                referenced_map_indices.insert(map_definition->second.index);
             } else if (inst.src == INST_LD_MODE_MAP_VALUE) {
                 std::string source;
                 uint64_t imm = static_cast<uint32_t>(program_output[i].instruction.imm);
@@ -1376,7 +2014,12 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
                 // As an example, this produces the following line:
                 // r0 = POINTER(_global_variable_sections[1].address_of_map_value + 4);
                 output.lines.push_back(std::format("{} = POINTER({});", destination, source));
-                referenced_map_indices.insert(map_definitions[output.relocation].index);
+                auto map_definition = map_definitions.find(output.relocation);
+                if (map_definition == map_definitions.end()) {
+                    throw bpf_code_generator_exception(
+                        "Map " + output.relocation + " doesn't exist", output.instruction_offset);
+                }
+                referenced_map_indices.insert(map_definition->second.index);
             }
         } break;
         case INST_CLS_LDX: {
@@ -1534,6 +2177,17 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
         } break;
         case INST_CLS_JMP:
         case INST_CLS_JMP32: {
+            if (state != nullptr) {
+                std::optional<bool> outcome = get_branch_outcome(*state, inst);
+                if (outcome.has_value()) {
+                    // The comparison is dropped, leaving either an unconditional jump or nothing.
+                    if (*outcome) {
+                        output.lines.push_back("goto " + program_output[i + inst.offset + 1].label + ";");
+                    }
+                    break;
+                }
+            }
+
             std::string destination = get_register_name(inst.dst);
             std::string destination_cast;
             if (IS_JMP32_CLASS_OPCODE(inst.opcode)) {
@@ -1643,6 +2297,10 @@ bpf_code_generator::bpf_code_generator_program::encode_instructions(
         default:
             throw bpf_code_generator_exception("invalid operand", output.instruction_offset);
         }
+
+        if (!reachable) {
+            output.lines.clear();
+        }
     }
 }
 
@@ -1674,8 +2332,8 @@ bpf_code_generator::emit_subprogram(std::ostream& output_stream, const bpf_code_
         }
         output_stream << prolog_line_info << INDENT "register uint64_t " << r.c_str() << " = 0;" << std::endl;
     }
-    if (subprogram.helper_functions.size() == 0) {
-        // Avoid unused parameter warning.
+    if (subprogram.helper_functions.size() == 0 || subprogram.optimized) {
+        // Avoid unused parameter warning. Optimization may remove every helper call.
         output_stream << prolog_line_info << INDENT "(void)context;" << std::endl;
     }
     output_stream << std::endl;
@@ -1694,12 +2352,13 @@ bpf_code_generator::bpf_code_generator_program::emit_instructions(
     std::string prolog_line_info;
 
     for (const auto& output : output_instructions) {
-        if (output.lines.empty()) {
-            continue;
-        }
+        // A jump that is never taken has no code, but may still be the target of another jump.
         if (!output.label.empty()) {
             output_stream << output.label << ":" << std::endl;
         }
+        if (output.lines.empty()) {
+            continue;
+        }
         auto current_line = line_info.find(output.instruction_offset);
         if (current_line != line_info.end() && !current_line->second.file_name.empty() &&
             current_line->second.line_number != 0) {
@@ -1728,6 +2387,99 @@ bpf_code_generator::bpf_code_generator_program::emit_instructions(
 void
 bpf_code_generator::emit_c_code(std::ostream& output_stream)
 {
+    emit_translation_units(output_stream, "", nullptr);
+}
+
+void
+bpf_code_generator::emit_c_code(
+    std::ostream& output_stream,
+    const std::string& program_unit_preamble,
+    std::map<std::string, std::string>& program_units)
+{
+    emit_translation_units(output_stream, program_unit_preamble, &program_units);
+}
+
+void
+bpf_code_generator::emit_program(
+    std::ostream& output_stream, bpf_code_generator_program& program, const std::string& function_name, bool is_static)
+{
+    auto& line_info = section_line_info[program.elf_section_name];
+    auto first_line_info = line_info.find(program.output_instructions.front().instruction_offset);
+    std::string prolog_line_info;
+
+    auto result = std::find_if(line_info.begin(), line_info.end(), [&prolog_line_info](const auto& pair) {
+        if (pair.second.file_name.empty() || pair.second.line_number == 0) {
+            return false;
+        }
+        prolog_line_info = std::format(
+            "#line {} {}\n", std::to_string(pair.second.line_number), pair.second.file_name.quoted_filename());
+        return true;
+    });
+
+    // Emit entry point.
+    output_stream << "#pragma code_seg(push, " << program.pe_section_name.quoted() << ")" << std::endl;
+    output_stream << std::format(
+                         "{}uint64_t\n{}(void* context, const program_runtime_context_t* runtime_context)",
+                         is_static ? "static " : "",
+                         function_name)
+                  << std::endl;
+    output_stream << prolog_line_info << "{" << std::endl;
+
+    // Emit prologue.
+    program.get_register_name(0);
+    program.get_register_name(1);
+    program.get_register_name(10);
+    output_stream << prolog_line_info << INDENT "// Prologue." << std::endl;
+    output_stream << prolog_line_info << INDENT "uint64_t stack[(UBPF_STACK_SIZE + 7) / 8];" << std::endl;
+    for (const auto& r : _register_names) {
+        // Skip unused registers.
+        if (program.referenced_registers.find(r) == program.referenced_registers.end()) {
+            continue;
+        }
+        output_stream << prolog_line_info << INDENT "register uint64_t " << r.c_str() << " = 0;" << std::endl;
+    }
+    output_stream << std::endl;
+    output_stream << prolog_line_info << INDENT "" << program.get_register_name(1) << " = (uintptr_t)context;"
+                  << std::endl;
+    output_stream << prolog_line_info << INDENT "" << program.get_register_name(10)
+                  << " = (uintptr_t)((uint8_t*)stack + sizeof(stack));" << std::endl;
+    if ((program.referenced_map_indices.size() == 0 && program.helper_functions.size() == 0) || program.optimized) {
+        // Optimization may remove every use of the runtime context.
+        output_stream << prolog_line_info << INDENT "UNREFERENCED_PARAMETER(runtime_context);" << std::endl;
+    }
+    output_stream << std::endl;
+
+    // Emit encoded instructions.
+    program.emit_instructions(output_stream, line_info);
+
+    // Emit epilogue.
+    output_stream << prolog_line_info << "}" << std::endl;
+    output_stream << "#pragma code_seg(pop)" << std::endl;
+    output_stream << "#line __LINE__ __FILE__" << std::endl << std::endl;
+
+    // Emit subprograms.
+    for (auto& [_, subprogram] : programs) {
+        if (is_subprogram(subprogram)) {
+            emit_subprogram(output_stream, subprogram);
+        }
+    }
+}
+
+void
+bpf_code_generator::emit_translation_units(
+    std::ostream& output_stream,
+    const std::string& program_unit_preamble,
+    _In_opt_ std::map<std::string, std::string>* program_units)
+{
+    encode_pending_programs();
+
+    // Programs split into their own translation units need external linkage,
+    // so prefix their names to keep them unique across linked objects.
+    auto entry_point_name = [&](const unsafe_string& program_name) {
+        return (program_units != nullptr) ? c_name.c_identifier() + "_" + program_name.c_identifier()
+                                          : program_name.c_identifier();
+    };
+
     // Emit C file.
     output_stream << "#include \"bpf2c.h\"" << std::endl << std::endl;
 
@@ -1979,18 +2731,21 @@ bpf_code_generator::emit_c_code(std::ostream& output_stream)
             continue;
         }
 
+        // Subprograms are emitted alongside the program that calls them.
+        std::ostringstream program_unit;
+        std::ostream& program_stream = (program_units != nullptr) ? program_unit : output_stream;
         if (programs.size() > program_count) {
-            output_stream << "// Forward references for local functions." << std::endl;
+            program_stream << "// Forward references for local functions." << std::endl;
             for (auto& [_, subprogram] : programs) {
                 if (is_subprogram(subprogram)) {
-                    output_stream << "static uint64_t" << std::endl;
-                    output_stream << subprogram.program_name.c_identifier()
-                                  << "(uint64_t r1, uint64_t r2, uint64_t r3, uint64_t r4, uint64_t r5, uint64_t r10, "
-                                     "void* context);"
-                                  << std::endl;
+                    program_stream << "static uint64_t" << std::endl;
+                    program_stream << subprogram.program_name.c_identifier()
+                                   << "(uint64_t r1, uint64_t r2, uint64_t r3, uint64_t r4, uint64_t r5, uint64_t r10, "
+                                      "void* context);"
+                                   << std::endl;
                 }
             }
-            output_stream << std::endl;
+            program_stream << std::endl;
         }
 
         // Emit the program and attach type GUID.
@@ -2044,63 +2799,16 @@ bpf_code_generator::emit_c_code(std::ostream& output_stream)
             output_stream << std::endl;
         }
 
-        auto& line_info = section_line_info[program.elf_section_name];
-        auto first_line_info = line_info.find(program.output_instructions.front().instruction_offset);
-        std::string prolog_line_info;
-
-        auto result = std::find_if(line_info.begin(), line_info.end(), [&prolog_line_info](const auto& pair) {
-            if (pair.second.file_name.empty() || pair.second.line_number == 0) {
-                return false;
-            }
-            prolog_line_info = std::format(
-                "#line {} {}\n", std::to_string(pair.second.line_number), pair.second.file_name.quoted_filename());
-            return true;
-        });
-
-        // Emit entry point.
-        output_stream << "#pragma code_seg(push, " << program.pe_section_name.quoted() << ")" << std::endl;
-        output_stream << std::format(
-                             "static uint64_t\n{}(void* context, const program_runtime_context_t* runtime_context)",
-                             program_name.c_identifier())
-                      << std::endl;
-        output_stream << prolog_line_info << "{" << std::endl;
-
-        // Emit prologue.
-        program.get_register_name(0);
-        program.get_register_name(1);
-        program.get_register_name(10);
-        output_stream << prolog_line_info << INDENT "// Prologue." << std::endl;
-        output_stream << prolog_line_info << INDENT "uint64_t stack[(UBPF_STACK_SIZE + 7) / 8];" << std::endl;
-        for (const auto& r : _register_names) {
-            // Skip unused registers.
-            if (program.referenced_registers.find(r) == program.referenced_registers.end()) {
-                continue;
-            }
-            output_stream << prolog_line_info << INDENT "register uint64_t " << r.c_str() << " = 0;" << std::endl;
-        }
-        output_stream << std::endl;
-        output_stream << prolog_line_info << INDENT "" << program.get_register_name(1) << " = (uintptr_t)context;"
-                      << std::endl;
-        output_stream << prolog_line_info << INDENT "" << program.get_register_name(10)
-                      << " = (uintptr_t)((uint8_t*)stack + sizeof(stack));" << std::endl;
-        if (program.referenced_map_indices.size() == 0 && program.helper_functions.size() == 0) {
-            output_stream << prolog_line_info << INDENT "UNREFERENCED_PARAMETER(runtime_context);" << std::endl;
-        }
-        output_stream << std::endl;
-
-        // Emit encoded instructions.
-        program.emit_instructions(output_stream, line_info);
-
-        // Emit epilogue.
-        output_stream << prolog_line_info << "}" << std::endl;
-        output_stream << "#pragma code_seg(pop)" << std::endl;
-        output_stream << "#line __LINE__ __FILE__" << std::endl << std::endl;
-
-        // Emit subprograms.
-        for (auto& [_, subprogram] : programs) {
-            if (is_subprogram(subprogram)) {
-                emit_subprogram(output_stream, subprogram);
-            }
+        if (program_units != nullptr) {
+            output_stream << "uint64_t" << std::endl
+                          << entry_point_name(program_name)
+                          << "(void* context, const program_runtime_context_t* runtime_context);" << std::endl
+                          << std::endl;
+            emit_program(program_stream, program, entry_point_name(program_name), false);
+            (*program_units)[program_name.raw()] =
+                "#include \"bpf2c.h\"\n" + program_unit_preamble + "\n" + program_unit.str();
+        } else {
+            emit_program(output_stream, program, entry_point_name(program_name), true);
         }
     }
 
@@ -2125,7 +2833,7 @@ bpf_code_generator::emit_c_code(std::ostream& output_stream)
                           << EBPF_NATIVE_PROGRAM_ENTRY_CURRENT_VERSION_SIZE << ", "
                           << EBPF_NATIVE_PROGRAM_ENTRY_CURRENT_VERSION_TOTAL_SIZE << "},"
                           << " // Version header." << std::endl;
-            output_stream << INDENT INDENT << program_name.c_identifier() << "," << std::endl;
+            output_stream << INDENT INDENT << entry_point_name(program_name) << "," << std::endl;
             output_stream << INDENT INDENT << program.pe_section_name.quoted() << "," << std::endl;
             output_stream << INDENT INDENT << program.elf_section_name.quoted() << "," << std::endl;
             output_stream << INDENT INDENT << program_name.quoted() << "," << std::endl;
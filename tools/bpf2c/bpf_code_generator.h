@@ -7,8 +7,10 @@
 #include "ebpf_structs.h"
 #include "elfio_wrapper.hpp"
 
+#include <array>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
@@ -193,7 +195,9 @@ class bpf_code_generator
     /**
      * @brief Construct a new bpf code generator object from an ELF file.
      *
-     * @param[in] stream Input stream containing the eBPF file to parse.
+     * @param[in] stream Input stream containing the eBPF file to parse. Section
+     * contents are read from the stream on first access, so it must outlive the
+     * generator.
      * @param[in] file_name C compatible name to export this as.
      * @param[in] elf_file_hash Optional bytes containing hash of the ELF file.
      */
@@ -207,8 +211,10 @@ class bpf_code_generator
      *
      * @param[in] c_name C compatible name to export this as.
      * @param[in] instructions Set of eBPF instructions to use.
+     * @param[in] optimize Remove checks and code that are proven redundant. See set_optimization().
      */
-    bpf_code_generator(const unsafe_string& c_name, const std::vector<ebpf_inst>& instructions);
+    bpf_code_generator(
+        const unsafe_string& c_name, const std::vector<ebpf_inst>& instructions, bool optimize = false);
 
     /**
      * @brief Retrieve a vector of section names.
@@ -276,6 +282,46 @@ class bpf_code_generator
     void
     emit_c_code(std::ostream& output);
 
+    /**
+     * @brief Emit the C code, placing each program and its subprograms in a
+     * translation unit of its own so that unchanged programs don't need to be
+     * recompiled. The maps, helper tables and program table remain in the main
+     * translation unit, which refers to the program entry points by external name.
+     *
+     * @param[in] output Output stream to write the main translation unit to.
+     * @param[in] program_unit_preamble Code emitted at the top of each program
+     * translation unit, after bpf2c.h is included.
+     * @param[out] program_units Receives the code of each program translation
+     * unit, keyed by program name.
+     */
+    void
+    emit_c_code(
+        std::ostream& output,
+        const std::string& program_unit_preamble,
+        std::map<std::string, std::string>& program_units);
+
+    /**
+     * @brief Set the number of threads used to encode instructions. When more
+     * than one thread is used, encoding is deferred until the code is emitted
+     * and then runs for all programs concurrently.
+     *
+     * @param[in] thread_count Number of threads to use.
+     */
+    void
+    set_code_generation_threads(size_t thread_count);
+
+    /**
+     * @brief Enable or disable optimization of the generated code. When enabled,
+     * the value of each register is tracked through every program and the
+     * facts proven about them are used to drop shift masks and division by
+     * zero checks that can never take effect, branches whose outcome is known
+     * and code that can't be reached. Must be called before the programs are parsed.
+     *
+     * @param[in] enable Whether to optimize the generated code.
+     */
+    void
+    set_optimization(bool enable);
+
     /**
      * @brief Get the helper function ids used by the current program.
      *
@@ -341,6 +387,34 @@ class bpf_code_generator
         std::vector<uint8_t> initial_data;
     } global_variable_section_t;
 
+    /**
+     * @brief What is known about the value of a register before an instruction executes.
+     */
+    typedef struct _register_value
+    {
+        enum class kind_t
+        {
+            unknown,
+            nonzero,
+            constant,
+            map_value, // Pointer into a global variable section, which is never null.
+        } kind = kind_t::unknown;
+        // Value of a constant, or offset into the global variable section of a map value.
+        uint64_t value = 0;
+        const global_variable_section_t* section = nullptr;
+
+        bool
+        operator==(const _register_value& other) const = default;
+
+        bool
+        is_nonzero() const
+        {
+            return kind == kind_t::nonzero || kind == kind_t::map_value || (kind == kind_t::constant && value != 0);
+        }
+    } register_value_t;
+
+    typedef std::array<register_value_t, 11> register_state_t;
+
     class bpf_code_generator_program
     {
       public:
@@ -359,12 +433,17 @@ class bpf_code_generator
         std::map<unsafe_string, helper_function_t> helper_functions;
         std::string program_info_hash_type{};
         const ebpf_program_info_t* program_info = nullptr;
+        // Whether the instructions were encoded using the results of analyze_instructions().
+        bool optimized = false;
 
         /**
          * @brief Assign a label to each jump target.
+         *
+         * @param[in] states Optional result of analyze_instructions(). If supplied,
+         * jumps that are unreachable or never taken don't get a label.
          */
         void
-        generate_labels();
+        generate_labels(const std::vector<std::optional<register_state_t>>& states = {});
 
         /**
          * @brief Extract list of helper functions called by this program.
@@ -373,14 +452,40 @@ class bpf_code_generator
         build_function_table();
 
         /**
-         * @brief Generate the C code for each eBPF instruction.
+         * @brief Generate the C code for each eBPF instruction. Only this
+         * program is modified, so different programs can be encoded concurrently.
          *
          * @param[in] map_definitions Map definitions.
+         * @param[in] global_variable_sections Global variable sections.
+         * @param[in] optimize Use the results of analyze_instructions() to simplify the code.
          */
         void
         encode_instructions(
-            std::map<unsafe_string, map_info_t>& map_definitions,
-            std::map<unsafe_string, global_variable_section_t>& global_variable_sections);
+            const std::map<unsafe_string, map_info_t>& map_definitions,
+            const std::map<unsafe_string, global_variable_section_t>& global_variable_sections,
+            bool optimize);
+
+        /**
+         * @brief Compute what is known about each register before each instruction,
+         * following every path through the program.
+         *
+         * @param[in] global_variable_sections Global variable sections.
+         * @return The register state before each instruction, with no value for
+         * instructions that can't be reached, or an empty vector if the program
+         * can't be analyzed.
+         */
+        std::vector<std::optional<register_state_t>>
+        analyze_instructions(const std::map<unsafe_string, global_variable_section_t>& global_variable_sections) const;
+
+        /**
+         * @brief Determine whether a jump is always or never taken.
+         *
+         * @param[in] state Register state before the jump.
+         * @param[in] instruction Jump instruction.
+         * @return Whether the jump is taken, or std::nullopt if that isn't known.
+         */
+        static std::optional<bool>
+        get_branch_outcome(const register_state_t& state, const ebpf_inst& instruction);
 
         /**
          * @brief Get the name of a register from its index.
@@ -430,6 +535,40 @@ class bpf_code_generator
     void
     generate(const bpf_code_generator::unsafe_string& program_name);
 
+    /**
+     * @brief Encode the instructions of every program whose encoding was deferred.
+     */
+    void
+    encode_pending_programs();
+
+    /**
+     * @brief Emit the C code, optionally splitting programs into their own translation units.
+     *
+     * @param[in] output Output stream to write the main translation unit to.
+     * @param[in] program_unit_preamble Code emitted at the top of each program translation unit.
+     * @param[out] program_units If not null, receives the program translation units.
+     */
+    void
+    emit_translation_units(
+        std::ostream& output,
+        const std::string& program_unit_preamble,
+        _In_opt_ std::map<std::string, std::string>* program_units);
+
+    /**
+     * @brief Emit a program entry point followed by all subprograms.
+     *
+     * @param[in] output_stream Output stream to write code to.
+     * @param[in] program Program to emit.
+     * @param[in] function_name Name of the entry point.
+     * @param[in] is_static Whether the entry point has internal linkage.
+     */
+    void
+    emit_program(
+        std::ostream& output_stream,
+        bpf_code_generator_program& program,
+        const std::string& function_name,
+        bool is_static);
+
     /**
      * @brief Check whether a progam is just a subprogram.
      *
@@ -504,6 +643,20 @@ class bpf_code_generator
     unsafe_string
     get_section_name_by_index(ELFIO::Elf_Half index) const;
 
+    /**
+     * @brief Parsed contents of the .BTF section, shared by the passes that need them.
+     */
+    struct btf_cache_t;
+
+    /**
+     * @brief Get the contents of the .BTF section, reading it on first use.
+     *
+     * @returns The cached .BTF section.
+     * @throws bpf_code_generator_exception if the file has no valid .BTF section.
+     */
+    btf_cache_t&
+    get_btf_cache();
+
     /**
      * @brief Invoke the visitor for each symbol in the ELF file section.
      *
@@ -522,4 +675,8 @@ class bpf_code_generator
     std::optional<std::vector<uint8_t>> elf_file_hash;
     std::map<unsafe_string, std::vector<unsafe_string>> map_initial_values;
     std::map<unsafe_string, global_variable_section_t> global_variable_sections;
+    std::shared_ptr<btf_cache_t> btf_cache;
+    size_t code_generation_threads = 1;
+    std::vector<unsafe_string> pending_programs;
+    bool optimize = false;
 };
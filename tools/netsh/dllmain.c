@@ -10,6 +10,7 @@
 #include "processes.h"
 #include "programs.h"
 #include "resource.h"
+#include "statistics.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -48,6 +49,7 @@ DllMain(HMODULE moduleHandle, unsigned long reasonForCall, void* reserved)
 #define CMD_EBPF_SHOW_MAPS L"maps"
 #define CMD_EBPF_SHOW_PINS L"pins"
 #define CMD_EBPF_SHOW_PROCESSES L"processes"
+#define CMD_EBPF_SHOW_STATISTICS L"statistics"
 
 #define CMD_EBPF_ADD_PROGRAM L"program"
 #define CMD_EBPF_DELETE_PROGRAM L"program"
@@ -85,6 +87,7 @@ CMD_ENTRY g_EbpfShowCommandTable[] = {
     CREATE_CMD_ENTRY(EBPF_SHOW_PROCESSES, handle_ebpf_show_processes),
     CREATE_CMD_ENTRY(EBPF_SHOW_PROGRAMS, handle_ebpf_show_programs),
     CREATE_CMD_ENTRY(EBPF_SHOW_SECTIONS, handle_ebpf_show_sections),
+    CREATE_CMD_ENTRY(EBPF_SHOW_STATISTICS, handle_ebpf_show_statistics),
     CREATE_CMD_ENTRY(EBPF_SHOW_VERIFICATION, handle_ebpf_show_verification),
 };
 #else
@@ -140,6 +143,7 @@ CMD_ENTRY_ORIGINAL g_EbpfShowCommandTableOriginal[] = {
     CREATE_CMD_ENTRY_ORIGINAL(EBPF_SHOW_PROCESSES, handle_ebpf_show_processes),
     CREATE_CMD_ENTRY_ORIGINAL(EBPF_SHOW_PROGRAMS, handle_ebpf_show_programs),
     CREATE_CMD_ENTRY_ORIGINAL(EBPF_SHOW_SECTIONS, handle_ebpf_show_sections),
+    CREATE_CMD_ENTRY_ORIGINAL(EBPF_SHOW_STATISTICS, handle_ebpf_show_statistics),
     CREATE_CMD_ENTRY_ORIGINAL(EBPF_SHOW_VERIFICATION, handle_ebpf_show_verification),
 };
 CMD_ENTRY_LONG g_EbpfShowCommandTableLong[] = {
@@ -151,6 +155,7 @@ CMD_ENTRY_LONG g_EbpfShowCommandTableLong[] = {
     CREATE_CMD_ENTRY_LONG(EBPF_SHOW_PROCESSES, handle_ebpf_show_processes),
     CREATE_CMD_ENTRY_LONG(EBPF_SHOW_PROGRAMS, handle_ebpf_show_programs),
     CREATE_CMD_ENTRY_LONG(EBPF_SHOW_SECTIONS, handle_ebpf_show_sections),
+    CREATE_CMD_ENTRY_LONG(EBPF_SHOW_STATISTICS, handle_ebpf_show_statistics),
     CREATE_CMD_ENTRY_LONG(EBPF_SHOW_VERIFICATION, handle_ebpf_show_verification),
 };
 